@@ -70,6 +70,29 @@ bool AccumulatorMap::Accumulate(PublicCoin pubCoin, bool fSkipValidation)
     return true;
 }
 
+//Add zerocoins to the accumulators of their denominations, with one exponentiation per denomination.
+bool AccumulatorMap::AccumulateBatch(const std::list<PublicCoin>& listPubcoins, bool fSkipValidation)
+{
+    std::map<CoinDenomination, std::vector<PublicCoin> > mapCoins;
+    for (const PublicCoin& pubCoin : listPubcoins) {
+        if (pubCoin.getDenomination() == CoinDenomination::ZQ_ERROR)
+            return false;
+        mapCoins[pubCoin.getDenomination()].push_back(pubCoin);
+    }
+
+    for (auto& it : mapCoins) {
+        if (fSkipValidation) {
+            std::vector<CBigNum> vValues;
+            for (const PublicCoin& pubCoin : it.second)
+                vValues.push_back(pubCoin.getValue());
+            mapAccumulators.at(it.first)->incrementBatch(vValues);
+        } else {
+            mapAccumulators.at(it.first)->accumulateBatch(it.second);
+        }
+    }
+    return true;
+}
+
 //Get the value of a specific accumulator
 CBigNum AccumulatorMap::GetValue(CoinDenomination denom)
 {
@@ -19,6 +19,7 @@ public:
     bool Load(uint256 nCheckpoint);
     void Load(const AccumulatorCheckpoints::Checkpoint& checkpoint);
     bool Accumulate(libzerocoin::PublicCoin pubCoin, bool fSkipValidation = false);
+    bool AccumulateBatch(const std::list<libzerocoin::PublicCoin>& listPubcoins, bool fSkipValidation = false);
     CBigNum GetValue(libzerocoin::CoinDenomination denom);
     libzerocoin::ZerocoinParams* GetZerocoinParams();
     void SetZerocoinParams(libzerocoin::ZerocoinParams* params);
@@ -10,6 +10,7 @@
 #include "init.h"
 #include "spork.h"
 #include "accumulatorcheckpoints.h"
+#include "consensus/merkle.h"
 
 #include <iterator>
 
@@ -215,6 +216,189 @@ bool InitializeAccumulators(const int nHeight, int& nHeightCheckpoint, Accumulat
     return true;
 }
 
+/**
+ * Where to find a block whose mints go into a precomputed checkpoint. Copied
+ * from the block index under cs_main, so the background thread never touches
+ * CBlockIndex entries that may change or go away while it runs.
+ */
+struct CCheckpointBlock
+{
+    uint256 hashBlock;
+    uint256 hashPrevBlock;
+    uint256 hashMerkleRoot;
+    CDiskBlockPos pos;
+};
+
+/**
+ * Accumulator checkpoint of an upcoming checkpoint block, computed by
+ * ThreadAccumulatorCheckpoints. The checkpoint at height h only depends on the
+ * checkpoint of block h - 10 and the mints of blocks h - 20 to h - 11, so all
+ * of it is known as soon as block h - 10 is connected.
+ */
+struct CPrecomputedCheckpoint
+{
+    int nHeight;
+    uint256 nCheckpointPrev;
+    //! blocks whose mints go into the checkpoint
+    std::vector<CCheckpointBlock> vBlocks;
+    bool fReady;
+    uint256 nCheckpoint;
+    AccumulatorCheckpoints::Checkpoint values;
+
+    CPrecomputedCheckpoint() : nHeight(0), nCheckpointPrev(0), fReady(false), nCheckpoint(0) {}
+};
+
+static CWaitableCriticalSection csPrecomputedCheckpoints;
+static CConditionVariable condPrecomputedCheckpoints;
+//! Keyed by the hash of block h - 10 the checkpoint was computed from
+static std::map<uint256, CPrecomputedCheckpoint> mapPrecomputedCheckpoints;
+static std::list<uint256> listCheckpointsToCompute;
+
+bool QueueAccumulatorCheckpoint(const CBlockIndex* pindex)
+{
+    AssertLockHeld(cs_main);
+
+    int nHeight = pindex->nHeight + 10;
+    if (pindex->nHeight % 10 != 0 || nHeight <= Params().Zerocoin_LastOldParams() + 21)
+        return false;
+
+    CPrecomputedCheckpoint checkpoint;
+    checkpoint.nHeight = nHeight;
+    checkpoint.nCheckpointPrev = pindex->nAccumulatorCheckpoint;
+    for (const CBlockIndex* pindexMints = pindex->pprev; pindexMints && pindexMints->nHeight >= nHeight - 20; pindexMints = pindexMints->pprev) {
+        if (pindexMints->nHeight < Params().Zerocoin_StartHeight())
+            continue;
+        if (!(pindexMints->nStatus & BLOCK_HAVE_DATA))
+            return false;
+
+        CCheckpointBlock block;
+        block.hashBlock = pindexMints->GetBlockHash();
+        block.hashPrevBlock = pindexMints->pprev ? pindexMints->pprev->GetBlockHash() : uint256(0);
+        block.hashMerkleRoot = pindexMints->hashMerkleRoot;
+        block.pos = pindexMints->GetBlockPos();
+        checkpoint.vBlocks.push_back(block);
+    }
+
+    boost::unique_lock<boost::mutex> lock(csPrecomputedCheckpoints);
+    uint256 hashBlock = pindex->GetBlockHash();
+    if (mapPrecomputedCheckpoints.count(hashBlock))
+        return true;
+
+    //drop checkpoints of heights that are long past
+    for (std::map<uint256, CPrecomputedCheckpoint>::iterator it = mapPrecomputedCheckpoints.begin(); it != mapPrecomputedCheckpoints.end();) {
+        if (it->second.nHeight <= nHeight - 10 * MAX_PRECOMPUTED_CHECKPOINTS) {
+            listCheckpointsToCompute.remove(it->first);
+            mapPrecomputedCheckpoints.erase(it++);
+        } else {
+            it++;
+        }
+    }
+
+    mapPrecomputedCheckpoints.insert(make_pair(hashBlock, checkpoint));
+    listCheckpointsToCompute.push_back(hashBlock);
+    condPrecomputedCheckpoints.notify_one();
+    return true;
+}
+
+bool EraseAccumulatorCheckpoint(const uint256& hashBlock)
+{
+    boost::unique_lock<boost::mutex> lock(csPrecomputedCheckpoints);
+    listCheckpointsToCompute.remove(hashBlock);
+    std::map<uint256, CPrecomputedCheckpoint>::iterator it = mapPrecomputedCheckpoints.find(hashBlock);
+    if (it == mapPrecomputedCheckpoints.end())
+        return false;
+    bool fReady = it->second.fReady;
+    mapPrecomputedCheckpoints.erase(it);
+    return fReady;
+}
+
+static bool ComputeAccumulatorCheckpoint(CPrecomputedCheckpoint& checkpoint)
+{
+    AccumulatorMap mapAccumulators(Params().Zerocoin_Params());
+    if (checkpoint.nCheckpointPrev != 0 && !mapAccumulators.Load(checkpoint.nCheckpointPrev))
+        return false;
+
+    std::list<PublicCoin> listPubcoinsRange;
+    for (const CCheckpointBlock& blockMints : checkpoint.vBlocks) {
+        boost::this_thread::interruption_point();
+
+        // The block was fully validated when it was connected, so matching
+        // the copied header commitments is enough to trust what was read.
+        CBlock block;
+        if (!ReadBlockFromDisk(block, blockMints.pos, false))
+            return false;
+        bool fMutated = false;
+        if (block.hashPrevBlock != blockMints.hashPrevBlock || block.hashMerkleRoot != blockMints.hashMerkleRoot ||
+            BlockMerkleRoot(block, &fMutated) != block.hashMerkleRoot || fMutated)
+            return error("%s : block on disk doesn't match %s", __func__, blockMints.hashBlock.GetHex());
+
+        std::list<PublicCoin> listPubcoins;
+        if (!BlockToPubcoinList(block, listPubcoins))
+            return false;
+        listPubcoinsRange.splice(listPubcoinsRange.end(), listPubcoins);
+    }
+
+    if (listPubcoinsRange.empty()) {
+        checkpoint.nCheckpoint = checkpoint.nCheckpointPrev;
+    } else {
+        for (const PublicCoin& pubcoin : listPubcoinsRange) {
+            if (pubcoin.getDenomination() == CoinDenomination::ZQ_ERROR)
+                return false;
+        }
+        if (!mapAccumulators.AccumulateBatch(listPubcoinsRange, true))
+            return false;
+        checkpoint.nCheckpoint = mapAccumulators.GetCheckpoint();
+    }
+
+    for (auto& denom : zerocoinDenomList)
+        checkpoint.values[denom] = mapAccumulators.GetValue(denom);
+    return true;
+}
+
+void ThreadAccumulatorCheckpoints()
+{
+    while (true) {
+        uint256 hashBlock;
+        CPrecomputedCheckpoint checkpoint;
+        {
+            boost::unique_lock<boost::mutex> lock(csPrecomputedCheckpoints);
+            while (listCheckpointsToCompute.empty())
+                condPrecomputedCheckpoints.wait(lock);
+            hashBlock = listCheckpointsToCompute.front();
+            listCheckpointsToCompute.pop_front();
+            checkpoint = mapPrecomputedCheckpoints.at(hashBlock);
+        }
+
+        if (!ComputeAccumulatorCheckpoint(checkpoint)) {
+            LogPrint("zero", "%s : could not precompute checkpoint of block %d\n", __func__, checkpoint.nHeight);
+            continue;
+        }
+
+        boost::unique_lock<boost::mutex> lock(csPrecomputedCheckpoints);
+        std::map<uint256, CPrecomputedCheckpoint>::iterator it = mapPrecomputedCheckpoints.find(hashBlock);
+        if (it == mapPrecomputedCheckpoints.end())
+            continue; // the block was disconnected in the meantime
+        it->second.nCheckpoint = checkpoint.nCheckpoint;
+        it->second.values = checkpoint.values;
+        it->second.fReady = true;
+        LogPrint("zero", "%s : precomputed checkpoint of block %d=%s\n", __func__, checkpoint.nHeight, checkpoint.nCheckpoint.GetHex());
+    }
+}
+
+bool GetPrecomputedCheckpoint(const uint256& hashFrom, int nHeight, const uint256& nCheckpointPrev, uint256& nCheckpoint, AccumulatorMap& mapAccumulators)
+{
+    boost::unique_lock<boost::mutex> lock(csPrecomputedCheckpoints);
+    std::map<uint256, CPrecomputedCheckpoint>::const_iterator it = mapPrecomputedCheckpoints.find(hashFrom);
+    if (it == mapPrecomputedCheckpoints.end() || !it->second.fReady || it->second.nHeight != nHeight ||
+        it->second.nCheckpointPrev != nCheckpointPrev)
+        return false;
+
+    mapAccumulators.SetZerocoinParams(Params().Zerocoin_Params());
+    mapAccumulators.Load(it->second.values);
+    nCheckpoint = it->second.nCheckpoint;
+    return true;
+}
+
 //Get checkpoint value for a specific block height
 bool CalculateAccumulatorCheckpoint(int nHeight, uint256& nCheckpoint, AccumulatorMap& mapAccumulators)
 {
@@ -229,6 +413,13 @@ bool CalculateAccumulatorCheckpoint(int nHeight, uint256& nCheckpoint, Accumulat
         return true;
     }
 
+    //the accumulators were most likely already updated in the background when block nHeight - 10 was connected
+    CBlockIndex* pindexFrom = chainActive[nHeight - 10];
+    if (pindexFrom && GetPrecomputedCheckpoint(pindexFrom->GetBlockHash(), nHeight, chainActive[nHeight - 1]->nAccumulatorCheckpoint, nCheckpoint, mapAccumulators)) {
+        LogPrint("zero", "%s checkpoint=%s (precomputed)\n", __func__, nCheckpoint.GetHex());
+        return true;
+    }
+
     //set the accumulators to last checkpoint value
     int nHeightCheckpoint;
     mapAccumulators.Reset();
@@ -237,6 +428,7 @@ bool CalculateAccumulatorCheckpoint(int nHeight, uint256& nCheckpoint, Accumulat
 
     //Accumulate all coins over the last ten blocks that havent been accumulated (height - 20 through height - 11)
     int nTotalMintsFound = 0;
+    std::list<PublicCoin> listPubcoinsRange;
     CBlockIndex *pindex = chainActive[nHeightCheckpoint - 20];
 
     while (pindex && pindex->nHeight < nHeight - 10) {
@@ -252,7 +444,7 @@ bool CalculateAccumulatorCheckpoint(int nHeight, uint256& nCheckpoint, Accumulat
 
         //grab mints from this block
         CBlock block;
-        if(!ReadBlockFromDisk(block, pindex))
+        if(!ReadTrustedBlockFromDisk(block, pindex))
             return error("%s: failed to read block from disk", __func__);
 
         std::list<PublicCoin> listPubcoins;
@@ -262,14 +454,18 @@ bool CalculateAccumulatorCheckpoint(int nHeight, uint256& nCheckpoint, Accumulat
         nTotalMintsFound += listPubcoins.size();
         LogPrint("zero", "%s found %d mints\n", __func__, listPubcoins.size());
 
-        //add the pubcoins to accumulator
         for (const PublicCoin& pubcoin : listPubcoins) {
-            if(!mapAccumulators.Accumulate(pubcoin, true))
+            if (pubcoin.getDenomination() == CoinDenomination::ZQ_ERROR)
                 return error("%s: failed to add pubcoin to accumulator at height %d", __func__, pindex->nHeight);
         }
+        listPubcoinsRange.splice(listPubcoinsRange.end(), listPubcoins);
         pindex = chainActive.Next(pindex);
     }
 
+    //add the pubcoins of all ten blocks to the accumulators at once
+    if (!mapAccumulators.AccumulateBatch(listPubcoinsRange, true))
+        return error("%s: failed to add pubcoins to accumulator at height %d", __func__, nHeight);
+
     // if there were no new mints found, the accumulator checkpoint will be the same as the last checkpoint
     if (nTotalMintsFound == 0)
         nCheckpoint = chainActive[nHeight - 1]->nAccumulatorCheckpoint;
@@ -293,6 +489,14 @@ bool ValidateAccumulatorCheckpoint(const CBlock& block, CBlockIndex* pindex, Acc
         if (!CalculateAccumulatorCheckpoint(pindex->nHeight, nCheckpointCalculated, mapAccumulators))
             return error("%s : failed to calculate accumulator checkpoint", __func__);
 
+        //a precomputed checkpoint never rejects a block on its own, the block data has the final say
+        CBlockIndex* pindexFrom = chainActive[pindex->nHeight - 10];
+        if (nCheckpointCalculated != block.nAccumulatorCheckpoint && pindexFrom && EraseAccumulatorCheckpoint(pindexFrom->GetBlockHash())) {
+            LogPrintf("%s : precomputed checkpoint %s of block %d does not match the block, computing it again\n", __func__, nCheckpointCalculated.GetHex(), pindex->nHeight);
+            if (!CalculateAccumulatorCheckpoint(pindex->nHeight, nCheckpointCalculated, mapAccumulators))
+                return error("%s : failed to calculate accumulator checkpoint", __func__);
+        }
+
         if (nCheckpointCalculated != block.nAccumulatorCheckpoint) {
             LogPrintf("%s: block=%d calculated: %s\n block: %s\n", __func__, pindex->nHeight, nCheckpointCalculated.GetHex(), block.nAccumulatorCheckpoint.GetHex());
             return error("%s : accumulator does not match calculated value", __func__);
@@ -335,15 +539,16 @@ int ComputeAccumulatedCoins(int nHeightEnd, libzerocoin::CoinDenomination denom)
     return n;
 }
 
+//Collect the values of this block's mints that have to be added to the witness, to be added by one incrementBatch
 int AddBlockMintsToAccumulator(const libzerocoin::PublicCoin& coin, const int nHeightMintAdded, const CBlockIndex* pindex,
-                           libzerocoin::Accumulator* accumulator, bool isWitness)
+                           std::vector<CBigNum>& vValues, bool isWitness)
 {
     // if this block contains mints of the denomination that is being spent, then add them to the witness
     int nMintsAdded = 0;
     if (pindex->MintedDenomination(coin.getDenomination())) {
         //grab mints from this block
         CBlock block;
-        if(!ReadBlockFromDisk(block, pindex))
+        if(!ReadTrustedBlockFromDisk(block, pindex))
             return error("%s: failed to read block from disk while adding pubcoins to witness", __func__);
 
         list<PublicCoin> listPubcoins;
@@ -358,7 +563,7 @@ int AddBlockMintsToAccumulator(const libzerocoin::PublicCoin& coin, const int nH
             if (isWitness && pindex->nHeight == nHeightMintAdded && pubcoin.getValue() == coin.getValue())
                 continue;
 
-            accumulator->increment(pubcoin.getValue());
+            vValues.push_back(pubcoin.getValue());
             ++nMintsAdded;
         }
     }
@@ -412,12 +617,18 @@ bool GenerateAccumulatorWitness(const PublicCoin &coin, Accumulator& accumulator
     if (!zerocoinDB->ReadCoinMint(coin.getValue(), txid))
         return error("%s failed to read mint from db", __func__);
 
-    CTransaction txMinted;
-    uint256 hashBlock;
-    if (!GetTransaction(txid, txMinted, hashBlock))
-        return error("%s failed to read tx", __func__);
-
-    int nHeightMintAdded = mapBlockIndex[hashBlock]->nHeight;
+    // mints recorded with their height don't need the transaction, which may be pruned
+    int nHeightMintAdded;
+    CZerocoinTxInfo infoMint;
+    if (zerocoinDB->ReadCoinMintInfo(GetPubCoinHash(coin.getValue()), infoMint)) {
+        nHeightMintAdded = infoMint.nHeight;
+    } else {
+        CTransaction txMinted;
+        uint256 hashBlock;
+        if (!GetTransaction(txid, txMinted, hashBlock))
+            return error("%s failed to read tx", __func__);
+        nHeightMintAdded = mapBlockIndex[hashBlock]->nHeight;
+    }
 
     //get the checkpoint added at the next multiple of 10
     int nHeightCheckpoint = nHeightMintAdded + (10 - (nHeightMintAdded % 10));
@@ -447,6 +658,7 @@ bool GenerateAccumulatorWitness(const PublicCoin &coin, Accumulator& accumulator
     nMintsAdded = 0;
     RandomizeSecurityLevel(nSecurityLevel); //make security level not always the same and predictable
     libzerocoin::Accumulator witnessAccumulator = accumulator;
+    std::vector<CBigNum> vWitnessValues;
     while (pindex) {
         if (pindex->nHeight != nAccStartHeight && pindex->pprev->nAccumulatorCheckpoint != pindex->nAccumulatorCheckpoint)
             ++nCheckpointsAdded;
@@ -463,9 +675,10 @@ bool GenerateAccumulatorWitness(const PublicCoin &coin, Accumulator& accumulator
             break;
         }
 
-        nMintsAdded += AddBlockMintsToAccumulator(coin, nHeightMintAdded, pindex, &witnessAccumulator, true);
+        nMintsAdded += AddBlockMintsToAccumulator(coin, nHeightMintAdded, pindex, vWitnessValues, true);
         pindex = chainActive.Next(pindex);
     }
+    witnessAccumulator.incrementBatch(vWitnessValues);
     witness.resetValue(witnessAccumulator, coin);
     if (!witness.VerifyWitness(accumulator, coin))
         return error("%s: failed to verify witness", __func__);
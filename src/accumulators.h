@@ -15,12 +15,21 @@
 
 class CBlockIndex;
 
+//! Number of upcoming checkpoints kept by the background accumulator thread
+static const int MAX_PRECOMPUTED_CHECKPOINTS = 4;
+
 std::map<libzerocoin::CoinDenomination, int> GetMintMaturityHeight();
 bool GenerateAccumulatorWitness(const libzerocoin::PublicCoin &coin, libzerocoin::Accumulator& accumulator, libzerocoin::AccumulatorWitness& witness, int nSecurityLevel, int& nMintsAdded, std::string& strError, CBlockIndex* pindexCheckpoint = nullptr);
 bool GetAccumulatorValueFromDB(uint256 nCheckpoint, libzerocoin::CoinDenomination denom, CBigNum& bnAccValue);
 bool GetAccumulatorValueFromChecksum(uint32_t nChecksum, bool fMemoryOnly, CBigNum& bnAccValue);
 void AddAccumulatorChecksum(const uint32_t nChecksum, const CBigNum &bnValue, bool fMemoryOnly);
 bool CalculateAccumulatorCheckpoint(int nHeight, uint256& nCheckpoint, AccumulatorMap& mapAccumulators);
+bool QueueAccumulatorCheckpoint(const CBlockIndex* pindex);
+/** Drop the checkpoint precomputed from this block, returns whether it had been computed already */
+bool EraseAccumulatorCheckpoint(const uint256& hashBlock);
+void ThreadAccumulatorCheckpoints();
+/** Fill nCheckpoint and mapAccumulators from a checkpoint ThreadAccumulatorCheckpoints already finished */
+bool GetPrecomputedCheckpoint(const uint256& hashFrom, int nHeight, const uint256& nCheckpointPrev, uint256& nCheckpoint, AccumulatorMap& mapAccumulators);
 bool ValidateAccumulatorCheckpoint(const CBlock& block, CBlockIndex* pindex, AccumulatorMap& mapAccumulators);
 void DatabaseChecksums(AccumulatorMap& mapAccumulators);
 bool LoadAccumulatorValuesFromDB(const uint256 nCheckpoint);
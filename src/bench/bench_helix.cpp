@@ -0,0 +1,30 @@
+// Copyright (c) 2015 The Bitcoin Core developers
+// Copyright (c) 2018-2019 The Helix developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "bench.h"
+
+#include "chainparams.h"
+#include "crypto/sha256.h"
+#include "util.h"
+
+#include <iostream>
+
+int main(int argc, char** argv)
+{
+    ParseParameters(argc, argv);
+    if (mapArgs.count("-?") || mapArgs.count("-h") || mapArgs.count("-help")) {
+        std::cout << "Usage: bench_helix [options]\n\n"
+                  << "  -filter=<text>   Only run benchmarks whose name contains <text>\n"
+                  << "  -time=<n>        Run each benchmark for about <n> seconds (default: 1)\n";
+        return 0;
+    }
+
+    SetupEnvironment();
+    fPrintToDebugLog = false; // don't want to write to debug.log file
+    SHA256AutoDetect();
+    SelectParams(CBaseChainParams::MAIN);
+
+    benchmark::BenchRunner::RunAll(GetArg("-time", 1), GetArg("-filter", ""));
+}
@@ -0,0 +1,65 @@
+// Copyright (c) 2018-2019 The Helix developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "bench.h"
+
+#include "primitives/block.h"
+#include "streams.h"
+#include "version.h"
+
+#include <cassert>
+
+// Shape of the synthetic block, close to a full block of two-in two-out payments
+static const int BLOCK_TX_COUNT = 2000;
+static const int BLOCK_TX_INPUTS = 2;
+static const int BLOCK_TX_OUTPUTS = 2;
+
+static CBlock DummyBlock()
+{
+    CBlock block;
+    block.nVersion = 4;
+    block.nTime = 1500000000;
+    block.nBits = 0x1e0fffff;
+    for (int i = 0; i < BLOCK_TX_COUNT; i++) {
+        CMutableTransaction tx;
+        for (int j = 0; j < BLOCK_TX_INPUTS; j++) {
+            CTxIn txin(COutPoint(uint256(i * BLOCK_TX_INPUTS + j + 1), j));
+            txin.scriptSig = CScript() << std::vector<unsigned char>(72, 0x30) << std::vector<unsigned char>(33, 0x02);
+            tx.vin.push_back(txin);
+        }
+        for (int j = 0; j < BLOCK_TX_OUTPUTS; j++) {
+            CScript scriptPubKey = CScript() << OP_DUP << OP_HASH160 << std::vector<unsigned char>(20, (unsigned char)j) << OP_EQUALVERIFY << OP_CHECKSIG;
+            tx.vout.push_back(CTxOut((i + 1) * CENT, scriptPubKey));
+        }
+        block.vtx.push_back(tx);
+    }
+    return block;
+}
+
+static void SerializeBlock(benchmark::State& state)
+{
+    CBlock block = DummyBlock();
+    CDataStream stream(SER_NETWORK, PROTOCOL_VERSION);
+    stream.reserve(::GetSerializeSize(block, SER_NETWORK, PROTOCOL_VERSION));
+    while (state.KeepRunning()) {
+        stream.clear();
+        stream << block;
+    }
+}
+
+static void DeserializeBlock(benchmark::State& state)
+{
+    CDataStream stream(SER_NETWORK, PROTOCOL_VERSION);
+    stream << DummyBlock();
+    std::vector<char> vchBlock(stream.begin(), stream.end());
+    while (state.KeepRunning()) {
+        CDataStream ss(vchBlock, SER_NETWORK, PROTOCOL_VERSION);
+        CBlock block;
+        ss >> block;
+        assert(block.vtx.size() == (size_t)BLOCK_TX_COUNT);
+    }
+}
+
+BENCHMARK(SerializeBlock);
+BENCHMARK(DeserializeBlock);
@@ -0,0 +1,85 @@
+// Copyright (c) 2016 The Bitcoin Core developers
+// Copyright (c) 2018-2019 The Helix developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "bench.h"
+
+#include "coins.h"
+#include "primitives/transaction.h"
+#include "script/script.h"
+
+#include <cassert>
+#include <vector>
+
+// Number of transactions created for the cache benchmarks
+static const int CACHE_TX_COUNT = 1000;
+// Number of outputs of each of those transactions
+static const int CACHE_TX_OUTPUTS = 2;
+
+static CScript DummyScript(int n)
+{
+    std::vector<unsigned char> vchHash(20, (unsigned char)n);
+    return CScript() << OP_DUP << OP_HASH160 << vchHash << OP_EQUALVERIFY << OP_CHECKSIG;
+}
+
+static std::vector<CTransaction> DummyTransactions()
+{
+    std::vector<CTransaction> vtx;
+    vtx.reserve(CACHE_TX_COUNT);
+    for (int i = 0; i < CACHE_TX_COUNT; i++) {
+        CMutableTransaction tx;
+        tx.vin.resize(1);
+        tx.vin[0].prevout = COutPoint(uint256(i + 1), 0);
+        for (int j = 0; j < CACHE_TX_OUTPUTS; j++)
+            tx.vout.push_back(CTxOut((i + 1) * CENT, DummyScript(i)));
+        vtx.push_back(tx);
+    }
+    return vtx;
+}
+
+// Look up the inputs of a transaction spending outputs already in the cache,
+// as AcceptToMemoryPool and ConnectBlock do
+static void CCoinsCaching(benchmark::State& state)
+{
+    std::vector<CTransaction> vtx = DummyTransactions();
+    CCoinsView viewDummy;
+    CCoinsViewCache coins(&viewDummy);
+    for (const CTransaction& tx : vtx)
+        coins.ModifyCoins(tx.GetHash())->FromTx(tx, 0);
+
+    CMutableTransaction txSpend;
+    for (int i = 0; i < 10; i++)
+        txSpend.vin.push_back(CTxIn(COutPoint(vtx[i * 97].GetHash(), i % CACHE_TX_OUTPUTS)));
+    txSpend.vout.push_back(CTxOut(CENT, DummyScript(0)));
+    CTransaction t1(txSpend);
+
+    while (state.KeepRunning()) {
+        bool fHave = coins.HaveInputs(t1);
+        CAmount nValue = coins.GetValueIn(t1);
+        assert(fHave && nValue > 0);
+    }
+}
+
+// Add the outputs of a block's worth of transactions to a child cache, spend
+// them all again and flush the result into the parent
+static void CCoinsViewCache_AddSpendFlush(benchmark::State& state)
+{
+    std::vector<CTransaction> vtx = DummyTransactions();
+    CCoinsView viewDummy;
+    CCoinsViewCache coinsTip(&viewDummy);
+    while (state.KeepRunning()) {
+        CCoinsViewCache view(&coinsTip);
+        for (const CTransaction& tx : vtx)
+            view.ModifyCoins(tx.GetHash())->FromTx(tx, 1);
+        for (const CTransaction& tx : vtx) {
+            CCoinsModifier coins = view.ModifyCoins(tx.GetHash());
+            for (int j = 0; j < CACHE_TX_OUTPUTS; j++)
+                coins->Spend(j);
+        }
+        view.Flush();
+    }
+}
+
+BENCHMARK(CCoinsCaching);
+BENCHMARK(CCoinsViewCache_AddSpendFlush);
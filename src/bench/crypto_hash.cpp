@@ -0,0 +1,67 @@
+// Copyright (c) 2016 The Bitcoin Core developers
+// Copyright (c) 2018-2019 The Helix developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "bench.h"
+
+#include "crypto/sha256.h"
+#include "hash.h"
+#include "uint256.h"
+
+#include <vector>
+
+/* Number of bytes to hash per iteration */
+static const uint64_t BUFFER_SIZE = 1000 * 1000;
+
+/* Size of the serialized block header the proof-of-work hashes run over */
+static const int HEADER_SIZE = 112;
+
+static void SHA256_1MB(benchmark::State& state)
+{
+    uint8_t hash[CSHA256::OUTPUT_SIZE];
+    std::vector<uint8_t> in(BUFFER_SIZE, 0);
+    while (state.KeepRunning())
+        CSHA256().Write(in.data(), in.size()).Finalize(hash);
+}
+
+static void SHA256D64_1(benchmark::State& state)
+{
+    std::vector<uint8_t> in(64, 0);
+    std::vector<uint8_t> out(32);
+    while (state.KeepRunning())
+        SHA256D64(out.data(), in.data(), 1);
+}
+
+static void SHA256D64_1024(benchmark::State& state)
+{
+    std::vector<uint8_t> in(64 * 1024, 0);
+    std::vector<uint8_t> out(32 * 1024);
+    while (state.KeepRunning())
+        SHA256D64(out.data(), in.data(), 1024);
+}
+
+static void HashQuark_Header(benchmark::State& state)
+{
+    std::vector<char> in(HEADER_SIZE, 0);
+    while (state.KeepRunning()) {
+        uint256 hash = HashQuark(in.begin(), in.end());
+        in[0] = hash.begin()[0];
+    }
+}
+
+static void HashArgon2_Header(benchmark::State& state)
+{
+    std::vector<char> in(HEADER_SIZE, 0);
+    uint256 hash;
+    while (state.KeepRunning()) {
+        hash_argon2(in.data(), (char*)hash.begin(), HEADER_SIZE);
+        in[0] = hash.begin()[0];
+    }
+}
+
+BENCHMARK(SHA256_1MB);
+BENCHMARK(SHA256D64_1);
+BENCHMARK(SHA256D64_1024);
+BENCHMARK(HashQuark_Header);
+BENCHMARK(HashArgon2_Header);
@@ -0,0 +1,51 @@
+// Copyright (c) 2018-2019 The Helix developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "bench.h"
+
+#include "chain.h"
+#include "kernel.h"
+#include "main.h"
+
+#include <vector>
+
+// Length of the dummy chain the stake modifier is looked up in
+static const int KERNEL_CHAIN_LENGTH = 200;
+
+static void CheckStakeKernelHash_Check(benchmark::State& state)
+{
+    // One block a minute, every block generating a stake modifier
+    std::vector<CBlockIndex> vIndex(KERNEL_CHAIN_LENGTH);
+    std::vector<uint256> vHash(KERNEL_CHAIN_LENGTH);
+    for (int i = 0; i < KERNEL_CHAIN_LENGTH; i++) {
+        CBlockIndex& index = vIndex[i];
+        vHash[i] = i + 1;
+        index.phashBlock = &vHash[i];
+        index.pprev = i ? &vIndex[i - 1] : NULL;
+        index.nHeight = i;
+        index.nTime = 1500000000 + 60 * i;
+        index.SetStakeModifier(i, true);
+    }
+
+    LOCK(cs_main);
+    for (int i = 0; i < KERNEL_CHAIN_LENGTH; i++)
+        mapBlockIndex.insert(std::make_pair(vHash[i], &vIndex[i]));
+    chainActive.SetTip(&vIndex.back());
+
+    const CBlockIndex* pindexFrom = &vIndex[KERNEL_CHAIN_LENGTH / 2];
+    CTxOut txoutPrev(1000 * COIN, CScript());
+    COutPoint prevout(vHash[0], 1);
+    unsigned int nTimeStake = pindexFrom->GetBlockTime() + nStakeMinAge + 60;
+    while (state.KeepRunning()) {
+        unsigned int nTimeTx = nTimeStake;
+        uint256 hashProofOfStake;
+        CheckStakeKernelHash(0x1e0fffff, pindexFrom, txoutPrev, prevout, nTimeTx, 0, true, hashProofOfStake);
+    }
+
+    chainActive.SetTip(NULL);
+    for (int i = 0; i < KERNEL_CHAIN_LENGTH; i++)
+        mapBlockIndex.erase(vHash[i]);
+}
+
+BENCHMARK(CheckStakeKernelHash_Check);
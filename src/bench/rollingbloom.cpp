@@ -0,0 +1,56 @@
+// Copyright (c) 2016 The Bitcoin Core developers
+// Copyright (c) 2018-2019 The Helix developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "bench.h"
+
+#include "bloom.h"
+#include "mruset.h"
+#include "protocol.h"
+#include "random.h"
+
+#include <vector>
+
+/* Number of distinct inventory items announced per run, sized like an inventory flood */
+static const int NUM_INVS = 200000;
+
+/* Items a peer remembers, as CNode sizes filterInventoryKnown */
+static const unsigned int NUM_KNOWN = 10000;
+
+static std::vector<CInv> RandomInventory()
+{
+    std::vector<CInv> vInv;
+    vInv.reserve(NUM_INVS);
+    for (int i = 0; i < NUM_INVS; i++)
+        vInv.push_back(CInv(MSG_TX, GetRandHash()));
+    return vInv;
+}
+
+static void RollingBloom_Inventory(benchmark::State& state)
+{
+    const std::vector<CInv> vInv = RandomInventory();
+    CRollingBloomFilter filter(NUM_KNOWN, 0.000001);
+    size_t nInv = 0;
+    while (state.KeepRunning()) {
+        const std::vector<unsigned char> vKey = vInv[nInv++ % vInv.size()].GetKey();
+        if (!filter.contains(vKey))
+            filter.insert(vKey);
+    }
+}
+
+/* The per-peer set the rolling filter replaced, for comparison */
+static void Mruset_Inventory(benchmark::State& state)
+{
+    const std::vector<CInv> vInv = RandomInventory();
+    mruset<CInv> setKnown(NUM_KNOWN);
+    size_t nInv = 0;
+    while (state.KeepRunning()) {
+        const CInv& inv = vInv[nInv++ % vInv.size()];
+        if (!setKnown.count(inv))
+            setKnown.insert(inv);
+    }
+}
+
+BENCHMARK(RollingBloom_Inventory);
+BENCHMARK(Mruset_Inventory);
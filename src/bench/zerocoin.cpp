@@ -0,0 +1,93 @@
+// Copyright (c) 2018-2019 The Helix developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "bench.h"
+
+#include "accumulators.h"
+#include "chainparams.h"
+#include "libzerocoin/Accumulator.h"
+#include "libzerocoin/Coin.h"
+#include "libzerocoin/CoinSpend.h"
+
+#include <cassert>
+#include <memory>
+
+using namespace libzerocoin;
+
+// Number of other coins in the accumulator a benchmarked spend is made against
+static const int ACCUMULATED_COINS = 5;
+
+/** A v2 coin, and an accumulator and witness that contain it, shared by the spend benchmarks */
+struct ZerocoinBenchSetup {
+    ZerocoinParams* params;
+    PrivateCoin coin;
+    Accumulator accumulator;
+    AccumulatorWitness witness;
+    uint32_t nChecksum;
+    uint256 ptxHash;
+
+    ZerocoinBenchSetup() : params(Params().Zerocoin_Params()),
+                           coin(params, CoinDenomination::ZQ_ONE),
+                           accumulator(params, CoinDenomination::ZQ_ONE),
+                           witness(params, accumulator, coin.getPublicCoin())
+    {
+        for (int i = 0; i < ACCUMULATED_COINS; i++) {
+            PrivateCoin coinOther(params, CoinDenomination::ZQ_ONE);
+            accumulator += coinOther.getPublicCoin();
+            witness += coinOther.getPublicCoin();
+        }
+        accumulator += coin.getPublicCoin();
+        nChecksum = GetChecksum(accumulator.getValue());
+        ptxHash = CBigNum::RandKBitBigum(256).getuint256();
+    }
+};
+
+static ZerocoinBenchSetup& GetZerocoinBenchSetup()
+{
+    static std::unique_ptr<ZerocoinBenchSetup> setup(new ZerocoinBenchSetup());
+    return *setup;
+}
+
+static void CoinSpend_Create(benchmark::State& state)
+{
+    ZerocoinBenchSetup& setup = GetZerocoinBenchSetup();
+    while (state.KeepRunning()) {
+        CoinSpend spend(setup.params, setup.params, setup.coin, setup.accumulator, setup.nChecksum, setup.witness, setup.ptxHash, SpendType::SPEND);
+    }
+}
+
+static void CoinSpend_Verify(benchmark::State& state)
+{
+    ZerocoinBenchSetup& setup = GetZerocoinBenchSetup();
+    CoinSpend spend(setup.params, setup.params, setup.coin, setup.accumulator, setup.nChecksum, setup.witness, setup.ptxHash, SpendType::SPEND);
+    while (state.KeepRunning()) {
+        bool fValid = spend.Verify(setup.accumulator);
+        assert(fValid);
+    }
+}
+
+static void Accumulator_Increment(benchmark::State& state)
+{
+    ZerocoinBenchSetup& setup = GetZerocoinBenchSetup();
+    Accumulator accumulator(setup.params, CoinDenomination::ZQ_ONE);
+    const CBigNum& bnValue = setup.coin.getPublicCoin().getValue();
+    while (state.KeepRunning()) {
+        accumulator.increment(bnValue);
+    }
+}
+
+static void PublicCoin_Validate(benchmark::State& state)
+{
+    ZerocoinBenchSetup& setup = GetZerocoinBenchSetup();
+    const PublicCoin& pubCoin = setup.coin.getPublicCoin();
+    while (state.KeepRunning()) {
+        bool fValid = pubCoin.validate();
+        assert(fValid);
+    }
+}
+
+BENCHMARK(CoinSpend_Create);
+BENCHMARK(CoinSpend_Verify);
+BENCHMARK(Accumulator_Increment);
+BENCHMARK(PublicCoin_Validate);
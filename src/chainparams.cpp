@@ -163,6 +163,7 @@ public:
         bnProofOfWorkLimit = ~uint256(0) >> 1;
 	nAuxpowChainId = 0x005C;
         nMaxReorganizationDepth = 100;
+        hashAssumeValid = uint256("314b9d5f38632fac521b9c802e0658a3e5c2ffb1489c7b584fec42fece3f7ee4"); // last checkpoint
         nEnforceBlockUpgradeMajority = 750;
         nRejectBlockOutdatedMajority = 950;
         nToCheckBlockUpgradeMajority = 1000;
@@ -284,6 +285,7 @@ public:
         vAlertPubKey = ParseHex("0462af22b469d8c12de76a033b81378b0c4c7694c19863b073f51b34476d5b39ba88769ab83e9e48389985fd838d41704449b9ece1fd36720b9116338b8fb30794");
         nDefaultPort = 37417;
 	nAuxpowChainId = 0x005C;
+        hashAssumeValid = 0;
         nEnforceBlockUpgradeMajority = 51;
         nRejectBlockOutdatedMajority = 75;
         nToCheckBlockUpgradeMajority = 100;
@@ -374,6 +376,7 @@ public:
         pchMessageStart[1] = 0x78;
         pchMessageStart[2] = 0x3a;
         pchMessageStart[3] = 0x40;
+        hashAssumeValid = 0;
         nEnforceBlockUpgradeMajority = 750;
         nRejectBlockOutdatedMajority = 950;
         nToCheckBlockUpgradeMajority = 1000;
@@ -440,6 +443,7 @@ public:
         fDefaultConsistencyChecks = true;
         fAllowMinDifficultyBlocks = false;
         fMineBlocksOnDemand = true;
+        hashAssumeValid = 0;
     }
 
     const Checkpoints::CCheckpointData& Checkpoints() const
@@ -455,6 +459,8 @@ public:
     virtual void setDefaultConsistencyChecks(bool afDefaultConsistencyChecks) { fDefaultConsistencyChecks = afDefaultConsistencyChecks; }
     virtual void setAllowMinDifficultyBlocks(bool afAllowMinDifficultyBlocks) { fAllowMinDifficultyBlocks = afAllowMinDifficultyBlocks; }
     virtual void setSkipProofOfWorkCheck(bool afSkipProofOfWorkCheck) { fSkipProofOfWorkCheck = afSkipProofOfWorkCheck; }
+    virtual void setZerocoinStartHeight(int anZerocoinStartHeight) { nZerocoinStartHeight = anZerocoinStartHeight; }
+    virtual void setZerocoinLastOldParams(int anZerocoinLastOldParams) { nZerocoinLastOldParams = anZerocoinLastOldParams; }
 };
 static CUnitTestParams unitTestParams;
 
@@ -55,6 +55,8 @@ public:
     int RejectBlockOutdatedMajority() const { return nRejectBlockOutdatedMajority; }
     int ToCheckBlockUpgradeMajority() const { return nToCheckBlockUpgradeMajority; }
     int MaxReorganizationDepth() const { return nMaxReorganizationDepth; }
+    /** Block whose ancestors skip script and zerocoin spend signature checks (default -assumevalid) */
+    uint256 AssumeValidBlock() const { return hashAssumeValid; }
 
     /** Used if GenerateBitcoins is called with a negative number of threads */
     int DefaultMinerThreads() const { return nMinerThreads; }
@@ -128,6 +130,7 @@ protected:
     uint256 bnProofOfWorkLimit;
   int16_t nAuxpowChainId;
     int nMaxReorganizationDepth;
+    uint256 hashAssumeValid;
     int nEnforceBlockUpgradeMajority;
     int nRejectBlockOutdatedMajority;
     int nToCheckBlockUpgradeMajority;
@@ -190,6 +193,8 @@ public:
     virtual void setDefaultConsistencyChecks(bool aDefaultConsistencyChecks) = 0;
     virtual void setAllowMinDifficultyBlocks(bool aAllowMinDifficultyBlocks) = 0;
     virtual void setSkipProofOfWorkCheck(bool aSkipProofOfWorkCheck) = 0;
+    virtual void setZerocoinStartHeight(int anZerocoinStartHeight) = 0;
+    virtual void setZerocoinLastOldParams(int anZerocoinLastOldParams) = 0;
 };
 
 
@@ -15,6 +15,7 @@
 #include <assert.h>
 #include <stdint.h>
 
+#include <boost/function.hpp>
 #include <boost/unordered_map.hpp>
 
 /** 
@@ -317,6 +318,13 @@ struct CCoinsCacheEntry {
 
 typedef boost::unordered_map<uint256, CCoinsCacheEntry, CCoinsKeyHasher> CCoinsMap;
 
+/** Which hash of the UTXO set GetStats computes */
+enum CoinStatsHashType {
+    COINSTATS_HASH_SERIALIZED, //!< hashSerialized, over all coins in txid order
+    COINSTATS_HASH_MUHASH,     //!< hashMuHash, a set hash that is computed in parallel
+    COINSTATS_HASH_NONE,
+};
+
 struct CCoinsStats {
     int nHeight;
     uint256 hashBlock;
@@ -324,12 +332,26 @@ struct CCoinsStats {
     uint64_t nTransactionOutputs;
     uint64_t nSerializedSize;
     uint256 hashSerialized;
+    uint256 hashMuHash;
     CAmount nTotalAmount;
 
-    CCoinsStats() : nHeight(0), hashBlock(0), nTransactions(0), nTransactionOutputs(0), nSerializedSize(0), hashSerialized(0), nTotalAmount(0) {}
+    CCoinsStats() : nHeight(0), hashBlock(0), nTransactions(0), nTransactionOutputs(0), nSerializedSize(0), hashSerialized(0), hashMuHash(0), nTotalAmount(0) {}
 };
 
 
+/** Read-only copy of the stored coins, as of when it was taken */
+class CCoinsViewSnapshot
+{
+public:
+    //! The block hash whose state the snapshot represents
+    virtual uint256 GetBestBlock() const = 0;
+
+    //! Call fn for every CCoins in txid order until it returns false
+    virtual bool ForEachCoins(const boost::function<bool(const uint256&, const CCoins&)>& fn) const = 0;
+
+    virtual ~CCoinsViewSnapshot() {}
+};
+
 /** Abstract view on the open txout dataset. */
 class CCoinsView
 {
@@ -349,7 +371,11 @@ public:
     virtual bool BatchWrite(CCoinsMap& mapCoins, const uint256& hashBlock);
 
     //! Calculate statistics about the unspent transaction output set
-    virtual bool GetStats(CCoinsStats& stats) const;
+    virtual bool GetStats(CCoinsStats& stats, CoinStatsHashType hashType = COINSTATS_HASH_SERIALIZED) const;
+
+    //! Take a snapshot of the stored coins that later writes don't change (NULL if
+    //! not supported). Like GetStats, this only sees what has been flushed to the database.
+    virtual CCoinsViewSnapshot* NewSnapshot() const;
 
     //! As we use CCoinsViews polymorphically, have a virtual destructor
     virtual ~CCoinsView() {}
@@ -369,7 +395,8 @@ public:
     uint256 GetBestBlock() const;
     void SetBackend(CCoinsView& viewIn);
     bool BatchWrite(CCoinsMap& mapCoins, const uint256& hashBlock);
-    bool GetStats(CCoinsStats& stats) const;
+    bool GetStats(CCoinsStats& stats, CoinStatsHashType hashType = COINSTATS_HASH_SERIALIZED) const;
+    CCoinsViewSnapshot* NewSnapshot() const;
 };
 
 class CCoinsViewCache;
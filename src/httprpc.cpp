@@ -84,6 +84,28 @@ static bool RPCAuthorized(const std::string& strAuth)
     return TimingResistantEqual(strUserPass, strRPCUserColonPass);
 }
 
+/** Serve a singleton request through the streaming variant of its method.
+ * Returns false if the method cannot be streamed; nothing has been sent then.
+ */
+static bool JSONRPCStreamReply(HTTPRequest* req, const JSONRequest& jreq)
+{
+    CJSONStreamWriter writer(HTTPChunkedReplySink(req, HTTP_OK, "application/json"));
+    try {
+        writer.Raw("{\"result\":");
+        if (!tableRPC.executeStreaming(jreq.strMethod, jreq.params, writer))
+            return false;
+        writer.Raw(",\"error\":null,\"id\":" + jreq.id.write() + "}\n");
+        writer.Flush();
+    } catch (...) {
+        // Until the first chunk is out the caller can still send an error reply
+        if (!writer.Flushed())
+            throw;
+        LogPrintf("%s: %s failed after its reply was started, truncating\n", __func__, SanitizeString(jreq.strMethod));
+    }
+    req->EndChunkedReply();
+    return true;
+}
+
 static bool HTTPReq_JSONRPC(HTTPRequest* req, const std::string &)
 {
     // JSONRPC handles only POST
@@ -122,6 +144,9 @@ static bool HTTPReq_JSONRPC(HTTPRequest* req, const std::string &)
         if (valRequest.isObject()) {
             jreq.parse(valRequest);
 
+            if (JSONRPCStreamReply(req, jreq))
+                return true;
+
             UniValue result = tableRPC.execute(jreq.strMethod, jreq.params);
 
             // Send reply
@@ -173,6 +198,8 @@ bool StartHTTPRPC()
     assert(EventBase());
     httpRPCTimerInterface = new HTTPRPCTimerInterface(EventBase());
     RPCRegisterTimerInterface(httpRPCTimerInterface);
+    // The batch's own worker plus the -rpcthreads helpers of the batch pool
+    RPCRegisterBatchDispatcher(HTTPQueueBatchTask, std::max((int)GetArg("-rpcthreads", DEFAULT_HTTP_THREADS), 1) + 1);
     return true;
 }
 
@@ -185,6 +212,7 @@ void StopHTTPRPC()
 {
     LogPrint("rpc", "Stopping HTTP RPC server\n");
     UnregisterHTTPHandler("/", true);
+    RPCUnregisterBatchDispatcher();
     if (httpRPCTimerInterface) {
         RPCUnregisterTimerInterface(httpRPCTimerInterface);
         delete httpRPCTimerInterface;
@@ -41,6 +41,9 @@
 /** Maximum size of http request (request line + headers) */
 static const size_t MAX_HEADERS_SIZE = 8192;
 
+/** Maximum bytes of a streamed reply that may wait to be sent before the producer blocks */
+static const size_t MAX_HTTP_CHUNK_BACKLOG = 1024 * 1024;
+
 /** HTTP request work item */
 class HTTPWorkItem : public HTTPClosure
 {
@@ -186,6 +189,8 @@ struct evhttp* eventHTTP = 0;
 static std::vector<CSubNet> rpc_allow_subnets;
 //! Work queue for handling longer requests off the event loop thread
 static WorkQueue<HTTPClosure>* workQueue = 0;
+//! Work queue for the helper tasks of JSON-RPC batches, so they never take a request slot
+static WorkQueue<HTTPClosure>* batchQueue = 0;
 //! Handlers for (sub)paths
 std::vector<HTTPPathHandler> pathHandlers;
 std::vector<evhttp_bound_socket *> boundSockets;
@@ -353,6 +358,33 @@ static bool HTTPBindAddresses(struct evhttp* http)
     return !boundSockets.empty();
 }
 
+/** Closure wrapping an arbitrary task for the worker threads */
+class HTTPTaskClosure : public HTTPClosure
+{
+public:
+    HTTPTaskClosure(const boost::function<void(void)>& task) : task(task)
+    {
+    }
+    void operator()()
+    {
+        task();
+    }
+
+private:
+    boost::function<void(void)> task;
+};
+
+bool HTTPQueueBatchTask(const boost::function<void(void)>& task)
+{
+    if (!batchQueue)
+        return false;
+    std::unique_ptr<HTTPTaskClosure> item(new HTTPTaskClosure(task));
+    if (!batchQueue->Enqueue(item.get()))
+        return false;
+    item.release(); /* if true, queue took ownership */
+    return true;
+}
+
 /** Simple wrapper to set thread name and run work queue */
 static void HTTPWorkQueueRun(WorkQueue<HTTPClosure>* queue)
 {
@@ -360,6 +392,12 @@ static void HTTPWorkQueueRun(WorkQueue<HTTPClosure>* queue)
     queue->Run();
 }
 
+static void HTTPBatchQueueRun(WorkQueue<HTTPClosure>* queue)
+{
+    RenameThread("bitcoin-httpbatch");
+    queue->Run();
+}
+
 /** libevent event log callback */
 static void libevent_log_cb(int severity, const char *msg)
 {
@@ -435,6 +473,7 @@ bool InitHTTPServer()
     LogPrintf("HTTP: creating work queue of depth %d\n", workQueueDepth);
 
     workQueue = new WorkQueue<HTTPClosure>(workQueueDepth);
+    batchQueue = new WorkQueue<HTTPClosure>(workQueueDepth);
     eventBase = base;
     eventHTTP = http;
     return true;
@@ -451,6 +490,8 @@ bool StartHTTPServer()
 
     for (int i = 0; i < rpcThreads; i++)
         boost::thread(boost::bind(&HTTPWorkQueueRun, workQueue));
+    for (int i = 0; i < rpcThreads; i++)
+        boost::thread(boost::bind(&HTTPBatchQueueRun, batchQueue));
     return true;
 }
 
@@ -465,6 +506,8 @@ void InterruptHTTPServer()
     }
     if (workQueue)
         workQueue->Interrupt();
+    if (batchQueue)
+        batchQueue->Interrupt();
 }
 
 void StopHTTPServer()
@@ -475,6 +518,11 @@ void StopHTTPServer()
         workQueue->WaitExit();
         delete workQueue;
     }
+    if (batchQueue) {
+        batchQueue->WaitExit();
+        delete batchQueue;
+        batchQueue = 0;
+    }
     MilliSleep(500); // Avoid race condition while the last HTTP-thread is exiting
     if (eventBase) {
         LogPrint("http", "Waiting for HTTP event thread to exit\n");
@@ -542,6 +590,11 @@ HTTPRequest::HTTPRequest(struct evhttp_request* req) : req(req),
 }
 HTTPRequest::~HTTPRequest()
 {
+    if (chunkQueue && req) {
+        // Handler gave up half way; terminate the body so the client sees the end
+        LogPrintf("%s: Unfinished chunked reply\n", __func__);
+        EndChunkedReply();
+    }
     if (!replySent) {
         // Keep track of whether reply was sent to avoid request leaks
         LogPrintf("%s: Unhandled request\n", __func__);
@@ -607,6 +660,181 @@ void HTTPRequest::WriteReply(int nStatus, const std::string& strReply)
     req = 0; // transferred back to main thread
 }
 
+/** Body chunks of a streamed reply. Worker threads append, and every event
+ * sent to the main http thread drains whatever is pending, in order, so the
+ * order in which libevent runs those events does not matter.
+ *
+ * Bytes that are queued here or still in the connection's output buffer are
+ * counted in nBacklog; producers wait while it is above
+ * MAX_HTTP_CHUNK_BACKLOG, so a slow client limits memory use instead of the
+ * whole reply piling up in libevent.
+ */
+struct HTTPChunkQueue
+{
+    CWaitableCriticalSection cs;
+    CConditionVariable cond;
+    struct evhttp_request* req;
+    int nStatus;
+    std::deque<struct evbuffer*> chunks;
+    //! Bytes queued or not yet written to the socket
+    size_t nBacklog;
+    //! Of nBacklog, bytes handed to libevent and not yet written
+    size_t nInFlight;
+    bool fStarted;
+    bool fEnd;
+    bool fDone;
+    //! The connection went away; producers must stop
+    bool fClosed;
+
+    HTTPChunkQueue(struct evhttp_request* req, int nStatus) : req(req), nStatus(nStatus),
+                                                              nBacklog(0), nInFlight(0),
+                                                              fStarted(false), fEnd(false), fDone(false), fClosed(false)
+    {
+    }
+    ~HTTPChunkQueue()
+    {
+        for (struct evbuffer* chunk : chunks)
+            evbuffer_free(chunk);
+    }
+};
+
+/** Runs in the main http thread when the connection of a streamed reply is
+ * closed. libevent detaches the request, which stays valid until
+ * evhttp_send_reply_end.
+ */
+static void HTTPChunkConnectionClosed(struct evhttp_connection*, void* arg)
+{
+    HTTPChunkQueue* queue = static_cast<HTTPChunkQueue*>(arg);
+    boost::unique_lock<boost::mutex> lock(queue->cs);
+    queue->fClosed = true;
+    queue->cond.notify_all();
+}
+
+#if LIBEVENT_VERSION_NUMBER >= 0x02010100
+/** Runs in the main http thread once the output buffer has been written */
+static void HTTPChunksWritten(struct evhttp_connection*, void* arg)
+{
+    HTTPChunkQueue* queue = static_cast<HTTPChunkQueue*>(arg);
+    boost::unique_lock<boost::mutex> lock(queue->cs);
+    queue->nBacklog -= queue->nInFlight;
+    queue->nInFlight = 0;
+    queue->cond.notify_all();
+}
+#endif
+
+/** Runs in the main http thread */
+static void HTTPSendChunks(std::shared_ptr<HTTPChunkQueue> queue)
+{
+    std::deque<struct evbuffer*> chunks;
+    bool fEnd;
+    bool fClosed;
+    {
+        boost::unique_lock<boost::mutex> lock(queue->cs);
+        if (queue->fDone)
+            return;
+        if (!queue->fStarted && !evhttp_request_get_connection(queue->req))
+            queue->fClosed = true;
+        chunks.swap(queue->chunks);
+        fEnd = queue->fEnd;
+        fClosed = queue->fClosed;
+        queue->fDone = fEnd;
+    }
+    struct evhttp_connection* evcon = evhttp_request_get_connection(queue->req);
+    if (!fClosed && !queue->fStarted) {
+        evhttp_connection_set_closecb(evcon, HTTPChunkConnectionClosed, queue.get());
+        evhttp_send_reply_start(queue->req, queue->nStatus, NULL);
+        queue->fStarted = true;
+    }
+    size_t nSent = 0;
+    for (struct evbuffer* chunk : chunks) {
+        nSent += evbuffer_get_length(chunk);
+        if (!fClosed) {
+#if LIBEVENT_VERSION_NUMBER >= 0x02010100
+            evhttp_send_reply_chunk_with_cb(queue->req, chunk, HTTPChunksWritten, queue.get());
+#else
+            evhttp_send_reply_chunk(queue->req, chunk);
+#endif
+        }
+        evbuffer_free(chunk);
+    }
+    {
+        boost::unique_lock<boost::mutex> lock(queue->cs);
+#if LIBEVENT_VERSION_NUMBER >= 0x02010100
+        if (!fClosed && !fEnd)
+            queue->nInFlight += nSent;
+        else
+            queue->nBacklog -= nSent;
+#else
+        queue->nBacklog -= nSent;
+#endif
+        queue->cond.notify_all();
+    }
+    if (fEnd) {
+        // The queue may be freed after this, so stop libevent from calling back into it
+        if (!fClosed)
+            evhttp_connection_set_closecb(evcon, NULL, NULL);
+        evhttp_send_reply_end(queue->req);
+    }
+}
+
+void HTTPRequest::StartChunkedReply(int nStatus)
+{
+    assert(!replySent && req);
+    chunkQueue = std::make_shared<HTTPChunkQueue>(req, nStatus);
+    replySent = true;
+}
+
+bool HTTPRequest::WriteReplyChunk(const std::string& strChunk)
+{
+    assert(chunkQueue && req);
+    {
+        boost::unique_lock<boost::mutex> lock(chunkQueue->cs);
+        while (!chunkQueue->fClosed && chunkQueue->nBacklog >= MAX_HTTP_CHUNK_BACKLOG)
+            chunkQueue->cond.wait(lock);
+        if (chunkQueue->fClosed)
+            return false;
+    }
+    if (strChunk.empty())
+        return true;
+    struct evbuffer* evb = evbuffer_new();
+    assert(evb);
+    evbuffer_add(evb, strChunk.data(), strChunk.size());
+    {
+        boost::unique_lock<boost::mutex> lock(chunkQueue->cs);
+        chunkQueue->chunks.push_back(evb);
+        chunkQueue->nBacklog += strChunk.size();
+    }
+    HTTPEvent* ev = new HTTPEvent(eventBase, true, boost::bind(HTTPSendChunks, chunkQueue));
+    ev->trigger(0);
+    return true;
+}
+
+void HTTPRequest::EndChunkedReply()
+{
+    assert(chunkQueue && req);
+    {
+        boost::unique_lock<boost::mutex> lock(chunkQueue->cs);
+        chunkQueue->fEnd = true;
+    }
+    HTTPEvent* ev = new HTTPEvent(eventBase, true, boost::bind(HTTPSendChunks, chunkQueue));
+    ev->trigger(0);
+    req = 0; // transferred back to main thread
+}
+
+boost::function<void(const std::string&)> HTTPChunkedReplySink(HTTPRequest* req, int nStatus, const std::string& strContentType)
+{
+    std::shared_ptr<bool> fStarted = std::make_shared<bool>(false);
+    return [req, nStatus, strContentType, fStarted](const std::string& strChunk) {
+        if (!*fStarted) {
+            req->WriteHeader("Content-Type", strContentType);
+            req->StartChunkedReply(nStatus);
+            *fStarted = true;
+        }
+        if (!req->WriteReplyChunk(strChunk))
+            throw std::runtime_error("HTTP client disconnected");
+    };
+}
+
 CService HTTPRequest::GetPeer()
 {
     evhttp_connection* con = evhttp_request_get_connection(req);
@@ -5,6 +5,7 @@
 #ifndef BITCOIN_HTTPSERVER_H
 #define BITCOIN_HTTPSERVER_H
 
+#include <memory>
 #include <string>
 #include <stdint.h>
 #include <boost/thread.hpp>
@@ -20,6 +21,7 @@ struct evhttp_request;
 struct event_base;
 class CService;
 class HTTPRequest;
+struct HTTPChunkQueue;
 
 /** Initialize HTTP server.
  * Call this before RegisterHTTPHandler or EventBase().
@@ -50,6 +52,12 @@ void UnregisterHTTPHandler(const std::string &prefix, bool exactMatch);
  */
 struct event_base* EventBase();
 
+/** Queue a JSON-RPC batch helper task on its own pool of -rpcthreads threads,
+ * separate from the request work queue.
+ * Returns false if the queue is full or the server is not running.
+ */
+bool HTTPQueueBatchTask(const boost::function<void(void)>& task);
+
 /** In-flight HTTP request.
  * Thin C++ wrapper around evhttp_request.
  */
@@ -58,6 +66,8 @@ class HTTPRequest
 private:
     struct evhttp_request* req;
     bool replySent;
+    //! Pending body chunks of a chunked reply, shared with the event loop
+    std::shared_ptr<HTTPChunkQueue> chunkQueue;
 
 public:
     HTTPRequest(struct evhttp_request* req);
@@ -113,8 +123,35 @@ public:
      * main thread, do not call any other HTTPRequest methods after calling this.
      */
     void WriteReply(int nStatus, const std::string& strReply = "");
+
+    /**
+     * Start a reply whose body is sent in pieces, using chunked transfer
+     * encoding where the client supports it. Write headers before calling this.
+     *
+     * @note After this only WriteReplyChunk and EndChunkedReply may be called.
+     */
+    void StartChunkedReply(int nStatus);
+    /**
+     * Queue the next piece of a chunked reply body for sending. Blocks while
+     * too much of the reply is still waiting to be sent. Returns false if the
+     * client has disconnected; the caller should stop producing and end the
+     * reply.
+     */
+    bool WriteReplyChunk(const std::string& strChunk);
+    /**
+     * Finish a chunked reply. As with WriteReply, the request is given back
+     * to the main thread afterwards.
+     */
+    void EndChunkedReply();
 };
 
+/** Chunk sink that starts a chunked reply with the given status and content
+ * type when it first receives data. The caller ends the reply with
+ * EndChunkedReply once it has passed in at least one non-empty chunk.
+ * Throws std::runtime_error if the client has disconnected.
+ */
+boost::function<void(const std::string&)> HTTPChunkedReplySink(HTTPRequest* req, int nStatus, const std::string& strContentType);
+
 /** Event handler closure.
  */
 class HTTPClosure
@@ -33,6 +33,7 @@
 #include "rpc/server.h"
 #include "script/standard.h"
 #include "scheduler.h"
+#include "snapshot.h"
 #include "spork.h"
 #include "sporkdb.h"
 #include "txdb.h"
@@ -350,6 +351,7 @@ std::string HelpMessage(HelpMessageMode mode)
     strUsage += HelpMessageOpt("-version", _("Print version and exit"));
     strUsage += HelpMessageOpt("-alertnotify=<cmd>", _("Execute command when a relevant alert is received or we see a really long fork (%s in cmd is replaced by message)"));
     strUsage += HelpMessageOpt("-alerts", strprintf(_("Receive and display P2P network alerts (default: %u)"), DEFAULT_ALERTS));
+    strUsage += HelpMessageOpt("-assumevalid=<hex>", strprintf(_("If this block is in the chain assume that it and its ancestors are valid and skip their script and zerocoin spend signature verification (0 to verify all, default: %s)"), Params(CBaseChainParams::MAIN).AssumeValidBlock().GetHex()));
     strUsage += HelpMessageOpt("-blocknotify=<cmd>", _("Execute command when the best block changes (%s in cmd is replaced by block hash)"));
     strUsage += HelpMessageOpt("-mempoolnotify=<cmd>", _("Execute command when a new transaction is accepted to the mempool (%s in cmd is replaced by transaction hash)"));
     strUsage += HelpMessageOpt("-blocksizenotify=<cmd>", _("Execute command when the best block changes and its size is over (%s in cmd is replaced by block hash, %d with the block size)"));
@@ -363,12 +365,18 @@ std::string HelpMessage(HelpMessageMode mode)
     strUsage += HelpMessageOpt("-datadir=<dir>", _("Specify data directory"));
     strUsage += HelpMessageOpt("-dbcache=<n>", strprintf(_("Set database cache size in megabytes (%d to %d, default: %d)"), nMinDbCache, nMaxDbCache, nDefaultDbCache));
     strUsage += HelpMessageOpt("-loadblock=<file>", _("Imports blocks from external blk000??.dat file") + " " + _("on startup"));
+    strUsage += HelpMessageOpt("-loadtxoutset=<file>", _("Start from a UTXO snapshot written by dumptxoutset instead of downloading and verifying all blocks (requires -prune, only used with an empty data directory)"));
+    strUsage += HelpMessageOpt("-loadtxoutsethash=<hex>", _("The snapshot_hash reported by dumptxoutset for the -loadtxoutset snapshot (required)"));
     strUsage += HelpMessageOpt("-maxreorg=<n>", strprintf(_("Set the Maximum reorg depth (default: %u)"), Params(CBaseChainParams::MAIN).MaxReorganizationDepth()));
     strUsage += HelpMessageOpt("-maxorphantx=<n>", strprintf(_("Keep at most <n> unconnectable transactions in memory (default: %u)"), DEFAULT_MAX_ORPHAN_TRANSACTIONS));
     strUsage += HelpMessageOpt("-par=<n>", strprintf(_("Set the number of script verification threads (%u to %d, 0 = auto, <0 = leave that many cores free, default: %d)"), -(int)boost::thread::hardware_concurrency(), MAX_SCRIPTCHECK_THREADS, DEFAULT_SCRIPTCHECK_THREADS));
 #ifndef WIN32
     strUsage += HelpMessageOpt("-pid=<file>", strprintf(_("Specify pid file (default: %s)"), "helixd.pid"));
 #endif
+    strUsage += HelpMessageOpt("-prune=<n>", strprintf(_("Reduce storage requirements by pruning (deleting) old blocks. "
+        "Blocks within %u of the tip and blocks needed to spend the wallet's zerocoin mints are kept. This mode disables wallet rescans. "
+        "Warning: Reverting this setting requires re-downloading the entire blockchain. "
+        "(default: 0 = disable pruning blocks, >%u = target size in MiB to use for block files)"), MIN_BLOCKS_TO_KEEP, MIN_DISK_SPACE_FOR_BLOCK_FILES / 1024 / 1024));
     strUsage += HelpMessageOpt("-reindex", _("Rebuild block chain index from current blk000??.dat files") + " " + _("on startup"));
     strUsage += HelpMessageOpt("-reindexaccumulators", _("Reindex the accumulator database") + " " + _("on startup"));
     strUsage += HelpMessageOpt("-reindexmoneysupply", _("Reindex the HLIX and zHLIX money supply statistics") + " " + _("on startup"));
@@ -377,7 +385,7 @@ std::string HelpMessage(HelpMessageMode mode)
     strUsage += HelpMessageOpt("-sysperms", _("Create new files with system default permissions, instead of umask 077 (only effective with disabled wallet functionality)"));
 #endif
     strUsage += HelpMessageOpt("-txindex", strprintf(_("Maintain a full transaction index, used by the getrawtransaction rpc call (default: %u)"), 0));
-    strUsage += HelpMessageOpt("-addrindex", strprintf(_("Maintain a full address index, used by the searchrawtransactions rpc call (default: %u)"), 0));
+    strUsage += HelpMessageOpt("-addrindex", strprintf(_("Maintain a full address index, used by the searchrawtransactions, getaddressbalance, getaddressutxos and getaddressdeltas rpc calls (default: %u)"), DEFAULT_ADDRINDEX));
     strUsage += HelpMessageOpt("-forcestart", _("Attempt to force blockchain corruption recovery") + " " + _("on startup"));
 
     strUsage += HelpMessageGroup(_("Connection options:"));
@@ -394,6 +402,7 @@ std::string HelpMessage(HelpMessageMode mode)
     strUsage += HelpMessageOpt("-listen", _("Accept connections from outside (default: 1 if no -proxy or -connect)"));
     strUsage += HelpMessageOpt("-listenonion", strprintf(_("Automatically create Tor hidden service (default: %d)"), DEFAULT_LISTEN_ONION));
     strUsage += HelpMessageOpt("-maxconnections=<n>", strprintf(_("Maintain at most <n> connections to peers (default: %u)"), 125));
+    strUsage += HelpMessageOpt("-maxrelaycache=<n>", strprintf(_("Keep at most <n> MiB of serialized transactions for answering relay requests (default: %u)"), DEFAULT_MAX_RELAY_CACHE));
     strUsage += HelpMessageOpt("-maxreceivebuffer=<n>", strprintf(_("Maximum per-connection receive buffer, <n>*1000 bytes (default: %u)"), 5000));
     strUsage += HelpMessageOpt("-maxsendbuffer=<n>", strprintf(_("Maximum per-connection send buffer, <n>*1000 bytes (default: %u)"), 1000));
     strUsage += HelpMessageOpt("-onion=<ip:port>", strprintf(_("Use separate SOCKS5 proxy to reach peers via Tor hidden services (default: %s)"), "-proxy"));
@@ -645,11 +654,13 @@ void ThreadImport(std::vector<boost::filesystem::path> vImportFiles)
             CDiskBlockPos pos(nFile, 0);
             if (!boost::filesystem::exists(GetBlockPosFilename(pos, "blk")))
                 break; // No block files left to reindex
-            FILE* file = OpenBlockFile(pos, true);
-            if (!file)
-                break; // This error is logged in OpenBlockFile
             LogPrintf("Reindexing block file blk%05u.dat...\n", (unsigned int)nFile);
-            LoadExternalBlockFile(file, &pos);
+            if (!ReindexBlockFile(pos)) {
+                FILE* file = OpenBlockFile(pos, true);
+                if (!file)
+                    break; // This error is logged in OpenBlockFile
+                LoadExternalBlockFile(file, &pos);
+            }
             nFile++;
         }
         pblocktree->WriteReindexing(false);
@@ -902,12 +913,20 @@ bool AppInit2(boost::thread_group& threadGroup, CScheduler& scheduler, const std
 
     InitSignatureCache();
     InitScriptExecutionCache();
+    InitZerocoinSpendCache();
 
     // Checkmempool and checkblockindex default to true in regtest mode
     mempool.setSanityCheck(GetBoolArg("-checkmempool", Params().DefaultConsistencyChecks()));
     fCheckBlockIndex = GetBoolArg("-checkblockindex", Params().DefaultConsistencyChecks());
     Checkpoints::fEnabled = GetBoolArg("-checkpoints", true);
 
+    std::string strAssumeValid = GetArg("-assumevalid", Params().AssumeValidBlock().GetHex());
+    if (strAssumeValid.empty() || strAssumeValid.size() > 64 || strAssumeValid.find_first_not_of("0123456789abcdefABCDEF") != std::string::npos)
+        return InitError(strprintf(_("Invalid block hash in -assumevalid: '%s'"), strAssumeValid));
+    hashAssumeValid = uint256(strAssumeValid);
+    if (hashAssumeValid != 0)
+        LogPrintf("Assuming ancestors of block %s have valid signatures.\n", hashAssumeValid.GetHex());
+
     // -par=0 means autodetect, but nScriptCheckThreads==0 means no concurrency
     nScriptCheckThreads = GetArg("-par", DEFAULT_SCRIPTCHECK_THREADS);
     if (nScriptCheckThreads <= 0)
@@ -917,6 +936,39 @@ bool AppInit2(boost::thread_group& threadGroup, CScheduler& scheduler, const std
     else if (nScriptCheckThreads > MAX_SCRIPTCHECK_THREADS)
         nScriptCheckThreads = MAX_SCRIPTCHECK_THREADS;
 
+    // block pruning; get the amount of disk space (in MiB) to allot for block & undo files
+    int64_t nSignedPruneTarget = GetArg("-prune", 0) * 1024 * 1024;
+    if (nSignedPruneTarget < 0)
+        return InitError(_("Prune cannot be configured with a negative value."));
+    nPruneTarget = (uint64_t)nSignedPruneTarget;
+    if (nPruneTarget) {
+        if (nPruneTarget < MIN_DISK_SPACE_FOR_BLOCK_FILES)
+            return InitError(strprintf(_("Prune configured below the minimum of %d MiB.  Please use a higher number."), MIN_DISK_SPACE_FOR_BLOCK_FILES / 1024 / 1024));
+#ifdef ENABLE_WALLET
+        if (GetBoolArg("-rescan", false))
+            return InitError(_("Rescans are not possible in pruned mode. You will need to use -reindex which will download the whole blockchain again."));
+#endif
+        // These rebuild their databases from every block on disk
+        if (GetBoolArg("-reindexmoneysupply", false) || GetBoolArg("-reindexzerocoin", false) || GetBoolArg("-reindexaccumulators", false))
+            return InitError(_("-reindexmoneysupply, -reindexzerocoin and -reindexaccumulators are not possible in pruned mode. You will need to use -reindex which will download the whole blockchain again."));
+        // The index would point into deleted files
+        if (mapArgs.count("-txindex") && GetBoolArg("-txindex", true))
+            return InitError(_("Prune mode is incompatible with -txindex."));
+        if (SoftSetBoolArg("-txindex", false))
+            LogPrintf("%s: parameter interaction: -prune set -> setting -txindex=0\n", __func__);
+        LogPrintf("Prune configured to target %uMiB on disk for block and undo files.\n", nPruneTarget / 1024 / 1024);
+        fPruneMode = true;
+    }
+
+    if (mapArgs.count("-loadtxoutset")) {
+        if (!fPruneMode)
+            return InitError(_("Loading a UTXO snapshot requires -prune, as the blocks below the snapshot are not available."));
+        if (GetBoolArg("-reindex", false))
+            return InitError(_("-loadtxoutset is incompatible with -reindex."));
+        if (uint256S(GetArg("-loadtxoutsethash", "0")) == 0)
+            return InitError(_("-loadtxoutset requires -loadtxoutsethash, the snapshot hash of a trusted snapshot."));
+    }
+
     fServer = GetBoolArg("-server", false);
     setvbuf(stdout, NULL, _IOLBF, 0); /// ***TODO*** do we still need this after -printtoconsole is gone?
 
@@ -935,6 +987,8 @@ bool AppInit2(boost::thread_group& threadGroup, CScheduler& scheduler, const std
     if (nConnectTimeout <= 0)
         nConnectTimeout = DEFAULT_CONNECT_TIMEOUT;
 
+    relayCache.SetMaxBytes(std::max(GetArg("-maxrelaycache", DEFAULT_MAX_RELAY_CACHE), (int64_t)0) * 1024 * 1024);
+
     // Fee-per-kilobyte amount considered the same as "free"
     // If you are mining, be careful setting this:
     // if you set it to zero then
@@ -1054,6 +1108,9 @@ bool AppInit2(boost::thread_group& threadGroup, CScheduler& scheduler, const std
             threadGroup.create_thread(&ThreadScriptCheck);
     }
 
+    // Precomputes accumulator checkpoints as blocks connect
+    threadGroup.create_thread(boost::bind(&TraceThread<void (*)()>, "acccheck", &ThreadAccumulatorCheckpoints));
+
     if (mapArgs.count("-sporkkey")) // spork priv key
     {
         if (!sporkManager.SetPrivKey(GetArg("-sporkkey", "")))
@@ -1395,7 +1452,7 @@ bool AppInit2(boost::thread_group& threadGroup, CScheduler& scheduler, const std
     else if (nTotalCache > (nMaxDbCache << 20))
         nTotalCache = (nMaxDbCache << 20); // total cache cannot be greater than nMaxDbCache
     size_t nBlockTreeDBCache = nTotalCache / 8;
-    if (nBlockTreeDBCache > (1 << 21) && !GetBoolArg("-txindex", true) && !GetBoolArg("-addrindex", true))
+    if (nBlockTreeDBCache > (1 << 21) && !GetBoolArg("-txindex", true) && !GetBoolArg("-addrindex", DEFAULT_ADDRINDEX))
         nBlockTreeDBCache = (1 << 21); // block tree db cache shouldn't be larger than 2 MiB
     nTotalCache -= nBlockTreeDBCache;
     size_t nCoinDBCache = nTotalCache / 2; // use half of the remaining cache for coindb cache
@@ -1432,6 +1489,20 @@ bool AppInit2(boost::thread_group& threadGroup, CScheduler& scheduler, const std
                 if (fReindex)
                     pblocktree->WriteReindexing(true);
 
+                if (mapArgs.count("-loadtxoutset")) {
+                    if (pcoinsdbview->GetBestBlock() == 0) {
+                        boost::filesystem::path pathSnapshot = GetArg("-loadtxoutset", "");
+                        if (!pathSnapshot.is_complete())
+                            pathSnapshot = GetDataDir() / pathSnapshot;
+                        uiInterface.InitMessage(_("Loading UTXO snapshot..."));
+                        std::string strSnapshotError;
+                        if (!LoadTxOutSet(pathSnapshot, pcoinsdbview, uint256S(GetArg("-loadtxoutsethash", "0")), strSnapshotError))
+                            return InitError(strprintf(_("Error loading UTXO snapshot %s: %s. Remove the blocks, chainstate and zerocoin directories before trying again."), pathSnapshot.string(), strSnapshotError));
+                    } else {
+                        LogPrintf("Ignoring -loadtxoutset, the chainstate is not empty\n");
+                    }
+                }
+
                 // Helix: load previous sessions sporks if we have them.
                 uiInterface.InitMessage(_("Loading sporks..."));
                 LoadSporksFromDB();
@@ -1461,11 +1532,24 @@ bool AppInit2(boost::thread_group& threadGroup, CScheduler& scheduler, const std
                     break;
                 }
 
-                if (fAddrIndex != GetBoolArg("-addrindex", true)) {
+                if (fAddrIndex != GetBoolArg("-addrindex", DEFAULT_ADDRINDEX)) {
                     strLoadError = _("You need to rebuild the database using -reindex to change -addrindex");
                     break;
                 }
 
+                // Check for changed -prune state. What we are concerned about is a user who has pruned blocks
+                // in the past, but is now trying to run unpruned.
+                if (fHavePruned && !fPruneMode) {
+                    strLoadError = _("You need to rebuild the database using -reindex to go back to unpruned mode.  This will redownload the entire blockchain");
+                    break;
+                }
+
+                int nAddrIndexVersion = 0;
+                if (fAddrIndex && (!pblocktree->ReadInt("addrindexversion", nAddrIndexVersion) || nAddrIndexVersion != ADDRESS_INDEX_VERSION)) {
+                    strLoadError = _("You need to rebuild the database using -reindex to upgrade the address index");
+                    break;
+                }
+
                 if (GetBoolArg("-reindexzerocoin", false)) {
                     uiInterface.InitMessage(_("Reindexing zerocoin database..."));
                     if (!zerocoinDB->WipeCoins("spends") || !zerocoinDB->WipeCoins("mints")) {
@@ -1498,7 +1582,7 @@ bool AppInit2(boost::thread_group& threadGroup, CScheduler& scheduler, const std
                                                 continue;
 
                                             libzerocoin::CoinSpend spend = TxInToZerocoinSpend(in);
-                                            zerocoinDB->WriteCoinSpend(spend.getCoinSerialNumber(), txid);
+                                            zerocoinDB->WriteCoinSpend(spend.getCoinSerialNumber(), txid, pindex->nHeight, spend.getDenomination());
                                         }
                                     }
 
@@ -1511,7 +1595,7 @@ bool AppInit2(boost::thread_group& threadGroup, CScheduler& scheduler, const std
                                             CValidationState state;
                                             libzerocoin::PublicCoin coin(GetZerocoinParams(pindex->nHeight));
                                             TxOutToPublicCoin(out, coin, state);
-                                            zerocoinDB->WriteCoinMint(coin, txid);
+                                            zerocoinDB->WriteCoinMint(coin, txid, pindex->nHeight);
                                         }
                                     }
                                 }
@@ -1523,11 +1607,14 @@ bool AppInit2(boost::thread_group& threadGroup, CScheduler& scheduler, const std
 
                 // Recalculate money supply for blocks that are impacted by accounting issue after zerocoin activation
                 if (GetBoolArg("-reindexmoneysupply", false)) {
-                    if (chainActive.Height() > Params().Zerocoin_StartHeight()) {
-                        RecalculateZHLIXMinted();
-                        RecalculateZHLIXSpent();
+                    if (chainActive.Height() > Params().Zerocoin_StartHeight() && (!RecalculateZHLIXMinted() || !RecalculateZHLIXSpent())) {
+                        strLoadError = _("Unable to recalculate the zHLIX supply, blocks are missing");
+                        break;
+                    }
+                    if (chainActive.Height() >= 1 && !RecalculateHLIXSupply(1)) {
+                        strLoadError = _("Unable to recalculate the money supply, blocks are missing");
+                        break;
                     }
-                    RecalculateHLIXSupply(1);
                 }
 
                 // Force recalculation of accumulators.
@@ -1731,6 +1818,16 @@ bool AppInit2(boost::thread_group& threadGroup, CScheduler& scheduler, const std
                 pindexRescan = chainActive.Genesis();
         }
         if (chainActive.Tip() && chainActive.Tip() != pindexRescan) {
+            // We can't rescan beyond pruned blocks; this happens when an old
+            // wallet is loaded into a pruned node.
+            if (fPruneMode) {
+                CBlockIndex* block = chainActive.Tip();
+                while (block && block->pprev && (block->pprev->nStatus & BLOCK_HAVE_DATA) && block->pprev->nTx > 0 && pindexRescan != block)
+                    block = block->pprev;
+                if (pindexRescan != block)
+                    return InitError(_("Prune: last wallet synchronisation goes beyond pruned data. You need to -reindex (download the whole blockchain again in case of pruned node)"));
+            }
+
             uiInterface.InitMessage(_("Rescanning..."));
             LogPrintf("Rescanning last %i blocks (from block %i)...\n", chainActive.Height() - pindexRescan->nHeight, pindexRescan->nHeight);
             nStart = GetTimeMillis();
@@ -1794,6 +1891,17 @@ bool AppInit2(boost::thread_group& threadGroup, CScheduler& scheduler, const std
     // defined.
     nRelevantServices |= NODE_WITNESS;
 
+    // if pruning, unset the service bit and perform the initial blockstore prune
+    // after any wallet rescanning has taken place.
+    if (fPruneMode) {
+        LogPrintf("Unsetting NODE_NETWORK on prune mode\n");
+        nLocalServices &= ~NODE_NETWORK;
+        if (!fReindex) {
+            uiInterface.InitMessage(_("Pruning blockstore..."));
+            PruneAndFlush();
+        }
+    }
+
     // ********************************************************* Step 9: import blocks
 
     if (mapArgs.count("-blocknotify"))
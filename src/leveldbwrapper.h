@@ -49,6 +49,12 @@ public:
         batch.Put(slKey, slValue);
     }
 
+    //! Write a key and value that are already serialized
+    void WriteRaw(const leveldb::Slice& slKey, const leveldb::Slice& slValue)
+    {
+        batch.Put(slKey, slValue);
+    }
+
     template <typename K>
     void Erase(const K& key)
     {
@@ -168,6 +174,45 @@ public:
     {
         return pdb->NewIterator(iteroptions);
     }
+
+    //! Iterate over the database as it was when psnapshot was taken
+    leveldb::Iterator* NewIterator(const leveldb::Snapshot* psnapshot)
+    {
+        leveldb::ReadOptions options = iteroptions;
+        options.snapshot = psnapshot;
+        return pdb->NewIterator(options);
+    }
+
+    //! Consistent read-only view of the database; must be released with ReleaseSnapshot
+    const leveldb::Snapshot* GetSnapshot()
+    {
+        return pdb->GetSnapshot();
+    }
+
+    void ReleaseSnapshot(const leveldb::Snapshot* psnapshot)
+    {
+        pdb->ReleaseSnapshot(psnapshot);
+    }
+};
+
+/** Consistent read-only view of a database as of when it was created */
+class CLevelDBSnapshot
+{
+private:
+    CLevelDBWrapper& db;
+    const leveldb::Snapshot* psnapshot;
+
+    CLevelDBSnapshot(const CLevelDBSnapshot&);
+    void operator=(const CLevelDBSnapshot&);
+
+public:
+    CLevelDBSnapshot(CLevelDBWrapper& dbIn) : db(dbIn), psnapshot(dbIn.GetSnapshot()) {}
+    ~CLevelDBSnapshot() { db.ReleaseSnapshot(psnapshot); }
+
+    leveldb::Iterator* NewIterator() const
+    {
+        return db.NewIterator(psnapshot);
+    }
 };
 
 #endif // BITCOIN_LEVELDBWRAPPER_H
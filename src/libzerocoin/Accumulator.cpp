@@ -46,6 +46,41 @@ void Accumulator::increment(const CBigNum& bnValue) {
     this->value = this->value.pow_mod(bnValue, this->params->accumulatorModulus);
 }
 
+// Multiply v[nBegin, nEnd) as a balanced tree, so the operands of each
+// multiplication stay about the same size
+static CBigNum ProductTree(const std::vector<CBigNum>& v, size_t nBegin, size_t nEnd) {
+    if (nEnd - nBegin == 1)
+        return v[nBegin];
+    size_t nMid = nBegin + (nEnd - nBegin) / 2;
+    return ProductTree(v, nBegin, nMid) * ProductTree(v, nMid, nEnd);
+}
+
+void Accumulator::incrementBatch(const std::vector<CBigNum>& vValues) {
+    if (vValues.empty())
+        return;
+    // old accumulator^{e1}^{e2}...^{en} = old accumulator^{e1*e2*...*en} mod N
+    this->value = this->value.pow_mod(ProductTree(vValues, 0, vValues.size()), this->params->accumulatorModulus);
+}
+
+void Accumulator::accumulateBatch(const std::vector<PublicCoin>& vCoins) {
+    std::vector<CBigNum> vValues;
+    vValues.reserve(vCoins.size());
+    for (const PublicCoin& coin : vCoins) {
+        if (this->denomination != coin.getDenomination())
+            throw std::runtime_error("Wrong denomination for coin");
+        if (!coin.validate())
+            throw std::runtime_error("Coin is not valid");
+        vValues.push_back(coin.getValue());
+    }
+
+	// Make sure we're initialized
+	if(!(this->value)) {
+		throw std::runtime_error("Accumulator is not initialized");
+	}
+
+    incrementBatch(vValues);
+}
+
 void Accumulator::accumulate(const PublicCoin& coin) {
 	// Make sure we're initialized
 	if(!(this->value)) {
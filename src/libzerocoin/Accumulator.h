@@ -62,6 +62,18 @@ public:
 	void accumulate(const PublicCoin &coin);
     void increment(const CBigNum& bnValue);
 
+	/**
+	 * Accumulate several coins with a single modular exponentiation, by
+	 * raising the accumulator to the product of their values. The result
+	 * is the same as accumulating them one by one.
+	 *
+	 * @param vCoins	the PublicCoins to accumulate
+	 *
+	 * @throw		Zerocoin exception if any coin is not valid.
+	 **/
+	void accumulateBatch(const std::vector<PublicCoin>& vCoins);
+    void incrementBatch(const std::vector<CBigNum>& vValues);
+
 	CoinDenomination getDenomination() const;
 	/** Get the accumulator result
 	 *
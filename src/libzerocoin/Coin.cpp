@@ -15,10 +15,77 @@
 #include <iostream>
 #include "Coin.h"
 #include "Commitment.h"
+#include "ZerocoinDefines.h"
+#include "cuckoocache.h"
+#include "crypto/sha256.h"
 #include "pubkey.h"
+#include "random.h"
+
+#include <boost/thread/shared_mutex.hpp>
 
 namespace libzerocoin {
 
+namespace {
+
+/** Entries are nonced hashes, so their bytes can be used as the cuckoo hashes directly */
+class PublicCoinCacheHasher
+{
+public:
+    template <uint8_t hash_select>
+    uint32_t operator()(const uint256& key) const
+    {
+        static_assert(hash_select < 8, "PublicCoinCacheHasher only has 8 hashes available.");
+        uint32_t u;
+        std::memcpy(&u, key.begin() + 4 * hash_select, 4);
+        return u;
+    }
+};
+
+/** Public coins that are known to be valid for their parameters */
+class PublicCoinCache
+{
+private:
+    //! Entries are SHA256(nonce || params || coin value)
+    uint256 nonce;
+    CuckooCache::cache<uint256, PublicCoinCacheHasher> setValid;
+    boost::shared_mutex cs_pubcoincache;
+
+public:
+    PublicCoinCache()
+    {
+        GetRandBytes(nonce.begin(), 32);
+        setValid.setup_bytes(ZEROCOIN_PUBCOIN_CACHE_BYTES);
+    }
+
+    uint256 ComputeEntry(const ZerocoinParams* params, const CBigNum& value)
+    {
+        uint256 entry;
+        std::vector<unsigned char> vch = value.getvch();
+        CSHA256().Write(nonce.begin(), 32).Write((const unsigned char*)&params, sizeof(params)).Write(vch.data(), vch.size()).Finalize(entry.begin());
+        return entry;
+    }
+
+    bool Contains(const uint256& entry)
+    {
+        boost::shared_lock<boost::shared_mutex> lock(cs_pubcoincache);
+        return setValid.contains(entry, false);
+    }
+
+    void Insert(const uint256& entry)
+    {
+        boost::unique_lock<boost::shared_mutex> lock(cs_pubcoincache);
+        setValid.insert(entry);
+    }
+};
+
+PublicCoinCache& GetPublicCoinCache()
+{
+    static PublicCoinCache cache;
+    return cache;
+}
+
+}
+
 //PublicCoin class
 PublicCoin::PublicCoin(const ZerocoinParams* p):
 	params(p) {
@@ -58,14 +125,26 @@ bool PublicCoin::validate() const
         return false;
     }
 
+    PublicCoinCache& cache = GetPublicCoinCache();
+    if (cache.Contains(cache.ComputeEntry(params, value)))
+        return true;
+
     if (!value.isPrime(params->zkp_iterations)) {
         cout << "PublicCoin::validate value is not prime\n";
         return false;
     }
 
+    // Only coins that passed the primality test are recorded
+    cache.Insert(cache.ComputeEntry(params, value));
     return true;
 }
 
+bool PublicCoin::isValidated() const
+{
+    PublicCoinCache& cache = GetPublicCoinCache();
+    return cache.Contains(cache.ComputeEntry(params, value));
+}
+
 //PrivateCoin class
 PrivateCoin::PrivateCoin(const ZerocoinParams* p, const CoinDenomination denomination, bool fMintNew): params(p), publicCoin(p) {
 	// Verify that the parameters are valid
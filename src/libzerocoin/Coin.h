@@ -59,11 +59,15 @@ public:
         return ((this->value == rhs.value) && (this->params == rhs.params) && (this->denomination == rhs.denomination));
     }
     bool operator!=(const PublicCoin& rhs) const { return !(*this == rhs); }
-    /** Checks that coin is prime and in the appropriate range given the parameters
+    /** Checks that coin is prime and in the appropriate range given the parameters.
+     * Coins that passed before are recorded and not tested for primality again.
      * @return true if valid
      */
     bool validate() const;
 
+    /** Whether validate() has already passed for this coin and will skip the primality test */
+    bool isValidated() const;
+
     ADD_SERIALIZE_METHODS;
     template <typename Stream, typename Operation>
     inline void SerializationOp(Stream& s, Operation ser_action, int nType, int nVersion)
@@ -30,6 +30,8 @@
 #define ZEROCOIN_COMMITMENT_EQUALITY_PROOF  "COMMITMENT_EQUALITY_PROOF"
 #define ZEROCOIN_ACCUMULATOR_PROOF          "ACCUMULATOR_PROOF"
 #define ZEROCOIN_SERIALNUMBER_PROOF         "SERIALNUMBER_PROOF"
+// Memory used to remember public coins that passed validation in a connected block
+#define ZEROCOIN_PUBCOIN_CACHE_BYTES        (4 << 20)
 
 // Activate multithreaded mode for proof verification
 #define ZEROCOIN_THREADING 1
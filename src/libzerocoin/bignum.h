@@ -9,6 +9,7 @@
 
 #include <stdexcept>
 #include <vector>
+#include <boost/thread/tss.hpp>
 #include <openssl/bn.h>
 #include "serialize.h"
 #include "uint256.h"
@@ -22,30 +23,96 @@ public:
 };
 
 
-/** RAII encapsulated BN_CTX (OpenSSL bignum context) */
-class CAutoBN_CTX
+/** Number of moduli a thread keeps Montgomery contexts for */
+static const unsigned int BIGNUM_MONT_CACHE_SIZE = 8;
+
+/**
+ * OpenSSL contexts owned by one thread and reused by all CBigNum operations on
+ * that thread: a BN_CTX, whose temporaries OpenSSL keeps between calls, and
+ * the Montgomery contexts of the last few odd moduli used with pow_mod. These
+ * are the zerocoin group and accumulator moduli, so setting them up again for
+ * every exponentiation is avoided.
+ */
+class CBigNumThreadContext
 {
-protected:
+private:
     BN_CTX* pctx;
-    BN_CTX* operator=(BN_CTX* pnew) { return pctx = pnew; }
+    std::vector<std::pair<BIGNUM*, BN_MONT_CTX*> > vMont;
+
+    CBigNumThreadContext(const CBigNumThreadContext&);
+    CBigNumThreadContext& operator=(const CBigNumThreadContext&);
 
 public:
-    CAutoBN_CTX()
+    CBigNumThreadContext()
     {
         pctx = BN_CTX_new();
         if (pctx == NULL)
-            throw bignum_error("CAutoBN_CTX : BN_CTX_new() returned NULL");
+            throw bignum_error("CBigNumThreadContext : BN_CTX_new() returned NULL");
+    }
+
+    ~CBigNumThreadContext()
+    {
+        for (auto& mont : vMont) {
+            BN_clear_free(mont.first);
+            BN_MONT_CTX_free(mont.second);
+        }
+        BN_CTX_free(pctx);
+    }
+
+    static CBigNumThreadContext& Get()
+    {
+        // thread_specific_ptr deletes the contexts when the thread ends
+        static boost::thread_specific_ptr<CBigNumThreadContext> ptrContext;
+        if (!ptrContext.get())
+            ptrContext.reset(new CBigNumThreadContext());
+        return *ptrContext;
+    }
+
+    BN_CTX* GetBN_CTX() { return pctx; }
+
+    /** Montgomery context for modulus m, or NULL if m is not odd and greater than one */
+    BN_MONT_CTX* GetMontgomery(const BIGNUM* m)
+    {
+        if (!BN_is_odd(m) || BN_is_negative(m) || BN_is_one(m))
+            return NULL;
+
+        for (auto& mont : vMont) {
+            if (BN_cmp(mont.first, m) == 0)
+                return mont.second;
+        }
+
+        BIGNUM* bnModulus = BN_dup(m);
+        BN_MONT_CTX* pmont = BN_MONT_CTX_new();
+        if (bnModulus == NULL || pmont == NULL || !BN_MONT_CTX_set(pmont, m, pctx)) {
+            BN_clear_free(bnModulus);
+            BN_MONT_CTX_free(pmont);
+            throw bignum_error("CBigNumThreadContext::GetMontgomery : BN_MONT_CTX_set failed");
+        }
+
+        if (vMont.size() >= BIGNUM_MONT_CACHE_SIZE) {
+            BN_clear_free(vMont.front().first);
+            BN_MONT_CTX_free(vMont.front().second);
+            vMont.erase(vMont.begin());
+        }
+        vMont.push_back(std::make_pair(bnModulus, pmont));
+        return pmont;
     }
+};
+
+/** BN_CTX (OpenSSL bignum context) of the current thread */
+class CAutoBN_CTX
+{
+protected:
+    BN_CTX* pctx;
 
-    ~CAutoBN_CTX()
+public:
+    CAutoBN_CTX()
     {
-        if (pctx != NULL)
-            BN_CTX_free(pctx);
+        pctx = CBigNumThreadContext::Get().GetBN_CTX();
     }
 
     operator BN_CTX*() { return pctx; }
     BN_CTX& operator*() { return *pctx; }
-    BN_CTX** operator&() { return &pctx; }
     bool operator!() { return (pctx == NULL); }
 };
 
@@ -515,17 +582,20 @@ public:
      * @param m modulus
      */
     CBigNum pow_mod(const CBigNum& e, const CBigNum& m) const {
-        CAutoBN_CTX pctx;
+        CBigNumThreadContext& context = CBigNumThreadContext::Get();
+        BN_MONT_CTX* pmont = context.GetMontgomery(m.bn);
         CBigNum ret;
-        if( e < 0){
+        if (BN_is_negative(e.bn)) {
             // g^-x = (g^-1)^x
             CBigNum inv = this->inverse(m);
-            CBigNum posE = e * -1;
-            if (!BN_mod_exp(ret.bn, inv.bn, posE.bn, m.bn, pctx))
+            CBigNum posE = e;
+            BN_set_negative(posE.bn, 0);
+            if (!mod_exp(ret.bn, inv.bn, posE.bn, m.bn, context.GetBN_CTX(), pmont))
                 throw bignum_error("CBigNum::pow_mod: BN_mod_exp failed on negative exponent");
-        }else
-            if (!BN_mod_exp(ret.bn, bn, e.bn, m.bn, pctx))
+        } else {
+            if (!mod_exp(ret.bn, bn, e.bn, m.bn, context.GetBN_CTX(), pmont))
                 throw bignum_error("CBigNum::pow_mod : BN_mod_exp failed");
+        }
 
         return ret;
     }
@@ -589,6 +659,16 @@ public:
         return BN_is_one(bn);
     }
 
+private:
+    static int mod_exp(BIGNUM* r, const BIGNUM* a, const BIGNUM* p, const BIGNUM* m, BN_CTX* pctx, BN_MONT_CTX* pmont)
+    {
+        if (pmont == NULL)
+            return BN_mod_exp(r, a, p, m, pctx);
+        return BN_mod_exp_mont(r, a, p, m, pctx, pmont);
+    }
+
+public:
+
 
 
     bool operator!() const
@@ -645,11 +725,9 @@ public:
     {
         // Note: BN_rshift segfaults on 64-bit if 2^shift is greater than the number
         //   if built on ubuntu 9.04 or 9.10, probably depends on version of OpenSSL
-        CBigNum a = 1;
-        a <<= shift;
-        if (BN_cmp(a.bn, bn) > 0)
+        if (BN_is_negative(bn) || BN_num_bits(bn) <= (int)shift)
         {
-            bn = 0;
+            BN_zero(bn);
             return *this;
         }
 
@@ -678,10 +756,8 @@ public:
     CBigNum& operator--()
     {
         // prefix operator
-        CBigNum r;
-        if (!BN_sub(r.bn, bn, BN_value_one()))
+        if (!BN_sub(bn, bn, BN_value_one()))
             throw bignum_error("CBigNum::operator-- : BN_sub failed");
-        bn = r.bn;
         return *this;
     }
 
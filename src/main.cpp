@@ -48,8 +48,16 @@
 #include "wallet/wallet.h"
 #endif
 
+#include <atomic>
+#include <memory>
 #include <sstream>
 
+#ifndef WIN32
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
 #include <boost/algorithm/string/replace.hpp>
 #include <boost/filesystem.hpp>
 #include <boost/filesystem/fstream.hpp>
@@ -95,10 +103,14 @@ int nScriptCheckThreads = 0;
 bool fImporting = false;
 bool fReindex = false;
 bool fTxIndex = true;
-bool fAddrIndex = true;
+bool fAddrIndex = DEFAULT_ADDRINDEX;
 bool fIsBareMultisigStd = true;
 bool fCheckBlockIndex = false;
 bool fVerifyingBlocks = false;
+bool fPruneMode = false;
+bool fHavePruned = false;
+uint64_t nPruneTarget = 0;
+uint256 hashAssumeValid;
 unsigned int nCoinCacheSize = 5000;
 unsigned int nBytesPerSigOp = DEFAULT_BYTES_PER_SIGOP;
 bool fAlerts = DEFAULT_ALERTS;
@@ -127,6 +139,7 @@ map<uint256, int64_t> mapZerocoinspends; //txid, time received
 void EraseOrphansFor(NodeId peer);
 
 static void CheckBlockIndex();
+void static FindFilesToPrune(std::set<int>& setFilesToPrune);
 
 /** Constant stuff for coinbase transactions we create: */
 CScript COINBASE_FLAGS;
@@ -169,6 +182,11 @@ int nSyncStarted = 0;
 /** All pairs A->B, where A (or one if its ancestors) misses transactions, but B has transactions. */
 multimap<CBlockIndex*, CBlockIndex*> mapBlocksUnlinked;
 
+/** Block index entries by the file and offset their data is stored at, so
+ *  that readers of a single transaction can name its block without hashing
+ *  the header. Protected by cs_main. */
+map<pair<int, unsigned int>, CBlockIndex*> mapBlockIndexByPos;
+
 CCriticalSection cs_LastBlockFile;
 std::vector<CBlockFileInfo> vinfoBlockFile;
 int nLastBlockFile = 0;
@@ -208,6 +226,12 @@ set<CBlockIndex*> setDirtyBlockIndex;
 
 /** Dirty block file entries. */
 set<int> setDirtyFileInfo;
+
+/** Global flag to indicate we should check to see if there are
+ *  block/undo files that should be deleted.  Set on startup
+ *  or if we allocate more file space when we're in prune mode
+ */
+bool fCheckForPruning = false;
 } // anon namespace
 
 //////////////////////////////////////////////////////////////////////////////
@@ -524,6 +548,33 @@ void InitScriptExecutionCache() {
             (nElems*sizeof(uint256)) >>20, (nMaxCacheSize*2)>>20, nElems);
 }
 
+/**
+ * Zerocoin spends whose proof verified against a given accumulator, so a spend
+ * checked when it entered the mempool is not verified again when its block
+ * arrives. Entries are SHA256(nonce || spend hash || accumulator checksum ||
+ * accumulator value || params).
+ */
+static CuckooCache::cache<uint256, SignatureCacheHasher> zerocoinSpendCache;
+static uint256 zerocoinSpendCacheNonce(GetRandHash());
+static boost::shared_mutex cs_zerocoinSpendCache;
+
+void InitZerocoinSpendCache()
+{
+    size_t nElems = zerocoinSpendCache.setup_bytes((size_t)ZEROCOIN_SPEND_CACHE_SIZE << 20);
+    LogPrintf("Using %zu MiB for zerocoin spend cache, able to store %zu elements\n",
+            (nElems*sizeof(uint256)) >>20, nElems);
+}
+
+static uint256 GetZerocoinSpendCacheEntry(const CoinSpend& spend, const CBigNum& bnAccumulatorValue, const libzerocoin::ZerocoinParams* params)
+{
+    uint256 entry;
+    uint256 hashSpend = SerializeHash(spend);
+    uint32_t nChecksum = spend.getAccumulatorChecksum();
+    std::vector<unsigned char> vchAccumulator = bnAccumulatorValue.getvch();
+    CSHA256().Write(zerocoinSpendCacheNonce.begin(), 32).Write(hashSpend.begin(), 32).Write((const unsigned char*)&nChecksum, sizeof(nChecksum)).Write(vchAccumulator.data(), vchAccumulator.size()).Write((const unsigned char*)&params, sizeof(params)).Finalize(entry.begin());
+    return entry;
+}
+
 bool GetNodeStateStats(NodeId nodeid, CNodeStateStats& stats)
 {
     LOCK(cs_main);
@@ -928,38 +979,27 @@ bool GetCoinAge(const CTransaction& tx, const unsigned int nTxTime, uint64_t& nC
     uint256 bnCentSecond = 0; // coin age in the unit of cent-seconds
     nCoinAge = 0;
 
-    CBlockIndex* pindex = NULL;
+    LOCK(cs_main);
     for (const CTxIn& txin : tx.vin) {
-        // First try finding the previous transaction in database
-        CTransaction txPrev;
-        uint256 hashBlockPrev;
-        if (!GetTransaction(txin.prevout.hash, txPrev, hashBlockPrev, true)) {
+        // The coin database has the value and height of unspent outputs, so
+        // neither -txindex nor the block of the previous transaction is needed
+        const CCoins* coins = pcoinsTip->AccessCoins(txin.prevout.hash);
+        if (!coins || !coins->IsAvailable(txin.prevout.n) || coins->nHeight <= 0 || coins->nHeight > chainActive.Height()) {
             LogPrintf("GetCoinAge: failed to find vin transaction \n");
             continue; // previous transaction not in main chain
         }
+        const CBlockIndex* pindex = chainActive[coins->nHeight];
 
-        BlockMap::iterator it = mapBlockIndex.find(hashBlockPrev);
-        if (it != mapBlockIndex.end())
-            pindex = it->second;
-        else {
-            LogPrintf("GetCoinAge() failed to find block index \n");
-            continue;
-        }
-
-        // Read block header
-	if (fDebug) LogPrintf("GetCoinAge: do GetBlockHeader()\n");
-        CBlockHeader prevblock = pindex->GetBlockHeader();
-
-        if (prevblock.nTime + nStakeMinAge > nTxTime)
+        if (pindex->nTime + nStakeMinAge > nTxTime)
             continue; // only count coins meeting min age requirement
 
-        if (nTxTime < prevblock.nTime) {
+        if (nTxTime < pindex->nTime) {
             LogPrintf("GetCoinAge: Timestamp Violation: txtime less than txPrev.nTime");
             return false; // Transaction timestamp violation
         }
 
-        int64_t nValueIn = txPrev.vout[txin.prevout.n].nValue;
-        bnCentSecond += uint256(nValueIn) * (nTxTime - prevblock.nTime);
+        int64_t nValueIn = coins->vout[txin.prevout.n].nValue;
+        bnCentSecond += uint256(nValueIn) * (nTxTime - pindex->nTime);
     }
 
     uint256 bnCoinDay = bnCentSecond / COIN / (24 * 60 * 60);
@@ -993,6 +1033,30 @@ void FindMints(vector<CMintMeta> vMintsToFind, vector<CMintMeta>& vMintsToUpdate
             continue;
         }
 
+        // mints and spends recorded with their height and denomination need no transaction lookups
+        CZerocoinTxInfo infoMint, infoSpend;
+        uint256 txidIndexedSpend;
+        bool fIndexedSpent = zerocoinDB->ReadCoinSpend(meta.hashSerial, txidIndexedSpend);
+        if (zerocoinDB->ReadCoinMintInfo(meta.hashPubcoin, infoMint) && infoMint.nHeight <= chainActive.Height() &&
+            (!fIndexedSpent || (zerocoinDB->ReadCoinSpendInfo(meta.hashSerial, infoSpend) && infoSpend.nHeight <= chainActive.Height()))) {
+            if (meta.txid == infoMint.txid && meta.nHeight == infoMint.nHeight && meta.isUsed == fIndexedSpent && meta.denom == infoMint.denom)
+                continue;
+
+            meta.txid = infoMint.txid;
+            meta.nHeight = infoMint.nHeight;
+            meta.isUsed = fIndexedSpent;
+            meta.denom = infoMint.denom;
+            LogPrintf("%s: found updates for pubcoinhash = %s\n", __func__, meta.hashPubcoin.GetHex());
+            vMintsToUpdate.push_back(meta);
+            continue;
+        }
+
+        // mints recorded without their height can only be checked through -txindex
+        if (!fTxIndex) {
+            LogPrint("zero", "%s : cannot check mint %s without -txindex\n", __func__, meta.hashPubcoin.GetHex());
+            continue;
+        }
+
         // make sure the txhash and block height meta data are correct for this mint
         CTransaction tx;
         uint256 hashBlock;
@@ -1079,26 +1143,58 @@ bool IsSerialKnown(const CBigNum& bnSerial)
     return zerocoinDB->ReadCoinSpend(bnSerial, txHash);
 }
 
-bool IsSerialInBlockchain(const CBigNum& bnSerial, int& nHeightTx) {
-    uint256 txHash = 0;
+/**
+ * Look up the spend of a serial. Spends recorded with their height are resolved
+ * from zerocoinDB alone, so they are found without -txindex and after their
+ * block was pruned; the spending transaction is then only read if ptx is set,
+ * and left null if its block is gone. Spends recorded without a height need the
+ * transaction itself. If that can't be found because blocks were pruned, the
+ * serial counts as spent rather than letting it be spent again.
+ */
+static bool FindSerialSpend(const uint256& hashSerial, int& nHeightTx, uint256& txidSpend, CTransaction* ptx)
+{
+    txidSpend = 0;
     // if not in zerocoinDB then its not in the blockchain
-    if (!zerocoinDB->ReadCoinSpend(bnSerial, txHash))
+    if (!zerocoinDB->ReadCoinSpend(hashSerial, txidSpend))
         return false;
 
-    return IsTransactionInChain(txHash, nHeightTx);
+    CTransaction tx;
+    CZerocoinTxInfo info;
+    if (zerocoinDB->ReadCoinSpendInfo(hashSerial, info)) {
+        if (info.nHeight > chainActive.Height())
+            return false;
+        nHeightTx = info.nHeight;
+        if (ptx) {
+            uint256 hashBlock;
+            if (!GetTransactionAtHeight(txidSpend, nHeightTx, *ptx, hashBlock))
+                *ptx = CTransaction();
+        }
+        return true;
+    }
+
+    if (IsTransactionInChain(txidSpend, nHeightTx, ptx ? *ptx : tx))
+        return true;
+    if (fHavePruned) {
+        LogPrintf("%s : spend %s of serial %s is not available, treating the serial as spent\n", __func__, txidSpend.GetHex(), hashSerial.GetHex());
+        nHeightTx = 0;
+        if (ptx)
+            *ptx = CTransaction();
+        return true;
+    }
+    return false;
+}
+
+bool IsSerialInBlockchain(const CBigNum& bnSerial, int& nHeightTx) {
+    uint256 txidSpend;
+    return FindSerialSpend(GetSerialHash(bnSerial), nHeightTx, txidSpend, NULL);
 }
 
 bool IsSerialInBlockchain(const uint256& hashSerial, int& nHeightTx, uint256& txidSpend) {
-    CTransaction tx;
-    return IsSerialInBlockchain(hashSerial, nHeightTx, txidSpend, tx);
+    return FindSerialSpend(hashSerial, nHeightTx, txidSpend, NULL);
 }
 
 bool IsSerialInBlockchain(const uint256& hashSerial, int& nHeightTx, uint256& txidSpend, CTransaction& tx) {
-    txidSpend = 0;
-    // if not in zerocoinDB then its not in the blockchain
-    if (!zerocoinDB->ReadCoinSpend(hashSerial, txidSpend))
-        return false;
-    return IsTransactionInChain(txidSpend, nHeightTx, tx);
+    return FindSerialSpend(hashSerial, nHeightTx, txidSpend, &tx);
 }
 
 bool RemoveSerialFromDB(const CBigNum& bnSerial)
@@ -1277,10 +1373,25 @@ bool ContextualCheckZerocoinMint(const CTransaction& tx, const PublicCoin& coin,
     return true;
 }
 
-bool ContextualCheckZerocoinSpend(const CTransaction& tx, const CoinSpend& spend, CBlockIndex* pindex, const uint256& hashBlock) {
+bool IsAssumedValid(const CBlockIndex* pindex)
+{
+    AssertLockHeld(cs_main);
+    if (hashAssumeValid == 0 || pindexBestHeader == NULL)
+        return false;
+    BlockMap::const_iterator it = mapBlockIndex.find(hashAssumeValid);
+    if (it == mapBlockIndex.end())
+        return false;
+    // Only ancestors of both the assumed valid block and the best header, and
+    // only while the best header has at least as much work behind it
+    return it->second->GetAncestor(pindex->nHeight) == pindex &&
+           pindexBestHeader->GetAncestor(pindex->nHeight) == pindex &&
+           pindexBestHeader->nChainWork >= it->second->nChainWork;
+}
+
+bool ContextualCheckZerocoinSpend(const CTransaction& tx, const CoinSpend& spend, CBlockIndex* pindex, const uint256& hashBlock, bool fCheckSignature) {
     //Check to see if the zHLIX is properly signed
     if (pindex->nHeight > Params().Zerocoin_LastOldParams()) {
-        if (!spend.HasValidSignature())
+        if (fCheckSignature && !spend.HasValidSignature())
             return error("%s: V2 zHLIX spend does not have a valid signature", __func__);
 
         libzerocoin::SpendType expectedType = libzerocoin::SpendType::SPEND;
@@ -1362,11 +1473,21 @@ bool CheckZerocoinSpend(const CTransaction tx, bool fVerifySignature, CValidatio
                 return state.DoS(100, error("%s: Zerocoinspend could not find accumulator associated with checksum %s", __func__, HexStr(BEGIN(nChecksum), END(nChecksum))));
             }
 
-            Accumulator accumulator(GetZerocoinParams(nHeight), newSpend.getDenomination(), bnAccumulatorValue);
+            //Check that the coin has been accumulated, unless this proof already verified against the same accumulator
+            uint256 hashCacheEntry = GetZerocoinSpendCacheEntry(newSpend, bnAccumulatorValue, GetZerocoinParams(nHeight));
+            bool fCached;
+            {
+                boost::shared_lock<boost::shared_mutex> lock(cs_zerocoinSpendCache);
+                fCached = zerocoinSpendCache.contains(hashCacheEntry, false);
+            }
+            if (!fCached) {
+                Accumulator accumulator(GetZerocoinParams(nHeight), newSpend.getDenomination(), bnAccumulatorValue);
+                if(!newSpend.Verify(accumulator))
+                    return state.DoS(100, error("CheckZerocoinSpend(): zerocoin spend did not verify"));
 
-            //Check that the coin has been accumulated
-            if(!newSpend.Verify(accumulator))
-                return state.DoS(100, error("CheckZerocoinSpend(): zerocoin spend did not verify"));
+                boost::unique_lock<boost::shared_mutex> lock(cs_zerocoinSpendCache);
+                zerocoinSpendCache.insert(hashCacheEntry);
+            }
         }
 
         if (serials.count(newSpend.getCoinSerialNumber()))
@@ -1615,7 +1736,7 @@ bool AcceptToMemoryPool(CTxMemPool& pool, CValidationState& state, const CTransa
                 if (!txIn.scriptSig.IsZerocoinSpend())
                     continue;
                 CoinSpend spend = TxInToZerocoinSpend(txIn);
-                if (!ContextualCheckZerocoinSpend(tx, spend, chainActive.Tip(), 0))
+                if (!ContextualCheckZerocoinSpend(tx, spend, chainActive.Tip(), 0, true))
                     return state.Invalid(error("%s: ContextualCheckZerocoinSpend failed for tx %s", __func__,
                                                tx.GetHash().GetHex()), REJECT_INVALID, "bad-txns-invalid-zhlix");
             }
@@ -1791,8 +1912,262 @@ bool AcceptToMemoryPool(CTxMemPool& pool, CValidationState& state, const CTransa
     return true;
 }
 
+/**
+ * Read-only block file handles kept open between transaction reads. A handle
+ * is checked out for exclusive use and handed back afterwards; once more than
+ * MAX_BLOCKFILE_READ_HANDLES are idle the least recently used one is closed.
+ */
+class CBlockFileReadPool
+{
+private:
+    CCriticalSection cs;
+    //! Idle handles, most recently used first
+    std::list<std::pair<int, FILE*> > listIdle;
+
+public:
+    ~CBlockFileReadPool()
+    {
+        for (std::list<std::pair<int, FILE*> >::iterator it = listIdle.begin(); it != listIdle.end(); it++)
+            fclose(it->second);
+    }
+
+    /** Return a handle to the block file of pos, positioned at pos.nPos */
+    FILE* Acquire(const CDiskBlockPos& pos)
+    {
+        FILE* file = NULL;
+        {
+            LOCK(cs);
+            for (std::list<std::pair<int, FILE*> >::iterator it = listIdle.begin(); it != listIdle.end(); it++) {
+                if (it->first == pos.nFile) {
+                    file = it->second;
+                    listIdle.erase(it);
+                    break;
+                }
+            }
+        }
+        if (!file)
+            return OpenBlockFile(pos, true);
+        if (fseek(file, pos.nPos, SEEK_SET)) {
+            fclose(file);
+            return OpenBlockFile(pos, true);
+        }
+        return file;
+    }
+
+    void Release(int nFile, FILE* file)
+    {
+        if (!file)
+            return;
+        FILE* fileEvict = NULL;
+        {
+            LOCK(cs);
+            listIdle.push_front(std::make_pair(nFile, file));
+            if (listIdle.size() > MAX_BLOCKFILE_READ_HANDLES) {
+                fileEvict = listIdle.back().second;
+                listIdle.pop_back();
+            }
+        }
+        if (fileEvict)
+            fclose(fileEvict);
+    }
+
+    /** Close the idle handles of a block file that is about to be removed */
+    void Close(int nFile)
+    {
+        LOCK(cs);
+        for (std::list<std::pair<int, FILE*> >::iterator it = listIdle.begin(); it != listIdle.end();) {
+            if (it->first == nFile) {
+                fclose(it->second);
+                it = listIdle.erase(it);
+            } else {
+                it++;
+            }
+        }
+    }
+};
+
+static CBlockFileReadPool blockFileReadPool;
+
+/**
+ * A read-only mapping of a whole block file. Blocks are deserialized straight
+ * from the mapped pages, which saves the fopen/fread/copy round trip of stdio
+ * for every block. Readers that move forward through the file get the pages
+ * ahead of them prefetched with madvise.
+ *
+ * A read error on mapped pages raises SIGBUS instead of failing a call, and a
+ * file that shrinks under its mapping does the same. The file still being
+ * appended to (and truncated when it is finalized) is therefore never mapped
+ * by CBlockFileMapCache; it is read through stdio like on WIN32. Reindexing
+ * maps files whose blocks are only re-registered in place (fKnown), which
+ * does not truncate them.
+ */
+class CMappedBlockFile
+{
+private:
+    const char* pdata;
+    uint64_t nSize;
+    CCriticalSection cs;
+    //! End of the last read, and of the range already handed to the kernel for readahead
+    uint64_t nLastReadEnd;
+    uint64_t nAdvisedEnd;
+
+    CMappedBlockFile(const CMappedBlockFile&);
+    CMappedBlockFile& operator=(const CMappedBlockFile&);
+
+public:
+    const int nFile;
+
+    CMappedBlockFile(int nFileIn, const char* pdataIn, uint64_t nSizeIn) : pdata(pdataIn), nSize(nSizeIn), nLastReadEnd(0), nAdvisedEnd(0), nFile(nFileIn) {}
+
+    ~CMappedBlockFile()
+    {
+#ifndef WIN32
+        munmap((void*)pdata, nSize);
+#endif
+    }
+
+    /** Map the given file, or return NULL if it can't be mapped */
+    static CMappedBlockFile* Map(int nFile, FILE* file, bool fSequential)
+    {
+#ifndef WIN32
+        // Block files are up to 128 MiB each; don't spend a 32-bit address space on them
+        if (!file || sizeof(void*) < 8)
+            return NULL;
+        struct stat st;
+        if (fstat(fileno(file), &st) != 0 || st.st_size <= 0)
+            return NULL;
+        void* p = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fileno(file), 0);
+        if (p == MAP_FAILED)
+            return NULL;
+        if (fSequential)
+            madvise(p, st.st_size, MADV_SEQUENTIAL);
+        return new CMappedBlockFile(nFile, (const char*)p, st.st_size);
+#else
+        return NULL;
+#endif
+    }
+
+    const char* begin() const { return pdata; }
+    uint64_t size() const { return nSize; }
+
+    /** Whether the block stored at nPos lies entirely within the mapping */
+    bool Contains(unsigned int nPos) const
+    {
+        // Every block is preceded by the message start and its serialized size
+        if (nPos < 8 || nPos > nSize)
+            return false;
+        uint32_t nBlockSize = ReadLE32((const unsigned char*)pdata + nPos - 4);
+        return (uint64_t)nPos + nBlockSize <= nSize;
+    }
+
+    /** Note a read of [nPos, nEnd) and prefetch what follows if reads move forward */
+    void ReadAhead(uint64_t nPos, uint64_t nEnd)
+    {
+#ifndef WIN32
+        uint64_t nAdviseBegin, nAdviseEnd;
+        {
+            LOCK(cs);
+            bool fForward = nPos >= nLastReadEnd && nPos - nLastReadEnd <= BLOCKFILE_READAHEAD_SIZE;
+            nLastReadEnd = nEnd;
+            if (!fForward) {
+                nAdvisedEnd = nEnd;
+                return;
+            }
+            if (nEnd + BLOCKFILE_READAHEAD_SIZE / 2 <= nAdvisedEnd)
+                return;
+            nAdviseBegin = std::max(nEnd, nAdvisedEnd);
+            nAdviseEnd = std::min(nEnd + BLOCKFILE_READAHEAD_SIZE, nSize);
+            if (nAdviseBegin >= nAdviseEnd)
+                return;
+            nAdvisedEnd = nAdviseEnd;
+        }
+        static const uint64_t nPageSize = sysconf(_SC_PAGESIZE);
+        nAdviseBegin -= nAdviseBegin % nPageSize;
+        madvise((void*)(pdata + nAdviseBegin), nAdviseEnd - nAdviseBegin, MADV_WILLNEED);
+#endif
+    }
+};
+
+/**
+ * The most recently used block file mappings. Mappings are shared, so one
+ * that is evicted or closed stays valid until its last reader is done.
+ */
+class CBlockFileMapCache
+{
+private:
+    CCriticalSection cs;
+    //! Most recently used first
+    std::list<std::shared_ptr<CMappedBlockFile> > listMapped;
+
+public:
+    /** Return a mapping of the block file of pos that holds the whole block at pos */
+    std::shared_ptr<CMappedBlockFile> Get(const CDiskBlockPos& pos)
+    {
+        {
+            LOCK(cs);
+            for (std::list<std::shared_ptr<CMappedBlockFile> >::iterator it = listMapped.begin(); it != listMapped.end(); it++) {
+                if ((*it)->nFile == pos.nFile) {
+                    std::shared_ptr<CMappedBlockFile> mapped = *it;
+                    listMapped.erase(it);
+                    if (!mapped->Contains(pos.nPos))
+                        break; // the file grew since it was mapped
+                    listMapped.push_front(mapped);
+                    return mapped;
+                }
+            }
+        }
+
+        {
+            // Files are finalized before a later one becomes the last, so only
+            // the last one can still change size
+            LOCK(cs_LastBlockFile);
+            if (pos.nFile >= nLastBlockFile)
+                return std::shared_ptr<CMappedBlockFile>();
+        }
+
+        FILE* file = OpenBlockFile(CDiskBlockPos(pos.nFile, 0), true);
+        std::shared_ptr<CMappedBlockFile> mapped(CMappedBlockFile::Map(pos.nFile, file, false));
+        if (file)
+            fclose(file);
+        if (!mapped || !mapped->Contains(pos.nPos))
+            return std::shared_ptr<CMappedBlockFile>();
+
+        LOCK(cs);
+        listMapped.push_front(mapped);
+        if (listMapped.size() > MAX_BLOCKFILE_MAPPINGS)
+            listMapped.pop_back();
+        return mapped;
+    }
+
+    /** Drop the mapping of a block file that is about to be removed */
+    void Close(int nFile)
+    {
+        LOCK(cs);
+        for (std::list<std::shared_ptr<CMappedBlockFile> >::iterator it = listMapped.begin(); it != listMapped.end();) {
+            if ((*it)->nFile == nFile)
+                it = listMapped.erase(it);
+            else
+                it++;
+        }
+    }
+};
+
+static CBlockFileMapCache blockFileMapCache;
+
+bool LookupBlockHashByPos(const CDiskTxPos& pos, uint256& hashBlock)
+{
+    AssertLockHeld(cs_main);
+    map<pair<int, unsigned int>, CBlockIndex*>::const_iterator it = mapBlockIndexByPos.find(make_pair(pos.nFile, pos.nPos));
+    if (it == mapBlockIndexByPos.end())
+        return false;
+    hashBlock = it->second->GetBlockHash();
+    return true;
+}
+
 bool ReadTransaction(CTransaction& tx, const CDiskTxPos &pos, uint256 &hashBlock) {
-    CAutoFile file(OpenBlockFile(pos, true), SER_DISK, CLIENT_VERSION);
+    CAutoFile file(blockFileReadPool.Acquire(pos), SER_DISK, CLIENT_VERSION);
+    if (file.IsNull())
+        return error("%s() : OpenBlockFile failed", __PRETTY_FUNCTION__);
     CBlockHeader header;
     try {
         file >> header;
@@ -1801,32 +2176,26 @@ bool ReadTransaction(CTransaction& tx, const CDiskTxPos &pos, uint256 &hashBlock
     } catch (std::exception &e) {
         return error("%s() : deserialize or I/O error", __PRETTY_FUNCTION__);
     }
-    hashBlock = header.GetHash();
+    blockFileReadPool.Release(pos.nFile, file.release());
+
+    if (hashBlock.IsNull())
+        hashBlock = header.GetHash();
     return true;
 }
 
-bool FindTransactionsByDestination(const CTxDestination &dest, std::set<CExtDiskTxPos> &setpos) {
-    uint160 addrid;
-    const CKeyID *pkeyid = boost::get<CKeyID>(&dest);
+bool GetAddressIndexId(const CTxDestination& dest, uint160& addrid)
+{
+    const CKeyID* pkeyid = boost::get<CKeyID>(&dest);
     if (pkeyid) {
         addrid = static_cast<uint160>(*pkeyid);
-    } else {
-        const CScriptID *pscriptid = boost::get<CScriptID>(&dest);
-        if (pscriptid) {
-            addrid = static_cast<uint160>(*pscriptid);
-        } else {
-            return false;
-        }
+        return true;
     }
-
-    LOCK(cs_main);
-    if (!fAddrIndex)
-        return false;
-    std::vector<CExtDiskTxPos> vPos;
-    if (!pblocktree->ReadAddrIndex(addrid, vPos))
-        return false;
-    setpos.insert(vPos.begin(), vPos.end());
-    return true;
+    const CScriptID* pscriptid = boost::get<CScriptID>(&dest);
+    if (pscriptid) {
+        addrid = static_cast<uint160>(*pscriptid);
+        return true;
+    }
+    return false;
 }
 
 bool AcceptableInputs(CTxMemPool& pool, CValidationState& state, const CTransaction& tx, bool fLimitFree, bool* pfMissingInputs, bool fRejectInsaneFee, bool isDSTX)
@@ -2039,6 +2408,8 @@ bool AcceptableInputs(CTxMemPool& pool, CValidationState& state, const CTransact
 bool GetTransaction(const uint256& hash, CTransaction& txOut, uint256& hashBlock, bool fAllowSlow)
 {
     CBlockIndex* pindexSlow = NULL;
+    CDiskTxPos postx;
+    bool fHavePos = false;
     {
         LOCK(cs_main);
         {
@@ -2048,30 +2419,13 @@ bool GetTransaction(const uint256& hash, CTransaction& txOut, uint256& hashBlock
         }
 
         if (fTxIndex) {
-            CDiskTxPos postx;
-            if (pblocktree->ReadTxIndex(hash, postx)) {
-                CAutoFile file(OpenBlockFile(postx, true), SER_DISK, CLIENT_VERSION);
-                if (file.IsNull())
-                    return error("%s: OpenBlockFile failed", __func__);
-                CBlockHeader header;
-                try {
-                    file >> header;
-                    fseek(file.Get(), postx.nTxOffset, SEEK_CUR);
-                    file >> txOut;
-                } catch (std::exception& e) {
-                    return error("%s : Deserialize or I/O error - %s", __func__, e.what());
-                }
-                hashBlock = header.GetHash();
-                if (txOut.GetHash() != hash)
-                    return error("%s : txid mismatch", __func__);
-                return true;
-            }
-
             // transaction not found in the index, nothing more can be done
-            return false;
-        }
-
-        if (fAllowSlow) { // use coin database to locate block that contains transaction, and scan it
+            if (!pblocktree->ReadTxIndex(hash, postx))
+                return false;
+            hashBlock.SetNull();
+            LookupBlockHashByPos(postx, hashBlock);
+            fHavePos = true;
+        } else if (fAllowSlow) { // use coin database to locate block that contains transaction, and scan it
             int nHeight = -1;
             {
                 CCoinsViewCache& view = *pcoinsTip;
@@ -2084,6 +2438,15 @@ bool GetTransaction(const uint256& hash, CTransaction& txOut, uint256& hashBlock
         }
     }
 
+    // The transaction is read without cs_main
+    if (fHavePos) {
+        if (!ReadTransaction(txOut, postx, hashBlock))
+            return false;
+        if (txOut.GetHash() != hash)
+            return error("%s : txid mismatch", __func__);
+        return true;
+    }
+
     if (pindexSlow) {
         CBlock block;
         if (ReadBlockFromDisk(block, pindexSlow)) {
@@ -2100,6 +2463,34 @@ bool GetTransaction(const uint256& hash, CTransaction& txOut, uint256& hashBlock
     return false;
 }
 
+bool GetTransactionAtHeight(const uint256& hash, int nHeight, CTransaction& txOut, uint256& hashBlock)
+{
+    if (fTxIndex && GetTransaction(hash, txOut, hashBlock, false))
+        return true;
+
+    CBlockIndex* pindex = NULL;
+    {
+        LOCK(cs_main);
+        if (nHeight < 0 || nHeight > chainActive.Height())
+            return false;
+        pindex = chainActive[nHeight];
+        if (!(pindex->nStatus & BLOCK_HAVE_DATA))
+            return false;
+    }
+
+    CBlock block;
+    if (!ReadTrustedBlockFromDisk(block, pindex))
+        return false;
+    for (const CTransaction& tx : block.vtx) {
+        if (tx.GetHash() == hash) {
+            txOut = tx;
+            hashBlock = pindex->GetBlockHash();
+            return true;
+        }
+    }
+    return false;
+}
+
 
 //////////////////////////////////////////////////////////////////////////////
 //
@@ -2127,24 +2518,37 @@ bool WriteBlockToDisk(CBlock& block, CDiskBlockPos& pos)
     return true;
 }
 
-bool ReadBlockFromDisk(CBlock& block, const CDiskBlockPos& pos)
+bool ReadBlockFromDisk(CBlock& block, const CDiskBlockPos& pos, bool fCheckPoW)
 {
     block.SetNull();
 
-    // Open history file to read
-    CAutoFile filein(OpenBlockFile(pos, true), SER_DISK, CLIENT_VERSION);
-    if (filein.IsNull())
-        return error("ReadBlockFromDisk : OpenBlockFile failed");
+    std::shared_ptr<CMappedBlockFile> mapped = blockFileMapCache.Get(pos);
+    if (mapped) {
+        // Read block from the mapped file
+        try {
+            CMemoryReader reader(mapped->begin(), mapped->size(), SER_DISK, CLIENT_VERSION);
+            reader.SetPos(pos.nPos);
+            reader >> block;
+            mapped->ReadAhead(pos.nPos, reader.GetPos());
+        } catch (std::exception& e) {
+            return error("%s : Deserialize or I/O error - %s", __func__, e.what());
+        }
+    } else {
+        // Open history file to read
+        CAutoFile filein(OpenBlockFile(pos, true), SER_DISK, CLIENT_VERSION);
+        if (filein.IsNull())
+            return error("ReadBlockFromDisk : OpenBlockFile failed");
 
-    // Read block
-    try {
-        filein >> block;
-    } catch (std::exception& e) {
-        return error("%s : Deserialize or I/O error - %s", __func__, e.what());
+        // Read block
+        try {
+            filein >> block;
+        } catch (std::exception& e) {
+            return error("%s : Deserialize or I/O error - %s", __func__, e.what());
+        }
     }
 
     // Check the header
-    if (block.IsProofOfWork() && block.nVersion > 3) {
+    if (fCheckPoW && block.IsProofOfWork() && block.nVersion > 3) {
       if (!CheckAuxPowProofOfWork(block,Params().GetAuxpowChainId()))
             return error("ReadBlockFromDisk : Errors in block header");
     }
@@ -2163,6 +2567,30 @@ bool ReadBlockFromDisk(CBlock& block, const CBlockIndex* pindex)
     return true;
 }
 
+bool ReadTrustedBlockFromDisk(CBlock& block, const CBlockIndex* pindex)
+{
+    if (!pindex->IsValid(BLOCK_VALID_TRANSACTIONS))
+        return ReadBlockFromDisk(block, pindex);
+
+    if (!ReadBlockFromDisk(block, pindex->GetBlockPos(), false))
+        return false;
+
+    // The transaction hashes were computed while deserializing, so checking
+    // them against the merkle root only costs the inner tree hashes.
+    const uint256 hashPrev = pindex->pprev ? pindex->pprev->GetBlockHash() : uint256(0);
+    if (block.nVersion != pindex->nVersion ||
+        block.hashPrevBlock != hashPrev ||
+        block.hashMerkleRoot != pindex->hashMerkleRoot ||
+        block.nTime != pindex->nTime ||
+        block.nBits != pindex->nBits ||
+        block.nNonce != pindex->nNonce ||
+        block.nAccumulatorCheckpoint != pindex->nAccumulatorCheckpoint)
+        return error("%s : header doesn't match index %s", __func__, pindex->GetBlockHash().ToString());
+    if (BlockMerkleRoot(block) != block.hashMerkleRoot)
+        return error("%s : transactions don't match merkle root of %s", __func__, pindex->GetBlockHash().ToString());
+    return true;
+}
+
 
 double ConvertBitsToDouble(unsigned int nBits)
 {
@@ -2646,6 +3074,36 @@ bool CheckInputs(const CTransaction& tx, CValidationState& state, const CCoinsVi
     return true;
 }
 
+// Index either: a) every data push >=8 bytes,  b) if no such pushes, the entire script
+void GetAddrIndexIds(const CScript& script, std::vector<uint160>& vIds)
+{
+    // Empty coinstake markers, zerocoin mints and data carriers pay no address
+    if (script.empty() || script.IsZerocoinMint() || script.IsUnspendable())
+        return;
+
+    CScript::const_iterator pc = script.begin();
+    CScript::const_iterator pend = script.end();
+    std::vector<unsigned char> data;
+    opcodetype opcode;
+    bool fHaveData = false;
+    while (pc < pend) {
+        script.GetOp(pc, opcode, data);
+        if (0 <= opcode && opcode <= OP_PUSHDATA4 && data.size() >= 8) { // data element
+            uint160 addrid;
+            if (data.size() <= 20) {
+                memcpy(&addrid, &data[0], data.size());
+            } else {
+                addrid = Hash160(data);
+            }
+            if (std::find(vIds.begin(), vIds.end(), addrid) == vIds.end())
+                vIds.push_back(addrid);
+            fHaveData = true;
+        }
+    }
+    if (!fHaveData)
+        vIds.push_back(Hash160(script));
+}
+
 bool DisconnectBlock(CBlock& block, CValidationState& state, CBlockIndex* pindex, CCoinsViewCache& view, bool* pfClean)
 {
     if (pindex->GetBlockHash() != view.GetBestBlock())
@@ -2667,6 +3125,11 @@ bool DisconnectBlock(CBlock& block, CValidationState& state, CBlockIndex* pindex
     if (blockUndo.vtxundo.size() + 1 != block.vtx.size())
         return error("DisconnectBlock() : block and undo data inconsistent");
 
+    bool fUpdateAddrIndex = fAddrIndex && !fVerifyingBlocks;
+    std::vector<std::pair<CAddressIndexKey, CAddressIndexValue> > vAddrDeltas;
+    std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > vAddrUnspent;
+    std::vector<uint160> vIds;
+
     // undo transactions in reverse order
     for (int i = block.vtx.size() - 1; i >= 0; i--) {
         const CTransaction& tx = block.vtx[i];
@@ -2727,6 +3190,18 @@ bool DisconnectBlock(CBlock& block, CValidationState& state, CBlockIndex* pindex
             outs->Clear();
         }
 
+        if (fUpdateAddrIndex) {
+            for (unsigned int k = 0; k < tx.vout.size(); k++) {
+                const CTxOut& out = tx.vout[k];
+                vIds.clear();
+                GetAddrIndexIds(out.scriptPubKey, vIds);
+                for (const uint160& addrid : vIds) {
+                    vAddrDeltas.push_back(std::make_pair(CAddressIndexKey(addrid, pindex->nHeight, i, hash, false, k), CAddressIndexValue(out.nValue, CDiskTxPos())));
+                    vAddrUnspent.push_back(std::make_pair(CAddressUnspentKey(addrid, hash, k), CAddressUnspentValue()));
+                }
+            }
+        }
+
         // restore inputs
         if (!tx.IsCoinBase() && !tx.IsZerocoinSpend()) { // not coinbases or zerocoinspend because they dont have traditional inputs
             const CTxUndo& txundo = blockUndo.vtxundo[i - 1];
@@ -2754,16 +3229,30 @@ bool DisconnectBlock(CBlock& block, CValidationState& state, CBlockIndex* pindex
                     coins->vout.resize(out.n + 1);
                 coins->vout[out.n] = undo.txout;
 
+                if (fUpdateAddrIndex) {
+                    vIds.clear();
+                    GetAddrIndexIds(undo.txout.scriptPubKey, vIds);
+                    for (const uint160& addrid : vIds) {
+                        vAddrDeltas.push_back(std::make_pair(CAddressIndexKey(addrid, pindex->nHeight, i, hash, true, j), CAddressIndexValue(-undo.txout.nValue, CDiskTxPos())));
+                        vAddrUnspent.push_back(std::make_pair(CAddressUnspentKey(addrid, out.hash, out.n), CAddressUnspentValue(undo.txout.nValue, undo.txout.scriptPubKey, coins->nHeight)));
+                    }
+                }
+
                 // erase the spent input
                 mapStakeSpent.erase(out);
             }
         }
     }
 
+    if (fUpdateAddrIndex && !pblocktree->UpdateAddrIndex(vAddrDeltas, vAddrUnspent, false))
+        return error("DisconnectBlock() : failed to erase address index");
+
     // move best block pointer to prevout block
     view.SetBestBlock(pindex->pprev->GetBlockHash());
 
     if (!fVerifyingBlocks) {
+        EraseAccumulatorCheckpoint(pindex->GetBlockHash());
+
         //if block is an accumulator checkpoint block, remove checkpoint and checksums from db
         uint256 nCheckpoint = pindex->nAccumulatorCheckpoint;
         if(nCheckpoint != pindex->pprev->nAccumulatorCheckpoint) {
@@ -2830,45 +3319,133 @@ void ThreadScriptCheck()
     scriptcheckqueue.Thread();
 }
 
-void RecalculateZHLIXMinted()
+//! max. number of threads looking up block supply changes for the supply recalculation
+static const int MAX_SUPPLY_THREADS = 8;
+//! number of blocks a supply thread claims at a time
+static const int SUPPLY_CHUNK_SIZE = 1000;
+
+/**
+ * Supply change of a block. Blocks connected before the records were kept have
+ * it computed from the block and its undo data, and it is recorded then, so
+ * every block is read at most once.
+ */
+static bool GetBlockSupply(const CBlockIndex* pindex, CBlockSupply& supply)
 {
-    CBlockIndex *pindex = chainActive[Params().Zerocoin_StartHeight()];
-    int nHeightEnd = chainActive.Height();
-    while (true) {
-        if (pindex->nHeight % 1000 == 0)
-            LogPrintf("%s : block %d...\n", __func__, pindex->nHeight);
+    if (pblocktree->ReadBlockSupply(pindex->GetBlockHash(), supply))
+        return true;
 
-        //overwrite possibly wrong vMintsInBlock data
-        CBlock block;
-        assert(ReadBlockFromDisk(block, pindex));
+    CBlock block;
+    if (!(pindex->nStatus & BLOCK_HAVE_DATA) || !ReadTrustedBlockFromDisk(block, pindex))
+        return error("%s : block %d is not available and has no supply record", __func__, pindex->nHeight);
 
-        std::list<CZerocoinMint> listMints;
-        BlockToZerocoinMintList(block, listMints);
+    // The values of the spent outputs are in the undo data
+    CBlockUndo blockUndo;
+    bool fHaveUndo = !pindex->GetUndoPos().IsNull() && pindex->pprev && blockUndo.ReadFromDisk(pindex->GetUndoPos(), pindex->pprev->GetBlockHash());
 
-        vector<libzerocoin::CoinDenomination> vDenomsBefore = pindex->vMintDenominationsInBlock;
-        pindex->vMintDenominationsInBlock.clear();
-        for (auto mint : listMints)
-            pindex->vMintDenominationsInBlock.emplace_back(mint.GetDenomination());
+    CAmount nValueIn = 0;
+    CAmount nValueOut = 0;
+    for (unsigned int i = 0; i < block.vtx.size(); i++) {
+        const CTransaction& tx = block.vtx[i];
+        for (unsigned int j = 0; j < tx.vin.size(); j++) {
+            if (tx.IsCoinBase())
+                break;
 
-        if (pindex->nHeight < nHeightEnd)
-            pindex = chainActive.Next(pindex);
-        else
-            break;
+            if (tx.vin[j].scriptSig.IsZerocoinSpend()) {
+                nValueIn += tx.vin[j].nSequence * COIN;
+                continue;
+            }
+
+            if (!fHaveUndo || i > blockUndo.vtxundo.size() || j >= blockUndo.vtxundo[i - 1].vprevout.size())
+                return error("%s : inputs of block %d are not available", __func__, pindex->nHeight);
+            nValueIn += blockUndo.vtxundo[i - 1].vprevout[j].txout.nValue;
+        }
+
+        for (unsigned int j = 0; j < tx.vout.size(); j++) {
+            if (j == 0 && tx.IsCoinStake())
+                continue;
+
+            nValueOut += tx.vout[j].nValue;
+        }
     }
+
+    std::list<CZerocoinMint> listMints;
+    BlockToZerocoinMintList(block, listMints);
+    std::list<libzerocoin::CoinDenomination> listSpends = ZerocoinSpendListFromBlock(block);
+
+    supply.nMoneySupplyDelta = nValueOut - nValueIn;
+    supply.vMintDenominations.clear();
+    for (const CZerocoinMint& mint : listMints)
+        supply.vMintDenominations.emplace_back(mint.GetDenomination());
+    supply.vSpendDenominations.assign(listSpends.begin(), listSpends.end());
+
+    if (!pblocktree->WriteBlockSupply(pindex->GetBlockHash(), supply))
+        return error("%s : failed to record the supply of block %d", __func__, pindex->nHeight);
+    return true;
 }
 
-void RecalculateZHLIXSpent()
+/** Supply changes of the active chain from nHeightStart to the tip, looked up in parallel chunks of heights */
+static bool GetBlockSupplies(int nHeightStart, std::vector<CBlockSupply>& vSupply)
 {
-    CBlockIndex* pindex = chainActive[Params().Zerocoin_StartHeight()];
-    while (true) {
+    std::vector<CBlockIndex*> vIndex;
+    for (CBlockIndex* pindex = chainActive[nHeightStart]; pindex; pindex = chainActive.Next(pindex))
+        vIndex.push_back(pindex);
+
+    // Blocks are independent of each other here, only the running totals are left to the callers
+    vSupply.assign(vIndex.size(), CBlockSupply());
+    std::atomic<size_t> nNext(0);
+    std::atomic<bool> fFailed(false);
+    auto GetChunks = [&]() {
+        while (!fFailed) {
+            size_t nBegin = nNext.fetch_add(SUPPLY_CHUNK_SIZE);
+            if (nBegin >= vIndex.size())
+                return;
+            size_t nEnd = std::min(nBegin + SUPPLY_CHUNK_SIZE, vIndex.size());
+            for (size_t i = nBegin; i < nEnd; i++) {
+                if (!GetBlockSupply(vIndex[i], vSupply[i])) {
+                    fFailed = true;
+                    return;
+                }
+            }
+        }
+    };
+
+    int nThreads = std::max(1, std::min((int)boost::thread::hardware_concurrency(), MAX_SUPPLY_THREADS));
+    boost::thread_group threadGroup;
+    for (int i = 1; i < nThreads; i++)
+        threadGroup.create_thread(GetChunks);
+    GetChunks();
+    threadGroup.join_all();
+    return !fFailed;
+}
+
+bool RecalculateZHLIXMinted()
+{
+    std::vector<CBlockSupply> vSupply;
+    if (!GetBlockSupplies(Params().Zerocoin_StartHeight(), vSupply))
+        return false;
+
+    CBlockIndex *pindex = chainActive[Params().Zerocoin_StartHeight()];
+    for (const CBlockSupply& supply : vSupply) {
         if (pindex->nHeight % 1000 == 0)
             LogPrintf("%s : block %d...\n", __func__, pindex->nHeight);
 
-        //Rewrite zHLIX supply
-        CBlock block;
-        assert(ReadBlockFromDisk(block, pindex));
+        //overwrite possibly wrong vMintsInBlock data
+        pindex->vMintDenominationsInBlock = supply.vMintDenominations;
+        pindex = chainActive.Next(pindex);
+    }
+    return true;
+}
 
-        list<libzerocoin::CoinDenomination> listDenomsSpent = ZerocoinSpendListFromBlock(block);
+bool RecalculateZHLIXSpent()
+{
+    std::vector<CBlockSupply> vSupply;
+    if (!GetBlockSupplies(Params().Zerocoin_StartHeight(), vSupply))
+        return false;
+
+    CBlockIndex* pindex = chainActive[Params().Zerocoin_StartHeight()];
+    for (const CBlockSupply& supply : vSupply) {
+        if (pindex->nHeight % 1000 == 0)
+            LogPrintf("%s : block %d...\n", __func__, pindex->nHeight);
 
         //Reset the supply to previous block
         pindex->mapZerocoinSupply = pindex->pprev->mapZerocoinSupply;
@@ -2880,17 +3457,15 @@ void RecalculateZHLIXSpent()
         }
 
         //Remove spends from zHLIX supply
-        for (auto denom : listDenomsSpent)
+        for (auto denom : supply.vSpendDenominations)
             pindex->mapZerocoinSupply.at(denom)--;
 
         //Rewrite money supply
         assert(pblocktree->WriteBlockIndex(CDiskBlockIndex(pindex)));
 
-        if (pindex->nHeight < chainActive.Height())
-            pindex = chainActive.Next(pindex);
-        else
-            break;
+        pindex = chainActive.Next(pindex);
     }
+    return true;
 }
 
 bool RecalculateHLIXSupply(int nHeightStart)
@@ -2898,55 +3473,26 @@ bool RecalculateHLIXSupply(int nHeightStart)
     if (nHeightStart > chainActive.Height())
         return false;
 
+    std::vector<CBlockSupply> vSupply;
+    if (!GetBlockSupplies(nHeightStart, vSupply))
+        return false;
+
     CBlockIndex* pindex = chainActive[nHeightStart];
     CAmount nSupplyPrev = pindex->pprev->nMoneySupply;
     if (nHeightStart == Params().Zerocoin_StartHeight())
         nSupplyPrev = CAmount(1880313101204990);
 
-    while (true) {
+    for (const CBlockSupply& supply : vSupply) {
         if (pindex->nHeight % 1000 == 0)
             LogPrintf("%s : block %d...\n", __func__, pindex->nHeight);
 
-        CBlock block;
-        assert(ReadBlockFromDisk(block, pindex));
-
-        CAmount nValueIn = 0;
-        CAmount nValueOut = 0;
-        for (const CTransaction& tx : block.vtx) {
-            for (unsigned int i = 0; i < tx.vin.size(); i++) {
-                if (tx.IsCoinBase())
-                    break;
-
-                if (tx.vin[i].scriptSig.IsZerocoinSpend()) {
-                    nValueIn += tx.vin[i].nSequence * COIN;
-                    continue;
-                }
-
-                COutPoint prevout = tx.vin[i].prevout;
-                CTransaction txPrev;
-                uint256 hashBlock;
-                assert(GetTransaction(prevout.hash, txPrev, hashBlock, true));
-                nValueIn += txPrev.vout[prevout.n].nValue;
-            }
-
-            for (unsigned int i = 0; i < tx.vout.size(); i++) {
-                if (i == 0 && tx.IsCoinStake())
-                    continue;
-
-                nValueOut += tx.vout[i].nValue;
-            }
-        }
-
         // Rewrite money supply
-        pindex->nMoneySupply = nSupplyPrev + nValueOut - nValueIn;
+        pindex->nMoneySupply = nSupplyPrev + supply.nMoneySupplyDelta;
         nSupplyPrev = pindex->nMoneySupply;
 
         assert(pblocktree->WriteBlockIndex(CDiskBlockIndex(pindex)));
 
-        if (pindex->nHeight < chainActive.Height())
-            pindex = chainActive.Next(pindex);
-        else
-            break;
+        pindex = chainActive.Next(pindex);
     }
     return true;
 }
@@ -3068,30 +3614,38 @@ static int64_t nTimeIndex = 0;
 static int64_t nTimeCallbacks = 0;
 static int64_t nTimeTotal = 0;
 
-// Index either: a) every data push >=8 bytes,  b) if no such pushes, the entire script
-void static BuildAddrIndex(const CScript &script, const CExtDiskTxPos &pos, std::vector<std::pair<uint160, CExtDiskTxPos> > &out)
-{
-    CScript::const_iterator pc = script.begin();
-    CScript::const_iterator pend = script.end();
-    std::vector<unsigned char> data;
-    opcodetype opcode;
-    bool fHaveData = false;
-    while (pc < pend) {
-        script.GetOp(pc, opcode, data);
-        if (0 <= opcode && opcode <= OP_PUSHDATA4 && data.size() >= 8) { // data element
-            uint160 addrid;
-            if (data.size() <= 20) {
-                memcpy(&addrid, &data[0], data.size());
-            } else {
-                addrid = Hash160(data);
+/** Collect the address index entries of one transaction: a negative delta
+ *  for every spent output (with the unspent entry removed) and a positive
+ *  delta for every created output (with an unspent entry added). */
+void static BuildAddrIndex(const CTransaction& tx, unsigned int nTxIndex, const CDiskTxPos& pos, int nHeight, const CCoinsViewCache& view,
+                           std::vector<std::pair<CAddressIndexKey, CAddressIndexValue> >& vDeltas,
+                           std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> >& vUnspent)
+{
+    const uint256 txhash = tx.GetHash();
+    std::vector<uint160> vIds;
+    if (!tx.IsCoinBase()) {
+        for (unsigned int j = 0; j < tx.vin.size(); j++) {
+            const COutPoint& prevout = tx.vin[j].prevout;
+            const CCoins* coins = view.AccessCoins(prevout.hash);
+            if (!coins || !coins->IsAvailable(prevout.n))
+                continue;
+            const CTxOut& prev = coins->vout[prevout.n];
+            vIds.clear();
+            GetAddrIndexIds(prev.scriptPubKey, vIds);
+            for (const uint160& addrid : vIds) {
+                vDeltas.push_back(std::make_pair(CAddressIndexKey(addrid, nHeight, nTxIndex, txhash, true, j), CAddressIndexValue(-prev.nValue, pos)));
+                vUnspent.push_back(std::make_pair(CAddressUnspentKey(addrid, prevout.hash, prevout.n), CAddressUnspentValue()));
             }
-            out.push_back(std::make_pair(addrid, pos));
-            fHaveData = true;
         }
     }
-    if (!fHaveData) {
-        uint160 addrid = Hash160(script);
-        out.push_back(std::make_pair(addrid, pos));
+    for (unsigned int k = 0; k < tx.vout.size(); k++) {
+        const CTxOut& out = tx.vout[k];
+        vIds.clear();
+        GetAddrIndexIds(out.scriptPubKey, vIds);
+        for (const uint160& addrid : vIds) {
+            vDeltas.push_back(std::make_pair(CAddressIndexKey(addrid, nHeight, nTxIndex, txhash, false, k), CAddressIndexValue(out.nValue, pos)));
+            vUnspent.push_back(std::make_pair(CAddressUnspentKey(addrid, txhash, k), CAddressUnspentValue(out.nValue, out.scriptPubKey, nHeight)));
+        }
     }
 }
 
@@ -3176,7 +3730,8 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
       }
     }
 
-    bool fScriptChecks = pindex->nHeight >= Checkpoints::GetTotalBlocksEstimate();
+    bool fAssumeValid = IsAssumedValid(pindex);
+    bool fScriptChecks = pindex->nHeight >= Checkpoints::GetTotalBlocksEstimate() && !fAssumeValid;
 
     // Do not allow blocks that contain transactions which 'overwrite' older transactions,
     // unless those are already completely spent.
@@ -3210,13 +3765,14 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
     int64_t nSigOpsCost = 0;
     CExtDiskTxPos pos(CDiskTxPos(pindex->GetBlockPos(), GetSizeOfCompactSize(block.vtx.size())), pindex->nHeight);
     std::vector<std::pair<uint256, CDiskTxPos> > vPosTxid;
-    std::vector<std::pair<uint160, CExtDiskTxPos> > vPosAddrid;
+    std::vector<std::pair<CAddressIndexKey, CAddressIndexValue> > vAddrDeltas;
+    std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > vAddrUnspent;
     std::vector<pair<CoinSpend, uint256> > vSpends;
     vector<pair<PublicCoin, uint256> > vMints;
     if (fTxIndex)
         vPosTxid.reserve(block.vtx.size());
     if (fAddrIndex)
-        vPosAddrid.reserve(block.vtx.size() * 4);
+        vAddrDeltas.reserve(block.vtx.size() * 4);
     vPosTxid.reserve(block.vtx.size());
     CBlockUndo blockundo;
     blockundo.vtxundo.reserve(block.vtx.size() - 1);
@@ -3263,7 +3819,7 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
                 //queue for db write after the 'justcheck' section has concluded
                 vSpends.emplace_back(make_pair(spend, tx.GetHash()));
 
-                if (!ContextualCheckZerocoinSpend(tx, spend, pindex, hashBlock))
+                if (!ContextualCheckZerocoinSpend(tx, spend, pindex, hashBlock, !fAssumeValid))
                     return state.DoS(100, error("%s: failed to add block %s with invalid zerocoinspend", __func__, tx.GetHash().GetHex()), REJECT_INVALID);
                 }
 
@@ -3333,19 +3889,8 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
         }
         if (fTxIndex)
             vPosTxid.push_back(std::make_pair(tx.GetHash(), pos));
-        if (fAddrIndex) {
-            if (!tx.IsCoinBase()) {
-                for (const CTxIn &txin : tx.vin) {
-                    CCoins coins;
-                    view.GetCoins(txin.prevout.hash, coins);
-                    if (coins.IsAvailable(txin.prevout.n)) {
-                        BuildAddrIndex(coins.vout[txin.prevout.n].scriptPubKey, pos, vPosAddrid);
-                    }
-                }
-            }
-            for (const CTxOut &txout : tx.vout)
-            BuildAddrIndex(txout.scriptPubKey, pos, vPosAddrid);
-        }
+        if (fAddrIndex && !fVerifyingBlocks)
+            BuildAddrIndex(tx, i, pos, pindex->nHeight, view, vAddrDeltas, vAddrUnspent);
 
         UpdateCoins(tx, state, view, i == 0 ? undoDummy : blockundo.vtxundo.back(), pindex->nHeight);
         pos.nTxOffset += ::GetSerializeSize(tx, SER_DISK, CLIENT_VERSION);
@@ -3439,6 +3984,15 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
             // update nUndoPos in block index
             pindex->nUndoPos = pos.nPos;
             pindex->nStatus |= BLOCK_HAVE_UNDO;
+
+            // Keep the supply change of the block so it can be recalculated without the block
+            CBlockSupply supply;
+            supply.nMoneySupplyDelta = nValueOut - nValueIn;
+            supply.vMintDenominations = pindex->vMintDenominationsInBlock;
+            std::list<libzerocoin::CoinDenomination> listSpends = ZerocoinSpendListFromBlock(block);
+            supply.vSpendDenominations.assign(listSpends.begin(), listSpends.end());
+            if (!pblocktree->WriteBlockSupply(pindex->GetBlockHash(), supply))
+                return state.Error("Failed to write block supply");
         }
 
         pindex->RaiseValidity(BLOCK_VALID_SCRIPTS);
@@ -3449,7 +4003,7 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
     set<uint256> setAddedTx;
     for (pair<CoinSpend, uint256> pSpend : vSpends) {
         //record spend to database
-        if (!zerocoinDB->WriteCoinSpend(pSpend.first.getCoinSerialNumber(), pSpend.second))
+        if (!zerocoinDB->WriteCoinSpend(pSpend.first.getCoinSerialNumber(), pSpend.second, pindex->nHeight, pSpend.first.getDenomination()))
             return state.Error(("Failed to record coin serial to database"));
 
         // Send signal to wallet if this is ours
@@ -3478,19 +4032,23 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
 
     //Record mints to db
     for (pair<PublicCoin, uint256> pMint : vMints) {
-        if (!zerocoinDB->WriteCoinMint(pMint.first, pMint.second))
+        if (!zerocoinDB->WriteCoinMint(pMint.first, pMint.second, pindex->nHeight))
             return state.Error(("Failed to record new mint to database"));
     }
 
     //Record accumulator checksums
     DatabaseChecksums(mapAccumulators);
 
+    //Start on the accumulator checkpoint due ten blocks from now, unless still catching up with the chain
+    if (!fVerifyingBlocks && !IsInitialBlockDownload())
+        QueueAccumulatorCheckpoint(pindex);
+
     if (fTxIndex)
         if (!pblocktree->WriteTxIndex(vPosTxid))
             return state.Error("Failed to write transaction index");
 
-    if (fAddrIndex)
-        if (!pblocktree->AddAddrIndex(vPosAddrid))
+    if (fAddrIndex && !fVerifyingBlocks)
+        if (!pblocktree->UpdateAddrIndex(vAddrDeltas, vAddrUnspent, true))
             return state.Error("Failed to write address index");
 
     // add new entries
@@ -3536,6 +4094,7 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
 }
 
 enum FlushStateMode {
+    FLUSH_STATE_NONE,
     FLUSH_STATE_IF_NEEDED,
     FLUSH_STATE_PERIODIC,
     FLUSH_STATE_ALWAYS
@@ -3544,14 +4103,28 @@ enum FlushStateMode {
 /**
  * Update the on-disk chain state.
  * The caches and indexes are flushed if either they're too large, forceWrite is set, or
- * fast is not set and it's been a while since the last write.
+ * fast is not set and it's been a while since the last write. In prune mode,
+ * block and undo files beyond the target are deleted after the flush.
  */
 bool static FlushStateToDisk(CValidationState& state, FlushStateMode mode)
 {
     LOCK(cs_main);
     static int64_t nLastWrite = 0;
+    std::set<int> setFilesToPrune;
+    bool fFlushForPrune = false;
     try {
-        if ((mode == FLUSH_STATE_ALWAYS) ||
+        if (fPruneMode && fCheckForPruning && !fReindex) {
+            fCheckForPruning = false;
+            FindFilesToPrune(setFilesToPrune);
+            if (!setFilesToPrune.empty()) {
+                fFlushForPrune = true;
+                if (!fHavePruned) {
+                    pblocktree->WriteFlag("prunedblockfiles", true);
+                    fHavePruned = true;
+                }
+            }
+        }
+        if ((mode == FLUSH_STATE_ALWAYS) || fFlushForPrune ||
             ((mode == FLUSH_STATE_PERIODIC || mode == FLUSH_STATE_IF_NEEDED) && pcoinsTip->GetCacheSize() > nCoinCacheSize) ||
             (mode == FLUSH_STATE_PERIODIC && GetTimeMicros() > nLastWrite + DATABASE_WRITE_INTERVAL * 1000000)) {
             // Typical CCoins structures on disk are around 100 bytes in size.
@@ -3584,6 +4157,9 @@ bool static FlushStateToDisk(CValidationState& state, FlushStateMode mode)
             // Finally flush the chainstate (which may refer to block index entries).
             if (!pcoinsTip->Flush())
                 return state.Error("Failed to write to coin database");
+            // Nothing refers to the pruned files any more; remove them.
+            if (fFlushForPrune)
+                UnlinkPrunedFiles(setFilesToPrune);
             // Update best block in wallet (so we can detect restored wallets).
             if (mode != FLUSH_STATE_IF_NEEDED) {
                 GetMainSignals().SetBestChain(chainActive.GetLocator());
@@ -3602,6 +4178,13 @@ void FlushStateToDisk()
     FlushStateToDisk(state, FLUSH_STATE_ALWAYS);
 }
 
+void PruneAndFlush()
+{
+    CValidationState state;
+    fCheckForPruning = true;
+    FlushStateToDisk(state, FLUSH_STATE_NONE);
+}
+
 /** Update chainActive and related internal data structures. */
 void static UpdateTip(CBlockIndex* pindexNew)
 {
@@ -4233,6 +4816,7 @@ bool ReceivedBlockTransactions(const CBlock& block, CValidationState& state, CBl
     pindexNew->nFile = pos.nFile;
     pindexNew->nDataPos = pos.nPos;
     pindexNew->nUndoPos = 0;
+    mapBlockIndexByPos[make_pair(pos.nFile, pos.nPos)] = pindexNew;
     pindexNew->nStatus |= BLOCK_HAVE_DATA | BLOCK_OPT_WITNESS;
     pindexNew->RaiseValidity(BLOCK_VALID_TRANSACTIONS);
     setDirtyBlockIndex.insert(pindexNew);
@@ -4304,6 +4888,8 @@ bool FindBlockPos(CValidationState& state, CDiskBlockPos& pos, unsigned int nAdd
         unsigned int nOldChunks = (pos.nPos + BLOCKFILE_CHUNK_SIZE - 1) / BLOCKFILE_CHUNK_SIZE;
         unsigned int nNewChunks = (vinfoBlockFile[nFile].nSize + BLOCKFILE_CHUNK_SIZE - 1) / BLOCKFILE_CHUNK_SIZE;
         if (nNewChunks > nOldChunks) {
+            if (fPruneMode)
+                fCheckForPruning = true;
             if (CheckDiskSpace(nNewChunks * BLOCKFILE_CHUNK_SIZE - pos.nPos)) {
                 FILE* file = OpenBlockFile(pos);
                 if (file) {
@@ -4334,6 +4920,8 @@ bool FindUndoPos(CValidationState& state, int nFile, CDiskBlockPos& pos, unsigne
     unsigned int nOldChunks = (pos.nPos + UNDOFILE_CHUNK_SIZE - 1) / UNDOFILE_CHUNK_SIZE;
     unsigned int nNewChunks = (nNewSize + UNDOFILE_CHUNK_SIZE - 1) / UNDOFILE_CHUNK_SIZE;
     if (nNewChunks > nOldChunks) {
+        if (fPruneMode)
+            fCheckForPruning = true;
         if (CheckDiskSpace(nNewChunks * UNDOFILE_CHUNK_SIZE - pos.nPos)) {
             FILE* file = OpenUndoFile(pos);
             if (file) {
@@ -4348,6 +4936,42 @@ bool FindUndoPos(CValidationState& state, int nFile, CDiskBlockPos& pos, unsigne
     return true;
 }
 
+bool StoreSnapshotBlock(CBlock& block, CBlockUndo* pblockundo, CDiskBlockIndex& diskindex)
+{
+    LOCK(cs_main);
+    CValidationState state;
+    unsigned int nBlockSize = ::GetSerializeSize(block, SER_DISK, CLIENT_VERSION);
+    CDiskBlockPos blockPos;
+    if (!FindBlockPos(state, blockPos, nBlockSize + 8, diskindex.nHeight, block.GetBlockTime()) || !WriteBlockToDisk(block, blockPos))
+        return error("%s : failed to write block %s", __func__, block.GetHash().ToString());
+    diskindex.nFile = blockPos.nFile;
+    diskindex.nDataPos = blockPos.nPos;
+    diskindex.nStatus |= BLOCK_HAVE_DATA;
+
+    if (pblockundo) {
+        CDiskBlockPos undoPos;
+        if (!FindUndoPos(state, blockPos.nFile, undoPos, ::GetSerializeSize(*pblockundo, SER_DISK, CLIENT_VERSION) + 40) ||
+            !pblockundo->WriteToDisk(undoPos, block.hashPrevBlock))
+            return error("%s : failed to write undo data of block %s", __func__, block.GetHash().ToString());
+        diskindex.nUndoPos = undoPos.nPos;
+        diskindex.nStatus |= BLOCK_HAVE_UNDO;
+    }
+    return true;
+}
+
+bool FlushBlockFileInfo()
+{
+    LOCK(cs_main);
+    FlushBlockFile();
+    std::vector<std::pair<int, const CBlockFileInfo*> > vFiles;
+    for (std::set<int>::iterator it = setDirtyFileInfo.begin(); it != setDirtyFileInfo.end(); it++)
+        vFiles.push_back(std::make_pair(*it, &vinfoBlockFile[*it]));
+    if (!pblocktree->WriteBatchSync(vFiles, nLastBlockFile, std::vector<const CBlockIndex*>()))
+        return false;
+    setDirtyFileInfo.clear();
+    return true;
+}
+
 bool CheckBlockHeader(const CBlockHeader& block, CValidationState& state, bool fCheckPOW)
 {
     // Check proof of work matches claimed amount
@@ -4371,7 +4995,7 @@ bool CheckBlock(const CBlock& block, CValidationState& state, bool fCheckPOW, bo
 
     // Check that the header is valid (particularly PoW).  This is mostly
     // redundant with the call in AcceptBlockHeader.
-    if (!CheckBlockHeader(block, state, block.IsProofOfWork()&&fCheckPOW))
+    if (!block.IsChecked() && !CheckBlockHeader(block, state, block.IsProofOfWork()&&fCheckPOW))
         return state.DoS(100, error("CheckBlock() : CheckBlockHeader failed"),
             REJECT_INVALID, "bad-header", true);
 
@@ -4382,7 +5006,7 @@ bool CheckBlock(const CBlock& block, CValidationState& state, bool fCheckPOW, bo
             REJECT_INVALID, "time-too-new");
 
     // Check the merkle root.
-    if (fCheckMerkleRoot) {
+    if (fCheckMerkleRoot && !block.IsChecked()) {
         bool mutated;
         uint256 hashMerkleRoot2 = block.BuildMerkleTree(&mutated);
         if (block.hashMerkleRoot != hashMerkleRoot2)
@@ -4962,6 +5586,9 @@ bool AcceptBlock(CBlock& block, CValidationState& state, CBlockIndex** ppindex,
         return state.Error(std::string("System error: ") + e.what());
     }
 
+    if (fCheckForPruning)
+        FlushStateToDisk(state, FLUSH_STATE_NONE); // we just allocated more disk space for block files
+
     return true;
 }
 
@@ -5056,7 +5683,7 @@ bool ProcessNewBlock(CValidationState& state, CNode* pfrom, CBlock* pblock, CDis
     //    return error("ProcessNewBlock() : duplicate proof-of-stake (%s, %d) for block %s", pblock->GetProofOfStake().first.ToString().c_str(), pblock->GetProofOfStake().second, pblock->GetHash().ToString().c_str());
 
     // NovaCoin: check proof-of-stake block signature
-    if (!pblock->CheckBlockSignature())
+    if (!pblock->IsChecked() && !pblock->CheckBlockSignature())
         return error("ProcessNewBlock() : bad proof-of-stake block signature");
 
     if (pblock->GetHash() != Params().HashGenesisBlock() && pfrom != NULL) {
@@ -5154,6 +5781,174 @@ bool CheckDiskSpace(uint64_t nAdditionalBytes)
     return true;
 }
 
+uint64_t CalculateCurrentUsage()
+{
+    uint64_t retval = 0;
+    for (const CBlockFileInfo& file : vinfoBlockFile) {
+        retval += file.nSize + file.nUndoSize;
+    }
+    return retval;
+}
+
+void PruneOneBlockFile(const int fileNumber)
+{
+    for (BlockMap::iterator it = mapBlockIndex.begin(); it != mapBlockIndex.end(); ++it) {
+        CBlockIndex* pindex = it->second;
+        if (pindex->nFile == fileNumber && (pindex->nStatus & (BLOCK_HAVE_DATA | BLOCK_HAVE_UNDO))) {
+            if (pindex->nStatus & BLOCK_HAVE_DATA)
+                mapBlockIndexByPos.erase(make_pair(pindex->nFile, pindex->nDataPos));
+            pindex->nStatus &= ~BLOCK_HAVE_DATA;
+            pindex->nStatus &= ~BLOCK_HAVE_UNDO;
+            pindex->nFile = 0;
+            pindex->nDataPos = 0;
+            pindex->nUndoPos = 0;
+            setDirtyBlockIndex.insert(pindex);
+
+            // Prune from mapBlocksUnlinked -- any block we prune would have
+            // to be downloaded again in order to consider its chain, at which
+            // point it would be considered as a candidate for
+            // mapBlocksUnlinked or setBlockIndexCandidates.
+            std::pair<std::multimap<CBlockIndex*, CBlockIndex*>::iterator, std::multimap<CBlockIndex*, CBlockIndex*>::iterator> range = mapBlocksUnlinked.equal_range(pindex->pprev);
+            while (range.first != range.second) {
+                std::multimap<CBlockIndex*, CBlockIndex*>::iterator itUnlinked = range.first;
+                range.first++;
+                if (itUnlinked->second == pindex)
+                    mapBlocksUnlinked.erase(itUnlinked);
+            }
+        }
+    }
+
+    vinfoBlockFile[fileNumber].SetNull();
+    setDirtyFileInfo.insert(fileNumber);
+}
+
+void UnlinkPrunedFiles(std::set<int>& setFilesToPrune)
+{
+    for (std::set<int>::iterator it = setFilesToPrune.begin(); it != setFilesToPrune.end(); ++it) {
+        CDiskBlockPos pos(*it, 0);
+        blockFileReadPool.Close(*it);
+        blockFileMapCache.Close(*it);
+        boost::filesystem::remove(GetBlockPosFilename(pos, "blk"));
+        boost::filesystem::remove(GetBlockPosFilename(pos, "rev"));
+        LogPrintf("Prune: %s deleted blk/rev (%05u)\n", __func__, *it);
+    }
+}
+
+int GetPruneHeight()
+{
+    AssertLockHeld(cs_main);
+    if ((!fPruneMode && !fHavePruned) || chainActive.Tip() == NULL)
+        return 0;
+    CBlockIndex* pindex = chainActive.Tip();
+    while (pindex->pprev && (pindex->pprev->nStatus & BLOCK_HAVE_DATA) && pindex->pprev->nTx > 0)
+        pindex = pindex->pprev;
+    return pindex->nHeight;
+}
+
+static CCriticalSection cs_pinnedBlockFiles;
+//! Number of pins on each block file that is being read without cs_main
+static std::map<int, int> mapPinnedBlockFiles;
+
+CBlockFilePin::CBlockFilePin(int nFileIn) : nFile(nFileIn)
+{
+    LOCK(cs_pinnedBlockFiles);
+    mapPinnedBlockFiles[nFile]++;
+}
+
+CBlockFilePin::~CBlockFilePin()
+{
+    LOCK(cs_pinnedBlockFiles);
+    if (--mapPinnedBlockFiles[nFile] == 0)
+        mapPinnedBlockFiles.erase(nFile);
+}
+
+static bool IsBlockFilePinned(int nFile)
+{
+    LOCK(cs_pinnedBlockFiles);
+    return mapPinnedBlockFiles.count(nFile) > 0;
+}
+
+/**
+ * Lowest height whose block data the zerocoin wallet may still read. Spending
+ * a mint builds its accumulator witness from the blocks following the
+ * checkpoint cluster the mint was added in (GenerateAccumulatorWitness).
+ */
+static int GetZerocoinPruneHeight()
+{
+    int nHeight = std::numeric_limits<int>::max();
+#ifdef ENABLE_WALLET
+    if (pwalletMain && pwalletMain->zhlixTracker) {
+        LOCK(pwalletMain->cs_wallet);
+        for (const CMintMeta& mint : pwalletMain->zhlixTracker->GetMints(false)) {
+            if (mint.nHeight > 0)
+                nHeight = std::min(nHeight, mint.nHeight - (mint.nHeight % 10));
+        }
+    }
+#endif
+    return nHeight;
+}
+
+/**
+ * Calculate the block/rev files that should be deleted to remain under target.
+ * Files holding blocks within MIN_BLOCKS_TO_KEEP (or the maximum reorganization
+ * depth) of the tip, or blocks the zerocoin wallet still needs, are kept.
+ */
+void static FindFilesToPrune(std::set<int>& setFilesToPrune)
+{
+    LOCK(cs_main);
+    if (chainActive.Tip() == NULL || nPruneTarget == 0)
+        return;
+
+    int nKeepDepth = std::max<int>(MIN_BLOCKS_TO_KEEP, Params().MaxReorganizationDepth());
+    if (chainActive.Tip()->nHeight <= nKeepDepth)
+        return;
+
+    // Takes cs_wallet, so it has to run before cs_LastBlockFile is taken
+    int nZerocoinPruneHeight = GetZerocoinPruneHeight();
+
+    LOCK(cs_LastBlockFile);
+    int nLastBlockWeCanPrune = std::min(chainActive.Tip()->nHeight - nKeepDepth, nZerocoinPruneHeight - 1);
+    uint64_t nCurrentUsage = CalculateCurrentUsage();
+    // We don't check to prune until after we've allocated new space for files,
+    // so leave a buffer under our target to account for another allocation
+    // before the next pruning.
+    uint64_t nBuffer = BLOCKFILE_CHUNK_SIZE + UNDOFILE_CHUNK_SIZE;
+    int count = 0;
+
+    if (nCurrentUsage + nBuffer >= nPruneTarget) {
+        for (int fileNumber = 0; fileNumber < nLastBlockFile; fileNumber++) {
+            uint64_t nBytesToPrune = vinfoBlockFile[fileNumber].nSize + vinfoBlockFile[fileNumber].nUndoSize;
+
+            if (vinfoBlockFile[fileNumber].nSize == 0)
+                continue;
+
+            if (nCurrentUsage + nBuffer < nPruneTarget) // are we below our target?
+                break;
+
+            // don't prune files that could have a block we still need, but keep scanning
+            if ((int)vinfoBlockFile[fileNumber].nHeightLast > nLastBlockWeCanPrune)
+                continue;
+
+            // a block is being read from this file without cs_main; try again next time
+            if (IsBlockFilePinned(fileNumber)) {
+                fCheckForPruning = true;
+                continue;
+            }
+
+            PruneOneBlockFile(fileNumber);
+            // Queue up the files for removal
+            setFilesToPrune.insert(fileNumber);
+            nCurrentUsage -= nBytesToPrune;
+            count++;
+        }
+    }
+
+    LogPrint("prune", "Prune: target=%dMiB actual=%dMiB diff=%dMiB max_prune_height=%d removed %d blk/rev pairs\n",
+        nPruneTarget / 1024 / 1024, nCurrentUsage / 1024 / 1024,
+        ((int64_t)nPruneTarget - (int64_t)nCurrentUsage) / 1024 / 1024,
+        nLastBlockWeCanPrune, count);
+}
+
 FILE* OpenDiskFile(const CDiskBlockPos& pos, const char* prefix, bool fReadOnly)
 {
     if (pos.IsNull())
@@ -5236,6 +6031,7 @@ bool static LoadBlockIndexDB(string& strError)
         CBlockIndex* pindex = item.second;
         pindex->nChainWork = (pindex->pprev ? pindex->pprev->nChainWork : 0) + GetBlockProof(*pindex);
         if (pindex->nStatus & BLOCK_HAVE_DATA) {
+            mapBlockIndexByPos[make_pair(pindex->nFile, pindex->nDataPos)] = pindex;
             if (pindex->pprev) {
                 if (pindex->pprev->nChainTx) {
                     pindex->nChainTx = pindex->pprev->nChainTx + pindex->nTx;
@@ -5307,6 +6103,11 @@ bool static LoadBlockIndexDB(string& strError)
     pblocktree->ReadFlag("addrindex", fAddrIndex);
     LogPrintf("LoadBlockIndexDB(): address index %s\n", fAddrIndex ? "enabled" : "disabled");
 
+    // Check whether we have ever pruned block & undo files
+    pblocktree->ReadFlag("prunedblockfiles", fHavePruned);
+    if (fHavePruned)
+        LogPrintf("LoadBlockIndexDB(): Block files have previously been pruned\n");
+
     // If this is written true before the next client init, then we know the shutdown process failed
     pblocktree->WriteFlag("shutdown", false);
 
@@ -5359,9 +6160,14 @@ bool CVerifyDB::VerifyDB(CCoinsView* coinsview, int nCheckLevel, int nCheckDepth
         uiInterface.ShowProgress(_("Verifying blocks..."), std::max(1, std::min(99, (int)(((double)(chainActive.Height() - pindex->nHeight)) / (double)nCheckDepth * (nCheckLevel >= 4 ? 50 : 100)))));
         if (pindex->nHeight < chainActive.Height() - nCheckDepth)
             break;
+        if (fPruneMode && !(pindex->nStatus & BLOCK_HAVE_DATA)) {
+            // If pruning, only go back as far as we have data.
+            LogPrintf("VerifyDB(): block verification stopping at height %d (pruning, no data)\n", pindex->nHeight);
+            break;
+        }
         CBlock block;
         // check level 0: read from disk
-        if (!ReadBlockFromDisk(block, pindex))
+        if (!ReadTrustedBlockFromDisk(block, pindex))
             return error("VerifyDB() : *** ReadBlockFromDisk failed at %d, hash=%s", pindex->nHeight, pindex->GetBlockHash().ToString());
         // check level 1: verify block validity
         if (nCheckLevel >= 1 && !CheckBlock(block, state))
@@ -5401,7 +6207,7 @@ bool CVerifyDB::VerifyDB(CCoinsView* coinsview, int nCheckLevel, int nCheckDepth
             uiInterface.ShowProgress(_("Verifying blocks..."), std::max(1, std::min(99, 100 - (int)(((double)(chainActive.Height() - pindex->nHeight)) / (double)nCheckDepth * 50))));
             pindex = chainActive.Next(pindex);
             CBlock block;
-            if (!ReadBlockFromDisk(block, pindex))
+            if (!ReadTrustedBlockFromDisk(block, pindex))
                 return error("VerifyDB() : *** ReadBlockFromDisk failed at %d, hash=%s", pindex->nHeight, pindex->GetBlockHash().ToString());
             if (!ConnectBlock(block, state, pindex, coins, false))
                 return error("VerifyDB() : *** found unconnectable block at %d, hash=%s", pindex->nHeight, pindex->GetBlockHash().ToString());
@@ -5448,6 +6254,9 @@ bool RewindBlockIndex(const CChainParams& params)
             // Remove have-data flags.
             pindexIter->nStatus &= ~(BLOCK_HAVE_DATA | BLOCK_HAVE_UNDO);
             // Remove storage location.
+            map<pair<int, unsigned int>, CBlockIndex*>::iterator itPos = mapBlockIndexByPos.find(make_pair(pindexIter->nFile, pindexIter->nDataPos));
+            if (itPos != mapBlockIndexByPos.end() && itPos->second == pindexIter)
+                mapBlockIndexByPos.erase(itPos);
             pindexIter->nFile = 0;
             pindexIter->nDataPos = 0;
             pindexIter->nUndoPos = 0;
@@ -5486,6 +6295,7 @@ bool RewindBlockIndex(const CChainParams& params)
 void UnloadBlockIndex()
 {
     mapBlockIndex.clear();
+    mapBlockIndexByPos.clear();
     setBlockIndexCandidates.clear();
     chainActive.SetTip(NULL);
     pindexBestInvalid = NULL;
@@ -5510,8 +6320,10 @@ bool InitBlockIndex()
     // Use the provided setting for -txindex in the new database
     fTxIndex = GetBoolArg("-txindex", true);
     pblocktree->WriteFlag("txindex", fTxIndex);
-    fAddrIndex = GetBoolArg("-addrindex", true);
+    fAddrIndex = GetBoolArg("-addrindex", DEFAULT_ADDRINDEX);
     pblocktree->WriteFlag("addrindex", fAddrIndex);
+    if (fAddrIndex)
+        pblocktree->WriteInt("addrindexversion", ADDRESS_INDEX_VERSION);
     LogPrintf("Initializing databases...\n");
 
     // Only add the genesis block if not reindexing (in which case we reuse the one already on disk)
@@ -5542,104 +6354,312 @@ bool InitBlockIndex()
 }
 
 
+/** Map of disk positions for blocks with unknown parent (only used for reindex) */
+static std::multimap<uint256, CDiskBlockPos> mapBlocksUnknownParent;
+
+/**
+ * Process a block read from a block file, together with any earlier blocks of
+ * the file that were waiting for it as their parent. Returns false if a
+ * system error means the import should stop.
+ */
+static bool ProcessImportedBlock(CBlock& block, const uint256& hash, CDiskBlockPos* dbp, int& nLoaded)
+{
+    // detect out of order blocks, and store them for later
+    if (hash != Params().HashGenesisBlock() && mapBlockIndex.find(block.hashPrevBlock) == mapBlockIndex.end()) {
+        LogPrint("reindex", "%s: Out of order block %s, parent %s not known\n", __func__, hash.ToString(),
+            block.hashPrevBlock.ToString());
+        if (dbp)
+            mapBlocksUnknownParent.insert(std::make_pair(block.hashPrevBlock, *dbp));
+        return true;
+    }
+
+    // process in case the block isn't known yet
+    if (mapBlockIndex.count(hash) == 0 || (mapBlockIndex[hash]->nStatus & BLOCK_HAVE_DATA) == 0) {
+        CValidationState state;
+        if (ProcessNewBlock(state, NULL, &block, dbp))
+            nLoaded++;
+        if (state.IsError())
+            return false;
+    } else if (hash != Params().HashGenesisBlock() && mapBlockIndex[hash]->nHeight % 1000 == 0) {
+        LogPrintf("Block Import: already had block %s at height %d\n", hash.ToString(), mapBlockIndex[hash]->nHeight);
+    }
+
+    // Recursively process earlier encountered successors of this block
+    deque<uint256> queue;
+    queue.push_back(hash);
+    while (!queue.empty()) {
+        uint256 head = queue.front();
+        queue.pop_front();
+        std::pair<std::multimap<uint256, CDiskBlockPos>::iterator, std::multimap<uint256, CDiskBlockPos>::iterator> range = mapBlocksUnknownParent.equal_range(head);
+        while (range.first != range.second) {
+            std::multimap<uint256, CDiskBlockPos>::iterator it = range.first;
+            if (ReadBlockFromDisk(block, it->second)) {
+                LogPrintf("%s: Processing out of order child %s of %s\n", __func__, block.GetHash().ToString(),
+                    head.ToString());
+                CValidationState dummy;
+                if (ProcessNewBlock(dummy, NULL, &block, &it->second)) {
+                    nLoaded++;
+                    queue.push_back(block.GetHash());
+                }
+            }
+            range.first++;
+            mapBlocksUnknownParent.erase(it);
+        }
+    }
+    return true;
+}
+
+/** Scan a stream of blocks as written to block files, processing each block found */
+template <typename Stream>
+static int LoadBlocksFromStream(Stream& blkdat, CDiskBlockPos* dbp)
+{
+    int nLoaded = 0;
+    uint64_t nRewind = blkdat.GetPos();
+    while (!blkdat.eof()) {
+        boost::this_thread::interruption_point();
+
+        blkdat.SetPos(nRewind);
+        nRewind++;         // start one byte further next time, in case of failure
+        blkdat.SetLimit(); // remove former limit
+        unsigned int nSize = 0;
+        try {
+            // locate a header
+            unsigned char buf[MESSAGE_START_SIZE];
+            blkdat.FindByte(Params().MessageStart()[0]);
+            nRewind = blkdat.GetPos() + 1;
+            blkdat >> FLATDATA(buf);
+            if (memcmp(buf, Params().MessageStart(), MESSAGE_START_SIZE))
+                continue;
+            // read size
+            blkdat >> nSize;
+            if (nSize < 80 || nSize > MAX_BLOCK_SIZE_CURRENT)
+                continue;
+        } catch (const std::exception&) {
+            // no valid block header found; don't complain
+            break;
+        }
+        try {
+            // read block
+            uint64_t nBlockPos = blkdat.GetPos();
+            if (dbp)
+                dbp->nPos = nBlockPos;
+            blkdat.SetLimit(nBlockPos + nSize);
+            blkdat.SetPos(nBlockPos);
+            CBlock block;
+            blkdat >> block;
+            nRewind = blkdat.GetPos();
+
+            if (!ProcessImportedBlock(block, block.GetHash(), dbp, nLoaded))
+                break;
+        } catch (std::exception& e) {
+            LogPrintf("%s : Deserialize or I/O error - %s", __func__, e.what());
+        }
+    }
+    return nLoaded;
+}
+
 bool LoadExternalBlockFile(FILE* fileIn, CDiskBlockPos* dbp)
 {
-    // Map of disk positions for blocks with unknown parent (only used for reindex)
-    static std::multimap<uint256, CDiskBlockPos> mapBlocksUnknownParent;
     int64_t nStart = GetTimeMillis();
 
     int nLoaded = 0;
     try {
-        // This takes over fileIn and calls fclose() on it in the CBufferedFile destructor
-        CBufferedFile blkdat(fileIn, 2*MAX_BLOCK_SIZE_CURRENT, MAX_BLOCK_SIZE_CURRENT+8, SER_DISK, CLIENT_VERSION);
-        uint64_t nRewind = blkdat.GetPos();
-        while (!blkdat.eof()) {
-            boost::this_thread::interruption_point();
+        // Scan the file through a read-only mapping where possible, so blocks
+        // are parsed in place and the kernel reads ahead of the scan
+        std::unique_ptr<CMappedBlockFile> mapped(CMappedBlockFile::Map(dbp ? dbp->nFile : -1, fileIn, true));
+        if (mapped) {
+            fclose(fileIn);
+            CMemoryReader blkdat(mapped->begin(), mapped->size(), SER_DISK, CLIENT_VERSION);
+            nLoaded = LoadBlocksFromStream(blkdat, dbp);
+        } else {
+            // This takes over fileIn and calls fclose() on it in the CBufferedFile destructor
+            CBufferedFile blkdat(fileIn, 2*MAX_BLOCK_SIZE_CURRENT, MAX_BLOCK_SIZE_CURRENT+8, SER_DISK, CLIENT_VERSION);
+            nLoaded = LoadBlocksFromStream(blkdat, dbp);
+        }
+    } catch (std::runtime_error& e) {
+        AbortNode(std::string("System error: ") + e.what());
+    }
+    if (nLoaded > 0)
+        LogPrintf("Loaded %i blocks from external file in %dms\n", nLoaded, GetTimeMillis() - nStart);
+    return nLoaded > 0;
+}
 
-            blkdat.SetPos(nRewind);
-            nRewind++;         // start one byte further next time, in case of failure
-            blkdat.SetLimit(); // remove former limit
-            unsigned int nSize = 0;
-            try {
-                // locate a header
-                unsigned char buf[MESSAGE_START_SIZE];
-                blkdat.FindByte(Params().MessageStart()[0]);
-                nRewind = blkdat.GetPos() + 1;
-                blkdat >> FLATDATA(buf);
-                if (memcmp(buf, Params().MessageStart(), MESSAGE_START_SIZE))
-                    continue;
-                // read size
-                blkdat >> nSize;
-                if (nSize < 80 || nSize > MAX_BLOCK_SIZE_CURRENT)
-                    continue;
-            } catch (const std::exception&) {
-                // no valid block header found; don't complain
+/**
+ * Parses the blocks of one block file image on several threads for -reindex.
+ * Workers deserialize blocks, hash them and verify their proof of work, merkle
+ * root and signature, staying at most REINDEX_PARSE_WINDOW blocks ahead of the
+ * single thread that hands the results on in file order.
+ */
+class CReindexParser
+{
+private:
+    const char* pbegin;
+    const uint64_t nSize;
+    const int nThreads;
+    //! Offset and size of every block found in the file
+    std::vector<std::pair<unsigned int, unsigned int> > vBlocks;
+
+    boost::mutex mutex;
+    boost::condition_variable condWorker;
+    boost::condition_variable condParsed;
+    //! Parsed blocks and their hashes; a finished entry without block failed to parse
+    std::vector<std::unique_ptr<CBlock> > vParsed;
+    std::vector<uint256> vHash;
+    std::vector<bool> vFinished;
+    size_t nNext;
+    size_t nConsumed;
+    bool fQuit;
+
+    /** Locate the blocks in the file by their message start and size prefix */
+    void Scan()
+    {
+        const unsigned char* pdata = (const unsigned char*)pbegin;
+        uint64_t nPos = 0;
+        while (nPos + 8 <= nSize) {
+            const unsigned char* p = (const unsigned char*)memchr(pdata + nPos, Params().MessageStart()[0], nSize - nPos);
+            if (!p)
                 break;
+            nPos = p - pdata;
+            if (nPos + 8 > nSize)
+                break;
+            unsigned int nBlockSize = ReadLE32(p + MESSAGE_START_SIZE);
+            if (memcmp(p, Params().MessageStart(), MESSAGE_START_SIZE) ||
+                nBlockSize < 80 || nBlockSize > MAX_BLOCK_SIZE_CURRENT || nPos + 8 + nBlockSize > nSize) {
+                nPos++;
+                continue;
+            }
+            vBlocks.push_back(std::make_pair(nPos + 8, nBlockSize));
+            nPos += 8 + nBlockSize;
+        }
+    }
+
+    void Worker()
+    {
+        while (true) {
+            size_t i;
+            {
+                boost::unique_lock<boost::mutex> lock(mutex);
+                while (!fQuit && nNext < vBlocks.size() && nNext >= nConsumed + REINDEX_PARSE_WINDOW)
+                    condWorker.wait(lock);
+                if (fQuit || nNext >= vBlocks.size())
+                    return;
+                i = nNext++;
             }
+
+            std::unique_ptr<CBlock> pblock(new CBlock());
+            uint256 hash;
             try {
-                // read block
-                uint64_t nBlockPos = blkdat.GetPos();
-                if (dbp)
-                    dbp->nPos = nBlockPos;
-                blkdat.SetLimit(nBlockPos + nSize);
-                blkdat.SetPos(nBlockPos);
-                CBlock block;
-                blkdat >> block;
-                nRewind = blkdat.GetPos();
-
-                // detect out of order blocks, and store them for later
-                uint256 hash = block.GetHash();
-                if (hash != Params().HashGenesisBlock() && mapBlockIndex.find(block.hashPrevBlock) == mapBlockIndex.end()) {
-                    LogPrint("reindex", "%s: Out of order block %s, parent %s not known\n", __func__, hash.ToString(),
-                        block.hashPrevBlock.ToString());
-                    if (dbp)
-                        mapBlocksUnknownParent.insert(std::make_pair(block.hashPrevBlock, *dbp));
-                    continue;
-                }
+                CMemoryReader reader(pbegin + vBlocks[i].first, vBlocks[i].second, SER_DISK, CLIENT_VERSION);
+                reader >> *pblock;
+                hash = pblock->GetHash();
+
+                // The same context-free checks as CheckBlock and ProcessNewBlock, which skip them for checked blocks
+                CValidationState state;
+                bool fMutated;
+                if (CheckBlockHeader(*pblock, state, pblock->IsProofOfWork()) &&
+                    pblock->BuildMerkleTree(&fMutated) == pblock->hashMerkleRoot && !fMutated &&
+                    pblock->CheckBlockSignature())
+                    pblock->SetChecked();
+            } catch (const std::exception& e) {
+                LogPrintf("%s : Deserialize or I/O error - %s\n", __func__, e.what());
+                pblock.reset();
+            }
 
-                // process in case the block isn't known yet
-                if (mapBlockIndex.count(hash) == 0 || (mapBlockIndex[hash]->nStatus & BLOCK_HAVE_DATA) == 0) {
-                    CValidationState state;
-                    if (ProcessNewBlock(state, NULL, &block, dbp))
-                        nLoaded++;
-                    if (state.IsError())
-                        break;
-                } else if (hash != Params().HashGenesisBlock() && mapBlockIndex[hash]->nHeight % 1000 == 0) {
-                    LogPrintf("Block Import: already had block %s at height %d\n", hash.ToString(), mapBlockIndex[hash]->nHeight);
-                }
+            {
+                boost::unique_lock<boost::mutex> lock(mutex);
+                vParsed[i] = std::move(pblock);
+                vHash[i] = hash;
+                vFinished[i] = true;
+            }
+            condParsed.notify_all();
+        }
+    }
 
-                // Recursively process earlier encountered successors of this block
-                deque<uint256> queue;
-                queue.push_back(hash);
-                while (!queue.empty()) {
-                    uint256 head = queue.front();
-                    queue.pop_front();
-                    std::pair<std::multimap<uint256, CDiskBlockPos>::iterator, std::multimap<uint256, CDiskBlockPos>::iterator> range = mapBlocksUnknownParent.equal_range(head);
-                    while (range.first != range.second) {
-                        std::multimap<uint256, CDiskBlockPos>::iterator it = range.first;
-                        if (ReadBlockFromDisk(block, it->second)) {
-                            LogPrintf("%s: Processing out of order child %s of %s\n", __func__, block.GetHash().ToString(),
-                                head.ToString());
-                            CValidationState dummy;
-                            if (ProcessNewBlock(dummy, NULL, &block, &it->second)) {
-                                nLoaded++;
-                                queue.push_back(block.GetHash());
-                            }
-                        }
-                        range.first++;
-                        mapBlocksUnknownParent.erase(it);
-                    }
+    void Stop(boost::thread_group& threadGroup)
+    {
+        {
+            boost::unique_lock<boost::mutex> lock(mutex);
+            fQuit = true;
+        }
+        condWorker.notify_all();
+        threadGroup.join_all();
+    }
+
+public:
+    CReindexParser(const char* pbeginIn, uint64_t nSizeIn, int nThreadsIn) : pbegin(pbeginIn), nSize(nSizeIn), nThreads(std::max(1, nThreadsIn)), nNext(0), nConsumed(0), fQuit(false) {}
+
+    /** Hand every block of the file to process in file order, until it returns false */
+    void Run(const boost::function<bool(CBlock&, const uint256&, unsigned int)>& process)
+    {
+        Scan();
+        vParsed.resize(vBlocks.size());
+        vHash.resize(vBlocks.size());
+        vFinished.resize(vBlocks.size(), false);
+        if (vBlocks.empty())
+            return;
+
+        boost::thread_group threadGroup;
+        for (int i = 0; i < nThreads; i++)
+            threadGroup.create_thread(boost::bind(&CReindexParser::Worker, this));
+
+        try {
+            for (size_t i = 0; i < vBlocks.size(); i++) {
+                std::unique_ptr<CBlock> pblock;
+                uint256 hash;
+                {
+                    boost::unique_lock<boost::mutex> lock(mutex);
+                    while (!vFinished[i])
+                        condParsed.wait(lock);
+                    pblock = std::move(vParsed[i]);
+                    hash = vHash[i];
+                    nConsumed = i + 1;
                 }
-            } catch (std::exception& e) {
-                LogPrintf("%s : Deserialize or I/O error - %s", __func__, e.what());
+                condWorker.notify_all();
+
+                if (!pblock)
+                    continue;
+                if (!process(*pblock, hash, vBlocks[i].first))
+                    break;
             }
+        } catch (...) {
+            Stop(threadGroup);
+            throw;
         }
+        Stop(threadGroup);
+    }
+};
+
+void ParseBlockFile(const char* pbegin, uint64_t nSize, int nThreads, const boost::function<bool(CBlock&, const uint256&, unsigned int)>& process)
+{
+    CReindexParser parser(pbegin, nSize, nThreads);
+    parser.Run(process);
+}
+
+bool ReindexBlockFile(const CDiskBlockPos& pos)
+{
+    FILE* file = OpenBlockFile(pos, true);
+    std::unique_ptr<CMappedBlockFile> mapped(CMappedBlockFile::Map(pos.nFile, file, true));
+    if (file)
+        fclose(file);
+    if (!mapped)
+        return false;
+
+    int64_t nStart = GetTimeMillis();
+    int nLoaded = 0;
+    try {
+        // -par=1 (no script check threads) still gets one parser thread
+        int nThreads = std::min(nScriptCheckThreads, MAX_REINDEX_PARSE_THREADS);
+        CDiskBlockPos dbp(pos.nFile, 0);
+        ParseBlockFile(mapped->begin(), mapped->size(), nThreads, [&](CBlock& block, const uint256& hash, unsigned int nPos) {
+            dbp.nPos = nPos;
+            return ProcessImportedBlock(block, hash, &dbp, nLoaded);
+        });
     } catch (std::runtime_error& e) {
         AbortNode(std::string("System error: ") + e.what());
     }
     if (nLoaded > 0)
-        LogPrintf("Loaded %i blocks from external file in %dms\n", nLoaded, GetTimeMillis() - nStart);
-    return nLoaded > 0;
+        LogPrintf("Loaded %i blocks from block file in %dms\n", nLoaded, GetTimeMillis() - nStart);
+    return true;
 }
 
 void static CheckBlockIndex()
@@ -5678,6 +6698,7 @@ void static CheckBlockIndex()
     int nHeight = 0;
     CBlockIndex* pindexFirstInvalid = NULL;         // Oldest ancestor of pindex which is invalid.
     CBlockIndex* pindexFirstMissing = NULL;         // Oldest ancestor of pindex which does not have BLOCK_HAVE_DATA.
+    CBlockIndex* pindexFirstNeverProcessed = NULL;  // Oldest ancestor of pindex for which nTx == 0.
     CBlockIndex* pindexFirstNotTreeValid = NULL;    // Oldest ancestor of pindex which does not have BLOCK_VALID_TREE (regardless of being valid or not).
     CBlockIndex* pindexFirstNotChainValid = NULL;   // Oldest ancestor of pindex which does not have BLOCK_VALID_CHAIN (regardless of being valid or not).
     CBlockIndex* pindexFirstNotScriptsValid = NULL; // Oldest ancestor of pindex which does not have BLOCK_VALID_SCRIPTS (regardless of being valid or not).
@@ -5685,6 +6706,7 @@ void static CheckBlockIndex()
         nNodes++;
         if (pindexFirstInvalid == NULL && pindex->nStatus & BLOCK_FAILED_VALID) pindexFirstInvalid = pindex;
         if (pindexFirstMissing == NULL && !(pindex->nStatus & BLOCK_HAVE_DATA)) pindexFirstMissing = pindex;
+        if (pindexFirstNeverProcessed == NULL && pindex->nTx == 0) pindexFirstNeverProcessed = pindex;
         if (pindex->pprev != NULL && pindexFirstNotTreeValid == NULL && (pindex->nStatus & BLOCK_VALID_MASK) < BLOCK_VALID_TREE) pindexFirstNotTreeValid = pindex;
         if (pindex->pprev != NULL && pindexFirstNotChainValid == NULL && (pindex->nStatus & BLOCK_VALID_MASK) < BLOCK_VALID_CHAIN) pindexFirstNotChainValid = pindex;
         if (pindex->pprev != NULL && pindexFirstNotScriptsValid == NULL && (pindex->nStatus & BLOCK_VALID_MASK) < BLOCK_VALID_SCRIPTS) pindexFirstNotScriptsValid = pindex;
@@ -5695,12 +6717,19 @@ void static CheckBlockIndex()
             assert(pindex->GetBlockHash() == Params().HashGenesisBlock()); // Genesis block's hash must match.
             assert(pindex == chainActive.Genesis());                       // The current active chain's genesis block must be this block.
         }
-        // HAVE_DATA is equivalent to VALID_TRANSACTIONS and equivalent to nTx > 0 (we stored the number of transactions in the block)
-        assert(!(pindex->nStatus & BLOCK_HAVE_DATA) == (pindex->nTx == 0));
+        if (!fHavePruned) {
+            // If we've never pruned, then HAVE_DATA should be equivalent to nTx > 0
+            assert(!(pindex->nStatus & BLOCK_HAVE_DATA) == (pindex->nTx == 0));
+            assert(pindexFirstMissing == pindexFirstNeverProcessed);
+        } else {
+            // If we have pruned, then we can only say that HAVE_DATA implies nTx > 0
+            if (pindex->nStatus & BLOCK_HAVE_DATA) assert(pindex->nTx > 0);
+        }
+        // VALID_TRANSACTIONS is equivalent to nTx > 0 (we stored the number of transactions in the block)
         assert(((pindex->nStatus & BLOCK_VALID_MASK) >= BLOCK_VALID_TRANSACTIONS) == (pindex->nTx > 0));
         if (pindex->nChainTx == 0) assert(pindex->nSequenceId == 0); // nSequenceId can't be set for blocks that aren't linked
-        // All parents having data is equivalent to all parents being VALID_TRANSACTIONS, which is equivalent to nChainTx being set.
-        assert((pindexFirstMissing != NULL) == (pindex->nChainTx == 0));                                             // nChainTx == 0 is used to signal that all parent block's transaction data is available.
+        // All parents having had data (at some point) is equivalent to all parents being VALID_TRANSACTIONS, which is equivalent to nChainTx being set.
+        assert((pindexFirstNeverProcessed != NULL) == (pindex->nChainTx == 0));                                      // nChainTx != 0 is used to signal that all parent blocks have been processed (but may have been pruned).
         assert(pindex->nHeight == nHeight);                                                                          // nHeight must be consistent.
         assert(pindex->pprev == NULL || pindex->nChainWork >= pindex->pprev->nChainWork);                            // For every block except the genesis block, the chainwork must be larger than the parent's.
         assert(nHeight < 2 || (pindex->pskip && (pindex->pskip->nHeight < nHeight)));                                // The pskip pointer must point back for all but the first 2 blocks.
@@ -5712,9 +6741,18 @@ void static CheckBlockIndex()
             // Checks for not-invalid blocks.
             assert((pindex->nStatus & BLOCK_FAILED_MASK) == 0); // The failed mask cannot be set for blocks without invalid parents.
         }
-        if (!CBlockIndexWorkComparator()(pindex, chainActive.Tip()) && pindexFirstMissing == NULL) {
-            if (pindexFirstInvalid == NULL) { // If this block sorts at least as good as the current tip and is valid, it must be in setBlockIndexCandidates.
-                assert(setBlockIndexCandidates.count(pindex));
+        if (!CBlockIndexWorkComparator()(pindex, chainActive.Tip()) && pindexFirstNeverProcessed == NULL) {
+            if (pindexFirstInvalid == NULL) {
+                // If this block sorts at least as good as the current tip and
+                // is valid and we have all data for its parents, it must be in
+                // setBlockIndexCandidates. chainActive.Tip() must also be there
+                // even if some data has been pruned.
+                if (pindexFirstMissing == NULL || pindex == chainActive.Tip()) {
+                    assert(setBlockIndexCandidates.count(pindex));
+                }
+                // If some parent is missing, then it could be that this block was in
+                // setBlockIndexCandidates but had to be removed because of the missing data.
+                // In this case it must be in mapBlocksUnlinked -- see test below.
             }
         } else { // If this block sorts worse than the current tip, it cannot be in setBlockIndexCandidates.
             assert(setBlockIndexCandidates.count(pindex) == 0);
@@ -5730,12 +6768,28 @@ void static CheckBlockIndex()
             }
             rangeUnlinked.first++;
         }
-        if (pindex->pprev && pindex->nStatus & BLOCK_HAVE_DATA && pindexFirstMissing != NULL) {
-            if (pindexFirstInvalid == NULL) { // If this block has block data available, some parent doesn't, and has no invalid parents, it must be in mapBlocksUnlinked.
-                assert(foundInUnlinked);
+        if (pindex->pprev && (pindex->nStatus & BLOCK_HAVE_DATA) && pindexFirstNeverProcessed != NULL && pindexFirstInvalid == NULL) {
+            // If this block has block data available, some parent was never received, and has no invalid parents, it must be in mapBlocksUnlinked.
+            assert(foundInUnlinked);
+        }
+        if (!(pindex->nStatus & BLOCK_HAVE_DATA)) assert(!foundInUnlinked); // Can't be in mapBlocksUnlinked if we don't HAVE_DATA
+        if (pindexFirstMissing == NULL) assert(!foundInUnlinked);           // We aren't missing data for any parent -- cannot be in mapBlocksUnlinked.
+        if (pindex->pprev && (pindex->nStatus & BLOCK_HAVE_DATA) && pindexFirstNeverProcessed == NULL && pindexFirstMissing != NULL) {
+            // We HAVE_DATA for this block, have received data for all parents at some point, but we're currently missing data for some parent.
+            assert(fHavePruned); // We must have pruned.
+            // This block may have entered mapBlocksUnlinked if:
+            //  - it has a descendant that at some point had more work than the
+            //    tip, and
+            //  - we tried switching to that descendant but were missing
+            //    data for some intermediate block between chainActive and the
+            //    tip.
+            // So if this block is itself better than chainActive.Tip() and it wasn't in
+            // setBlockIndexCandidates, then it must be in mapBlocksUnlinked.
+            if (!CBlockIndexWorkComparator()(pindex, chainActive.Tip()) && setBlockIndexCandidates.count(pindex) == 0) {
+                if (pindexFirstInvalid == NULL) {
+                    assert(foundInUnlinked);
+                }
             }
-        } else { // If this block does not have block data available, or all parents do, it cannot be in mapBlocksUnlinked.
-            assert(!foundInUnlinked);
         }
         // assert(pindex->GetBlockHash() == pindex->GetBlockHeader().GetHash()); // Perhaps too slow
         // End: actual consistency checks.
@@ -5755,6 +6809,7 @@ void static CheckBlockIndex()
             // If pindex was the first with a certain property, unset the corresponding variable.
             if (pindex == pindexFirstInvalid) pindexFirstInvalid = NULL;
             if (pindex == pindexFirstMissing) pindexFirstMissing = NULL;
+            if (pindex == pindexFirstNeverProcessed) pindexFirstNeverProcessed = NULL;
             if (pindex == pindexFirstNotTreeValid) pindexFirstNotTreeValid = NULL;
             if (pindex == pindexFirstNotChainValid) pindexFirstNotChainValid = NULL;
             if (pindex == pindexFirstNotScriptsValid) pindexFirstNotScriptsValid = NULL;
@@ -5947,7 +7002,7 @@ void static ProcessGetData(CNode* pfrom)
                 if (send && (mi->second->nStatus & BLOCK_HAVE_DATA)) {
                     // Send block from disk
                     CBlock block;
-                    if (!ReadBlockFromDisk(block, (*mi).second))
+                    if (!ReadTrustedBlockFromDisk(block, (*mi).second))
                         assert(!"cannot load block from disk");
                     if (inv.type == MSG_BLOCK)
                         pfrom->PushMessageWithFlag(SERIALIZE_TRANSACTION_NO_WITNESS, NetMsgType::BLOCK, block);
@@ -5967,7 +7022,7 @@ void static ProcessGetData(CNode* pfrom)
                             // however we MUST always provide at least what the remote peer needs
                             typedef std::pair<unsigned int, uint256> PairType;
                             for (PairType& pair : merkleBlock.vMatchedTxn)
-                                if (!pfrom->setInventoryKnown.count(CInv(MSG_TX, pair.second)))
+                                if (!pfrom->filterInventoryKnown.contains(CInv(MSG_TX, pair.second).GetKey()))
                                     pfrom->PushMessageWithFlag(SERIALIZE_TRANSACTION_NO_WITNESS, NetMsgType::TX, block.vtx[pair.first]);
                         }
                         // else
@@ -5989,10 +7044,10 @@ void static ProcessGetData(CNode* pfrom)
                 // Send stream from relay memory
                 bool pushed = false;
                 {
-                    LOCK(cs_mapRelay);
-                    map<CInv, CDataStream>::iterator mi = mapRelay.find(inv);
-                    if (mi != mapRelay.end()) {
-                        pfrom->PushMessageWithFlag(inv.type == MSG_WITNESS_TX ? 0 : SERIALIZE_TRANSACTION_NO_WITNESS, inv.GetCommand(), (*mi).second);
+                    CSerializeDataRef payload;
+                    unsigned int nChecksum;
+                    if (relayCache.Find(inv, payload, nChecksum)) {
+                        pfrom->PushSharedMessage(inv.GetCommand(), payload, nChecksum);
                         pushed = true;
                     }
                 }
@@ -6342,7 +7397,7 @@ bool static ProcessMessage(CNode* pfrom, string strCommand, CDataStream& vRecv,
                 {
                     LOCK(cs_vNodes);
                     // Use deterministic randomness to send to the same nodes for 24 hours
-                    // at a time so the setAddrKnowns of the chosen nodes prevent repeats
+                    // at a time so the addrKnowns of the chosen nodes prevent repeats
                     static uint256 hashSalt;
                     if (hashSalt == 0)
                         hashSalt = GetRandHash();
@@ -7206,9 +8261,9 @@ bool SendMessages(CNode* pto, bool fSendTrickle)
         if (!IsInitialBlockDownload() && (GetTime() - nLastRebroadcast > 24 * 60 * 60)) {
             LOCK(cs_vNodes);
             for (CNode* pnode : vNodes) {
-                // Periodically clear setAddrKnown to allow refresh broadcasts
+                // Periodically clear addrKnown to allow refresh broadcasts
                 if (nLastRebroadcast)
-                    pnode->setAddrKnown.clear();
+                    pnode->addrKnown.reset();
 
                 // Rebroadcast our address
                 AdvertizeLocal(pnode);
@@ -7224,8 +8279,8 @@ bool SendMessages(CNode* pto, bool fSendTrickle)
             vector<CAddress> vAddr;
             vAddr.reserve(pto->vAddrToSend.size());
             for (const CAddress& addr : pto->vAddrToSend) {
-                // returns true if wasn't already contained in the set
-                if (pto->setAddrKnown.insert(addr).second) {
+                if (!pto->addrKnown.contains(addr.GetKey())) {
+                    pto->addrKnown.insert(addr.GetKey());
                     vAddr.push_back(addr);
                     // receiver rejects addr messages larger than 1000
                     if (vAddr.size() >= 1000) {
@@ -7291,7 +8346,8 @@ bool SendMessages(CNode* pto, bool fSendTrickle)
             vInv.reserve(pto->vInventoryToSend.size());
             vInvWait.reserve(pto->vInventoryToSend.size());
             for (const CInv& inv : pto->vInventoryToSend) {
-                if ((inv.type == MSG_TX || inv.type == MSG_WITNESS_TX) && pto->setInventoryKnown.count(inv))
+                const std::vector<unsigned char> vKey = inv.GetKey();
+                if ((inv.type == MSG_TX || inv.type == MSG_WITNESS_TX) && pto->filterInventoryKnown.contains(vKey))
                     continue;
 
                 // trickle out tx inv to protect privacy
@@ -7310,8 +8366,8 @@ bool SendMessages(CNode* pto, bool fSendTrickle)
                     }
                 }
 
-                // returns true if wasn't already contained in the set
-                if (pto->setInventoryKnown.insert(inv).second) {
+                if (!pto->filterInventoryKnown.contains(vKey)) {
+                    pto->filterInventoryKnown.insert(vKey);
                     vInv.push_back(inv);
                     if (vInv.size() >= 1000) {
                         pto->PushMessage(NetMsgType::INV, vInv);
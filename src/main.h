@@ -19,6 +19,7 @@
 #include "chainparams.h"
 #include "coins.h"
 #include "consensus/validation.h"
+#include "crypto/common.h"
 #include "net.h"
 #include "pow.h"
 #include "primitives/block.h"
@@ -45,6 +46,7 @@
 
 #include "libzerocoin/CoinSpend.h"
 
+#include <boost/function.hpp>
 #include <boost/unordered_map.hpp>
 
 class CBlockIndex;
@@ -92,12 +94,28 @@ static const unsigned int MAX_BLOCKFILE_SIZE = 0x8000000; // 128 MiB
 static const unsigned int BLOCKFILE_CHUNK_SIZE = 0x1000000; // 16 MiB
 /** The pre-allocation chunk size for rev?????.dat files (since 0.8) */
 static const unsigned int UNDOFILE_CHUNK_SIZE = 0x100000; // 1 MiB
+/** Minimum number of blocks kept on disk in prune mode, to be able to disconnect them in a reorg */
+static const unsigned int MIN_BLOCKS_TO_KEEP = 288;
+/** Smallest -prune target, in bytes, for block and undo files (blk?????.dat and rev?????.dat) */
+static const uint64_t MIN_DISK_SPACE_FOR_BLOCK_FILES = 550 * 1024 * 1024;
+/** Maximum number of idle read-only block file handles kept open for transaction lookups */
+static const unsigned int MAX_BLOCKFILE_READ_HANDLES = 16;
+/** Maximum number of block files kept memory-mapped for block reads */
+static const unsigned int MAX_BLOCKFILE_MAPPINGS = 8;
+/** How far ahead of a sequential reader mapped block file pages are prefetched */
+static const unsigned int BLOCKFILE_READAHEAD_SIZE = 0x800000; // 8 MiB
+/** Maximum number of threads parsing block files during -reindex; -par limits them further */
+static const int MAX_REINDEX_PARSE_THREADS = 8;
+/** How many blocks the -reindex parser threads may run ahead of block processing */
+static const unsigned int REINDEX_PARSE_WINDOW = 256;
 /** Coinbase transaction outputs can only be spent after this number of new blocks (network rule) */
 static const int COINBASE_MATURITY = 50;
 /** Maximum number of script-checking threads allowed */
 static const int MAX_SCRIPTCHECK_THREADS = 16;
 /** -par default (number of script-checking threads, 0 = auto) */
 static const int DEFAULT_SCRIPTCHECK_THREADS = 0;
+/** Memory in MiB for zerocoin spend proofs already verified against their accumulator */
+static const unsigned int ZEROCOIN_SPEND_CACHE_SIZE = 1;
 /** Number of blocks that can be requested at any given time from a single peer. */
 static const int MAX_BLOCKS_IN_TRANSIT_PER_PEER = 16;
 /** Timeout in seconds during which a peer must stall block download progress before being disconnected. */
@@ -123,6 +141,11 @@ static const unsigned int MAX_STANDARD_P2WSH_STACK_ITEM_SIZE = 80;
 /** The maximum size of a standard witnessScript */
 static const unsigned int MAX_STANDARD_P2WSH_SCRIPT_SIZE = 3600;
 
+/** Layout version of the address index (-addrindex); older indexes have to be rebuilt with -reindex */
+static const int ADDRESS_INDEX_VERSION = 2;
+/** Default for -addrindex */
+static const bool DEFAULT_ADDRINDEX = true;
+
 /** Enable bloom filter */
  static const bool DEFAULT_PEERBLOOMFILTERS = true;
 
@@ -152,6 +175,14 @@ extern unsigned int nCoinCacheSize;
 extern CFeeRate minRelayTxFee;
 extern bool fAlerts;
 extern bool fVerifyingBlocks;
+/** True if we're running in -prune mode. */
+extern bool fPruneMode;
+/** True if any block files have ever been pruned. */
+extern bool fHavePruned;
+/** Number of bytes of block and undo files that we're trying to stay below. */
+extern uint64_t nPruneTarget;
+/** Block whose ancestors on the best header chain skip script and zerocoin spend signature checks (0 to verify all). */
+extern uint256 hashAssumeValid;
 
 extern bool fLargeWorkForkFound;
 extern bool fLargeWorkInvalidChainFound;
@@ -208,6 +239,14 @@ FILE* OpenUndoFile(const CDiskBlockPos& pos, bool fReadOnly = false);
 boost::filesystem::path GetBlockPosFilename(const CDiskBlockPos& pos, const char* prefix);
 /** Import blocks from an external file */
 bool LoadExternalBlockFile(FILE* fileIn, CDiskBlockPos* dbp = NULL);
+/** Import the blocks of a block file during -reindex, parsing them on several threads. Returns false if the file can't be mapped. */
+bool ReindexBlockFile(const CDiskBlockPos& pos);
+/**
+ * Parse the blocks found in a block file image on nThreads threads and hand
+ * each one to process in file order, with its hash and offset, until process
+ * returns false. Blocks whose context-free checks passed are marked checked.
+ */
+void ParseBlockFile(const char* pbegin, uint64_t nSize, int nThreads, const boost::function<bool(CBlock&, const uint256&, unsigned int)>& process);
 /** Initialize a new block tree database + block data on disk */
 bool InitBlockIndex();
 /** Load the block tree and coins database from disk */
@@ -238,6 +277,8 @@ bool IsInitialBlockDownload();
 std::string GetWarnings(std::string strFor);
 /** Retrieve a transaction (from memory pool, or from disk, if possible) */
 bool GetTransaction(const uint256& hash, CTransaction& tx, uint256& hashBlock, bool fAllowSlow = false);
+/** Retrieve a transaction of the active chain whose height is known, e.g. from zerocoinDB; works without -txindex unless the block was pruned */
+bool GetTransactionAtHeight(const uint256& hash, int nHeight, CTransaction& tx, uint256& hashBlock);
 /** Find the best known block, and make it the tip of the block chain */
 
 bool DisconnectBlocksAndReprocess(int blocks);
@@ -261,6 +302,34 @@ bool GetNodeStateStats(NodeId nodeid, CNodeStateStats& stats);
 void Misbehaving(NodeId nodeid, int howmuch);
 /** Flush all state, indexes and buffers to disk. */
 void FlushStateToDisk();
+/** Prune block files and flush state to disk. */
+void PruneAndFlush();
+/** Calculate the amount of disk space the block & undo files currently use */
+uint64_t CalculateCurrentUsage();
+/**
+ *  Mark one block file as pruned: its blocks lose their data and undo
+ *  positions in the block index and the file info is reset.
+ */
+void PruneOneBlockFile(const int fileNumber);
+/** Actually unlink the specified files */
+void UnlinkPrunedFiles(std::set<int>& setFilesToPrune);
+
+/** Lowest height from which every block up to the tip is still stored (0 if none were pruned). Requires cs_main. */
+int GetPruneHeight();
+
+/**
+ * Keeps a block file from being pruned while a block is read from it without
+ * holding cs_main. Create it under cs_main, after checking BLOCK_HAVE_DATA.
+ */
+class CBlockFilePin
+{
+private:
+    int nFile;
+
+public:
+    explicit CBlockFilePin(int nFileIn);
+    ~CBlockFilePin();
+};
 
 
 /** (try to) add transaction to memory pool **/
@@ -353,6 +422,180 @@ struct CExtDiskTxPos : public CDiskTxPos
     }
 };
 
+/**
+ * Key of one address index entry: a single input or output of a transaction
+ * touching the address. Height, transaction index and input/output index are
+ * stored big-endian so that the entries of an address sort in chain order and
+ * a history can be read page by page from any position.
+ */
+struct CAddressIndexKey
+{
+    uint160 addrid;
+    unsigned int nHeight;
+    unsigned int nTxIndex;
+    uint256 txhash;
+    bool fSpending;
+    unsigned int nIndex;
+
+    CAddressIndexKey()
+    {
+        SetNull();
+    }
+
+    CAddressIndexKey(const uint160& addridIn, unsigned int nHeightIn, unsigned int nTxIndexIn, const uint256& txhashIn, bool fSpendingIn, unsigned int nIndexIn)
+        : addrid(addridIn), nHeight(nHeightIn), nTxIndex(nTxIndexIn), txhash(txhashIn), fSpending(fSpendingIn), nIndex(nIndexIn) {}
+
+    void SetNull()
+    {
+        addrid.SetNull();
+        nHeight = 0;
+        nTxIndex = 0;
+        txhash.SetNull();
+        fSpending = false;
+        nIndex = 0;
+    }
+
+    unsigned int GetSerializeSize(int nType, int nVersion) const
+    {
+        return 20 + 4 + 4 + 32 + 1 + 4;
+    }
+
+    template <typename Stream>
+    void Serialize(Stream& s, int nType, int nVersion) const
+    {
+        unsigned char buf[4];
+        addrid.Serialize(s, nType, nVersion);
+        WriteBE32(buf, nHeight);
+        s.write((char*)buf, 4);
+        WriteBE32(buf, nTxIndex);
+        s.write((char*)buf, 4);
+        txhash.Serialize(s, nType, nVersion);
+        char ch = fSpending ? 1 : 0;
+        s.write(&ch, 1);
+        WriteBE32(buf, nIndex);
+        s.write((char*)buf, 4);
+    }
+
+    template <typename Stream>
+    void Unserialize(Stream& s, int nType, int nVersion)
+    {
+        unsigned char buf[4];
+        addrid.Unserialize(s, nType, nVersion);
+        s.read((char*)buf, 4);
+        nHeight = ReadBE32(buf);
+        s.read((char*)buf, 4);
+        nTxIndex = ReadBE32(buf);
+        txhash.Unserialize(s, nType, nVersion);
+        char ch;
+        s.read(&ch, 1);
+        fSpending = ch != 0;
+        s.read((char*)buf, 4);
+        nIndex = ReadBE32(buf);
+    }
+};
+
+/** Value of an address index entry: the amount the address gained (negative
+ *  when spending) and where the transaction is stored. */
+struct CAddressIndexValue
+{
+    CAmount nValue;
+    CDiskTxPos pos;
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action, int nType, int nVersion)
+    {
+        READWRITE(nValue);
+        READWRITE(pos);
+    }
+
+    CAddressIndexValue() : nValue(0) {}
+    CAddressIndexValue(CAmount nValueIn, const CDiskTxPos& posIn) : nValue(nValueIn), pos(posIn) {}
+};
+
+/** Key of an unspent output paying to an indexed address. */
+struct CAddressUnspentKey
+{
+    uint160 addrid;
+    uint256 txhash;
+    unsigned int nIndex;
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action, int nType, int nVersion)
+    {
+        READWRITE(addrid);
+        READWRITE(txhash);
+        READWRITE(nIndex);
+    }
+
+    CAddressUnspentKey() : nIndex(0) {}
+    CAddressUnspentKey(const uint160& addridIn, const uint256& txhashIn, unsigned int nIndexIn)
+        : addrid(addridIn), txhash(txhashIn), nIndex(nIndexIn) {}
+};
+
+/** An unspent output paying to an indexed address. A null value marks an
+ *  output that was spent and has to be removed from the index. */
+struct CAddressUnspentValue
+{
+    CAmount nValue;
+    CScript script;
+    int nHeight;
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action, int nType, int nVersion)
+    {
+        READWRITE(nValue);
+        READWRITE(script);
+        READWRITE(nHeight);
+    }
+
+    CAddressUnspentValue()
+    {
+        SetNull();
+    }
+
+    CAddressUnspentValue(CAmount nValueIn, const CScript& scriptIn, int nHeightIn)
+        : nValue(nValueIn), script(scriptIn), nHeight(nHeightIn) {}
+
+    void SetNull()
+    {
+        nValue = -1;
+        script.clear();
+        nHeight = 0;
+    }
+
+    bool IsNull() const
+    {
+        return nValue == -1;
+    }
+};
+
+/** Running totals of an indexed address, kept so that balance queries do not
+ *  have to walk the history. */
+struct CAddressSummary
+{
+    CAmount nBalance;
+    CAmount nReceived;
+    uint64_t nTxCount;
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action, int nType, int nVersion)
+    {
+        READWRITE(nBalance);
+        READWRITE(nReceived);
+        READWRITE(VARINT(nTxCount));
+    }
+
+    CAddressSummary() : nBalance(0), nReceived(0), nTxCount(0) {}
+};
+
 CAmount GetMinRelayFee(const CTransaction& tx, unsigned int nBytes, bool fAllowFree);
 bool MoneyRange(CAmount nValueOut);
 
@@ -414,7 +657,7 @@ void UpdateCoins(const CTransaction& tx, CValidationState& state, CCoinsViewCach
 bool CheckTransaction(const CTransaction& tx, bool fZerocoinActive, bool fRejectBadUTXO, CValidationState& state, bool fWitnessActive);
 bool CheckZerocoinMint(const uint256& txHash, const CTxOut& txout, CValidationState& state, bool fCheckOnly = false);
 bool CheckZerocoinSpend(const CTransaction& tx, bool fVerifySignature, CValidationState& state);
-bool ContextualCheckZerocoinSpend(const CTransaction& tx, const libzerocoin::CoinSpend& spend, CBlockIndex* pindex);
+bool ContextualCheckZerocoinSpend(const CTransaction& tx, const libzerocoin::CoinSpend& spend, CBlockIndex* pindex, const uint256& hashBlock, bool fCheckSignature);
 libzerocoin::CoinSpend TxInToZerocoinSpend(const CTxIn& txin);
 bool TxOutToPublicCoin(const CTxOut txout, libzerocoin::PublicCoin& pubCoin, CValidationState& state);
 bool BlockToPubcoinList(const CBlock& block, list<libzerocoin::PublicCoin>& listPubcoins);
@@ -434,8 +677,10 @@ libzerocoin::ZerocoinParams* GetZerocoinParams(int nHeight);
 bool IsTransactionInChain(const uint256& txId, int& nHeightTx, CTransaction& tx);
 bool IsTransactionInChain(const uint256& txId, int& nHeightTx);
 bool IsBlockHashInChain(const uint256& hashBlock);
-void RecalculateZHLIXSpent();
-void RecalculateZHLIXMinted();
+/** Rebuild the supply totals from each block's supply record, or the block
+ *  itself when it has none. False if neither is available (pruned). */
+bool RecalculateZHLIXSpent();
+bool RecalculateZHLIXMinted();
 bool RecalculateHLIXSupply(int nHeightStart);
 bool ReindexAccumulators(list<uint256>& listMissingCheckpoints, string& strError);
 
@@ -515,10 +760,35 @@ public:
 
 /** Functions for disk access for blocks */
 bool WriteBlockToDisk(CBlock& block, CDiskBlockPos& pos);
-bool ReadBlockFromDisk(CBlock& block, const CDiskBlockPos& pos);
+bool ReadBlockFromDisk(CBlock& block, const CDiskBlockPos& pos, bool fCheckPoW = true);
 bool ReadBlockFromDisk(CBlock& block, const CBlockIndex* pindex);
+/**
+ * Read a block that was fully validated before it was stored. Instead of
+ * recomputing the proof of work and block hash, the header is compared field
+ * by field with the index and the transactions are checked against its merkle
+ * root. Falls back to ReadBlockFromDisk for blocks that are not known valid.
+ */
+bool ReadTrustedBlockFromDisk(CBlock& block, const CBlockIndex* pindex);
+/**
+ * Append a block that came with a UTXO snapshot, and its undo data if given,
+ * to the block files before the block index is loaded, and point diskindex at
+ * them. FlushBlockFileInfo must be called once all of them are stored.
+ */
+bool StoreSnapshotBlock(CBlock& block, CBlockUndo* pblockundo, CDiskBlockIndex& diskindex);
+/** Write the block file information changed since the last flush to the block tree database */
+bool FlushBlockFileInfo();
+/** Name the block stored at pos from the block index, without hashing its header. Requires cs_main. */
+bool LookupBlockHashByPos(const CDiskTxPos& pos, uint256& hashBlock);
+/**
+ * Read the transaction at pos. Takes no locks: callers name the block with
+ * LookupBlockHashByPos beforehand, otherwise (hashBlock null on entry) it is
+ * hashed from the block header.
+ */
 bool ReadTransaction(CTransaction& tx, const CDiskTxPos &pos, uint256 &hashBlock);
-bool FindTransactionsByDestination(const CTxDestination &dest, std::set<CExtDiskTxPos> &setpos);
+/** Map a destination to the id its entries are stored under in the address index. */
+bool GetAddressIndexId(const CTxDestination& dest, uint160& addrid);
+/** Ids an output script is stored under in the address index; none if it pays no address. */
+void GetAddrIndexIds(const CScript& script, std::vector<uint160>& vIds);
 
 
 /** Functions for validating blocks and updating the block tree */
@@ -544,6 +814,8 @@ bool CheckWork(const CBlock block, CBlockIndex* const pindexPrev);
 
 /** Context-dependent validity checks */
 bool ContextualCheckBlockHeader(const CBlockHeader& block, CValidationState& state, CBlockIndex* pindexPrev);
+/** Whether the block is covered by -assumevalid, so ConnectBlock skips its script and zerocoin spend signature checks */
+bool IsAssumedValid(const CBlockIndex* pindex);
 bool ContextualCheckBlock(const CBlock& block, CValidationState& state, CBlockIndex* pindexPrev);
 
 /** Check a block is completely valid from start to finish (only works on top of our current best block, with cs_main held) */
@@ -664,5 +936,6 @@ int64_t GetVirtualTransactionSize(const CTransaction& tx);
 int64_t GetVirtualTransactionSize(int64_t nCost);
 
 void InitScriptExecutionCache();
+void InitZerocoinSpendCache();
 
 #endif // BITCOIN_MAIN_H
@@ -0,0 +1,133 @@
+// Copyright (c) 2018-2019 The Helix developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "muhash.h"
+
+#include "crypto/sha256.h"
+#include "hash.h"
+#include "uint256.h"
+
+#include <stdexcept>
+
+static const int MUHASH_BYTES = 384;
+
+/** The modulus and its Montgomery context, shared read-only by all instances */
+class CMuHashModulus
+{
+public:
+    BIGNUM* bnPrime;
+    //! 2^3072 mod prime
+    BIGNUM* bnR;
+    BN_MONT_CTX* pmont;
+
+    CMuHashModulus()
+    {
+        BN_CTX* pctx = BN_CTX_new();
+        bnPrime = BN_new();
+        bnR = BN_new();
+        pmont = BN_MONT_CTX_new();
+        if (!pctx || !bnPrime || !bnR || !pmont ||
+            !BN_set_word(bnR, 1103717) ||
+            !BN_lshift(bnPrime, BN_value_one(), 3072) ||
+            !BN_sub(bnPrime, bnPrime, bnR) ||
+            !BN_MONT_CTX_set(pmont, bnPrime, pctx))
+            throw std::runtime_error("CMuHashModulus : initialization failed");
+        BN_CTX_free(pctx);
+    }
+
+    ~CMuHashModulus()
+    {
+        BN_MONT_CTX_free(pmont);
+        BN_free(bnR);
+        BN_free(bnPrime);
+    }
+};
+
+static const CMuHashModulus& GetModulus()
+{
+    static CMuHashModulus modulus;
+    return modulus;
+}
+
+CMuHash3072::CMuHash3072() : bnProduct(BN_new()), nMontgomery(0), pctx(BN_CTX_new())
+{
+    if (!bnProduct || !pctx || !BN_one(bnProduct))
+        throw std::runtime_error("CMuHash3072 : BN_new failed");
+}
+
+CMuHash3072::CMuHash3072(const CMuHash3072& other) : bnProduct(BN_dup(other.bnProduct)), nMontgomery(other.nMontgomery), pctx(BN_CTX_new())
+{
+    if (!bnProduct || !pctx)
+        throw std::runtime_error("CMuHash3072 : BN_dup failed");
+}
+
+CMuHash3072::~CMuHash3072()
+{
+    BN_CTX_free(pctx);
+    BN_clear_free(bnProduct);
+}
+
+CMuHash3072& CMuHash3072::operator=(const CMuHash3072& other)
+{
+    if (!BN_copy(bnProduct, other.bnProduct))
+        throw std::runtime_error("CMuHash3072 : BN_copy failed");
+    nMontgomery = other.nMontgomery;
+    return *this;
+}
+
+CMuHash3072& CMuHash3072::Insert(const unsigned char* pch, size_t nSize)
+{
+    // Expand the element to 3072 bits with SHA256 in counter mode
+    uint256 seed = Hash(pch, pch + nSize);
+    unsigned char vch[MUHASH_BYTES];
+    for (unsigned char i = 0; i < MUHASH_BYTES / CSHA256::OUTPUT_SIZE; i++)
+        CSHA256().Write(seed.begin(), seed.size()).Write(&i, 1).Finalize(vch + i * CSHA256::OUTPUT_SIZE);
+
+    const CMuHashModulus& modulus = GetModulus();
+    BN_CTX_start(pctx);
+    BIGNUM* bnElement = BN_CTX_get(pctx);
+    bool fOk = bnElement && BN_bin2bn(vch, MUHASH_BYTES, bnElement) &&
+               (BN_cmp(bnElement, modulus.bnPrime) < 0 || BN_sub(bnElement, bnElement, modulus.bnPrime));
+    // A Montgomery multiplication is about twice as fast as BN_mod_mul; its
+    // 2^-3072 factor is only corrected for once, in Finalize
+    fOk = fOk && BN_mod_mul_montgomery(bnProduct, bnProduct, bnElement, modulus.pmont, pctx);
+    BN_CTX_end(pctx);
+    if (!fOk)
+        throw std::runtime_error("CMuHash3072::Insert : BN operation failed");
+    nMontgomery++;
+    return *this;
+}
+
+CMuHash3072& CMuHash3072::Combine(const CMuHash3072& other)
+{
+    if (!BN_mod_mul_montgomery(bnProduct, bnProduct, other.bnProduct, GetModulus().pmont, pctx))
+        throw std::runtime_error("CMuHash3072::Combine : BN operation failed");
+    nMontgomery += other.nMontgomery + 1;
+    return *this;
+}
+
+uint256 CMuHash3072::Finalize() const
+{
+    const CMuHashModulus& modulus = GetModulus();
+    unsigned char vch[MUHASH_BYTES] = {};
+    BN_CTX_start(pctx);
+    BIGNUM* bnExponent = BN_CTX_get(pctx);
+    BIGNUM* bnResult = BN_CTX_get(pctx);
+    bool fOk = bnResult != NULL;
+    if (fOk)
+        BN_zero(bnExponent);
+    for (int i = 0; i < 64; i++)
+        if ((nMontgomery >> i) & 1)
+            fOk = fOk && BN_set_bit(bnExponent, i);
+    fOk = fOk && BN_mod_exp(bnResult, modulus.bnR, bnExponent, modulus.bnPrime, pctx) &&
+          BN_mod_mul(bnResult, bnResult, bnProduct, modulus.bnPrime, pctx);
+    if (fOk) {
+        int nBytes = BN_num_bytes(bnResult);
+        BN_bn2bin(bnResult, vch + MUHASH_BYTES - nBytes);
+    }
+    BN_CTX_end(pctx);
+    if (!fOk)
+        throw std::runtime_error("CMuHash3072::Finalize : BN operation failed");
+    return Hash(vch, vch + MUHASH_BYTES);
+}
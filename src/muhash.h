@@ -0,0 +1,44 @@
+// Copyright (c) 2018-2019 The Helix developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef HELIX_MUHASH_H
+#define HELIX_MUHASH_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <openssl/bn.h>
+
+class uint256;
+
+/**
+ * Hash of a set of byte strings that does not depend on the order in which
+ * they were added: every element is mapped to a number modulo the prime
+ * 2^3072 - 1103717 and the set hash is their product. Hashes of disjoint
+ * sets can be combined with Combine, so a set can be hashed in parallel.
+ */
+class CMuHash3072
+{
+private:
+    //! Product of the elements, divided by R^nMontgomery with R = 2^3072
+    BIGNUM* bnProduct;
+    //! Number of Montgomery multiplications done on bnProduct
+    uint64_t nMontgomery;
+    BN_CTX* pctx;
+
+public:
+    CMuHash3072();
+    CMuHash3072(const CMuHash3072& other);
+    ~CMuHash3072();
+    CMuHash3072& operator=(const CMuHash3072& other);
+
+    //! Add an element to the set
+    CMuHash3072& Insert(const unsigned char* pch, size_t nSize);
+    //! Add all elements of a disjoint set
+    CMuHash3072& Combine(const CMuHash3072& other);
+    //! Digest of the set
+    uint256 Finalize() const;
+};
+
+#endif // HELIX_MUHASH_H
@@ -95,9 +95,7 @@ bool fAddressesInitialized = false;
 
 vector<CNode*> vNodes;
 CCriticalSection cs_vNodes;
-map<CInv, CDataStream> mapRelay;
-deque<pair<int64_t, CInv> > vRelayExpiration;
-CCriticalSection cs_mapRelay;
+CRelayCache relayCache;
 limitedmap<CInv, int64_t> mapAlreadyAskedFor(MAX_INV_SZ);
 
 static deque<string> vOneShots;
@@ -800,10 +798,10 @@ int CNetMessage::readData(const char* pch, unsigned int nBytes)
 // requires LOCK(cs_vSend)
 void SocketSendData(CNode* pnode)
 {
-    std::deque<CSerializeData>::iterator it = pnode->vSendMsg.begin();
+    std::deque<CSerializeDataRef>::iterator it = pnode->vSendMsg.begin();
 
     while (it != pnode->vSendMsg.end()) {
-        const CSerializeData& data = *it;
+        const CSerializeData& data = **it;
         assert(data.size() > pnode->nSendOffset);
         int nBytes = send(pnode->hSocket, &data[pnode->nSendOffset], data.size() - pnode->nSendOffset, MSG_NOSIGNAL | MSG_DONTWAIT);
         if (nBytes > 0) {
@@ -1837,18 +1835,9 @@ void RelayTransaction(const CTransaction& tx)
 void RelayTransaction(const CTransaction& tx, const CDataStream& ss)
 {
     CInv inv(MSG_TX, tx.GetHash());
-    {
-        LOCK(cs_mapRelay);
-        // Expire old relay messages
-        while (!vRelayExpiration.empty() && vRelayExpiration.front().first < GetTime()) {
-            mapRelay.erase(vRelayExpiration.front().second);
-            vRelayExpiration.pop_front();
-        }
+    // Save original serialized message so newer versions are preserved
+    relayCache.Insert(inv, std::make_shared<const CSerializeData>(ss.begin(), ss.end()));
 
-        // Save original serialized message so newer versions are preserved
-        mapRelay.insert(std::make_pair(inv, ss));
-        vRelayExpiration.push_back(std::make_pair(GetTime() + 15 * 60, inv));
-    }
     LOCK(cs_vNodes);
     for (CNode* pnode : vNodes) {
         if (!pnode->fRelayTxes)
@@ -1886,6 +1875,90 @@ void RelayInv(CInv& inv)
     }
 }
 
+static unsigned int MessageChecksum(const CSerializeData& payload)
+{
+    uint256 hash = Hash(payload.begin(), payload.end());
+    unsigned int nChecksum = 0;
+    memcpy(&nChecksum, &hash, sizeof(nChecksum));
+    return nChecksum;
+}
+
+CRelayCache::CRelayCache() : nBytes(0), nMaxBytes(DEFAULT_MAX_RELAY_CACHE * 1024 * 1024), nEvicted(0), nHits(0), nMisses(0)
+{
+}
+
+void CRelayCache::SetMaxBytes(size_t nMaxBytesIn)
+{
+    LOCK(cs);
+    nMaxBytes = nMaxBytesIn;
+}
+
+void CRelayCache::EraseFront()
+{
+    std::map<CInv, CRelayEntry>::iterator mi = mapRelay.find(vRelayExpiration.front().second);
+    if (mi != mapRelay.end()) {
+        nBytes -= mi->second.payload->size();
+        mapRelay.erase(mi);
+    }
+    vRelayExpiration.pop_front();
+}
+
+bool CRelayCache::Insert(const CInv& inv, const CSerializeDataRef& payload)
+{
+    LOCK(cs);
+    // Expire old relay messages
+    int64_t nNow = GetTime();
+    while (!vRelayExpiration.empty() && vRelayExpiration.front().first < nNow)
+        EraseFront();
+
+    if (mapRelay.count(inv))
+        return false;
+    // A single payload larger than the whole cache is only ever served from the mempool
+    if (payload->size() > nMaxBytes)
+        return false;
+
+    // Evict oldest entries until the new payload fits
+    while (!vRelayExpiration.empty() && nBytes + payload->size() > nMaxBytes) {
+        EraseFront();
+        nEvicted++;
+    }
+
+    CRelayEntry entry;
+    entry.payload = payload;
+    entry.nChecksum = MessageChecksum(*payload);
+    mapRelay.insert(std::make_pair(inv, entry));
+    vRelayExpiration.push_back(std::make_pair(nNow + RELAY_CACHE_EXPIRY, inv));
+    nBytes += payload->size();
+    return true;
+}
+
+bool CRelayCache::Find(const CInv& inv, CSerializeDataRef& payload, unsigned int& nChecksum)
+{
+    LOCK(cs);
+    std::map<CInv, CRelayEntry>::const_iterator mi = mapRelay.find(inv);
+    if (mi == mapRelay.end()) {
+        nMisses++;
+        return false;
+    }
+    nHits++;
+    payload = mi->second.payload;
+    nChecksum = mi->second.nChecksum;
+    return true;
+}
+
+CRelayCache::Stats CRelayCache::GetStats() const
+{
+    LOCK(cs);
+    Stats stats;
+    stats.nEntries = mapRelay.size();
+    stats.nBytes = nBytes;
+    stats.nMaxBytes = nMaxBytes;
+    stats.nEvicted = nEvicted;
+    stats.nHits = nHits;
+    stats.nMisses = nMisses;
+    return stats;
+}
+
 void CNode::RecordBytesRecv(uint64_t bytes)
 {
     LOCK(cs_totalBytesRecv);
@@ -2041,7 +2114,7 @@ bool CAddrDB::Read(CAddrMan& addr)
 unsigned int ReceiveFloodSize() { return 1000 * GetArg("-maxreceivebuffer", 5 * 1000); }
 unsigned int SendBufferSize() { return 1000 * GetArg("-maxsendbuffer", 1 * 1000); }
 
-CNode::CNode(SOCKET hSocketIn, CAddress addrIn, std::string addrNameIn, bool fInboundIn) : ssSend(SER_NETWORK, INIT_PROTO_VERSION), setAddrKnown(5000)
+CNode::CNode(SOCKET hSocketIn, CAddress addrIn, std::string addrNameIn, bool fInboundIn) : ssSend(SER_NETWORK, INIT_PROTO_VERSION), addrKnown(5000, 0.001), filterInventoryKnown(10000, 0.000001)
 {
     nServices = 0;
     nServicesExpected = 0;
@@ -2071,7 +2144,6 @@ CNode::CNode(SOCKET hSocketIn, CAddress addrIn, std::string addrNameIn, bool fIn
     nStartingHeight = -1;
     fGetAddr = false;
     fRelayTxes = false;
-    setInventoryKnown.max_size(SendBufferSize() / 1000);
     pfilter = new CBloomFilter();
     nPingNonceSent = 0;
     nPingUsecStart = 0;
@@ -2184,17 +2256,53 @@ void CNode::EndMessage() UNLOCK_FUNCTION(cs_vSend)
 
     LogPrint("net", "(%d bytes) peer=%d\n", nSize, id);
 
-    std::deque<CSerializeData>::iterator it = vSendMsg.insert(vSendMsg.end(), CSerializeData());
-    ssSend.GetAndClear(*it);
-    nSendSize += (*it).size();
+    std::shared_ptr<CSerializeData> pdata = std::make_shared<CSerializeData>();
+    ssSend.GetAndClear(*pdata);
+    nSendSize += pdata->size();
+    vSendMsg.push_back(pdata);
 
     // If write queue empty, attempt "optimistic write"
-    if (it == vSendMsg.begin())
+    if (vSendMsg.size() == 1)
         SocketSendData(this);
 
     LEAVE_CRITICAL_SECTION(cs_vSend);
 }
 
+void CNode::PushSharedMessage(const char* pszCommand, const CSerializeDataRef& payload, unsigned int nChecksum)
+{
+    // The -*messagestest options drop or modify ssSend in EndMessage, which must not
+    // touch the shared payload, so send a private copy through the normal path instead
+    if (mapArgs.count("-dropmessagestest") || mapArgs.count("-fuzzmessagestest")) {
+        BeginMessage(pszCommand);
+        ssSend.write(payload->data(), payload->size());
+        EndMessage();
+        return;
+    }
+
+    LOCK(cs_vSend);
+    assert(ssSend.size() == 0);
+
+    // The header is the only per-peer copy; the payload buffer is queued by reference
+    CMessageHeader hdr(pszCommand, payload->size());
+    hdr.nChecksum = nChecksum;
+    CDataStream ssHeader(SER_NETWORK, INIT_PROTO_VERSION);
+    ssHeader << hdr;
+    std::shared_ptr<CSerializeData> pheader = std::make_shared<CSerializeData>();
+    ssHeader.GetAndClear(*pheader);
+
+    LogPrint("net", "sending: %s (%d bytes, shared) peer=%d\n", SanitizeString(pszCommand), payload->size(), id);
+
+    bool fQueueEmpty = vSendMsg.empty();
+    nSendSize += pheader->size() + payload->size();
+    vSendMsg.push_back(pheader);
+    if (!payload->empty())
+        vSendMsg.push_back(payload);
+
+    // If write queue was empty, attempt "optimistic write"
+    if (fQueueEmpty)
+        SocketSendData(this);
+}
+
 //
 // CBanDB
 //
@@ -11,7 +11,6 @@
 #include "compat.h"
 #include "hash.h"
 #include "limitedmap.h"
-#include "mruset.h"
 #include "netbase.h"
 #include "protocol.h"
 #include "random.h"
@@ -21,6 +20,7 @@
 #include "utilstrencodings.h"
 
 #include <deque>
+#include <memory>
 #include <stdint.h>
 
 #ifndef WIN32
@@ -36,6 +36,7 @@ class CAddrMan;
 class CBlockIndex;
 class CScheduler;
 class CNode;
+class CRelayCache;
 
 /** Time between pings automatically sent out for latency probing and keepalive (in seconds). */
 static const int PING_INTERVAL = 2 * 60;
@@ -57,6 +58,10 @@ static const bool DEFAULT_UPNP = false;
 #endif
 /** The maximum number of entries in mapAskFor */
 static const size_t MAPASKFOR_MAX_SZ = MAX_INV_SZ;
+/** Default for -maxrelaycache, the relay cache size limit in megabytes */
+static const unsigned int DEFAULT_MAX_RELAY_CACHE = 50;
+/** Time a relayed transaction stays in the relay cache (in seconds) */
+static const int64_t RELAY_CACHE_EXPIRY = 15 * 60;
 
 unsigned int ReceiveFloodSize();
 unsigned int SendBufferSize();
@@ -128,9 +133,7 @@ extern int nMaxConnections;
 
 extern std::vector<CNode*> vNodes;
 extern CCriticalSection cs_vNodes;
-extern std::map<CInv, CDataStream> mapRelay;
-extern std::deque<std::pair<int64_t, CInv> > vRelayExpiration;
-extern CCriticalSection cs_mapRelay;
+extern CRelayCache relayCache;
 extern limitedmap<CInv, int64_t> mapAlreadyAskedFor;
 
 extern std::vector<std::string> vAddedNodes;
@@ -272,6 +275,54 @@ public:
 
 typedef std::map<CSubNet, CBanEntry> banmap_t;
 
+/** An immutable serialized message payload, shared between the relay cache and peer send queues */
+typedef std::shared_ptr<const CSerializeData> CSerializeDataRef;
+
+/**
+ * Serialized transactions we have announced, kept for answering getdata.
+ * Entries are shared, read-only buffers: a payload queued to many peers is
+ * held in memory once. Entries expire after RELAY_CACHE_EXPIRY, and the
+ * oldest are evicted early whenever the payload bytes exceed the limit.
+ */
+class CRelayCache
+{
+public:
+    struct Stats {
+        size_t nEntries;
+        size_t nBytes;
+        size_t nMaxBytes;
+        uint64_t nEvicted;
+        uint64_t nHits;
+        uint64_t nMisses;
+    };
+
+    CRelayCache();
+
+    void SetMaxBytes(size_t nMaxBytesIn);
+    //! Store a payload for inv; returns false if inv is already cached
+    bool Insert(const CInv& inv, const CSerializeDataRef& payload);
+    //! Look up a payload and its message checksum
+    bool Find(const CInv& inv, CSerializeDataRef& payload, unsigned int& nChecksum);
+    Stats GetStats() const;
+
+private:
+    struct CRelayEntry {
+        CSerializeDataRef payload;
+        unsigned int nChecksum;
+    };
+
+    mutable CCriticalSection cs;
+    std::map<CInv, CRelayEntry> mapRelay;
+    std::deque<std::pair<int64_t, CInv> > vRelayExpiration;
+    size_t nBytes;
+    size_t nMaxBytes;
+    uint64_t nEvicted;
+    uint64_t nHits;
+    uint64_t nMisses;
+
+    void EraseFront();
+};
+
 
 /** Information about a peer */
 class CNode
@@ -285,7 +336,7 @@ public:
     size_t nSendSize;   // total size of all vSendMsg entries
     size_t nSendOffset; // offset inside the first vSendMsg already sent
     uint64_t nSendBytes;
-    std::deque<CSerializeData> vSendMsg;
+    std::deque<CSerializeDataRef> vSendMsg;
     CCriticalSection cs_vSend;
 
     std::deque<CInv> vRecvGetData;
@@ -354,12 +405,12 @@ public:
 
     // flood relay
     std::vector<CAddress> vAddrToSend;
-    mruset<CAddress> setAddrKnown;
+    CRollingBloomFilter addrKnown;
     bool fGetAddr;
     std::set<uint256> setKnown;
 
     // inventory based relay
-    mruset<CInv> setInventoryKnown;
+    CRollingBloomFilter filterInventoryKnown;
     std::vector<CInv> vInventoryToSend;
     CCriticalSection cs_inventory;
     std::multimap<int64_t, CInv> mapAskFor;
@@ -434,7 +485,7 @@ public:
 
     void AddAddressKnown(const CAddress& addr)
     {
-        setAddrKnown.insert(addr);
+        addrKnown.insert(addr.GetKey());
     }
 
     void PushAddress(const CAddress& addr)
@@ -442,7 +493,7 @@ public:
         // Known checking here is only to save space from duplicates.
         // SendMessages will filter it again for knowns that were added
         // after addresses were pushed.
-        if (addr.IsValid() && !setAddrKnown.count(addr)) {
+        if (addr.IsValid() && !addrKnown.contains(addr.GetKey())) {
             if (vAddrToSend.size() >= MAX_ADDR_TO_SEND) {
                 vAddrToSend[insecure_rand() % vAddrToSend.size()] = addr;
             } else {
@@ -456,7 +507,7 @@ public:
     {
         {
             LOCK(cs_inventory);
-            setInventoryKnown.insert(inv);
+            filterInventoryKnown.insert(inv.GetKey());
         }
     }
 
@@ -464,7 +515,7 @@ public:
     {
         {
             LOCK(cs_inventory);
-            if ((inv.type == MSG_TX || inv.type == MSG_WITNESS_TX) && setInventoryKnown.count(inv))
+            if ((inv.type == MSG_TX || inv.type == MSG_WITNESS_TX) && filterInventoryKnown.contains(inv.GetKey()))
                 return;
             vInventoryToSend.push_back(inv);
         }
@@ -472,6 +523,12 @@ public:
 
     void AskFor(const CInv& inv);
 
+    /**
+     * Queue a message whose payload is already serialized and may be shared
+     * with other peers. The payload is referenced, not copied.
+     */
+    void PushSharedMessage(const char* pszCommand, const CSerializeDataRef& payload, unsigned int nChecksum);
+
     // TODO: Document the postcondition of this function.  Is cs_vSend locked?
     void BeginMessage(const char* pszCommand) EXCLUSIVE_LOCK_FUNCTION(cs_vSend);
 
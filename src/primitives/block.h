@@ -86,6 +86,13 @@ public:
     mutable CScript payee;
     mutable std::vector<uint256> vMerkleTree;
 
+private:
+    //! Proof of work, merkle root and block signature were already verified
+    //! by the -reindex parser threads. Copies start unchecked, since they
+    //! are usually made to be modified.
+    mutable bool fChecked;
+
+public:
     CBlock()
     {
         SetNull();
@@ -97,6 +104,23 @@ public:
         *((CBlockHeader*)this) = header;
     }
 
+    CBlock(const CBlock& other) : CBlockHeader(other), vtx(other.vtx), vchBlockSig(other.vchBlockSig),
+                                  payee(other.payee), vMerkleTree(other.vMerkleTree), fChecked(false) {}
+
+    CBlock& operator=(const CBlock& other)
+    {
+        CBlockHeader::operator=(other);
+        vtx = other.vtx;
+        vchBlockSig = other.vchBlockSig;
+        payee = other.payee;
+        vMerkleTree = other.vMerkleTree;
+        fChecked = false;
+        return *this;
+    }
+
+    bool IsChecked() const { return fChecked; }
+    void SetChecked() const { fChecked = true; }
+
     ADD_SERIALIZE_METHODS;
 
     template <typename Stream, typename Operation>
@@ -114,6 +138,7 @@ public:
         vMerkleTree.clear();
         payee = CScript();
         vchBlockSig.clear();
+        fChecked = false;
     }
 
     CBlockHeader GetBlockHeader() const
@@ -6,6 +6,7 @@
 #include "protocol.h"
 
 #include "chainparams.h"
+#include "crypto/common.h"
 #include "util.h"
 #include "utilstrencodings.h"
 
@@ -269,6 +270,14 @@ const char* CInv::GetCommand() const
         return "unknown";
 }
 
+std::vector<unsigned char> CInv::GetKey() const
+{
+    std::vector<unsigned char> vKey(hash.begin(), hash.end());
+    vKey.resize(36);
+    WriteLE32(&vKey[32], (uint32_t)type);
+    return vKey;
+}
+
 std::string CInv::ToString() const
 {
     return strprintf("%s %s", GetCommand(), hash.ToString());
@@ -387,6 +387,8 @@ public:
     bool IsKnownType() const;
     bool IsMasterNodeType() const;
     const char* GetCommand() const;
+    //! Compact key (hash followed by type) used by the per-peer known-inventory filters
+    std::vector<unsigned char> GetKey() const;
     std::string ToString() const;
 
     // TODO: make private (improves encapsulation)
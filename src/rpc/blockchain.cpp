@@ -11,6 +11,7 @@
 #include "consensus/validation.h"
 #include "main.h"
 #include "rpc/server.h"
+#include "snapshot.h"
 #include "sync.h"
 #include "txdb.h"
 #include "util.h"
@@ -380,7 +381,8 @@ UniValue blockheaderToJSON(const CBlockIndex* blockindex)
     return result;
 }
 
-UniValue blockToJSON(const CBlock& block, const CBlockIndex* blockindex, bool txDetails = false)
+/** Requires cs_main. Without fTxList "tx" is left null for the caller to fill in. */
+static UniValue blockToJSON(const CBlock& block, const CBlockIndex* blockindex, bool txDetails, bool fTxList)
 {
     UniValue result(UniValue::VOBJ);
     result.push_back(Pair("hash", block.GetHash().GetHex()));
@@ -405,8 +407,9 @@ UniValue blockToJSON(const CBlock& block, const CBlockIndex* blockindex, bool tx
     }
     result.push_back(Pair("merkleroot", block.hashMerkleRoot.GetHex()));
     result.push_back(Pair("acc_checkpoint", block.nAccumulatorCheckpoint.GetHex()));
-    UniValue txs(UniValue::VARR);
-    for (const CTransaction& tx : block.vtx) {
+    UniValue txs(fTxList ? UniValue::VARR : UniValue::VNULL);
+    for (unsigned int i = 0; fTxList && i < block.vtx.size(); i++) {
+        const CTransaction& tx = block.vtx[i];
         if (txDetails) {
             UniValue objTx(UniValue::VOBJ);
             TxToJSON(tx, uint256(0), objTx, true, RPCSerializationFlags());
@@ -440,6 +443,47 @@ UniValue blockToJSON(const CBlock& block, const CBlockIndex* blockindex, bool tx
     return result;
 }
 
+UniValue blockToJSON(const CBlock& block, const CBlockIndex* blockindex, bool txDetails = false)
+{
+    return blockToJSON(block, blockindex, txDetails, true);
+}
+
+/**
+ * Stream blockToJSON, writing transactions one at a time. Takes cs_main only
+ * for the header fields; do not call it with locks held, as the writer can
+ * block on a slow client.
+ */
+void blockToJSONStream(const CBlock& block, const CBlockIndex* blockindex, bool txDetails, CJSONStreamWriter& writer)
+{
+    UniValue header;
+    {
+        LOCK(cs_main);
+        header = blockToJSON(block, blockindex, txDetails, false);
+    }
+    const std::vector<std::string>& keys = header.getKeys();
+    const std::vector<UniValue>& values = header.getValues();
+
+    writer.BeginObject();
+    for (unsigned int i = 0; i < keys.size(); i++) {
+        writer.Key(keys[i]);
+        if (keys[i] != "tx") {
+            writer.Value(values[i]);
+            continue;
+        }
+        writer.BeginArray();
+        for (const CTransaction& tx : block.vtx) {
+            if (txDetails) {
+                UniValue objTx(UniValue::VOBJ);
+                TxToJSON(tx, uint256(0), objTx, true, RPCSerializationFlags());
+                writer.Value(objTx);
+            } else
+                writer.Value(tx.GetHash().GetHex());
+        }
+        writer.EndArray();
+    }
+    writer.EndObject();
+}
+
 UniValue getblockcount(const UniValue& params, bool fHelp)
 {
     if (fHelp || params.size() != 0)
@@ -532,36 +576,39 @@ UniValue getmoneysupply(const UniValue& params, bool fHelp) {
   return obj;
 }
 
+/** Requires mempool.cs */
+static UniValue mempoolEntryToJSON(const CTxMemPoolEntry& e)
+{
+    UniValue info(UniValue::VOBJ);
+    info.push_back(Pair("size", (int)e.GetTxSize()));
+    info.push_back(Pair("fee", ValueFromAmount(e.GetFee())));
+    info.push_back(Pair("time", e.GetTime()));
+    info.push_back(Pair("height", (int)e.GetHeight()));
+    info.push_back(Pair("startingpriority", e.GetPriority(e.GetHeight())));
+    info.push_back(Pair("currentpriority", e.GetPriority(chainActive.Height())));
+    const CTransaction& tx = e.GetTx();
+    set<string> setDepends;
+    for (const CTxIn& txin : tx.vin) {
+        if (mempool.exists(txin.prevout.hash))
+            setDepends.insert(txin.prevout.hash.ToString());
+    }
+
+    UniValue depends(UniValue::VARR);
+    for (const string& dep : setDepends) {
+        depends.push_back(dep);
+    }
+
+    info.push_back(Pair("depends", depends));
+    return info;
+}
+
 UniValue mempoolToJSON(bool fVerbose = false)
 {
     if (fVerbose) {
         LOCK(mempool.cs);
         UniValue o(UniValue::VOBJ);
-        for (const PAIRTYPE(uint256, CTxMemPoolEntry) & entry : mempool.mapTx) {
-            const uint256& hash = entry.first;
-            const CTxMemPoolEntry& e = entry.second;
-            UniValue info(UniValue::VOBJ);
-            info.push_back(Pair("size", (int)e.GetTxSize()));
-            info.push_back(Pair("fee", ValueFromAmount(e.GetFee())));
-            info.push_back(Pair("time", e.GetTime()));
-            info.push_back(Pair("height", (int)e.GetHeight()));
-            info.push_back(Pair("startingpriority", e.GetPriority(e.GetHeight())));
-            info.push_back(Pair("currentpriority", e.GetPriority(chainActive.Height())));
-            const CTransaction& tx = e.GetTx();
-            set<string> setDepends;
-            for (const CTxIn& txin : tx.vin) {
-                if (mempool.exists(txin.prevout.hash))
-                    setDepends.insert(txin.prevout.hash.ToString());
-            }
-
-            UniValue depends(UniValue::VARR);
-            for (const string& dep : setDepends) {
-                depends.push_back(dep);
-            }
-
-            info.push_back(Pair("depends", depends));
-            o.push_back(Pair(hash.ToString(), info));
-        }
+        for (const PAIRTYPE(uint256, CTxMemPoolEntry) & entry : mempool.mapTx)
+            o.push_back(Pair(entry.first.ToString(), mempoolEntryToJSON(entry.second)));
         return o;
     } else {
         vector<uint256> vtxid;
@@ -575,6 +622,32 @@ UniValue mempoolToJSON(bool fVerbose = false)
     }
 }
 
+/**
+ * Stream the verbose form of mempoolToJSON one entry at a time. mempool.cs is
+ * taken per entry rather than across writes, which can block on a slow
+ * client; transactions that leave the pool meanwhile are skipped.
+ */
+void mempoolToJSONStream(CJSONStreamWriter& writer)
+{
+    vector<uint256> vtxid;
+    mempool.queryHashes(vtxid);
+
+    writer.BeginObject();
+    for (const uint256& hash : vtxid) {
+        UniValue info;
+        {
+            LOCK(mempool.cs);
+            std::map<uint256, CTxMemPoolEntry>::const_iterator it = mempool.mapTx.find(hash);
+            if (it == mempool.mapTx.end())
+                continue;
+            info = mempoolEntryToJSON(it->second);
+        }
+        writer.Key(hash.ToString());
+        writer.Value(info);
+    }
+    writer.EndObject();
+}
+
 UniValue getrawmempool(const UniValue& params, bool fHelp)
 {
     if (fHelp || params.size() > 1)
@@ -612,6 +685,15 @@ UniValue getrawmempool(const UniValue& params, bool fHelp)
     return mempoolToJSON(fVerbose);
 }
 
+bool streamgetrawmempool(const UniValue& params, CJSONStreamWriter& writer)
+{
+    if (params.size() != 1 || !params[0].isBool() || !params[0].get_bool())
+        return false;
+
+    mempoolToJSONStream(writer);
+    return true;
+}
+
 UniValue getblockhash(const UniValue& params, bool fHelp)
 {
     if (fHelp || params.size() != 1)
@@ -682,8 +764,6 @@ UniValue getblock(const UniValue& params, bool fHelp)
             "\nExamples:\n" +
             HelpExampleCli("getblock", "\"00000000000fd08c2fb661d2fcb0d49abb3a91e5f27082ce64feed3b4dede2e2\"") + HelpExampleRpc("getblock", "\"00000000000fd08c2fb661d2fcb0d49abb3a91e5f27082ce64feed3b4dede2e2\""));
 
-    LOCK(cs_main);
-
     std::string strHash = params[0].get_str();
     uint256 hash(strHash);
 
@@ -691,14 +771,26 @@ UniValue getblock(const UniValue& params, bool fHelp)
     if (params.size() > 1)
         fVerbose = params[1].get_bool();
 
-    if (mapBlockIndex.count(hash) == 0)
-        throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Block not found");
+    CBlockIndex* pblockindex = NULL;
+    std::unique_ptr<CBlockFilePin> pin;
+    {
+        LOCK(cs_main);
+        BlockMap::iterator mi = mapBlockIndex.find(hash);
+        if (mi == mapBlockIndex.end())
+            throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Block not found");
+        pblockindex = mi->second;
+        if (fHavePruned && !(pblockindex->nStatus & BLOCK_HAVE_DATA) && pblockindex->nTx > 0)
+            throw JSONRPCError(RPC_INTERNAL_ERROR, "Block not available (pruned data)");
+        pin.reset(new CBlockFilePin(pblockindex->nFile));
+    }
 
+    // Stored blocks never change, so read and encode them without holding
+    // cs_main; concurrent getblock calls in a batch then overlap on disk I/O.
+    // The pin keeps pruning from deleting the file during the read.
     CBlock block;
-    CBlockIndex* pblockindex = mapBlockIndex[hash];
-
-    if (!ReadBlockFromDisk(block, pblockindex))
+    if (!ReadTrustedBlockFromDisk(block, pblockindex))
         throw JSONRPCError(RPC_INTERNAL_ERROR, "Can't read block from disk");
+    pin.reset();
 
     if (!fVerbose) {
         CDataStream ssBlock(SER_NETWORK, PROTOCOL_VERSION | RPCSerializationFlags());
@@ -707,9 +799,40 @@ UniValue getblock(const UniValue& params, bool fHelp)
         return strHex;
     }
 
+    LOCK(cs_main);
     return blockToJSON(block, pblockindex);
 }
 
+bool streamgetblock(const UniValue& params, CJSONStreamWriter& writer)
+{
+    if (params.size() < 1 || params.size() > 2)
+        return false;
+    if (params.size() > 1 && !params[1].get_bool())
+        return false;
+
+    uint256 hash(params[0].get_str());
+    CBlockIndex* pblockindex = NULL;
+    std::unique_ptr<CBlockFilePin> pin;
+    {
+        LOCK(cs_main);
+        BlockMap::iterator mi = mapBlockIndex.find(hash);
+        if (mi == mapBlockIndex.end())
+            throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Block not found");
+        pblockindex = mi->second;
+        if (fHavePruned && !(pblockindex->nStatus & BLOCK_HAVE_DATA) && pblockindex->nTx > 0)
+            throw JSONRPCError(RPC_INTERNAL_ERROR, "Block not available (pruned data)");
+        pin.reset(new CBlockFilePin(pblockindex->nFile));
+    }
+
+    CBlock block;
+    if (!ReadTrustedBlockFromDisk(block, pblockindex))
+        throw JSONRPCError(RPC_INTERNAL_ERROR, "Can't read block from disk");
+    pin.reset();
+
+    blockToJSONStream(block, pblockindex, false, writer);
+    return true;
+}
+
 UniValue getblockheader(const UniValue& params, bool fHelp)
 {
     if (fHelp || params.size() < 1 || params.size() > 2)
@@ -762,13 +885,20 @@ UniValue getblockheader(const UniValue& params, bool fHelp)
     return blockheaderToJSON(pblockindex);
 }
 
+/** Last gettxoutsetinfo result for each hash type; only used while its best block is current */
+static CCriticalSection cs_coinstats;
+static std::map<CoinStatsHashType, CCoinsStats> mapCoinStatsCache;
+
 UniValue gettxoutsetinfo(const UniValue& params, bool fHelp)
 {
-    if (fHelp || params.size() != 0)
+    if (fHelp || params.size() > 1)
         throw runtime_error(
-            "gettxoutsetinfo\n"
+            "gettxoutsetinfo ( \"hash_type\" )\n"
             "\nReturns statistics about the unspent transaction output set.\n"
-            "Note this call may take some time.\n"
+            "Note this call may take some time. Results are cached until the best block changes.\n"
+            "\nArguments:\n"
+            "1. \"hash_type\"   (string, optional, default=\"hash_serialized\") Which UTXO set hash to calculate:\n"
+            "                   \"hash_serialized\", \"muhash\" (faster, calculated in parallel) or \"none\"\n"
             "\nResult:\n"
             "{\n"
             "  \"height\":n,     (numeric) The current block height (index)\n"
@@ -776,30 +906,111 @@ UniValue gettxoutsetinfo(const UniValue& params, bool fHelp)
             "  \"transactions\": n,      (numeric) The number of transactions\n"
             "  \"txouts\": n,            (numeric) The number of output transactions\n"
             "  \"bytes_serialized\": n,  (numeric) The serialized size\n"
-            "  \"hash_serialized\": \"hash\",   (string) The serialized hash\n"
+            "  \"hash_serialized\": \"hash\",   (string) The serialized hash (only with hash_type \"hash_serialized\")\n"
+            "  \"muhash\": \"hash\",   (string) The order independent set hash (only with hash_type \"muhash\")\n"
             "  \"total_amount\": x.xxx          (numeric) The total amount\n"
             "}\n"
             "\nExamples:\n" +
-            HelpExampleCli("gettxoutsetinfo", "") + HelpExampleRpc("gettxoutsetinfo", ""));
-
-    LOCK(cs_main);
+            HelpExampleCli("gettxoutsetinfo", "") + HelpExampleCli("gettxoutsetinfo", "\"muhash\"") + HelpExampleRpc("gettxoutsetinfo", ""));
+
+    CoinStatsHashType hashType = COINSTATS_HASH_SERIALIZED;
+    if (params.size() > 0) {
+        std::string strHashType = params[0].get_str();
+        if (strHashType == "muhash")
+            hashType = COINSTATS_HASH_MUHASH;
+        else if (strHashType == "none")
+            hashType = COINSTATS_HASH_NONE;
+        else if (strHashType != "hash_serialized")
+            throw JSONRPCError(RPC_INVALID_PARAMETER, strprintf("Unknown hash_type %s", strHashType));
+    }
 
-    UniValue ret(UniValue::VOBJ);
+    uint256 hashBestBlock;
+    {
+        LOCK(cs_main);
+        FlushStateToDisk();
+        hashBestBlock = pcoinsTip->GetBestBlock();
+    }
 
     CCoinsStats stats;
-    FlushStateToDisk();
-    if (pcoinsTip->GetStats(stats)) {
+    bool fFound = false;
+    {
+        LOCK(cs_coinstats);
+        std::map<CoinStatsHashType, CCoinsStats>::const_iterator it = mapCoinStatsCache.find(hashType);
+        if (it != mapCoinStatsCache.end() && it->second.hashBlock == hashBestBlock) {
+            stats = it->second;
+            fFound = true;
+        }
+    }
+    // GetStats reads a database snapshot, so blocks can be connected meanwhile
+    if (!fFound && pcoinsTip->GetStats(stats, hashType)) {
+        fFound = true;
+        LOCK(cs_coinstats);
+        mapCoinStatsCache[hashType] = stats;
+    }
+
+    UniValue ret(UniValue::VOBJ);
+    if (fFound) {
         ret.push_back(Pair("height", (int64_t)stats.nHeight));
         ret.push_back(Pair("bestblock", stats.hashBlock.GetHex()));
         ret.push_back(Pair("transactions", (int64_t)stats.nTransactions));
         ret.push_back(Pair("txouts", (int64_t)stats.nTransactionOutputs));
         ret.push_back(Pair("bytes_serialized", (int64_t)stats.nSerializedSize));
-        ret.push_back(Pair("hash_serialized", stats.hashSerialized.GetHex()));
+        if (hashType == COINSTATS_HASH_SERIALIZED)
+            ret.push_back(Pair("hash_serialized", stats.hashSerialized.GetHex()));
+        else if (hashType == COINSTATS_HASH_MUHASH)
+            ret.push_back(Pair("muhash", stats.hashMuHash.GetHex()));
         ret.push_back(Pair("total_amount", ValueFromAmount(stats.nTotalAmount)));
     }
     return ret;
 }
 
+UniValue dumptxoutset(const UniValue& params, bool fHelp)
+{
+    if (fHelp || params.size() != 1)
+        throw runtime_error(
+            "dumptxoutset \"path\"\n"
+            "\nWrite the unspent transaction output set at the current tip to a file, together with the\n"
+            "block index, zerocoin and spork data needed to start another node from it with -loadtxoutset.\n"
+            "Note this call may take some time.\n"
+            "\nArguments:\n"
+            "1. \"path\"    (string, required) The file to write, relative to the data directory if not absolute\n"
+            "\nResult:\n"
+            "{\n"
+            "  \"height\":n,     (numeric) The height of the snapshot block\n"
+            "  \"bestblock\": \"hex\",   (string) the snapshot block hash hex\n"
+            "  \"path\": \"path\",   (string) the file that was written\n"
+            "  \"transactions\": n,      (numeric) The number of transactions\n"
+            "  \"txouts\": n,            (numeric) The number of output transactions\n"
+            "  \"hash_serialized\": \"hash\",   (string) The serialized hash\n"
+            "  \"total_amount\": x.xxx,         (numeric) The total amount\n"
+            "  \"snapshot_hash\": \"hash\",     (string) The hash of all snapshot data, to pass to -loadtxoutsethash\n"
+            "}\n"
+            "\nExamples:\n" +
+            HelpExampleCli("dumptxoutset", "\"utxo.dat\"") + HelpExampleRpc("dumptxoutset", "\"utxo.dat\""));
+
+    boost::filesystem::path path = params[0].get_str();
+    if (!path.is_complete())
+        path = GetDataDir() / path;
+    if (boost::filesystem::exists(path))
+        throw JSONRPCError(RPC_INVALID_PARAMETER, strprintf("%s already exists", path.string()));
+
+    CSnapshotMetadata metadata;
+    std::string strError;
+    if (!DumpTxOutSet(path, metadata, strError))
+        throw JSONRPCError(RPC_INTERNAL_ERROR, strError);
+
+    UniValue ret(UniValue::VOBJ);
+    ret.push_back(Pair("height", metadata.nHeight));
+    ret.push_back(Pair("bestblock", metadata.hashBlock.GetHex()));
+    ret.push_back(Pair("path", path.string()));
+    ret.push_back(Pair("transactions", (int64_t)metadata.nTransactions));
+    ret.push_back(Pair("txouts", (int64_t)metadata.nTransactionOutputs));
+    ret.push_back(Pair("hash_serialized", metadata.hashSerialized.GetHex()));
+    ret.push_back(Pair("total_amount", ValueFromAmount(metadata.nTotalAmount)));
+    ret.push_back(Pair("snapshot_hash", metadata.hashSnapshot.GetHex()));
+    return ret;
+}
+
 UniValue gettxout(const UniValue& params, bool fHelp)
 {
     if (fHelp || params.size() < 2 || params.size() > 3)
@@ -919,7 +1130,9 @@ UniValue getblockchaininfo(const UniValue& params, bool fHelp)
             "  \"bestblockhash\": \"...\", (string) the hash of the currently best block\n"
             "  \"difficulty\": xxxxxx,     (numeric) the current difficulty\n"
             "  \"verificationprogress\": xxxx, (numeric) estimate of verification progress [0..1]\n"
-            "  \"chainwork\": \"xxxx\"     (string) total amount of work in active chain, in hexadecimal\n"
+            "  \"chainwork\": \"xxxx\",    (string) total amount of work in active chain, in hexadecimal\n"
+            "  \"pruned\": xx,             (boolean) if the blocks are subject to pruning\n"
+            "  \"pruneheight\": xxxxxx,    (numeric) lowest-height complete block stored (only present if pruning is enabled)\n"
             "}\n"
             "\nExamples:\n" +
             HelpExampleCli("getblockchaininfo", "") + HelpExampleRpc("getblockchaininfo", ""));
@@ -934,6 +1147,9 @@ UniValue getblockchaininfo(const UniValue& params, bool fHelp)
     obj.push_back(Pair("difficulty",           (double)GetDifficulty()));
     obj.push_back(Pair("verificationprogress", Checkpoints::GuessVerificationProgress(chainActive.Tip())));
     obj.push_back(Pair("chainwork",            chainActive.Tip()->nChainWork.GetHex()));
+    obj.push_back(Pair("pruned",               fPruneMode));
+    if (fPruneMode)
+        obj.push_back(Pair("pruneheight",      GetPruneHeight()));
     return obj;
 }
 
@@ -1084,7 +1300,7 @@ UniValue getfeeinfo(const UniValue& params, bool fHelp)
     for (int i = nStartHeight; i <= nBestHeight; i++) {
         CBlockIndex* pindex = chainActive[i];
         CBlock block;
-        if (!ReadBlockFromDisk(block, pindex))
+        if (!ReadTrustedBlockFromDisk(block, pindex))
             throw JSONRPCError(RPC_DATABASE_ERROR, "failed to read block from disk");
 
         CAmount nValueIn = 0;
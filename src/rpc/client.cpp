@@ -86,6 +86,9 @@ static const CRPCConvertParam vRPCConvertParams[] =
         { "searchrawtransactions", 2 },
         { "searchrawtransactions", 3 },
         { "searchrawtransactions", 4 },
+        { "getaddressdeltas", 1 },
+        { "getaddressdeltas", 2 },
+        { "getaddressdeltas", 3 },
         {"sendrawtransaction", 2},
         {"gettxout", 1},
         {"gettxout", 2},
@@ -342,6 +342,14 @@ UniValue getnettotals(const UniValue& params, bool fHelp)
             "  \"totalbytesrecv\": n,   (numeric) Total bytes received\n"
             "  \"totalbytessent\": n,   (numeric) Total bytes sent\n"
             "  \"timemillis\": t        (numeric) Total cpu time\n"
+            "  \"relaycache\": {        (json object) Serialized transactions kept for relay\n"
+            "    \"entries\": n,        (numeric) Number of cached transactions\n"
+            "    \"bytes\": n,          (numeric) Bytes of serialized transactions held\n"
+            "    \"maxbytes\": n,       (numeric) Byte limit (-maxrelaycache)\n"
+            "    \"evicted\": n,        (numeric) Entries dropped early to stay under the limit\n"
+            "    \"hits\": n,           (numeric) getdata requests answered from the cache\n"
+            "    \"misses\": n          (numeric) getdata requests not found in the cache\n"
+            "  }\n"
             "}\n"
             "\nExamples:\n" +
             HelpExampleCli("getnettotals", "") + HelpExampleRpc("getnettotals", ""));
@@ -350,6 +358,16 @@ UniValue getnettotals(const UniValue& params, bool fHelp)
     obj.push_back(Pair("totalbytesrecv", CNode::GetTotalBytesRecv()));
     obj.push_back(Pair("totalbytessent", CNode::GetTotalBytesSent()));
     obj.push_back(Pair("timemillis", GetTimeMillis()));
+
+    CRelayCache::Stats stats = relayCache.GetStats();
+    UniValue relayObj(UniValue::VOBJ);
+    relayObj.push_back(Pair("entries", (uint64_t)stats.nEntries));
+    relayObj.push_back(Pair("bytes", (uint64_t)stats.nBytes));
+    relayObj.push_back(Pair("maxbytes", (uint64_t)stats.nMaxBytes));
+    relayObj.push_back(Pair("evicted", stats.nEvicted));
+    relayObj.push_back(Pair("hits", stats.nHits));
+    relayObj.push_back(Pair("misses", stats.nMisses));
+    obj.push_back(Pair("relaycache", relayObj));
     return obj;
 }
 
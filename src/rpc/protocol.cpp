@@ -67,6 +67,93 @@ UniValue JSONRPCError(int code, const string& message)
     return error;
 }
 
+CJSONStreamWriter::CJSONStreamWriter(const Sink& sink, size_t nFlushThreshold) : sink(sink),
+                                                                                   nFlushThreshold(nFlushThreshold),
+                                                                                   nBytesFlushed(0),
+                                                                                   fAfterKey(false)
+{
+    strBuffer.reserve(nFlushThreshold);
+}
+
+void CJSONStreamWriter::Separate()
+{
+    if (fAfterKey) {
+        fAfterKey = false;
+        return;
+    }
+    if (!vFirst.empty()) {
+        if (!vFirst.back())
+            strBuffer += ',';
+        vFirst.back() = false;
+    }
+}
+
+void CJSONStreamWriter::MaybeFlush()
+{
+    if (strBuffer.size() >= nFlushThreshold)
+        Flush();
+}
+
+void CJSONStreamWriter::BeginObject()
+{
+    Separate();
+    strBuffer += '{';
+    vFirst.push_back(true);
+}
+
+void CJSONStreamWriter::EndObject()
+{
+    assert(!vFirst.empty() && !fAfterKey);
+    strBuffer += '}';
+    vFirst.pop_back();
+    MaybeFlush();
+}
+
+void CJSONStreamWriter::BeginArray()
+{
+    Separate();
+    strBuffer += '[';
+    vFirst.push_back(true);
+}
+
+void CJSONStreamWriter::EndArray()
+{
+    assert(!vFirst.empty() && !fAfterKey);
+    strBuffer += ']';
+    vFirst.pop_back();
+    MaybeFlush();
+}
+
+void CJSONStreamWriter::Key(const std::string& key)
+{
+    Separate();
+    strBuffer += UniValue(key).write();
+    strBuffer += ':';
+    fAfterKey = true;
+}
+
+void CJSONStreamWriter::Value(const UniValue& value)
+{
+    Separate();
+    strBuffer += value.write();
+    MaybeFlush();
+}
+
+void CJSONStreamWriter::Raw(const std::string& str)
+{
+    strBuffer += str;
+    MaybeFlush();
+}
+
+void CJSONStreamWriter::Flush()
+{
+    if (strBuffer.empty())
+        return;
+    nBytesFlushed += strBuffer.size();
+    sink(strBuffer);
+    strBuffer.clear();
+}
+
 /** Username used when cookie authentication is in use (arbitrary, only for
  * recognizability in debugging/logging purposes)
  */
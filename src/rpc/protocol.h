@@ -10,7 +10,9 @@
 #include <map>
 #include <stdint.h>
 #include <string>
+#include <vector>
 #include <boost/filesystem.hpp>
+#include <boost/function.hpp>
 
 #include <univalue.h>
 
@@ -79,6 +81,49 @@ UniValue JSONRPCReplyObj(const UniValue& result, const UniValue& error, const Un
 std::string JSONRPCReply(const UniValue& result, const UniValue& error, const UniValue& id);
 UniValue JSONRPCError(int code, const std::string& message);
 
+/**
+ * Incremental JSON serializer. Output collects in a small buffer that is handed
+ * to a sink whenever it grows past the flush threshold, so large documents can
+ * be sent without building a UniValue tree or one big string first. Callers
+ * pass small subtrees (a transaction, a mempool entry) as UniValue values.
+ */
+class CJSONStreamWriter
+{
+public:
+    typedef boost::function<void(const std::string&)> Sink;
+
+    //! Default number of buffered bytes that triggers a flush to the sink
+    static const size_t DEFAULT_FLUSH_THRESHOLD = 64 * 1024;
+
+    CJSONStreamWriter(const Sink& sink, size_t nFlushThreshold = DEFAULT_FLUSH_THRESHOLD);
+
+    void BeginObject();
+    void EndObject();
+    void BeginArray();
+    void EndArray();
+    //! Write an object key; the next value written belongs to it
+    void Key(const std::string& key);
+    void Value(const UniValue& value);
+    //! Append already serialized JSON without separators
+    void Raw(const std::string& str);
+    //! Hand all buffered output to the sink
+    void Flush();
+    //! Whether any output has been handed to the sink yet
+    bool Flushed() const { return nBytesFlushed > 0; }
+
+private:
+    Sink sink;
+    size_t nFlushThreshold;
+    size_t nBytesFlushed;
+    std::string strBuffer;
+    //! Per open container: whether no element has been written yet
+    std::vector<bool> vFirst;
+    bool fAfterKey;
+
+    void Separate();
+    void MaybeFlush();
+};
+
 /** Get name of RPC authentication cookie file */
 boost::filesystem::path GetAuthCookieFile();
 /** Generate a new RPC authentication cookie and write it to disk */
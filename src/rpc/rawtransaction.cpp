@@ -20,6 +20,7 @@
 #include "script/sign.h"
 #include "script/standard.h"
 #include "swifttx.h"
+#include "txdb.h"
 #include "uint256.h"
 #include "utilmoneystr.h"
 #ifdef ENABLE_WALLET
@@ -130,11 +131,11 @@ void TxToJSON(const CTransaction& tx, const uint256 hashBlock, UniValue& entry,
     }
 }
 
-UniValue searchrawtransactions(const UniValue& params, bool fHelp)
+/** Look up the transactions matching a searchrawtransactions call and hand
+ * each result to fn, in address index order.
+ */
+static void SearchRawTransactions(const UniValue& params, const boost::function<void(const UniValue&)>& fn)
 {
-    if (fHelp || params.size() < 1 || params.size() > 4)
-        throw runtime_error("searchrawtransactions <address> [verbose=1] [skip=0] [count=100]\n");
-    
     if (!fAddrIndex)
         throw JSONRPCError(RPC_MISC_ERROR, "Address index not enabled");
     
@@ -142,11 +143,10 @@ UniValue searchrawtransactions(const UniValue& params, bool fHelp)
         throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Invalid address");
 
     CTxDestination dest = DecodeDestination(params[0].get_str());
-    
-    std::set<CExtDiskTxPos> setpos;
-    if (!FindTransactionsByDestination(dest, setpos))
+    uint160 addrid;
+    if (!GetAddressIndexId(dest, addrid))
         throw JSONRPCError(RPC_DATABASE_ERROR, "Cannot search for address");
-    
+
     int nSkip = 0;
     int nCount = 100;
     bool fVerbose = true;
@@ -156,35 +156,257 @@ UniValue searchrawtransactions(const UniValue& params, bool fHelp)
         nSkip = params[2].get_int();
     if (params.size() > 3)
         nCount = params[3].get_int();
-    
-    if (nSkip < 0)
-        nSkip += setpos.size();
+
+    if (nSkip < 0) {
+        CAddressSummary summary;
+        if (!pblocktree->ReadAddrSummary(addrid, summary))
+            throw JSONRPCError(RPC_DATABASE_ERROR, "Cannot search for address");
+        nSkip += summary.nTxCount;
+    }
     if (nSkip < 0)
         nSkip = 0;
     if (nCount < 0)
         nCount = 0;
-    
-    std::set<CExtDiskTxPos>::const_iterator it = setpos.begin();
-    while (it != setpos.end() && nSkip--) it++;
-    
-    UniValue result(UniValue::VARR);
-    while (it != setpos.end() && nCount--) {
+
+    // The index holds one entry per input and output; collapse them to
+    // transactions and stop reading as soon as the requested page is full.
+    std::vector<CDiskTxPos> vPos;
+    uint256 hashLast;
+    CAddressIndexKey start;
+    start.addrid = addrid;
+    if (nCount > 0 && !pblocktree->ReadAddrIndex(start, [&](const CAddressIndexKey& key, const CAddressIndexValue& value) {
+            if (key.txhash == hashLast)
+                return true;
+            hashLast = key.txhash;
+            if (nSkip > 0) {
+                nSkip--;
+                return true;
+            }
+            vPos.push_back(value.pos);
+            return (int)vPos.size() < nCount;
+        }))
+        throw JSONRPCError(RPC_DATABASE_ERROR, "Cannot search for address");
+
+    // Name all blocks under one lock; the transactions are read without it
+    std::vector<uint256> vHashBlock(vPos.size());
+    {
+        LOCK(cs_main);
+        for (unsigned int i = 0; i < vPos.size(); i++)
+            LookupBlockHashByPos(vPos[i], vHashBlock[i]);
+    }
+
+    for (unsigned int i = 0; i < vPos.size(); i++) {
+        const CDiskTxPos& pos = vPos[i];
         CTransaction tx;
-        uint256 hashBlock;
-        if (!ReadTransaction(tx, *it, hashBlock))
+        uint256 hashBlock = vHashBlock[i];
+        if (!ReadTransaction(tx, pos, hashBlock))
             throw JSONRPCError(RPC_DESERIALIZATION_ERROR, "Cannot read transaction from disk");
         if (fVerbose) {
             UniValue object(UniValue::VOBJ);
-            TxToJSON(tx, hashBlock, object, true, RPCSerializationFlags());
-            result.push_back(object);
+            {
+                LOCK(cs_main);
+                TxToJSON(tx, hashBlock, object, true, RPCSerializationFlags());
+            }
+            fn(object);
         } else {
             CDataStream ssTx(SER_NETWORK, PROTOCOL_VERSION | RPCSerializationFlags());
             ssTx << tx;
             string strHex = HexStr(ssTx.begin(), ssTx.end());
-            result.push_back(strHex);
+            fn(UniValue(strHex));
         }
-        it++;
     }
+}
+
+UniValue searchrawtransactions(const UniValue& params, bool fHelp)
+{
+    if (fHelp || params.size() < 1 || params.size() > 4)
+        throw runtime_error("searchrawtransactions <address> [verbose=1] [skip=0] [count=100]\n");
+
+    UniValue result(UniValue::VARR);
+    SearchRawTransactions(params, [&result](const UniValue& entry) { result.push_back(entry); });
+    return result;
+}
+
+bool streamsearchrawtransactions(const UniValue& params, CJSONStreamWriter& writer)
+{
+    if (params.size() < 1 || params.size() > 4)
+        return false;
+
+    writer.BeginArray();
+    SearchRawTransactions(params, [&writer](const UniValue& entry) { writer.Value(entry); });
+    writer.EndArray();
+    return true;
+}
+
+static uint160 AddressIndexIdFromParam(const UniValue& param)
+{
+    if (!fAddrIndex)
+        throw JSONRPCError(RPC_MISC_ERROR, "Address index not enabled");
+    if (!IsValidDestinationString(param.get_str()))
+        throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Invalid address");
+    uint160 addrid;
+    if (!GetAddressIndexId(DecodeDestination(param.get_str()), addrid))
+        throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Address is not indexed");
+    return addrid;
+}
+
+UniValue getaddressbalance(const UniValue& params, bool fHelp)
+{
+    if (fHelp || params.size() != 1)
+        throw runtime_error(
+            "getaddressbalance \"address\"\n"
+            "\nReturns the balance of an address, read from the address index (requires -addrindex).\n"
+            "\nArguments:\n"
+            "1. \"address\"      (string, required) The helix address\n"
+            "\nResult:\n"
+            "{\n"
+            "  \"balance\": x.xxx,   (numeric) The current balance in HLIX\n"
+            "  \"received\": x.xxx,  (numeric) The total amount received in HLIX\n"
+            "  \"txcount\": n        (numeric) The number of transactions touching the address\n"
+            "}\n"
+            "\nExamples:\n" +
+            HelpExampleCli("getaddressbalance", "\"1D1ZrZNe3JUo7ZycKEYQQiQAWd9y54F4XZ\"") +
+            HelpExampleRpc("getaddressbalance", "\"1D1ZrZNe3JUo7ZycKEYQQiQAWd9y54F4XZ\""));
+
+    uint160 addrid = AddressIndexIdFromParam(params[0]);
+    CAddressSummary summary;
+    if (!pblocktree->ReadAddrSummary(addrid, summary))
+        throw JSONRPCError(RPC_DATABASE_ERROR, "Cannot read address index");
+
+    UniValue result(UniValue::VOBJ);
+    result.push_back(Pair("balance", ValueFromAmount(summary.nBalance)));
+    result.push_back(Pair("received", ValueFromAmount(summary.nReceived)));
+    result.push_back(Pair("txcount", (uint64_t)summary.nTxCount));
+    return result;
+}
+
+UniValue getaddressutxos(const UniValue& params, bool fHelp)
+{
+    if (fHelp || params.size() != 1)
+        throw runtime_error(
+            "getaddressutxos \"address\"\n"
+            "\nReturns the unspent outputs of an address, read from the address index (requires -addrindex).\n"
+            "\nArguments:\n"
+            "1. \"address\"      (string, required) The helix address\n"
+            "\nResult:\n"
+            "[\n"
+            "  {\n"
+            "    \"txid\": \"id\",       (string) The transaction id\n"
+            "    \"vout\": n,            (numeric) The output index\n"
+            "    \"scriptPubKey\": \"hex\", (string) The output script\n"
+            "    \"amount\": x.xxx,      (numeric) The output value in HLIX\n"
+            "    \"height\": n           (numeric) The height of the block containing the output\n"
+            "  }\n"
+            "  ,...\n"
+            "]\n"
+            "\nExamples:\n" +
+            HelpExampleCli("getaddressutxos", "\"1D1ZrZNe3JUo7ZycKEYQQiQAWd9y54F4XZ\"") +
+            HelpExampleRpc("getaddressutxos", "\"1D1ZrZNe3JUo7ZycKEYQQiQAWd9y54F4XZ\""));
+
+    uint160 addrid = AddressIndexIdFromParam(params[0]);
+    std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > vUnspent;
+    if (!pblocktree->ReadAddrUnspent(addrid, vUnspent))
+        throw JSONRPCError(RPC_DATABASE_ERROR, "Cannot read address index");
+
+    UniValue result(UniValue::VARR);
+    for (const std::pair<CAddressUnspentKey, CAddressUnspentValue>& entry : vUnspent) {
+        UniValue output(UniValue::VOBJ);
+        output.push_back(Pair("txid", entry.first.txhash.GetHex()));
+        output.push_back(Pair("vout", (int64_t)entry.first.nIndex));
+        output.push_back(Pair("scriptPubKey", HexStr(entry.second.script.begin(), entry.second.script.end())));
+        output.push_back(Pair("amount", ValueFromAmount(entry.second.nValue)));
+        output.push_back(Pair("height", entry.second.nHeight));
+        result.push_back(output);
+    }
+    return result;
+}
+
+UniValue getaddressdeltas(const UniValue& params, bool fHelp)
+{
+    if (fHelp || params.size() < 1 || params.size() > 5)
+        throw runtime_error(
+            "getaddressdeltas \"address\" ( start end count \"cursor\" )\n"
+            "\nReturns the balance changes of an address in chain order, read from the address index\n"
+            "(requires -addrindex). Long histories are returned in pages: pass the \"next\" value of a\n"
+            "reply as cursor to continue after it.\n"
+            "\nArguments:\n"
+            "1. \"address\"      (string, required) The helix address\n"
+            "2. start          (numeric, optional, default=0) The first block height to include\n"
+            "3. end            (numeric, optional, default=no limit) The last block height to include\n"
+            "4. count          (numeric, optional, default=1000) The maximum number of deltas to return\n"
+            "5. \"cursor\"       (string, optional) Continue from the \"next\" value of a previous call\n"
+            "\nResult:\n"
+            "{\n"
+            "  \"deltas\": [\n"
+            "    {\n"
+            "      \"txid\": \"id\",     (string) The transaction id\n"
+            "      \"index\": n,         (numeric) The input or output index\n"
+            "      \"spending\": true|false, (boolean) Whether this is an input spending from the address\n"
+            "      \"height\": n,        (numeric) The block height\n"
+            "      \"amount\": x.xxx     (numeric) The balance change in HLIX\n"
+            "    }\n"
+            "    ,...\n"
+            "  ],\n"
+            "  \"next\": \"cursor\"     (string) Cursor for the next page, or null if there are no more deltas\n"
+            "}\n"
+            "\nExamples:\n" +
+            HelpExampleCli("getaddressdeltas", "\"1D1ZrZNe3JUo7ZycKEYQQiQAWd9y54F4XZ\" 0 100000 500") +
+            HelpExampleRpc("getaddressdeltas", "\"1D1ZrZNe3JUo7ZycKEYQQiQAWd9y54F4XZ\", 0, 100000, 500"));
+
+    uint160 addrid = AddressIndexIdFromParam(params[0]);
+    int nStart = 0;
+    int nEnd = std::numeric_limits<int>::max();
+    int nCount = 1000;
+    if (params.size() > 1)
+        nStart = std::max(0, params[1].get_int());
+    if (params.size() > 2 && params[2].get_int() >= 0)
+        nEnd = params[2].get_int();
+    if (params.size() > 3)
+        nCount = params[3].get_int();
+    if (nCount <= 0)
+        throw JSONRPCError(RPC_INVALID_PARAMETER, "count must be positive");
+
+    CAddressIndexKey start(addrid, nStart, 0, uint256(0), false, 0);
+    if (params.size() > 4 && !params[4].isNull()) {
+        std::string strCursor = params[4].get_str();
+        if (!IsHex(strCursor))
+            throw JSONRPCError(RPC_INVALID_PARAMETER, "Invalid cursor");
+        std::vector<unsigned char> vCursor = ParseHex(strCursor);
+        CDataStream ssCursor(vCursor, SER_DISK, CLIENT_VERSION);
+        try {
+            ssCursor >> start;
+        } catch (const std::exception&) {
+            throw JSONRPCError(RPC_INVALID_PARAMETER, "Invalid cursor");
+        }
+        if (start.addrid != addrid)
+            throw JSONRPCError(RPC_INVALID_PARAMETER, "Cursor belongs to a different address");
+    }
+
+    UniValue deltas(UniValue::VARR);
+    UniValue next(UniValue::VNULL);
+    if (!pblocktree->ReadAddrIndex(start, [&](const CAddressIndexKey& key, const CAddressIndexValue& value) {
+            if (key.nHeight > (unsigned int)nEnd)
+                return false;
+            if ((int)deltas.size() == nCount) {
+                CDataStream ssNext(SER_DISK, CLIENT_VERSION);
+                ssNext << key;
+                next = HexStr(ssNext.begin(), ssNext.end());
+                return false;
+            }
+            UniValue delta(UniValue::VOBJ);
+            delta.push_back(Pair("txid", key.txhash.GetHex()));
+            delta.push_back(Pair("index", (int64_t)key.nIndex));
+            delta.push_back(Pair("spending", key.fSpending));
+            delta.push_back(Pair("height", (int64_t)key.nHeight));
+            delta.push_back(Pair("amount", ValueFromAmount(value.nValue)));
+            deltas.push_back(delta);
+            return true;
+        }))
+        throw JSONRPCError(RPC_DATABASE_ERROR, "Cannot read address index");
+
+    UniValue result(UniValue::VOBJ);
+    result.push_back(Pair("deltas", deltas));
+    result.push_back(Pair("next", next));
     return result;
 }
 
@@ -33,6 +33,9 @@
 
 #include <univalue.h>
 
+#include <memory>
+#include <set>
+
 using namespace RPCServer;
 using namespace std;
 
@@ -47,6 +50,11 @@ static std::vector<RPCTimerInterface*> timerInterfaces;
  * @note Can be changed to std::unique_ptr when C++11 */
 static std::map<std::string, boost::shared_ptr<RPCTimerBase> > deadlineTimers;
 
+/* Worker pool used to run read-only batch calls concurrently */
+static CCriticalSection cs_rpcBatch;
+static RPCTaskDispatcher batchDispatcher;
+static int nBatchWorkers = 1;
+
 static struct CRPCSignals
 {
     boost::signals2::signal<void ()> Started;
@@ -315,6 +323,7 @@ static const CRPCCommand vRPCCommands[] =
         {"blockchain", "getrawmempool", &getrawmempool, true, false, false},
         {"blockchain", "gettxout", &gettxout, true, false, false},
         {"blockchain", "gettxoutsetinfo", &gettxoutsetinfo, true, false, false},
+        {"blockchain", "dumptxoutset", &dumptxoutset, true, false, false},
         {"blockchain", "invalidateblock", &invalidateblock, true, true, false},
         {"blockchain", "reconsiderblock", &reconsiderblock, true, true, false},
         {"blockchain", "verifychain", &verifychain, true, false, false},
@@ -349,6 +358,11 @@ static const CRPCCommand vRPCCommands[] =
         {"rawtransactions", "sendrawtransaction", &sendrawtransaction, false, false, false},
         {"rawtransactions", "signrawtransaction", &signrawtransaction, false, false, false}, /* uses wallet if enabled */
 
+        /* Address index */
+        {"addressindex", "getaddressbalance", &getaddressbalance, true, false, false},
+        {"addressindex", "getaddressutxos", &getaddressutxos, true, false, false},
+        {"addressindex", "getaddressdeltas", &getaddressdeltas, true, false, false},
+
         /* Utility functions */
         {"util", "createmultisig", &createmultisig, true, true, false},
         {"util", "createwitnessaddress", &createwitnessaddress, true, true, false},
@@ -469,6 +483,19 @@ static const CRPCCommand vRPCCommands[] =
 #endif // ENABLE_WALLET
 };
 
+/**
+ * Methods whose results can be large enough to be worth streaming to HTTP
+ * clients instead of being built as one UniValue tree.
+ */
+static const struct {
+    const char* name;
+    rpcstreamfn_type streamer;
+} vRPCStreamCommands[] = {
+      {"getblock", &streamgetblock},
+      {"getrawmempool", &streamgetrawmempool},
+      {"searchrawtransactions", &streamsearchrawtransactions},
+};
+
 CRPCTable::CRPCTable()
 {
     unsigned int vcidx;
@@ -478,6 +505,8 @@ CRPCTable::CRPCTable()
         pcmd = &vRPCCommands[vcidx];
         mapCommands[pcmd->name] = pcmd;
     }
+    for (vcidx = 0; vcidx < (sizeof(vRPCStreamCommands) / sizeof(vRPCStreamCommands[0])); vcidx++)
+        mapStreamCommands[vRPCStreamCommands[vcidx].name] = vRPCStreamCommands[vcidx].streamer;
 }
 
 const CRPCCommand *CRPCTable::operator[](const std::string &name) const
@@ -587,11 +616,128 @@ static UniValue JSONRPCExecOne(const UniValue& req)
     return rpc_result;
 }
 
+/**
+ * Methods that only read chain, mempool or wallet state and do their own
+ * locking. Consecutive calls to these inside a batch may run concurrently.
+ */
+static const std::set<std::string> setParallelBatchMethods = {
+    "decoderawtransaction", "decodescript", "findserial", "getaddressbalance",
+    "getaddressdeltas", "getaddressutxos", "getbestblockhash", "getblock",
+    "getblockchaininfo", "getblockcount", "getblockhash", "getblockheader",
+    "getdifficulty", "getmempoolinfo", "getrawmempool", "getrawtransaction",
+    "gettxout", "searchrawtransactions", "validateaddress", "verifymessage"};
+
+static bool IsParallelBatchRequest(const UniValue& req)
+{
+    if (!req.isObject())
+        return false;
+    const UniValue& valMethod = find_value(req.get_obj(), "method");
+    return valMethod.isStr() && setParallelBatchMethods.count(valMethod.get_str());
+}
+
+/**
+ * A run of parallel-safe batch requests. Workers claim requests by index
+ * until none are left, so the thread that owns the batch can always finish
+ * the run on its own even if no other worker picks up a task.
+ */
+class CRPCBatchRun
+{
+private:
+    CWaitableCriticalSection cs;
+    CConditionVariable cond;
+    size_t nNext;
+    size_t nDone;
+
+    bool ExecNext()
+    {
+        size_t i;
+        {
+            boost::unique_lock<boost::mutex> lock(cs);
+            if (nNext >= vReq.size())
+                return false;
+            i = nNext++;
+        }
+        UniValue result = JSONRPCExecOne(vReq[i]);
+        boost::unique_lock<boost::mutex> lock(cs);
+        vResult[i] = result;
+        if (++nDone == vReq.size())
+            cond.notify_all();
+        return true;
+    }
+
+public:
+    std::vector<UniValue> vReq;
+    std::vector<UniValue> vResult;
+
+    CRPCBatchRun() : nNext(0), nDone(0) {}
+
+    void Run()
+    {
+        while (ExecNext()) {
+        }
+    }
+
+    void Wait()
+    {
+        boost::unique_lock<boost::mutex> lock(cs);
+        while (nDone < vReq.size())
+            cond.wait(lock);
+    }
+};
+
+static void JSONRPCExecParallel(const UniValue& vReq, unsigned int nBegin, unsigned int nEnd, std::vector<UniValue>& vResult)
+{
+    RPCTaskDispatcher dispatcher;
+    int nHelpers = 0;
+    {
+        LOCK(cs_rpcBatch);
+        dispatcher = batchDispatcher;
+        nHelpers = std::min(nBatchWorkers - 1, (int)(nEnd - nBegin) - 1);
+    }
+
+    // The run is shared with the helper tasks, which may outlive this call
+    // if they are dequeued after the owning thread has finished the run.
+    std::shared_ptr<CRPCBatchRun> run = std::make_shared<CRPCBatchRun>();
+    for (unsigned int i = nBegin; i < nEnd; i++)
+        run->vReq.push_back(vReq[i]);
+    run->vResult.resize(run->vReq.size());
+
+    for (int i = 0; i < nHelpers && dispatcher; i++) {
+        if (!dispatcher([run]() { run->Run(); }))
+            break;
+    }
+    run->Run();
+    run->Wait();
+
+    for (unsigned int i = nBegin; i < nEnd; i++)
+        vResult[i] = run->vResult[i - nBegin];
+}
+
 std::string JSONRPCExecBatch(const UniValue& vReq)
 {
+    std::vector<UniValue> vResult(vReq.size());
+    unsigned int reqIdx = 0;
+    while (reqIdx < vReq.size()) {
+        // Anything that may change state is a barrier: it runs on its own,
+        // after every earlier request and before every later one.
+        if (!IsParallelBatchRequest(vReq[reqIdx])) {
+            vResult[reqIdx] = JSONRPCExecOne(vReq[reqIdx]);
+            reqIdx++;
+            continue;
+        }
+        unsigned int nEnd = reqIdx + 1;
+        while (nEnd < vReq.size() && IsParallelBatchRequest(vReq[nEnd]))
+            nEnd++;
+        if (nEnd - reqIdx == 1)
+            vResult[reqIdx] = JSONRPCExecOne(vReq[reqIdx]);
+        else
+            JSONRPCExecParallel(vReq, reqIdx, nEnd, vResult);
+        reqIdx = nEnd;
+    }
+
     UniValue ret(UniValue::VARR);
-    for (unsigned int reqIdx = 0; reqIdx < vReq.size(); reqIdx++)
-        ret.push_back(JSONRPCExecOne(vReq[reqIdx]));
+    for (const UniValue& result : vResult)
+        ret.push_back(result);
 
     return ret.write() + "\n";
 }
@@ -612,14 +758,43 @@ UniValue CRPCTable::execute(const std::string &strMethod, const UniValue &params
 
     g_rpcSignals.PreCommand(*pcmd);
 
+    UniValue result;
     try {
         // Execute
-        return pcmd->actor(params, false);
+        result = pcmd->actor(params, false);
+    } catch (std::exception& e) {
+        throw JSONRPCError(RPC_MISC_ERROR, e.what());
+    }
+
+    g_rpcSignals.PostCommand(*pcmd);
+    return result;
+}
+
+bool CRPCTable::executeStreaming(const std::string &strMethod, const UniValue &params, CJSONStreamWriter &writer) const
+{
+    const CRPCCommand* pcmd = tableRPC[strMethod];
+    std::map<std::string, rpcstreamfn_type>::const_iterator it = mapStreamCommands.find(strMethod);
+    if (!pcmd || it == mapStreamCommands.end())
+        return false;
+
+    // Return immediately if in warmup
+    {
+        LOCK(cs_rpcWarmup);
+        if (fRPCInWarmup)
+            throw JSONRPCError(RPC_IN_WARMUP, rpcWarmupStatus);
+    }
+
+    g_rpcSignals.PreCommand(*pcmd);
+
+    bool fStreamed;
+    try {
+        fStreamed = it->second(params, writer);
     } catch (std::exception& e) {
         throw JSONRPCError(RPC_MISC_ERROR, e.what());
     }
 
     g_rpcSignals.PostCommand(*pcmd);
+    return fStreamed;
 }
 
 std::vector<std::string> CRPCTable::listCommands() const
@@ -657,6 +832,20 @@ void RPCUnregisterTimerInterface(RPCTimerInterface *iface)
     timerInterfaces.erase(i);
 }
 
+void RPCRegisterBatchDispatcher(const RPCTaskDispatcher& dispatcher, int nWorkers)
+{
+    LOCK(cs_rpcBatch);
+    batchDispatcher = dispatcher;
+    nBatchWorkers = std::max(nWorkers, 1);
+}
+
+void RPCUnregisterBatchDispatcher()
+{
+    LOCK(cs_rpcBatch);
+    batchDispatcher.clear();
+    nBatchWorkers = 1;
+}
+
 void RPCRunLater(const std::string& name, boost::function<void(void)> func, int64_t nSeconds)
 {
     if (timerInterfaces.empty())
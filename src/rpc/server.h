@@ -112,8 +112,27 @@ void RPCUnregisterTimerInterface(RPCTimerInterface *iface);
  */
 void RPCRunLater(const std::string& name, boost::function<void(void)> func, int64_t nSeconds);
 
+/** Hands a task to an RPC worker thread; returns false if it could not be queued */
+typedef boost::function<bool(const boost::function<void(void)>&)> RPCTaskDispatcher;
+
+/**
+ * Register the worker pool that read-only calls of a JSON-RPC batch are spread over.
+ * nWorkers is the number of threads serving the dispatcher, including the
+ * one that executes the batch itself.
+ */
+void RPCRegisterBatchDispatcher(const RPCTaskDispatcher& dispatcher, int nWorkers);
+/** Unregister the batch worker pool; batches then run serially */
+void RPCUnregisterBatchDispatcher();
+
 typedef UniValue(*rpcfn_type)(const UniValue& params, bool fHelp);
 
+/**
+ * Streaming variant of an RPC method, writing its result straight to writer.
+ * Returns false without writing anything to leave the call to the regular
+ * actor, e.g. for bad parameters or results too small to be worth streaming.
+ */
+typedef bool(*rpcstreamfn_type)(const UniValue& params, CJSONStreamWriter& writer);
+
 class CRPCCommand
 {
 public:
@@ -132,6 +151,7 @@ class CRPCTable
 {
 private:
     std::map<std::string, const CRPCCommand*> mapCommands;
+    std::map<std::string, rpcstreamfn_type> mapStreamCommands;
 
 public:
     CRPCTable();
@@ -147,6 +167,13 @@ public:
      */
     UniValue execute(const std::string &method, const UniValue &params) const;
 
+    /**
+     * Execute a method through its streaming variant, if it has one.
+     * @returns false if the method cannot be streamed; nothing has been written then.
+     * @throws an exception (UniValue) when an error happens.
+     */
+    bool executeStreaming(const std::string &method, const UniValue &params, CJSONStreamWriter &writer) const;
+
     /**
     * Returns a list of registered commands
     * @returns List of registered commands.
@@ -182,6 +209,7 @@ extern std::string HelpExampleCli(std::string methodname, std::string args);
 extern std::string HelpExampleRpc(std::string methodname, std::string args);
 
 extern void EnsureWalletIsUnlocked(bool fAllowAnonOnly = false);
+extern void EnsureRescanAvailable(int nStartHeight);
 
 extern UniValue getconnectioncount(const UniValue& params, bool fHelp); // in rpc/net.cpp
 extern UniValue getpeerinfo(const UniValue& params, bool fHelp);
@@ -284,6 +312,10 @@ extern UniValue decodescript(const UniValue& params, bool fHelp);
 extern UniValue signrawtransaction(const UniValue& params, bool fHelp);
 extern UniValue sendrawtransaction(const UniValue& params, bool fHelp);
 extern UniValue searchrawtransactions(const UniValue& params, bool fHelp);
+extern bool streamsearchrawtransactions(const UniValue& params, CJSONStreamWriter& writer);
+extern UniValue getaddressbalance(const UniValue& params, bool fHelp);
+extern UniValue getaddressutxos(const UniValue& params, bool fHelp);
+extern UniValue getaddressdeltas(const UniValue& params, bool fHelp);
 
 
 extern UniValue findserial(const UniValue& params, bool fHelp); // in rpc/blockchain.cpp
@@ -294,11 +326,14 @@ extern UniValue getmoneysupply(const UniValue& params, bool fHelp);
 extern UniValue settxfee(const UniValue& params, bool fHelp);
 extern UniValue getmempoolinfo(const UniValue& params, bool fHelp);
 extern UniValue getrawmempool(const UniValue& params, bool fHelp);
+extern bool streamgetrawmempool(const UniValue& params, CJSONStreamWriter& writer);
 extern UniValue getblockhash(const UniValue& params, bool fHelp);
 extern UniValue getblock(const UniValue& params, bool fHelp);
+extern bool streamgetblock(const UniValue& params, CJSONStreamWriter& writer);
 extern UniValue getblockheader(const UniValue& params, bool fHelp);
 extern UniValue getfeeinfo(const UniValue& params, bool fHelp);
 extern UniValue gettxoutsetinfo(const UniValue& params, bool fHelp);
+extern UniValue dumptxoutset(const UniValue& params, bool fHelp);
 extern UniValue gettxout(const UniValue& params, bool fHelp);
 extern UniValue verifychain(const UniValue& params, bool fHelp);
 extern UniValue getchaintips(const UniValue& params, bool fHelp);
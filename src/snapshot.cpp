@@ -0,0 +1,528 @@
+// Copyright (c) 2018-2019 The Helix developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "snapshot.h"
+
+#include "chainparams.h"
+#include "clientversion.h"
+#include "hash.h"
+#include "main.h"
+#include "sporkdb.h"
+#include "streams.h"
+#include "txdb.h"
+#include "util.h"
+
+#include <boost/filesystem.hpp>
+#include <boost/scoped_ptr.hpp>
+
+/**
+ * A snapshot is the network magic and the first CSnapshotMetadata fields,
+ * followed by records that each start with one of these types, the coins
+ * statistics and hashSnapshot, and finally the double SHA256 of everything
+ * before it. Coins come first, in txid order, then the raw zerocoin and spork
+ * database entries, where every zerocoin spend and mint carries its height,
+ * then the block index of the active chain from the genesis block up to the
+ * snapshot block. Each of the last MIN_BLOCKS_TO_KEEP index
+ * records is preceded by its block, undo data and supply record, so the new
+ * node can compute accumulator checkpoints and disconnect blocks near the tip.
+ */
+static const char SNAPSHOT_COINS = 'c';
+static const char SNAPSHOT_ZEROCOIN = 'z';
+static const char SNAPSHOT_SPORK = 's';
+static const char SNAPSHOT_BLOCK = 'k';
+static const char SNAPSHOT_BLOCKINDEX = 'b';
+static const char SNAPSHOT_END = 'e';
+
+/** Number of entries written to a database in one batch while loading */
+static const unsigned int SNAPSHOT_BATCH_SIZE = 50000;
+
+/** Reads or writes a file while hashing every byte that passes through */
+class CHashingFile
+{
+private:
+    CAutoFile& file;
+    CHashWriter hasher;
+
+public:
+    CHashingFile(CAutoFile& fileIn) : file(fileIn), hasher(fileIn.GetType(), fileIn.GetVersion()) {}
+
+    void read(char* pch, size_t nSize)
+    {
+        file.read(pch, nSize);
+        hasher.write(pch, nSize);
+    }
+
+    void write(const char* pch, size_t nSize)
+    {
+        file.write(pch, nSize);
+        hasher.write(pch, nSize);
+    }
+
+    template <typename T>
+    CHashingFile& operator<<(const T& obj)
+    {
+        ::Serialize(*this, obj, file.GetType(), file.GetVersion());
+        return (*this);
+    }
+
+    template <typename T>
+    CHashingFile& operator>>(T& obj)
+    {
+        ::Unserialize(*this, obj, file.GetType(), file.GetVersion());
+        return (*this);
+    }
+
+    // invalidates the object
+    uint256 GetHash() { return hasher.GetHash(); }
+
+    int GetType() { return file.GetType(); }
+    int GetVersion() { return file.GetVersion(); }
+};
+
+/** hashSnapshot: the UTXO set hash combined with the hash of all other records */
+static uint256 GetSnapshotHash(const uint256& hashSerialized, CHashWriter& hasherRecords)
+{
+    CHashWriter ss(SER_GETHASH, PROTOCOL_VERSION);
+    ss << hashSerialized << hasherRecords.GetHash();
+    return ss.GetHash();
+}
+
+/**
+ * Whether a raw zerocoin database entry can be used by a node without old
+ * blocks or a transaction index: spends and mints have to carry the height of
+ * their transaction, or serials and pubcoins could not be placed in the chain.
+ */
+static bool IsZerocoinRecordUsable(const std::string& strKey, const std::string& strValue, int nHeightSnapshot)
+{
+    if (strKey.empty() || (strKey[0] != 's' && strKey[0] != 'm'))
+        return true;
+    try {
+        CDataStream ssValue(strValue.data(), strValue.data() + strValue.size(), SER_DISK, CLIENT_VERSION);
+        CZerocoinTxInfo info;
+        ssValue >> info;
+        return ssValue.empty() && info.nHeight >= 0 && info.nHeight <= nHeightSnapshot;
+    } catch (const std::exception&) {
+        return false;
+    }
+}
+
+static bool WriteDatabase(CHashingFile& out, CHashWriter& hasherRecords, char chType, const CLevelDBSnapshot& snapshot, int nHeightSnapshot, std::string& strError)
+{
+    boost::scoped_ptr<leveldb::Iterator> pcursor(snapshot.NewIterator());
+    for (pcursor->SeekToFirst(); pcursor->Valid(); pcursor->Next()) {
+        boost::this_thread::interruption_point();
+        std::string strKey = pcursor->key().ToString(), strValue = pcursor->value().ToString();
+        if (chType == SNAPSHOT_ZEROCOIN && !IsZerocoinRecordUsable(strKey, strValue, nHeightSnapshot)) {
+            strError = "The zerocoin database has spends or mints without a height, restart with -reindexzerocoin first";
+            return false;
+        }
+        out << chType << strKey << strValue;
+        hasherRecords << chType << strKey << strValue;
+    }
+    if (!pcursor->status().ok()) {
+        strError = "Unable to read zerocoin or spork database";
+        return false;
+    }
+    return true;
+}
+
+/** Where one of the blocks shipped with a snapshot is stored */
+struct CSnapshotBlockPos {
+    const CBlockIndex* pindex;
+    CDiskBlockPos posData;
+    CDiskBlockPos posUndo;
+    bool fHaveUndo;
+};
+
+bool DumpTxOutSet(const boost::filesystem::path& path, CSnapshotMetadata& metadata, std::string& strError)
+{
+    boost::filesystem::path pathTemp = path;
+    pathTemp += ".incomplete";
+
+    // Take consistent snapshots of the databases at the tip, then let the
+    // node go on while they are written out
+    boost::scoped_ptr<CCoinsViewSnapshot> pcoins;
+    boost::scoped_ptr<CLevelDBSnapshot> pzerocoin, pspork;
+    const CBlockIndex* pindexSnapshot;
+    std::map<int, CSnapshotBlockPos> mapBlockPos;
+    std::vector<std::shared_ptr<CBlockFilePin> > vPins;
+    {
+        LOCK(cs_main);
+        FlushStateToDisk();
+        pcoins.reset(pcoinsTip->NewSnapshot());
+        if (!pcoins) {
+            strError = "Unable to read UTXO set";
+            return false;
+        }
+        BlockMap::iterator mi = mapBlockIndex.find(pcoins->GetBestBlock());
+        if (mi == mapBlockIndex.end() || !chainActive.Contains(mi->second)) {
+            strError = "UTXO set is not at a block of the active chain";
+            return false;
+        }
+        pindexSnapshot = mi->second;
+        pzerocoin.reset(new CLevelDBSnapshot(*zerocoinDB));
+        pspork.reset(new CLevelDBSnapshot(*pSporkDB));
+
+        // Pin the files of the blocks to ship so they aren't pruned before they are read
+        for (const CBlockIndex* pindex = pindexSnapshot; pindex && mapBlockPos.size() < MIN_BLOCKS_TO_KEEP; pindex = pindex->pprev) {
+            if (!(pindex->nStatus & BLOCK_HAVE_DATA)) {
+                strError = strprintf("Block %d is not available", pindex->nHeight);
+                return false;
+            }
+            CSnapshotBlockPos& blockpos = mapBlockPos[pindex->nHeight];
+            blockpos.pindex = pindex;
+            blockpos.posData = pindex->GetBlockPos();
+            blockpos.posUndo = pindex->GetUndoPos();
+            blockpos.fHaveUndo = (pindex->nStatus & BLOCK_HAVE_UNDO) && pindex->pprev;
+            vPins.push_back(std::make_shared<CBlockFilePin>(pindex->nFile));
+        }
+    }
+
+    metadata = CSnapshotMetadata();
+    metadata.hashGenesisBlock = Params().HashGenesisBlock();
+    metadata.hashBlock = pindexSnapshot->GetBlockHash();
+    metadata.nHeight = pindexSnapshot->nHeight;
+
+    // The block index of the active chain, which is immutable below the snapshot block
+    std::vector<const CBlockIndex*> vChain(pindexSnapshot->nHeight + 1);
+    for (const CBlockIndex* pindex = pindexSnapshot; pindex; pindex = pindex->pprev)
+        vChain[pindex->nHeight] = pindex;
+
+    CAutoFile file(fopen(pathTemp.string().c_str(), "wb"), SER_DISK, CLIENT_VERSION);
+    if (file.IsNull()) {
+        strError = strprintf("Unable to open %s for writing", pathTemp.string());
+        return false;
+    }
+
+    try {
+        CHashingFile out(file);
+        unsigned char pchMessageStart[MESSAGE_START_SIZE];
+        memcpy(pchMessageStart, Params().MessageStart(), MESSAGE_START_SIZE);
+        out << FLATDATA(pchMessageStart) << metadata.nVersion << metadata.hashGenesisBlock << metadata.hashBlock << metadata.nHeight;
+
+        CCoinsStats stats;
+        CCoinsStatsHasher hasher(stats, metadata.hashBlock);
+        bool fWritten = pcoins->ForEachCoins([&out, &hasher](const uint256& txid, const CCoins& coins) {
+            out << SNAPSHOT_COINS << txid << coins;
+            hasher.Add(txid, coins, ::GetSerializeSize(coins, SER_DISK, CLIENT_VERSION));
+            return true;
+        });
+        if (!fWritten) {
+            strError = "Unable to read UTXO set";
+            return false;
+        }
+        hasher.Finalize();
+        pcoins.reset();
+
+        CHashWriter hasherRecords(SER_GETHASH, CLIENT_VERSION);
+        if (!WriteDatabase(out, hasherRecords, SNAPSHOT_ZEROCOIN, *pzerocoin, metadata.nHeight, strError) ||
+            !WriteDatabase(out, hasherRecords, SNAPSHOT_SPORK, *pspork, metadata.nHeight, strError))
+            return false;
+        pzerocoin.reset();
+        pspork.reset();
+
+        for (unsigned int nHeight = 0; nHeight < vChain.size(); nHeight++) {
+            boost::this_thread::interruption_point();
+            std::map<int, CSnapshotBlockPos>::const_iterator it = mapBlockPos.find(nHeight);
+            if (it != mapBlockPos.end()) {
+                CBlock block;
+                CBlockUndo blockundo;
+                if (!ReadBlockFromDisk(block, it->second.posData) || block.GetHash() != it->second.pindex->GetBlockHash() ||
+                    (it->second.fHaveUndo && !blockundo.ReadFromDisk(it->second.posUndo, block.hashPrevBlock))) {
+                    strError = strprintf("Unable to read block %d", nHeight);
+                    return false;
+                }
+                out << SNAPSHOT_BLOCK << block << it->second.fHaveUndo;
+                hasherRecords << SNAPSHOT_BLOCK << block << it->second.fHaveUndo;
+                if (it->second.fHaveUndo) {
+                    out << blockundo;
+                    hasherRecords << blockundo;
+                }
+                CBlockSupply supply;
+                bool fHaveSupply = pblocktree->ReadBlockSupply(block.GetHash(), supply);
+                out << fHaveSupply;
+                hasherRecords << fHaveSupply;
+                if (fHaveSupply) {
+                    out << supply;
+                    hasherRecords << supply;
+                }
+            }
+
+            // Block positions are the new node's own, and blocks below the shipped ones are missing
+            CDiskBlockIndex diskindex;
+            {
+                LOCK(cs_main);
+                diskindex = CDiskBlockIndex(vChain[nHeight]);
+            }
+            diskindex.nStatus &= BLOCK_VALID_MASK;
+            diskindex.nFile = 0;
+            diskindex.nDataPos = 0;
+            diskindex.nUndoPos = 0;
+            out << SNAPSHOT_BLOCKINDEX << diskindex;
+            hasherRecords << SNAPSHOT_BLOCKINDEX << diskindex;
+        }
+        vPins.clear();
+
+        metadata.nTransactions = stats.nTransactions;
+        metadata.nTransactionOutputs = stats.nTransactionOutputs;
+        metadata.hashSerialized = stats.hashSerialized;
+        metadata.nTotalAmount = stats.nTotalAmount;
+        metadata.hashSnapshot = GetSnapshotHash(stats.hashSerialized, hasherRecords);
+        out << SNAPSHOT_END << metadata.nTransactions << metadata.nTransactionOutputs << metadata.hashSerialized << metadata.nTotalAmount << metadata.hashSnapshot;
+        file << out.GetHash();
+    } catch (const std::exception& e) {
+        strError = strprintf("I/O error writing %s: %s", pathTemp.string(), e.what());
+        return false;
+    }
+    file.fclose();
+
+    if (!RenameOver(pathTemp, path)) {
+        strError = strprintf("Unable to rename %s to %s", pathTemp.string(), path.string());
+        return false;
+    }
+    LogPrintf("%s: wrote UTXO snapshot of block %s (height %d) to %s, snapshot hash %s\n", __func__, metadata.hashBlock.ToString(), metadata.nHeight, path.string(), metadata.hashSnapshot.ToString());
+    return true;
+}
+
+/** Check the trailing checksum of a snapshot before anything is written to the databases */
+static bool VerifySnapshotChecksum(const boost::filesystem::path& path, std::string& strError)
+{
+    CAutoFile file(fopen(path.string().c_str(), "rb"), SER_DISK, CLIENT_VERSION);
+    if (file.IsNull()) {
+        strError = strprintf("Unable to open %s", path.string());
+        return false;
+    }
+    uint64_t nSize = boost::filesystem::file_size(path);
+    if (nSize < 32) {
+        strError = "Snapshot file is truncated";
+        return false;
+    }
+
+    try {
+        CHashWriter hasher(SER_DISK, CLIENT_VERSION);
+        std::vector<char> vchBuf(1 << 20);
+        for (uint64_t nLeft = nSize - 32; nLeft > 0;) {
+            boost::this_thread::interruption_point();
+            size_t nRead = std::min<uint64_t>(nLeft, vchBuf.size());
+            file.read(&vchBuf[0], nRead);
+            hasher.write(&vchBuf[0], nRead);
+            nLeft -= nRead;
+        }
+        uint256 hashFile;
+        file >> hashFile;
+        if (hashFile != hasher.GetHash()) {
+            strError = "Snapshot file checksum mismatch";
+            return false;
+        }
+    } catch (const std::exception& e) {
+        strError = strprintf("I/O error reading %s: %s", path.string(), e.what());
+        return false;
+    }
+    return true;
+}
+
+bool LoadTxOutSet(const boost::filesystem::path& path, CCoinsViewDB* pcoinsdb, const uint256& hashExpected, std::string& strError)
+{
+    if (hashExpected == 0) {
+        strError = "The expected snapshot hash is not set";
+        return false;
+    }
+    if (!VerifySnapshotChecksum(path, strError))
+        return false;
+
+    CAutoFile file(fopen(path.string().c_str(), "rb"), SER_DISK, CLIENT_VERSION);
+    if (file.IsNull()) {
+        strError = strprintf("Unable to open %s", path.string());
+        return false;
+    }
+
+    try {
+        CHashingFile in(file);
+        unsigned char pchMessageStart[MESSAGE_START_SIZE];
+        CSnapshotMetadata metadata;
+        in >> FLATDATA(pchMessageStart) >> metadata.nVersion;
+        if (memcmp(pchMessageStart, Params().MessageStart(), MESSAGE_START_SIZE)) {
+            strError = "Snapshot is for a different network";
+            return false;
+        }
+        if (metadata.nVersion != UTXO_SNAPSHOT_VERSION) {
+            strError = strprintf("Unsupported snapshot version %d", metadata.nVersion);
+            return false;
+        }
+        in >> metadata.hashGenesisBlock >> metadata.hashBlock >> metadata.nHeight;
+        if (metadata.hashGenesisBlock != Params().HashGenesisBlock()) {
+            strError = "Snapshot is for a different network";
+            return false;
+        }
+        LogPrintf("%s: loading UTXO snapshot of block %s (height %d)\n", __func__, metadata.hashBlock.ToString(), metadata.nHeight);
+
+        CCoinsStats stats;
+        CCoinsStatsHasher hasher(stats, metadata.hashBlock);
+        CHashWriter hasherRecords(SER_GETHASH, CLIENT_VERSION);
+        CCoinsMap mapCoins;
+        CLevelDBBatch batchZerocoin, batchSpork;
+        unsigned int nZerocoin = 0, nSpork = 0;
+        std::vector<CDiskBlockIndex> vBlockIndex;
+        uint256 hashPrev = 0;
+        int nHeight = -1;
+        //! The block record preceding the next block index record, if any
+        boost::scoped_ptr<CBlock> pblock;
+        boost::scoped_ptr<CBlockUndo> pblockundo;
+        boost::scoped_ptr<CBlockSupply> pblocksupply;
+
+        char chType = SNAPSHOT_COINS;
+        in >> chType;
+        while (chType == SNAPSHOT_COINS) {
+            boost::this_thread::interruption_point();
+            uint256 txid;
+            CCoinsCacheEntry entry;
+            in >> txid >> entry.coins;
+            hasher.Add(txid, entry.coins, ::GetSerializeSize(entry.coins, SER_DISK, CLIENT_VERSION));
+            entry.flags = CCoinsCacheEntry::DIRTY;
+            mapCoins[txid] = entry;
+            if (mapCoins.size() >= SNAPSHOT_BATCH_SIZE && !pcoinsdb->BatchWrite(mapCoins, uint256(0))) {
+                strError = "Failed to write coins database";
+                return false;
+            }
+            in >> chType;
+        }
+        if (!pcoinsdb->BatchWrite(mapCoins, uint256(0))) {
+            strError = "Failed to write coins database";
+            return false;
+        }
+        hasher.Finalize();
+
+        while (chType != SNAPSHOT_END) {
+            boost::this_thread::interruption_point();
+            if (chType == SNAPSHOT_ZEROCOIN || chType == SNAPSHOT_SPORK) {
+                std::string strKey, strValue;
+                in >> strKey >> strValue;
+                hasherRecords << chType << strKey << strValue;
+                bool fZerocoin = chType == SNAPSHOT_ZEROCOIN;
+                if (fZerocoin && !IsZerocoinRecordUsable(strKey, strValue, metadata.nHeight)) {
+                    strError = "Snapshot has zerocoin spends or mints without a height";
+                    return false;
+                }
+                (fZerocoin ? batchZerocoin : batchSpork).WriteRaw(strKey, strValue);
+                if (++(fZerocoin ? nZerocoin : nSpork) % SNAPSHOT_BATCH_SIZE == 0) {
+                    if (!(fZerocoin ? (CLevelDBWrapper*)zerocoinDB : pSporkDB)->WriteBatch(fZerocoin ? batchZerocoin : batchSpork)) {
+                        strError = "Failed to write zerocoin or spork database";
+                        return false;
+                    }
+                    (fZerocoin ? batchZerocoin : batchSpork) = CLevelDBBatch();
+                }
+            } else if (chType == SNAPSHOT_BLOCK) {
+                bool fHaveUndo;
+                pblock.reset(new CBlock());
+                in >> *pblock >> fHaveUndo;
+                hasherRecords << chType << *pblock << fHaveUndo;
+                pblockundo.reset();
+                if (fHaveUndo) {
+                    pblockundo.reset(new CBlockUndo());
+                    in >> *pblockundo;
+                    hasherRecords << *pblockundo;
+                }
+                bool fHaveSupply;
+                in >> fHaveSupply;
+                hasherRecords << fHaveSupply;
+                pblocksupply.reset();
+                if (fHaveSupply) {
+                    pblocksupply.reset(new CBlockSupply());
+                    in >> *pblocksupply;
+                    hasherRecords << *pblocksupply;
+                }
+            } else if (chType == SNAPSHOT_BLOCKINDEX) {
+                CDiskBlockIndex diskindex;
+                in >> diskindex;
+                hasherRecords << chType << diskindex;
+                if (diskindex.hashPrev != hashPrev || diskindex.nHeight != nHeight + 1 || (nHeight < 0 && diskindex.GetBlockHash() != Params().HashGenesisBlock())) {
+                    strError = strprintf("Snapshot block index is not a chain at height %d", diskindex.nHeight);
+                    return false;
+                }
+                if (pblock) {
+                    if (pblock->GetHash() != diskindex.GetBlockHash()) {
+                        strError = strprintf("Snapshot block does not match the block index at height %d", diskindex.nHeight);
+                        return false;
+                    }
+                    if (!StoreSnapshotBlock(*pblock, pblockundo.get(), diskindex) ||
+                        (pblocksupply && !pblocktree->WriteBlockSupply(diskindex.GetBlockHash(), *pblocksupply))) {
+                        strError = "Failed to write block files";
+                        return false;
+                    }
+                    pblock.reset();
+                    pblockundo.reset();
+                    pblocksupply.reset();
+                } else if (!vBlockIndex.empty() && (vBlockIndex.back().nStatus & BLOCK_HAVE_DATA)) {
+                    strError = strprintf("Snapshot blocks are not contiguous at height %d", diskindex.nHeight);
+                    return false;
+                }
+                hashPrev = diskindex.GetBlockHash();
+                nHeight = diskindex.nHeight;
+                vBlockIndex.push_back(diskindex);
+                if (vBlockIndex.size() >= SNAPSHOT_BATCH_SIZE) {
+                    if (!pblocktree->WriteBlockIndexes(vBlockIndex)) {
+                        strError = "Failed to write block index";
+                        return false;
+                    }
+                    // Keep the last record, for the contiguity check above
+                    vBlockIndex.erase(vBlockIndex.begin(), vBlockIndex.end() - 1);
+                }
+            } else {
+                strError = strprintf("Unknown snapshot record type %d", (int)chType);
+                return false;
+            }
+            in >> chType;
+        }
+
+        if (hashPrev != metadata.hashBlock || nHeight != metadata.nHeight || pblock) {
+            strError = "Snapshot block index does not end at the snapshot block";
+            return false;
+        }
+        if (!(vBlockIndex.back().nStatus & BLOCK_HAVE_DATA)) {
+            strError = "Snapshot does not hold the blocks before the snapshot block";
+            return false;
+        }
+
+        in >> metadata.nTransactions >> metadata.nTransactionOutputs >> metadata.hashSerialized >> metadata.nTotalAmount >> metadata.hashSnapshot;
+        if (stats.hashSerialized != metadata.hashSerialized || stats.nTransactions != metadata.nTransactions ||
+            stats.nTransactionOutputs != metadata.nTransactionOutputs || stats.nTotalAmount != metadata.nTotalAmount) {
+            strError = strprintf("Snapshot UTXO set hash %s does not match its header (%s)", stats.hashSerialized.ToString(), metadata.hashSerialized.ToString());
+            return false;
+        }
+        uint256 hashSnapshot = GetSnapshotHash(stats.hashSerialized, hasherRecords);
+        if (hashSnapshot != metadata.hashSnapshot || hashSnapshot != hashExpected) {
+            strError = strprintf("Snapshot hash %s does not match the expected %s", hashSnapshot.ToString(), hashExpected.ToString());
+            return false;
+        }
+
+        if (!zerocoinDB->WriteBatch(batchZerocoin) || !pSporkDB->WriteBatch(batchSpork) || !pblocktree->WriteBlockIndexes(vBlockIndex) || !FlushBlockFileInfo()) {
+            strError = "Failed to write block index, zerocoin or spork database";
+            return false;
+        }
+
+        // Blocks below the shipped ones are missing, exactly as if they had been pruned
+        fTxIndex = GetBoolArg("-txindex", true);
+        fAddrIndex = GetBoolArg("-addrindex", DEFAULT_ADDRINDEX);
+        fHavePruned = true;
+        if (!pblocktree->WriteFlag("txindex", fTxIndex) || !pblocktree->WriteFlag("addrindex", fAddrIndex) ||
+            (fAddrIndex && !pblocktree->WriteInt("addrindexversion", ADDRESS_INDEX_VERSION)) ||
+            !pblocktree->WriteFlag("prunedblockfiles", true) || !pblocktree->Sync() || !zerocoinDB->Sync() || !pSporkDB->Sync()) {
+            strError = "Failed to write block index";
+            return false;
+        }
+
+        // Commit: from here on the chainstate is the snapshot's
+        CCoinsMap mapEmpty;
+        if (!pcoinsdb->BatchWrite(mapEmpty, metadata.hashBlock)) {
+            strError = "Failed to write coins database";
+            return false;
+        }
+        LogPrintf("%s: loaded %u transactions with %u unspent outputs, snapshot hash %s\n", __func__,
+            stats.nTransactions, stats.nTransactionOutputs, hashSnapshot.ToString());
+    } catch (const std::exception& e) {
+        strError = strprintf("I/O error reading %s: %s", path.string(), e.what());
+        return false;
+    }
+    return true;
+}
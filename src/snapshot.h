@@ -0,0 +1,64 @@
+// Copyright (c) 2018-2019 The Helix developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef HELIX_SNAPSHOT_H
+#define HELIX_SNAPSHOT_H
+
+#include "amount.h"
+#include "uint256.h"
+
+#include <string>
+
+#include <boost/filesystem/path.hpp>
+
+class CCoinsViewDB;
+
+/** Version of the UTXO snapshot format written by dumptxoutset */
+static const int UTXO_SNAPSHOT_VERSION = 2;
+
+/**
+ * Description of a UTXO snapshot. The coins statistics are the ones
+ * gettxoutsetinfo reports at the snapshot block. hashSnapshot commits to
+ * those coins and to everything else the snapshot holds: the zerocoin and
+ * spork databases, the block index records with their supply data and the
+ * blocks shipped with it. It is what -loadtxoutsethash must be set to.
+ */
+class CSnapshotMetadata
+{
+public:
+    int nVersion;
+    uint256 hashGenesisBlock;
+    uint256 hashBlock;
+    int nHeight;
+    uint64_t nTransactions;
+    uint64_t nTransactionOutputs;
+    uint256 hashSerialized;
+    CAmount nTotalAmount;
+    uint256 hashSnapshot;
+
+    CSnapshotMetadata() : nVersion(UTXO_SNAPSHOT_VERSION), hashGenesisBlock(0), hashBlock(0), nHeight(0), nTransactions(0), nTransactionOutputs(0), hashSerialized(0), nTotalAmount(0), hashSnapshot(0) {}
+};
+
+/**
+ * Write the UTXO set at the current tip to a file, together with the block
+ * index of the active chain, the last MIN_BLOCKS_TO_KEEP blocks with their
+ * undo data and the zerocoin and spork databases. Fails if a zerocoin spend or
+ * mint has no height (see -reindexzerocoin), since a node loaded from the
+ * snapshot has no old blocks or transaction index to look it up in. cs_main is
+ * only held to take consistent database snapshots; the file is written
+ * without it.
+ */
+bool DumpTxOutSet(const boost::filesystem::path& path, CSnapshotMetadata& metadata, std::string& strError);
+
+/**
+ * Populate empty block index, coins, zerocoin and spork databases and block
+ * files from a file written by DumpTxOutSet. The snapshot's hashSnapshot must
+ * match hashExpected, which can't be zero, and its zerocoin spends and mints
+ * must carry their heights. The coins database only gets its
+ * best block, which makes the snapshot take effect, once everything else has
+ * been written and checked.
+ */
+bool LoadTxOutSet(const boost::filesystem::path& path, CCoinsViewDB* pcoinsdb, const uint256& hashExpected, std::string& strError);
+
+#endif // HELIX_SNAPSHOT_H
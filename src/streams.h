@@ -606,4 +606,105 @@ public:
     int GetVersion() { return nVersion; }
 };
 
+/** Non-owning stream over a read-only span of memory, such as a memory-mapped
+ *  block file. Objects are deserialized straight from the source bytes, and
+ *  the positioning interface mirrors CBufferedFile.
+ */
+class CMemoryReader
+{
+private:
+    int nType;
+    int nVersion;
+
+    const char* pbegin;
+    uint64_t nSize;
+    uint64_t nReadPos;
+    uint64_t nReadLimit;
+
+public:
+    CMemoryReader(const char* pbeginIn, uint64_t nSizeIn, int nTypeIn, int nVersionIn) : nType(nTypeIn), nVersion(nVersionIn), pbegin(pbeginIn), nSize(nSizeIn), nReadPos(0), nReadLimit((uint64_t)(-1)) {}
+
+    // check whether we're at the end of the source
+    bool eof() const
+    {
+        return nReadPos >= nSize;
+    }
+
+    // read a number of bytes
+    CMemoryReader& read(char* pch, size_t nRead)
+    {
+        if (nRead + nReadPos > nReadLimit)
+            throw std::ios_base::failure("Read attempted past buffer limit");
+        if (nRead + nReadPos > nSize)
+            throw std::ios_base::failure("CMemoryReader::read : end of data");
+        memcpy(pch, pbegin + nReadPos, nRead);
+        nReadPos += nRead;
+        return (*this);
+    }
+
+    CMemoryReader& ignore(size_t nSkip)
+    {
+        if (nSkip + nReadPos > nReadLimit)
+            throw std::ios_base::failure("Read attempted past buffer limit");
+        if (nSkip + nReadPos > nSize)
+            throw std::ios_base::failure("CMemoryReader::ignore : end of data");
+        nReadPos += nSkip;
+        return (*this);
+    }
+
+    // return the current reading position
+    uint64_t GetPos() const
+    {
+        return nReadPos;
+    }
+
+    // move to a given reading position
+    bool SetPos(uint64_t nPos)
+    {
+        if (nPos > nSize) {
+            nReadPos = nSize;
+            return false;
+        }
+        nReadPos = nPos;
+        return true;
+    }
+
+    // prevent reading beyond a certain position
+    // no argument removes the limit
+    bool SetLimit(uint64_t nPos = (uint64_t)(-1))
+    {
+        if (nPos < nReadPos)
+            return false;
+        nReadLimit = nPos;
+        return true;
+    }
+
+    template <typename T>
+    CMemoryReader& operator>>(T& obj)
+    {
+        // Unserialize from this stream
+        ::Unserialize(*this, obj, nType, nVersion);
+        return (*this);
+    }
+
+    // search for a given byte in the stream, and remain positioned on it
+    void FindByte(char ch)
+    {
+        const void* p = nReadPos < nSize ? memchr(pbegin + nReadPos, ch, nSize - nReadPos) : NULL;
+        if (!p) {
+            nReadPos = nSize;
+            throw std::ios_base::failure("CMemoryReader::FindByte : end of data");
+        }
+        nReadPos = (const char*)p - pbegin;
+    }
+
+    //
+    // Stream subset
+    //
+    void SetType(int n) { nType = n; }
+    int GetType() { return nType; }
+    void SetVersion(int n) { nVersion = n; }
+    int GetVersion() { return nVersion; }
+};
+
 #endif // BITCOIN_STREAMS_H
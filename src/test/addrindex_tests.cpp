@@ -0,0 +1,127 @@
+// Copyright (c) 2018-2019 The Helix developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "key.h"
+#include "main.h"
+#include "random.h"
+#include "script/standard.h"
+#include "txdb.h"
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_AUTO_TEST_SUITE(addrindex_tests)
+
+BOOST_AUTO_TEST_CASE(addrindex_ids)
+{
+    CKey key;
+    key.MakeNewKey(true);
+    CPubKey pubkey = key.GetPubKey();
+    CScript redeem = GetScriptForRawPubKey(pubkey);
+    std::vector<uint160> vIds;
+
+    GetAddrIndexIds(GetScriptForDestination(pubkey.GetID()), vIds);
+    BOOST_CHECK_EQUAL(vIds.size(), 1U);
+    BOOST_CHECK(vIds[0] == uint160(pubkey.GetID()));
+
+    // Pay-to-pubkey is found under the key's address
+    vIds.clear();
+    GetAddrIndexIds(redeem, vIds);
+    BOOST_CHECK_EQUAL(vIds.size(), 1U);
+    BOOST_CHECK(vIds[0] == uint160(pubkey.GetID()));
+
+    vIds.clear();
+    GetAddrIndexIds(GetScriptForDestination(CScriptID(redeem)), vIds);
+    BOOST_CHECK_EQUAL(vIds.size(), 1U);
+    BOOST_CHECK(vIds[0] == uint160(CScriptID(redeem)));
+
+    uint160 addrid;
+    BOOST_CHECK(GetAddressIndexId(CTxDestination(pubkey.GetID()), addrid));
+    BOOST_CHECK(addrid == uint160(pubkey.GetID()));
+
+    // Outputs that pay no address are not indexed
+    vIds.clear();
+    GetAddrIndexIds(CScript(), vIds);
+    BOOST_CHECK(vIds.empty());
+    std::vector<unsigned char> vchPubcoin(128, 0x5a);
+    GetAddrIndexIds(CScript() << OP_ZEROCOINMINT << vchPubcoin, vIds);
+    BOOST_CHECK(vIds.empty());
+    GetAddrIndexIds(CScript() << OP_RETURN << ToByteVector(pubkey), vIds);
+    BOOST_CHECK(vIds.empty());
+}
+
+BOOST_AUTO_TEST_CASE(addrindex_summary)
+{
+    uint160 addrid;
+    GetRandBytes(addrid.begin(), addrid.size());
+    uint256 txFund = GetRandHash();
+    uint256 txSpend = GetRandHash();
+    CScript script = CScript() << OP_TRUE;
+
+    // One transaction paying the address twice, then one spending both outputs
+    // and paying change back
+    std::vector<std::pair<CAddressIndexKey, CAddressIndexValue> > vFund;
+    std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > vFundUnspent;
+    for (unsigned int k = 0; k < 2; k++) {
+        vFund.push_back(std::make_pair(CAddressIndexKey(addrid, 10, 1, txFund, false, k), CAddressIndexValue(5 * COIN, CDiskTxPos())));
+        vFundUnspent.push_back(std::make_pair(CAddressUnspentKey(addrid, txFund, k), CAddressUnspentValue(5 * COIN, script, 10)));
+    }
+    BOOST_CHECK(pblocktree->UpdateAddrIndex(vFund, vFundUnspent, true));
+
+    std::vector<std::pair<CAddressIndexKey, CAddressIndexValue> > vSpend;
+    std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > vSpendUnspent;
+    for (unsigned int j = 0; j < 2; j++) {
+        vSpend.push_back(std::make_pair(CAddressIndexKey(addrid, 11, 1, txSpend, true, j), CAddressIndexValue(-5 * COIN, CDiskTxPos())));
+        vSpendUnspent.push_back(std::make_pair(CAddressUnspentKey(addrid, txFund, j), CAddressUnspentValue()));
+    }
+    vSpend.push_back(std::make_pair(CAddressIndexKey(addrid, 11, 1, txSpend, false, 0), CAddressIndexValue(3 * COIN, CDiskTxPos())));
+    vSpendUnspent.push_back(std::make_pair(CAddressUnspentKey(addrid, txSpend, 0), CAddressUnspentValue(3 * COIN, script, 11)));
+    BOOST_CHECK(pblocktree->UpdateAddrIndex(vSpend, vSpendUnspent, true));
+
+    CAddressSummary summary;
+    BOOST_CHECK(pblocktree->ReadAddrSummary(addrid, summary));
+    BOOST_CHECK_EQUAL(summary.nBalance, 3 * COIN);
+    BOOST_CHECK_EQUAL(summary.nReceived, 13 * COIN);
+    BOOST_CHECK_EQUAL(summary.nTxCount, 2U);
+
+    std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > vUnspent;
+    BOOST_CHECK(pblocktree->ReadAddrUnspent(addrid, vUnspent));
+    BOOST_CHECK_EQUAL(vUnspent.size(), 1U);
+    BOOST_CHECK(vUnspent[0].first.txhash == txSpend);
+    BOOST_CHECK_EQUAL(vUnspent[0].second.nValue, 3 * COIN);
+
+    // History is returned in chain order
+    std::vector<CAddressIndexKey> vKeys;
+    BOOST_CHECK(pblocktree->ReadAddrIndex(CAddressIndexKey(addrid, 0, 0, uint256(), false, 0), [&vKeys](const CAddressIndexKey& key, const CAddressIndexValue&) {
+        vKeys.push_back(key);
+        return true;
+    }));
+    BOOST_CHECK_EQUAL(vKeys.size(), 5U);
+    for (unsigned int i = 1; i < vKeys.size(); i++)
+        BOOST_CHECK(vKeys[i - 1].nHeight <= vKeys[i].nHeight);
+
+    // Disconnecting both blocks, as DisconnectBlock does, leaves nothing behind
+    vSpendUnspent.clear();
+    for (unsigned int j = 0; j < 2; j++)
+        vSpendUnspent.push_back(std::make_pair(CAddressUnspentKey(addrid, txFund, j), CAddressUnspentValue(5 * COIN, script, 10)));
+    vSpendUnspent.push_back(std::make_pair(CAddressUnspentKey(addrid, txSpend, 0), CAddressUnspentValue()));
+    BOOST_CHECK(pblocktree->UpdateAddrIndex(vSpend, vSpendUnspent, false));
+    for (unsigned int k = 0; k < 2; k++)
+        vFundUnspent[k].second = CAddressUnspentValue();
+    BOOST_CHECK(pblocktree->UpdateAddrIndex(vFund, vFundUnspent, false));
+
+    BOOST_CHECK(pblocktree->ReadAddrSummary(addrid, summary));
+    BOOST_CHECK_EQUAL(summary.nTxCount, 0U);
+    BOOST_CHECK_EQUAL(summary.nBalance, 0);
+    vUnspent.clear();
+    BOOST_CHECK(pblocktree->ReadAddrUnspent(addrid, vUnspent));
+    BOOST_CHECK(vUnspent.empty());
+    vKeys.clear();
+    BOOST_CHECK(pblocktree->ReadAddrIndex(CAddressIndexKey(addrid, 0, 0, uint256(), false, 0), [&vKeys](const CAddressIndexKey& key, const CAddressIndexValue&) {
+        vKeys.push_back(key);
+        return true;
+    }));
+    BOOST_CHECK(vKeys.empty());
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -5,7 +5,12 @@
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
 #include "primitives/transaction.h"
+#include "chainparams.h"
+#include "clientversion.h"
+#include "consensus/merkle.h"
 #include "main.h"
+#include "streams.h"
+#include "txdb.h"
 
 #include <boost/test/unit_test.hpp>
 
@@ -54,4 +59,225 @@ BOOST_AUTO_TEST_CASE(subsidy_limit_test)
     }
 }
 
+BOOST_AUTO_TEST_CASE(reindex_parse_block_file)
+{
+    // A block file image holding the genesis block and a chain of blocks
+    // stored children first, with stray bytes in between
+    std::vector<CBlock> vBlocks(1, Params().GenesisBlock());
+    for (unsigned int i = 0; i < 2 * REINDEX_PARSE_WINDOW + 10; i++) {
+        CMutableTransaction tx;
+        tx.vin.resize(1);
+        tx.vin[0].scriptSig = CScript() << i << OP_0;
+        tx.vout.resize(1);
+        CBlock block;
+        block.nVersion = 1;
+        block.hashPrevBlock = vBlocks.back().GetHash();
+        block.vtx.push_back(tx);
+        // Every third block fails its merkle root check
+        if (i % 3)
+            block.hashMerkleRoot = block.BuildMerkleTree();
+        vBlocks.push_back(block);
+    }
+    for (unsigned int i = 1; i + 1 < vBlocks.size(); i += 2)
+        std::swap(vBlocks[i], vBlocks[i + 1]);
+
+    CDataStream ss(SER_DISK, CLIENT_VERSION);
+    std::vector<unsigned int> vPos;
+    for (unsigned int i = 0; i < vBlocks.size(); i++) {
+        ss << (uint8_t)i << (uint8_t)0;
+        unsigned int nSize = ::GetSerializeSize(vBlocks[i], SER_DISK, CLIENT_VERSION);
+        ss << FLATDATA(Params().MessageStart()) << nSize;
+        vPos.push_back(ss.size());
+        ss << vBlocks[i];
+    }
+    std::vector<char> vch(ss.begin(), ss.end());
+
+    std::vector<uint256> vHash;
+    std::vector<unsigned int> vPosFound;
+    std::vector<bool> vChecked;
+    ParseBlockFile(&vch[0], vch.size(), 4, [&](CBlock& block, const uint256& hash, unsigned int nPos) {
+        BOOST_CHECK(block.GetHash() == hash);
+        vHash.push_back(hash);
+        vPosFound.push_back(nPos);
+        vChecked.push_back(block.IsChecked());
+        return true;
+    });
+
+    // Blocks arrive in file order whichever thread parsed them
+    BOOST_REQUIRE_EQUAL(vHash.size(), vBlocks.size());
+    for (unsigned int i = 0; i < vBlocks.size(); i++) {
+        BOOST_CHECK(vHash[i] == vBlocks[i].GetHash());
+        BOOST_CHECK_EQUAL(vPosFound[i], vPos[i]);
+    }
+
+    // Only blocks that passed the context-free checks are marked checked
+    BOOST_CHECK(vChecked[0]);
+    for (unsigned int i = 1; i < vChecked.size(); i++)
+        BOOST_CHECK_EQUAL(vChecked[i], vBlocks[i].hashMerkleRoot == vBlocks[i].BuildMerkleTree());
+
+    // Processing stops when asked to
+    unsigned int nProcessed = 0;
+    ParseBlockFile(&vch[0], vch.size(), 1, [&](CBlock& block, const uint256& hash, unsigned int nPos) {
+        return ++nProcessed < 5;
+    });
+    BOOST_CHECK_EQUAL(nProcessed, 5U);
+}
+
+BOOST_AUTO_TEST_CASE(block_checked_flag_not_copied)
+{
+    CBlock block(Params().GenesisBlock());
+    BOOST_CHECK(!block.IsChecked());
+    block.SetChecked();
+    BOOST_CHECK(block.IsChecked());
+
+    CBlock copy(block);
+    BOOST_CHECK(!copy.IsChecked());
+    BOOST_CHECK(copy.GetHash() == block.GetHash());
+    copy.SetChecked();
+    copy = Params().GenesisBlock();
+    BOOST_CHECK(!copy.IsChecked());
+
+    block.SetNull();
+    BOOST_CHECK(!block.IsChecked());
+}
+
+BOOST_AUTO_TEST_CASE(assumevalid_skips_checks)
+{
+    LOCK(cs_main);
+
+    // A chain of twelve blocks and a fork off it at height 5
+    std::vector<uint256> vHash(13);
+    std::vector<CBlockIndex> vIndex(13);
+    for (unsigned int i = 0; i < vIndex.size(); i++) {
+        vHash[i] = uint256(i + 1);
+        vIndex[i].phashBlock = &vHash[i];
+        vIndex[i].nHeight = i < 12 ? i : 5;
+        vIndex[i].nTime = 1000 + i * 60;
+        vIndex[i].pprev = i == 0 ? NULL : i < 12 ? &vIndex[i - 1] : &vIndex[4];
+        vIndex[i].BuildSkip();
+    }
+    CBlockIndex* pindexFork = &vIndex[12];
+
+    for (unsigned int i = 0; i < vIndex.size(); i++)
+        vIndex[i].nChainWork = vIndex[i].nHeight + 1;
+
+    uint256 hashOld = hashAssumeValid;
+    CBlockIndex* pindexBestHeaderOld = pindexBestHeader;
+    hashAssumeValid = vHash[10];
+    pindexBestHeader = &vIndex[11];
+
+    // Nothing is covered until the assumed valid block is in the index
+    BOOST_CHECK(!IsAssumedValid(&vIndex[5]));
+    BOOST_CHECK(!IsAssumedValid(&vIndex[10]));
+
+    // Then only its ancestors on the best header chain are
+    mapBlockIndex.insert(std::make_pair(vHash[10], &vIndex[10]));
+    BOOST_CHECK(IsAssumedValid(&vIndex[5]));
+    BOOST_CHECK(IsAssumedValid(&vIndex[10]));
+    BOOST_CHECK(!IsAssumedValid(pindexFork));
+    BOOST_CHECK(!IsAssumedValid(&vIndex[11]));
+
+    // Not while the best header is on a fork or has less work behind it
+    pindexBestHeader = pindexFork;
+    BOOST_CHECK(!IsAssumedValid(&vIndex[5]));
+    BOOST_CHECK(!IsAssumedValid(&vIndex[4]));
+    pindexBestHeader = &vIndex[11];
+    vIndex[11].nChainWork = vIndex[10].nChainWork - 1;
+    BOOST_CHECK(!IsAssumedValid(&vIndex[5]));
+    vIndex[11].nChainWork = vIndex[10].nChainWork + 1;
+    BOOST_CHECK(IsAssumedValid(&vIndex[5]));
+
+    // Disabled, nothing is
+    hashAssumeValid = 0;
+    BOOST_CHECK(!IsAssumedValid(&vIndex[5]));
+
+    mapBlockIndex.erase(vHash[10]);
+    pindexBestHeader = pindexBestHeaderOld;
+    hashAssumeValid = hashOld;
+}
+
+BOOST_AUTO_TEST_CASE(recalculate_supply_from_records)
+{
+    LOCK(cs_main);
+    CBlockTreeDB* pblocktreeOld = pblocktree;
+    CBlockIndex* pindexTipOld = chainActive.Tip();
+    pblocktree = new CBlockTreeDB(1 << 20, true);
+
+    // A chain of six blocks; only the last one has its data, as if the others were pruned
+    std::vector<uint256> vHash(6);
+    std::vector<CBlockIndex> vIndex(6);
+    for (unsigned int i = 0; i < vIndex.size(); i++) {
+        vHash[i] = uint256(i + 1);
+        vIndex[i].phashBlock = &vHash[i];
+        vIndex[i].nHeight = i;
+        vIndex[i].pprev = i == 0 ? NULL : &vIndex[i - 1];
+        vIndex[i].BuildSkip();
+    }
+    vIndex[0].nMoneySupply = 100 * COIN;
+    chainActive.SetTip(&vIndex.back());
+
+    CMutableTransaction txCoinbase;
+    txCoinbase.vin.resize(1);
+    txCoinbase.vin[0].prevout.SetNull();
+    txCoinbase.vout.push_back(CTxOut(3 * COIN, CScript()));
+    CBlock block;
+    block.hashPrevBlock = vHash[4];
+    block.vtx.push_back(CTransaction(txCoinbase));
+    block.hashMerkleRoot = BlockMerkleRoot(block);
+    CDiskBlockPos pos(2000, 0);
+    BOOST_CHECK(WriteBlockToDisk(block, pos));
+    CBlockIndex& indexData = vIndex[5];
+    indexData.nFile = pos.nFile;
+    indexData.nDataPos = pos.nPos;
+    indexData.nStatus = BLOCK_HAVE_DATA | BLOCK_VALID_TRANSACTIONS;
+    indexData.nVersion = block.nVersion;
+    indexData.hashMerkleRoot = block.hashMerkleRoot;
+    indexData.nTime = block.nTime;
+    indexData.nBits = block.nBits;
+    indexData.nNonce = block.nNonce;
+    indexData.nAccumulatorCheckpoint = block.nAccumulatorCheckpoint;
+
+    CBlockSupply supply;
+    supply.nMoneySupplyDelta = 7 * COIN;
+    supply.vMintDenominations.push_back(libzerocoin::CoinDenomination::ZQ_ONE);
+    supply.vSpendDenominations.push_back(libzerocoin::CoinDenomination::ZQ_FIVE);
+    for (unsigned int i = 1; i < 5; i++) {
+        if (i != 3)
+            BOOST_CHECK(pblocktree->WriteBlockSupply(vHash[i], supply));
+    }
+
+    CBlockSupply supplyRead;
+    BOOST_CHECK(pblocktree->ReadBlockSupply(vHash[1], supplyRead));
+    BOOST_CHECK_EQUAL(supplyRead.nMoneySupplyDelta, supply.nMoneySupplyDelta);
+    BOOST_CHECK(supplyRead.vMintDenominations == supply.vMintDenominations);
+    BOOST_CHECK(supplyRead.vSpendDenominations == supply.vSpendDenominations);
+    BOOST_CHECK(!pblocktree->ReadBlockSupply(vHash[3], supplyRead));
+
+    // Block 3 has neither a supply record nor data, which fails before anything is rewritten
+    BOOST_CHECK(!RecalculateHLIXSupply(1));
+    BOOST_CHECK_EQUAL(vIndex[2].nMoneySupply, 0);
+
+    // The records are enough to rebuild the supply, and the block that has its data gets one
+    BOOST_CHECK(pblocktree->WriteBlockSupply(vHash[3], supply));
+    BOOST_CHECK(RecalculateHLIXSupply(1));
+    BOOST_CHECK_EQUAL(vIndex[4].nMoneySupply, 128 * COIN);
+    BOOST_CHECK_EQUAL(vIndex[5].nMoneySupply, 131 * COIN);
+    CDiskBlockIndex diskindex;
+    // The index is written under the hash of its header, the one of the block on disk
+    BOOST_CHECK(pblocktree->Read(std::make_pair('b', block.GetHash()), diskindex));
+    BOOST_CHECK_EQUAL(diskindex.nMoneySupply, 131 * COIN);
+    BOOST_CHECK(pblocktree->ReadBlockSupply(vHash[5], supplyRead));
+    BOOST_CHECK_EQUAL(supplyRead.nMoneySupplyDelta, 3 * COIN);
+    BOOST_CHECK(supplyRead.vMintDenominations.empty() && supplyRead.vSpendDenominations.empty());
+
+    // Once recorded, the block data isn't needed anymore
+    indexData.nStatus = 0;
+    BOOST_CHECK(RecalculateHLIXSupply(1));
+    BOOST_CHECK_EQUAL(vIndex[5].nMoneySupply, 131 * COIN);
+
+    chainActive.SetTip(pindexTipOld);
+    delete pblocktree;
+    pblocktree = pblocktreeOld;
+}
+
 BOOST_AUTO_TEST_SUITE_END()
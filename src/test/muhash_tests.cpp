@@ -0,0 +1,40 @@
+// Copyright (c) 2018-2019 The Helix developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "muhash.h"
+#include "uint256.h"
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_AUTO_TEST_SUITE(muhash_tests)
+
+BOOST_AUTO_TEST_CASE(muhash_order_and_combine)
+{
+    const unsigned char a[] = {1, 2, 3}, b[] = {4, 5}, c[] = {6};
+
+    CMuHash3072 abc;
+    abc.Insert(a, sizeof(a)).Insert(b, sizeof(b)).Insert(c, sizeof(c));
+    CMuHash3072 cba;
+    cba.Insert(c, sizeof(c)).Insert(b, sizeof(b)).Insert(a, sizeof(a));
+    BOOST_CHECK(abc.Finalize() == cba.Finalize());
+
+    // Hashes of disjoint parts combine to the hash of the whole set
+    CMuHash3072 ac, bOnly, combined;
+    ac.Insert(a, sizeof(a)).Insert(c, sizeof(c));
+    bOnly.Insert(b, sizeof(b));
+    combined.Combine(bOnly).Combine(ac);
+    BOOST_CHECK(combined.Finalize() == abc.Finalize());
+    BOOST_CHECK(ac.Finalize() != abc.Finalize());
+
+    CMuHash3072 empty, emptyCombined;
+    emptyCombined.Combine(empty);
+    BOOST_CHECK(empty.Finalize() == emptyCombined.Finalize());
+    BOOST_CHECK(empty.Finalize() != abc.Finalize());
+
+    CMuHash3072 copy(ac);
+    copy.Insert(b, sizeof(b));
+    BOOST_CHECK(copy.Finalize() == abc.Finalize());
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,118 @@
+// Copyright (c) 2018-2019 The Helix developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "net.h"
+#include "uint256.h"
+#include "utiltime.h"
+
+#include <boost/test/unit_test.hpp>
+
+static CSerializeDataRef RelayPayload(size_t nSize)
+{
+    return std::make_shared<const CSerializeData>(nSize, 'x');
+}
+
+static CInv RelayInv(int n)
+{
+    return CInv(MSG_TX, uint256(n + 1));
+}
+
+BOOST_AUTO_TEST_SUITE(net_tests)
+
+BOOST_AUTO_TEST_CASE(relaycache_byte_accounting)
+{
+    CRelayCache cache;
+    cache.SetMaxBytes(1000);
+
+    BOOST_CHECK(cache.Insert(RelayInv(0), RelayPayload(100)));
+    BOOST_CHECK(cache.Insert(RelayInv(1), RelayPayload(250)));
+    // Inserting a known inv again neither replaces nor counts it
+    BOOST_CHECK(!cache.Insert(RelayInv(1), RelayPayload(500)));
+    // A payload larger than the whole cache is refused without evicting anything
+    BOOST_CHECK(!cache.Insert(RelayInv(2), RelayPayload(1001)));
+
+    CRelayCache::Stats stats = cache.GetStats();
+    BOOST_CHECK_EQUAL(stats.nEntries, 2U);
+    BOOST_CHECK_EQUAL(stats.nBytes, 350U);
+    BOOST_CHECK_EQUAL(stats.nMaxBytes, 1000U);
+    BOOST_CHECK_EQUAL(stats.nEvicted, 0U);
+
+    // The cached buffer is the one inserted, with the checksum a message header needs
+    CSerializeDataRef payload = RelayPayload(10);
+    BOOST_CHECK(cache.Insert(RelayInv(3), payload));
+    CSerializeDataRef payloadFound;
+    unsigned int nChecksum = 0;
+    BOOST_CHECK(cache.Find(RelayInv(3), payloadFound, nChecksum));
+    BOOST_CHECK(payloadFound == payload);
+    uint256 hash = Hash(payload->begin(), payload->end());
+    BOOST_CHECK(memcmp(&nChecksum, &hash, sizeof(nChecksum)) == 0);
+
+    BOOST_CHECK(!cache.Find(RelayInv(2), payloadFound, nChecksum));
+    stats = cache.GetStats();
+    BOOST_CHECK_EQUAL(stats.nBytes, 360U);
+    BOOST_CHECK_EQUAL(stats.nHits, 1U);
+    BOOST_CHECK_EQUAL(stats.nMisses, 1U);
+}
+
+BOOST_AUTO_TEST_CASE(relaycache_eviction)
+{
+    CRelayCache cache;
+    cache.SetMaxBytes(1000);
+    for (int i = 0; i < 4; i++)
+        BOOST_CHECK(cache.Insert(RelayInv(i), RelayPayload(200)));
+
+    // 800 + 300 does not fit: the oldest entry goes, the rest stay
+    BOOST_CHECK(cache.Insert(RelayInv(4), RelayPayload(300)));
+    CSerializeDataRef payload;
+    unsigned int nChecksum;
+    BOOST_CHECK(!cache.Find(RelayInv(0), payload, nChecksum));
+    for (int i = 1; i <= 4; i++)
+        BOOST_CHECK(cache.Find(RelayInv(i), payload, nChecksum));
+
+    CRelayCache::Stats stats = cache.GetStats();
+    BOOST_CHECK_EQUAL(stats.nEntries, 4U);
+    BOOST_CHECK_EQUAL(stats.nBytes, 900U);
+    BOOST_CHECK_EQUAL(stats.nEvicted, 1U);
+
+    // A large payload evicts as many of the oldest entries as it needs
+    BOOST_CHECK(cache.Insert(RelayInv(5), RelayPayload(700)));
+    BOOST_CHECK(!cache.Find(RelayInv(1), payload, nChecksum));
+    BOOST_CHECK(!cache.Find(RelayInv(2), payload, nChecksum));
+    BOOST_CHECK(!cache.Find(RelayInv(3), payload, nChecksum));
+    BOOST_CHECK(cache.Find(RelayInv(4), payload, nChecksum));
+    stats = cache.GetStats();
+    BOOST_CHECK_EQUAL(stats.nBytes, 1000U);
+    BOOST_CHECK_EQUAL(stats.nEvicted, 4U);
+
+    // An evicted payload stays valid for peers that still have it queued
+    BOOST_CHECK_EQUAL(payload->size(), 300U);
+}
+
+BOOST_AUTO_TEST_CASE(relaycache_expiry)
+{
+    int64_t nTime = GetTime();
+    SetMockTime(nTime);
+
+    CRelayCache cache;
+    BOOST_CHECK(cache.Insert(RelayInv(0), RelayPayload(100)));
+    SetMockTime(nTime + RELAY_CACHE_EXPIRY / 2);
+    BOOST_CHECK(cache.Insert(RelayInv(1), RelayPayload(100)));
+
+    // Expiry happens on the next insert and is not counted as an eviction
+    SetMockTime(nTime + RELAY_CACHE_EXPIRY + 1);
+    BOOST_CHECK(cache.Insert(RelayInv(2), RelayPayload(100)));
+    CSerializeDataRef payload;
+    unsigned int nChecksum;
+    BOOST_CHECK(!cache.Find(RelayInv(0), payload, nChecksum));
+    BOOST_CHECK(cache.Find(RelayInv(1), payload, nChecksum));
+
+    CRelayCache::Stats stats = cache.GetStats();
+    BOOST_CHECK_EQUAL(stats.nEntries, 2U);
+    BOOST_CHECK_EQUAL(stats.nBytes, 200U);
+    BOOST_CHECK_EQUAL(stats.nEvicted, 0U);
+
+    SetMockTime(0);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -6,11 +6,15 @@
 #include "rpc/client.h"
 
 #include "base58.h"
+#include "chainparams.h"
+#include "key.h"
+#include "main.h"
 #include "netbase.h"
 #include "util.h"
 
 #include <boost/algorithm/string.hpp>
 #include <boost/test/unit_test.hpp>
+#include <boost/thread.hpp>
 
 #include <univalue.h>
 
@@ -46,6 +50,8 @@ UniValue CallRPC(string args)
     }
 }
 
+extern UniValue blockToJSON(const CBlock& block, const CBlockIndex* blockindex, bool txDetails = false);
+extern void blockToJSONStream(const CBlock& block, const CBlockIndex* blockindex, bool txDetails, CJSONStreamWriter& writer);
 
 BOOST_AUTO_TEST_SUITE(rpc_tests)
 
@@ -181,6 +187,186 @@ BOOST_AUTO_TEST_CASE(json_parse_errors)
     BOOST_CHECK_THROW(ParseNonRFCJSONValue("3J98t1WpEZ73CNmQviecrnyiWrnqRhWNL"), std::runtime_error);
 }
 
+static void AppendChunk(std::vector<std::string>* chunks, const std::string& chunk)
+{
+    chunks->push_back(chunk);
+}
+
+BOOST_AUTO_TEST_CASE(rpc_json_stream_writer)
+{
+    UniValue tx(UniValue::VOBJ);
+    tx.push_back(Pair("txid", "ab\"cd"));
+    tx.push_back(Pair("value", 1.5));
+    UniValue txs(UniValue::VARR);
+    UniValue expected(UniValue::VOBJ);
+    expected.push_back(Pair("hash", "00ff"));
+    expected.push_back(Pair("empty", UniValue(UniValue::VARR)));
+
+    std::vector<std::string> chunks;
+    CJSONStreamWriter writer(boost::bind(AppendChunk, &chunks, _1), 16);
+    writer.BeginObject();
+    writer.Key("hash");
+    writer.Value("00ff");
+    writer.Key("empty");
+    writer.BeginArray();
+    writer.EndArray();
+    writer.Key("tx");
+    writer.BeginArray();
+    for (int i = 0; i < 10; i++) {
+        writer.Value(tx);
+        txs.push_back(tx);
+    }
+    writer.EndArray();
+    writer.EndObject();
+    expected.push_back(Pair("tx", txs));
+
+    // Output was handed out in pieces before the document was complete
+    BOOST_CHECK(writer.Flushed());
+    BOOST_CHECK(chunks.size() > 1);
+    writer.Flush();
+
+    std::string strStreamed;
+    for (const std::string& chunk : chunks)
+        strStreamed += chunk;
+    BOOST_CHECK_EQUAL(strStreamed, expected.write());
+}
+
+static bool RunOnThread(boost::thread_group* threads, const boost::function<void(void)>& task)
+{
+    threads->create_thread(task);
+    return true;
+}
+
+static UniValue BatchRequest(const std::string& strMethod, const UniValue& params, int id)
+{
+    UniValue req(UniValue::VOBJ);
+    req.push_back(Pair("method", strMethod));
+    req.push_back(Pair("params", params));
+    req.push_back(Pair("id", id));
+    return req;
+}
+
+BOOST_AUTO_TEST_CASE(rpc_batch_parallel)
+{
+    if (RPCIsInWarmup(NULL))
+        SetRPCWarmupFinished();
+
+    std::string strGenesis = Params().GenesisBlock().GetHash().GetHex();
+    UniValue paramsHeight(UniValue::VARR);
+    paramsHeight.push_back(0);
+    UniValue paramsHash(UniValue::VARR);
+    paramsHash.push_back(strGenesis);
+    UniValue paramsBadHash(UniValue::VARR);
+    paramsBadHash.push_back(uint256().GetHex());
+
+    // Parallel-safe requests around a barrier and failing requests
+    UniValue vReq(UniValue::VARR);
+    vReq.push_back(BatchRequest("getblockhash", paramsHeight, 0));
+    vReq.push_back(BatchRequest("getblock", paramsHash, 1));
+    vReq.push_back(BatchRequest("getblock", paramsBadHash, 2));
+    vReq.push_back(BatchRequest("getblockcount", UniValue(UniValue::VARR), 3));
+    vReq.push_back(BatchRequest("nosuchmethod", UniValue(UniValue::VARR), 4));
+    vReq.push_back(BatchRequest("getbestblockhash", UniValue(UniValue::VARR), 5));
+    vReq.push_back(BatchRequest("getblockheader", paramsHash, 6));
+
+    boost::thread_group threads;
+    RPCRegisterBatchDispatcher(boost::bind(RunOnThread, &threads, _1), 4);
+    std::string strReply = JSONRPCExecBatch(vReq);
+    RPCUnregisterBatchDispatcher();
+    threads.join_all();
+
+    UniValue vReply;
+    BOOST_CHECK(vReply.read(strReply));
+    BOOST_CHECK(vReply.isArray());
+    BOOST_CHECK_EQUAL(vReply.size(), vReq.size());
+
+    // Replies keep the order of the requests
+    for (unsigned int i = 0; i < vReply.size(); i++)
+        BOOST_CHECK_EQUAL(find_value(vReply[i].get_obj(), "id").get_int(), (int)i);
+
+    BOOST_CHECK_EQUAL(find_value(vReply[0].get_obj(), "result").get_str(), strGenesis);
+    BOOST_CHECK_EQUAL(find_value(find_value(vReply[1].get_obj(), "result").get_obj(), "hash").get_str(), strGenesis);
+    BOOST_CHECK(find_value(vReply[2].get_obj(), "result").isNull());
+    BOOST_CHECK(find_value(vReply[2].get_obj(), "error").isObject());
+    BOOST_CHECK_EQUAL(find_value(vReply[3].get_obj(), "result").get_int(), 0);
+    BOOST_CHECK_EQUAL(find_value(find_value(vReply[4].get_obj(), "error").get_obj(), "code").get_int(), (int)RPC_METHOD_NOT_FOUND);
+    BOOST_CHECK_EQUAL(find_value(vReply[5].get_obj(), "result").get_str(), strGenesis);
+    BOOST_CHECK_EQUAL(find_value(find_value(vReply[6].get_obj(), "result").get_obj(), "height").get_int(), 0);
+}
+
+BOOST_AUTO_TEST_CASE(rpc_block_stream)
+{
+    const CBlock& block = Params().GenesisBlock();
+    CBlockIndex* pindex;
+    {
+        LOCK(cs_main);
+        pindex = chainActive.Genesis();
+    }
+
+    for (int i = 0; i < 2; i++) {
+        bool fTxDetails = i;
+        std::vector<std::string> chunks;
+        CJSONStreamWriter writer(boost::bind(AppendChunk, &chunks, _1), 16);
+        blockToJSONStream(block, pindex, fTxDetails, writer);
+        writer.Flush();
+
+        std::string strStreamed;
+        for (const std::string& chunk : chunks)
+            strStreamed += chunk;
+        std::string strExpected;
+        {
+            LOCK(cs_main);
+            strExpected = blockToJSON(block, pindex, fTxDetails).write();
+        }
+        BOOST_CHECK_EQUAL(strStreamed, strExpected);
+    }
+}
+
+#ifdef ENABLE_WALLET
+BOOST_AUTO_TEST_CASE(rpc_prune_rescan)
+{
+    if (RPCIsInWarmup(NULL)) SetRPCWarmupFinished();
+
+    CKey key;
+    key.MakeNewKey(true);
+    string strAddress = EncodeDestination(key.GetPubKey().GetID());
+
+    // Extend the chain with five blocks of which the first two were pruned
+    CBlockIndex* pindexGenesis;
+    vector<CBlockIndex> vIndex(5);
+    {
+        LOCK(cs_main);
+        pindexGenesis = chainActive.Tip();
+        BOOST_CHECK_EQUAL(GetPruneHeight(), 0);
+        CBlockIndex* pindexPrev = pindexGenesis;
+        for (unsigned int i = 0; i < vIndex.size(); i++) {
+            vIndex[i].pprev = pindexPrev;
+            vIndex[i].nHeight = pindexPrev->nHeight + 1;
+            vIndex[i].nTx = 1;
+            vIndex[i].nStatus = i < 2 ? 0 : BLOCK_HAVE_DATA;
+            pindexPrev = &vIndex[i];
+        }
+        chainActive.SetTip(pindexPrev);
+        BOOST_CHECK_EQUAL(GetPruneHeight(), 0);
+        fPruneMode = true;
+        BOOST_CHECK_EQUAL(GetPruneHeight(), pindexGenesis->nHeight + 3);
+    }
+
+    BOOST_CHECK_THROW(EnsureRescanAvailable(0), UniValue);
+    BOOST_CHECK_THROW(EnsureRescanAvailable(pindexGenesis->nHeight + 2), UniValue);
+    BOOST_CHECK_NO_THROW(EnsureRescanAvailable(pindexGenesis->nHeight + 3));
+    BOOST_CHECK_THROW(CallRPC("importaddress " + strAddress + " \"\" true"), runtime_error);
+    BOOST_CHECK_NO_THROW(CallRPC("importaddress " + strAddress + " \"\" false"));
+
+    {
+        LOCK(cs_main);
+        fPruneMode = false;
+        chainActive.SetTip(pindexGenesis);
+    }
+    BOOST_CHECK_NO_THROW(EnsureRescanAvailable(0));
+}
+#endif
+
 BOOST_AUTO_TEST_CASE(rpc_ban)
 {
     BOOST_CHECK_NO_THROW(CallRPC(string("clearbanned")));
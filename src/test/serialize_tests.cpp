@@ -161,4 +161,39 @@ BOOST_AUTO_TEST_CASE(insert_delete)
     BOOST_CHECK_EQUAL(ss.size(), 0);
 }
 
+BOOST_AUTO_TEST_CASE(memory_reader)
+{
+    CDataStream ss(SER_DISK, 0);
+    ss << (uint8_t)0xf9 << (uint32_t)12345 << string("block") << (uint8_t)0xf9 << (uint64_t)7;
+    vector<char> vch(ss.begin(), ss.end());
+
+    CMemoryReader reader(&vch[0], vch.size(), SER_DISK, 0);
+    uint8_t magic;
+    uint32_t n;
+    string str;
+    reader >> magic >> n >> str;
+    BOOST_CHECK_EQUAL(magic, 0xf9);
+    BOOST_CHECK_EQUAL(n, 12345U);
+    BOOST_CHECK_EQUAL(str, "block");
+    uint64_t nPos = reader.GetPos();
+
+    // Limits and positioning behave like CBufferedFile
+    BOOST_CHECK(reader.SetLimit(nPos + 1));
+    uint64_t m;
+    BOOST_CHECK_THROW(reader >> m, std::ios_base::failure);
+    BOOST_CHECK_THROW(reader.ignore(2), std::ios_base::failure);
+    BOOST_CHECK_EQUAL(reader.GetPos(), nPos);
+    reader.ignore(1);
+    reader.SetLimit();
+    BOOST_CHECK(reader.SetPos(0));
+    reader.ignore(1);
+    reader.FindByte((char)0xf9);
+    BOOST_CHECK_EQUAL(reader.GetPos(), nPos);
+    reader >> magic >> m;
+    BOOST_CHECK_EQUAL(m, 7U);
+    BOOST_CHECK(reader.eof());
+    BOOST_CHECK_THROW(reader.FindByte((char)0xf9), std::ios_base::failure);
+    BOOST_CHECK(!reader.SetPos(vch.size() + 1));
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,151 @@
+// Copyright (c) 2018-2019 The Helix developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "snapshot.h"
+
+#include "chainparams.h"
+#include "main.h"
+#include "primitives/zerocoin.h"
+#include "sporkdb.h"
+#include "txdb.h"
+#include "util.h"
+
+#include <boost/filesystem.hpp>
+#include <boost/test/unit_test.hpp>
+
+BOOST_AUTO_TEST_SUITE(snapshot_tests)
+
+/** Swaps in empty databases for a snapshot to be loaded into, and restores the originals */
+struct SnapshotTarget {
+    CBlockTreeDB* pblocktreeSaved;
+    CZerocoinDB* zerocoinDBSaved;
+    CSporkDB* pSporkDBSaved;
+    bool fTxIndexSaved, fAddrIndexSaved, fHavePrunedSaved;
+    CCoinsViewDB coinsdb;
+
+    SnapshotTarget() : pblocktreeSaved(pblocktree), zerocoinDBSaved(zerocoinDB), pSporkDBSaved(pSporkDB),
+                       fTxIndexSaved(fTxIndex), fAddrIndexSaved(fAddrIndex), fHavePrunedSaved(fHavePruned), coinsdb(1 << 20, true)
+    {
+        pblocktree = new CBlockTreeDB(1 << 20, true);
+        zerocoinDB = new CZerocoinDB(0, true);
+        pSporkDB = new CSporkDB(0, true);
+    }
+
+    ~SnapshotTarget()
+    {
+        delete pblocktree;
+        delete zerocoinDB;
+        delete pSporkDB;
+        pblocktree = pblocktreeSaved;
+        zerocoinDB = zerocoinDBSaved;
+        pSporkDB = pSporkDBSaved;
+        fTxIndex = fTxIndexSaved;
+        fAddrIndex = fAddrIndexSaved;
+        fHavePruned = fHavePrunedSaved;
+    }
+};
+
+BOOST_AUTO_TEST_CASE(snapshot_roundtrip)
+{
+    bool fOwnDBs = !zerocoinDB;
+    if (fOwnDBs) {
+        zerocoinDB = new CZerocoinDB(0, true);
+        pSporkDB = new CSporkDB(0, true);
+    }
+
+    boost::filesystem::path path = GetDataDir() / "snapshot_tests.dat";
+    boost::filesystem::path pathOther = GetDataDir() / "snapshot_tests_other.dat";
+    CSnapshotMetadata metadata, metadataOther;
+    std::string strError;
+    BOOST_CHECK(DumpTxOutSet(path, metadata, strError));
+    BOOST_CHECK_EQUAL(metadata.hashBlock.GetHex(), chainActive.Tip()->GetBlockHash().GetHex());
+    BOOST_CHECK(metadata.hashSnapshot != 0);
+
+    // Spork and zerocoin records are part of the snapshot hash
+    BOOST_CHECK(pSporkDB->Write(std::string("snapshot_tests"), 1));
+    BOOST_CHECK(DumpTxOutSet(pathOther, metadataOther, strError));
+    BOOST_CHECK(metadataOther.hashSerialized == metadata.hashSerialized);
+    BOOST_CHECK(metadataOther.hashSnapshot != metadata.hashSnapshot);
+
+    {
+        // Loading needs the expected hash, and it has to match
+        SnapshotTarget target;
+        BOOST_CHECK(!LoadTxOutSet(pathOther, &target.coinsdb, uint256(0), strError));
+        BOOST_CHECK(!LoadTxOutSet(pathOther, &target.coinsdb, metadata.hashSnapshot, strError));
+        BOOST_CHECK(target.coinsdb.GetBestBlock() == 0);
+    }
+
+    {
+        SnapshotTarget target;
+        BOOST_CHECK(LoadTxOutSet(pathOther, &target.coinsdb, metadataOther.hashSnapshot, strError));
+        BOOST_CHECK(target.coinsdb.GetBestBlock() == metadata.hashBlock);
+        BOOST_CHECK(pSporkDB->Exists(std::string("snapshot_tests")));
+
+        // The snapshot block is shipped with the snapshot and can be read
+        // through the loaded block index, so checkpoints can be computed
+        CDiskBlockIndex diskindex;
+        BOOST_CHECK(pblocktree->Read(std::make_pair('b', metadata.hashBlock), diskindex));
+        BOOST_CHECK(diskindex.nStatus & BLOCK_HAVE_DATA);
+        CBlock block;
+        BOOST_CHECK(ReadBlockFromDisk(block, diskindex.GetBlockPos()));
+        BOOST_CHECK(block.GetHash() == metadata.hashBlock);
+        bool fPruned = false;
+        BOOST_CHECK(pblocktree->ReadFlag("prunedblockfiles", fPruned) && fPruned);
+    }
+
+    pSporkDB->Erase(std::string("snapshot_tests"));
+    boost::filesystem::remove(path);
+    boost::filesystem::remove(pathOther);
+    if (fOwnDBs) {
+        delete zerocoinDB;
+        delete pSporkDB;
+        zerocoinDB = NULL;
+        pSporkDB = NULL;
+    }
+}
+
+BOOST_AUTO_TEST_CASE(snapshot_zerocoin_heights)
+{
+    bool fOwnDBs = !zerocoinDB;
+    if (fOwnDBs) {
+        zerocoinDB = new CZerocoinDB(0, true);
+        pSporkDB = new CSporkDB(0, true);
+    }
+
+    boost::filesystem::path path = GetDataDir() / "snapshot_tests_zerocoin.dat";
+    CSnapshotMetadata metadata;
+    std::string strError;
+    CBigNum bnSerial(98765);
+    uint256 txid(1234);
+    int nHeight = chainActive.Height();
+
+    // A spend without a height couldn't be placed in the chain by the new node
+    BOOST_CHECK(zerocoinDB->WriteCoinSpend(bnSerial, txid));
+    BOOST_CHECK(!DumpTxOutSet(path, metadata, strError));
+    BOOST_CHECK(strError.find("-reindexzerocoin") != std::string::npos);
+    BOOST_CHECK(!boost::filesystem::exists(path));
+
+    // With its height it is shipped, and the loaded node finds it without blocks or txindex
+    BOOST_CHECK(zerocoinDB->WriteCoinSpend(bnSerial, txid, nHeight, libzerocoin::ZQ_ONE));
+    BOOST_CHECK(DumpTxOutSet(path, metadata, strError));
+    {
+        SnapshotTarget target;
+        BOOST_CHECK(LoadTxOutSet(path, &target.coinsdb, metadata.hashSnapshot, strError));
+        CZerocoinTxInfo info;
+        BOOST_CHECK(zerocoinDB->ReadCoinSpendInfo(GetSerialHash(bnSerial), info));
+        BOOST_CHECK(info.txid == txid);
+        BOOST_CHECK_EQUAL(info.nHeight, nHeight);
+    }
+
+    zerocoinDB->EraseCoinSpend(bnSerial);
+    boost::filesystem::remove(path);
+    if (fOwnDBs) {
+        delete zerocoinDB;
+        delete pSporkDB;
+        zerocoinDB = NULL;
+        pSporkDB = NULL;
+    }
+}
+
+BOOST_AUTO_TEST_SUITE_END()
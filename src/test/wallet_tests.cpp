@@ -4,6 +4,12 @@
 
 #include "wallet/wallet.h"
 
+#include "crypto/sha256.h"
+#include "main.h"
+#include "random.h"
+#include "script/standard.h"
+#include "wallet/wallet_ismine.h"
+
 #include <set>
 #include <stdint.h>
 #include <utility>
@@ -305,4 +311,200 @@ BOOST_AUTO_TEST_CASE(coin_selection_tests)
     empty_wallet();
 }
 
+// Balances and spendable transactions as the full mapWallet scan computes them
+static void CheckUnspentTxs(const CWallet& wallet)
+{
+    std::set<uint256> setIndexed;
+    for (const CWalletTx* pcoin : wallet.GetUnspentTxs())
+        setIndexed.insert(pcoin->GetHash());
+
+    CAmount nBalance = 0, nUnconfirmed = 0;
+    for (const PAIRTYPE(const uint256, CWalletTx)& item : wallet.mapWallet) {
+        const CWalletTx& wtx = item.second;
+        if (wtx.IsTrusted())
+            nBalance += wtx.GetAvailableCredit();
+        if (!IsFinalTx(wtx) || (!wtx.IsTrusted() && wtx.GetDepthInMainChain() == 0))
+            nUnconfirmed += wtx.GetAvailableCredit();
+
+        // Every transaction with an output of ours that is not spent must be indexed
+        for (unsigned int i = 0; i < wtx.vout.size(); i++) {
+            if (wallet.IsMine(wtx.vout[i]) != ISMINE_NO && !wallet.IsSpent(item.first, i))
+                BOOST_CHECK_MESSAGE(setIndexed.count(item.first), "unspent output " << item.first.GetHex() << ":" << i << " is not indexed");
+        }
+    }
+    BOOST_CHECK_EQUAL(wallet.GetBalance(), nBalance);
+    BOOST_CHECK_EQUAL(wallet.GetUnconfirmedBalance(), nUnconfirmed);
+}
+
+// Connect a block holding vtx on top of the active chain
+static CBlockIndex* ConnectTestBlock(CBlock& block, const std::vector<CTransaction>& vtx)
+{
+    CBlockIndex* pindexPrev = chainActive.Tip();
+    block.vtx = vtx;
+    block.hashPrevBlock = pindexPrev->GetBlockHash();
+    block.nTime = pindexPrev->nTime + 60;
+    block.hashMerkleRoot = block.BuildMerkleTree();
+
+    CBlockIndex* pindex = new CBlockIndex(block);
+    BlockMap::iterator mi = mapBlockIndex.insert(std::make_pair(block.GetHash(), pindex)).first;
+    pindex->phashBlock = &mi->first;
+    pindex->pprev = pindexPrev;
+    pindex->nHeight = pindexPrev->nHeight + 1;
+    chainActive.SetTip(pindex);
+    return pindex;
+}
+
+BOOST_AUTO_TEST_CASE(wallet_unspent_index)
+{
+    LOCK(cs_main);
+    CBlockIndex* pindexGenesis = chainActive.Tip();
+    BOOST_REQUIRE(pindexGenesis);
+
+    bool fFirstRun;
+    CWallet wallet("wallet_unspent_test.dat");
+    wallet.LoadWallet(fFirstRun);
+    LOCK(wallet.cs_wallet);
+
+    CKey key;
+    key.MakeNewKey(true);
+    BOOST_CHECK(wallet.AddKeyPubKey(key, key.GetPubKey()));
+    CScript scriptMine = GetScriptForDestination(key.GetPubKey().GetID());
+    CKey keyOther;
+    keyOther.MakeNewKey(true);
+    CScript scriptOther = GetScriptForDestination(keyOther.GetPubKey().GetID());
+
+    // Received from elsewhere: two outputs of ours
+    CMutableTransaction txReceive;
+    txReceive.vin.resize(1);
+    txReceive.vin[0].prevout = COutPoint(GetRandHash(), 0);
+    txReceive.vout.push_back(CTxOut(10 * COIN, scriptMine));
+    txReceive.vout.push_back(CTxOut(5 * COIN, scriptMine));
+
+    // Spends the first output back to us, the second one away
+    CMutableTransaction txSelf;
+    txSelf.vin.push_back(CTxIn(COutPoint(txReceive.GetHash(), 0)));
+    txSelf.vout.push_back(CTxOut(9 * COIN, scriptMine));
+    CMutableTransaction txAway;
+    txAway.vin.push_back(CTxIn(COutPoint(txReceive.GetHash(), 1)));
+    txAway.vout.push_back(CTxOut(4 * COIN, scriptOther));
+
+    CBlock block1, block2;
+    ConnectTestBlock(block1, std::vector<CTransaction>(1, txReceive));
+    wallet.SyncTransaction(txReceive, &block1);
+    CheckUnspentTxs(wallet);
+    BOOST_CHECK_EQUAL(wallet.GetBalance(), 15 * COIN);
+
+    // Both outputs spent in the main chain: the receive drops out of the index
+    std::vector<CTransaction> vtx;
+    vtx.push_back(txSelf);
+    vtx.push_back(txAway);
+    CBlockIndex* pindex2 = ConnectTestBlock(block2, vtx);
+    wallet.SyncTransaction(txSelf, &block2);
+    wallet.SyncTransaction(txAway, &block2);
+    CheckUnspentTxs(wallet);
+    BOOST_CHECK_EQUAL(wallet.GetBalance(), 9 * COIN);
+    std::vector<const CWalletTx*> vUnspent = wallet.GetUnspentTxs();
+    BOOST_CHECK_EQUAL(vUnspent.size(), 1U);
+    BOOST_CHECK(vUnspent[0]->GetHash() == txSelf.GetHash());
+
+    // Reorg: the spends leave the chain (and are not in the mempool), so the outputs they spent are available again
+    chainActive.SetTip(pindex2->pprev);
+    wallet.SyncTransaction(txSelf, NULL);
+    wallet.SyncTransaction(txAway, NULL);
+    CheckUnspentTxs(wallet);
+    BOOST_CHECK_EQUAL(wallet.GetBalance(), 15 * COIN);
+
+    // Reconnect the spends, then drop the one back to us from the wallet
+    chainActive.SetTip(pindex2);
+    wallet.SyncTransaction(txSelf, &block2);
+    wallet.SyncTransaction(txAway, &block2);
+    CheckUnspentTxs(wallet);
+    wallet.EraseFromWallet(txSelf.GetHash());
+    CheckUnspentTxs(wallet);
+
+    // Imports force a rebuild from mapWallet
+    wallet.MarkDirty();
+    CheckUnspentTxs(wallet);
+
+    chainActive.SetTip(pindexGenesis);
+    for (const CBlock* pblock : {&block1, &block2}) {
+        BlockMap::iterator mi = mapBlockIndex.find(pblock->GetHash());
+        delete mi->second;
+        mapBlockIndex.erase(mi);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(wallet_scan_filter)
+{
+    CWallet keystore;
+    std::vector<CPubKey> vPubKeys;
+    {
+        LOCK(keystore.cs_wallet);
+        for (int i = 0; i < 3; i++) {
+            CKey key;
+            key.MakeNewKey(i != 1);
+            BOOST_CHECK(keystore.AddKeyPubKey(key, key.GetPubKey()));
+            vPubKeys.push_back(key.GetPubKey());
+        }
+    }
+    CKey keyOther;
+    keyOther.MakeNewKey(true);
+    CKey keyWatched;
+    keyWatched.MakeNewKey(true);
+
+    CScript multisig = GetScriptForMultisig(1, {vPubKeys[0], keyOther.GetPubKey()});
+    CScript witnessScript = GetScriptForRawPubKey(vPubKeys[1]);
+    uint256 witnessHash;
+    CSHA256().Write(witnessScript.data(), witnessScript.size()).Finalize(witnessHash.begin());
+    CScript watched = GetScriptForDestination(keyWatched.GetPubKey().GetID());
+    BOOST_CHECK(keystore.AddCScript(multisig));
+    BOOST_CHECK(keystore.AddCScript(witnessScript));
+    BOOST_CHECK(keystore.AddWatchOnly(watched));
+
+    CWalletScanFilter filter;
+    keystore.GetScanFilter(filter);
+    BOOST_CHECK_EQUAL(filter.nKeyStoreSize, keystore.GetKeyStoreSize());
+
+    std::vector<CScript> vOurs;
+    for (const CPubKey& pubkey : vPubKeys) {
+        vOurs.push_back(GetScriptForRawPubKey(pubkey));
+        vOurs.push_back(GetScriptForDestination(pubkey.GetID()));
+        vOurs.push_back(GetScriptForDestination(WitnessV0KeyHash(pubkey.GetID())));
+    }
+    vOurs.push_back(multisig);
+    vOurs.push_back(GetScriptForDestination(CScriptID(multisig)));
+    vOurs.push_back(GetScriptForDestination(CScriptID(witnessScript)));
+    vOurs.push_back(GetScriptForDestination(WitnessV0ScriptHash(witnessHash)));
+    vOurs.push_back(watched);
+
+    std::vector<CScript> vOthers;
+    vOthers.push_back(GetScriptForRawPubKey(keyOther.GetPubKey()));
+    vOthers.push_back(GetScriptForDestination(keyOther.GetPubKey().GetID()));
+    vOthers.push_back(GetScriptForMultisig(1, {keyOther.GetPubKey(), keyWatched.GetPubKey()}));
+    vOthers.push_back(CScript() << OP_RETURN << ToByteVector(witnessHash));
+
+    // No false negatives: everything the wallet owns or watches passes the filter
+    for (const CScript& script : vOurs)
+        BOOST_CHECK(filter.IsRelevant(script));
+    for (const CScript& script : vOthers) {
+        BOOST_CHECK(IsMine(keystore, script) == ISMINE_NO);
+        BOOST_CHECK(!filter.IsRelevant(script));
+    }
+
+    CMutableTransaction tx;
+    tx.vout.resize(2);
+    tx.vout[0].scriptPubKey = vOthers[0];
+    tx.vout[1].scriptPubKey = vOthers[1];
+    BOOST_CHECK(!filter.IsRelevant(CTransaction(tx)));
+    tx.vout[1].scriptPubKey = vOurs[1];
+    BOOST_CHECK(filter.IsRelevant(CTransaction(tx)));
+
+    // Keys added later are not in the snapshot, which the size reveals
+    {
+        LOCK(keystore.cs_wallet);
+        BOOST_CHECK(keystore.AddKeyPubKey(keyOther, keyOther.GetPubKey()));
+    }
+    BOOST_CHECK(filter.nKeyStoreSize != keystore.GetKeyStoreSize());
+}
+
 BOOST_AUTO_TEST_SUITE_END()
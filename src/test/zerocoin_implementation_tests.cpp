@@ -10,6 +10,8 @@
 #include "primitives/deterministicmint.h"
 #include "key.h"
 #include "accumulatorcheckpoints.h"
+#include "consensus/merkle.h"
+#include "utiltime.h"
 #include "libzerocoin/bignum.h"
 #include <boost/test/unit_test.hpp>
 #include <iostream>
@@ -235,6 +237,7 @@ BOOST_AUTO_TEST_CASE(checkzerocoinspend_test)
 
     //populate the witness and accumulators
     CValidationState state;
+    vector<PublicCoin> vPubcoins;
     for(pair<string, string> raw : vecRawMints) {
         CTransaction tx;
         BOOST_CHECK_MESSAGE(DecodeHexTx(tx, raw.first, true), "Failed to deserialize hex transaction");
@@ -246,10 +249,16 @@ BOOST_AUTO_TEST_CASE(checkzerocoinspend_test)
 
                 accumulator += publicCoin;
                 witness += publicCoin;
+                vPubcoins.push_back(publicCoin);
             }
         }
     }
 
+    //accumulating all coins with one exponentiation gives the same accumulator
+    Accumulator accumulatorBatch(Params().Zerocoin_Params(), CoinDenomination::ZQ_ONE);
+    accumulatorBatch.accumulateBatch(vPubcoins);
+    BOOST_CHECK_MESSAGE(accumulatorBatch == accumulator, "Batched accumulator does not match");
+
     // Create a New Zerocoin with specific denomination given by pubCoin
     PrivateCoin privateCoin(Params().OldZerocoin_Params(), pubCoin.getDenomination());
     privateCoin.setPublicCoin(pubCoin);
@@ -329,6 +338,41 @@ BOOST_AUTO_TEST_CASE(checkzerocoinspend_test)
     string str = "Failed to detect overspend. Error Message: " + strError;
     BOOST_CHECK_MESSAGE(strError == "Transaction spend more than was redeemed in zerocoins", str);
 
+    /** check that a serial stays spent after the block of its spend was pruned */
+    {
+        LOCK(cs_main);
+        bool fOwnDB = !zerocoinDB;
+        if (fOwnDB)
+            zerocoinDB = new CZerocoinDB(0, true);
+        bool fTxIndexSaved = fTxIndex, fHavePrunedSaved = fHavePruned;
+        fTxIndex = false;
+        fHavePruned = true;
+
+        CBigNum bnSerial = spend1.getCoinSerialNumber();
+        BOOST_CHECK(ContextualCheckZerocoinSpend(txNew, spend1, chainActive.Tip(), 0, false));
+
+        // The spend was recorded with its height, its transaction can't be read anymore
+        BOOST_CHECK(zerocoinDB->WriteCoinSpend(bnSerial, GetRandHash(), chainActive.Height(), spend1.getDenomination()));
+        int nHeightSpend = -1;
+        BOOST_CHECK(IsSerialInBlockchain(bnSerial, nHeightSpend));
+        BOOST_CHECK_EQUAL(nHeightSpend, chainActive.Height());
+        BOOST_CHECK(!ContextualCheckZerocoinSpend(txNew, spend1, chainActive.Tip(), 0, false));
+
+        // A spend recorded before heights were kept can't be told apart from a pruned one
+        BOOST_CHECK(zerocoinDB->WriteCoinSpend(bnSerial, GetRandHash()));
+        BOOST_CHECK(!ContextualCheckZerocoinSpend(txNew, spend1, chainActive.Tip(), 0, false));
+        fHavePruned = false;
+        BOOST_CHECK(ContextualCheckZerocoinSpend(txNew, spend1, chainActive.Tip(), 0, false));
+
+        BOOST_CHECK(zerocoinDB->EraseCoinSpend(bnSerial));
+        fTxIndex = fTxIndexSaved;
+        fHavePruned = fHavePrunedSaved;
+        if (fOwnDB) {
+            delete zerocoinDB;
+            zerocoinDB = NULL;
+        }
+    }
+
 
     cout << "checking v2 spend\n";
 
@@ -475,6 +519,23 @@ BOOST_AUTO_TEST_CASE(bignum_setdecimal)
     BOOST_CHECK_MESSAGE(bnDec == bnHex, "CBigNum.SetDec() does not work correctly");
 }
 
+BOOST_AUTO_TEST_CASE(bignum_pow_mod)
+{
+    CBigNum bnModulus;
+    bnModulus.SetHex(strHexModulus);
+    CBigNum bnModulusEven = bnModulus * 2;
+    CBigNum bnExponent = 37;
+
+    //the odd modulus goes through the cached montgomery context, the even one does not
+    for (int i = 0; i < 3; i++) {
+        CBigNum bnBase = CBigNum::randBignum(bnModulus);
+        CBigNum bnPow = bnBase.pow(bnExponent);
+        BOOST_CHECK(bnBase.pow_mod(bnExponent, bnModulus) == bnPow % bnModulus);
+        BOOST_CHECK(bnBase.pow_mod(bnExponent, bnModulusEven) == bnPow % bnModulusEven);
+        BOOST_CHECK(bnBase.pow_mod(-bnExponent, bnModulus).mul_mod(bnBase.pow_mod(bnExponent, bnModulus), bnModulus).isOne());
+    }
+}
+
 BOOST_AUTO_TEST_CASE(test_checkpoints)
 {
     BOOST_CHECK_MESSAGE(AccumulatorCheckpoints::LoadCheckpoints("main"), "failed to load checkpoints");
@@ -483,6 +544,172 @@ BOOST_AUTO_TEST_CASE(test_checkpoints)
                                 .GetHex() == "9906699894789515272058113392849395226377513415094683581662885302621205216552016386292174931884177226515814091949629402279587227202011350368181257455821315481938496974789120608702072418185324479793574217866893522377128550974100076517694713305212201146629219319536046369213785902391357324171504197172727203684132813755153453542193361341157321581663564080521563477555394728269597633234537043560999923589455137129172823622120746315891921176708036978467051197280121984392248721477112188048843042324061662189474678151842417307324568035469065747762883870604772954490239326299279251860758190333593784293988393138219503245941245474196700359275008911433911105641681066235285476877452426480287889381926828017107670872103535824061379029561281460643115748", "does not match");
 }
 
+BOOST_AUTO_TEST_CASE(publiccoin_validation_cache)
+{
+    SelectParams(CBaseChainParams::UNITTEST);
+    libzerocoin::ZerocoinParams* zerocoinParams = Params().Zerocoin_Params();
+
+    // A new coin is tested for primality once, later checks use the cache
+    PrivateCoin privateCoin(zerocoinParams, CoinDenomination::ZQ_ONE);
+    PublicCoin pubCoin = privateCoin.getPublicCoin();
+    BOOST_CHECK(!pubCoin.isValidated());
+    BOOST_CHECK(pubCoin.validate());
+    BOOST_CHECK(pubCoin.isValidated());
+    BOOST_CHECK(pubCoin.validate());
+
+    // Invalid coins are never recorded, however often they are checked
+    PublicCoin pubCoinEven(zerocoinParams, pubCoin.getValue() + 1, CoinDenomination::ZQ_ONE);
+    BOOST_CHECK(!pubCoinEven.validate());
+    BOOST_CHECK(!pubCoinEven.isValidated());
+    BOOST_CHECK(!pubCoinEven.validate());
+
+    PublicCoin pubCoinLow(zerocoinParams, zerocoinParams->accumulatorParams.minCoinValue, CoinDenomination::ZQ_ONE);
+    BOOST_CHECK(!pubCoinLow.validate());
+    BOOST_CHECK(!pubCoinLow.isValidated());
+}
+
+/** Write a block on top of index.pprev with a mint of bnMint, or none if it is 0, and point the index at it */
+static void WriteCheckpointTestBlock(CBlockIndex& index, int nFile, const CBigNum& bnMint)
+{
+    CMutableTransaction tx;
+    tx.vin.resize(1);
+    tx.vin[0].prevout.SetNull();
+    tx.vin[0].scriptSig = CScript() << index.nHeight;
+    tx.vout.resize(1);
+    CBlock block;
+    block.hashPrevBlock = index.pprev ? index.pprev->GetBlockHash() : uint256(0);
+    block.vtx.push_back(CTransaction(tx));
+    if (bnMint != 0) {
+        CMutableTransaction txMint;
+        txMint.vin.resize(1);
+        txMint.vin[0].prevout = COutPoint(uint256(1), 0);
+        std::vector<unsigned char> vch = bnMint.getvch();
+        txMint.vout.push_back(CTxOut(COIN, CScript() << OP_ZEROCOINMINT << vch.size() << vch));
+        block.vtx.push_back(CTransaction(txMint));
+    }
+    block.hashMerkleRoot = BlockMerkleRoot(block);
+
+    CDiskBlockPos pos(nFile, 0);
+    BOOST_CHECK(WriteBlockToDisk(block, pos));
+    index.nFile = pos.nFile;
+    index.nDataPos = pos.nPos;
+    index.nStatus = BLOCK_HAVE_DATA | BLOCK_VALID_TRANSACTIONS;
+    index.nVersion = block.nVersion;
+    index.hashMerkleRoot = block.hashMerkleRoot;
+    index.nTime = block.nTime;
+    index.nBits = block.nBits;
+    index.nNonce = block.nNonce;
+}
+
+BOOST_AUTO_TEST_CASE(precomputed_checkpoint_test)
+{
+    SelectParams(CBaseChainParams::UNITTEST);
+    // Low zerocoin heights, so the test chain can be the active chain
+    const int nStartHeightOld = Params().Zerocoin_StartHeight();
+    const int nLastOldParamsOld = Params().Zerocoin_LastOldParams();
+    ModifiableParams()->setZerocoinStartHeight(50);
+    ModifiableParams()->setZerocoinLastOldParams(100);
+    AccumulatorMap mapAccumulators(Params().Zerocoin_Params());
+    uint256 nCheckpoint;
+
+    // A chain from ten blocks before the first checkpoint that is precomputed
+    // up to the checkpoint after it, with a mint of pubcoin size in the fourth block
+    const CBigNum bnMint = CBigNum(1234567) << 1500;
+    const CBigNum bnMintOther = CBigNum(7654321) << 1500;
+    const int nHeightFrom = ((Params().Zerocoin_LastOldParams() + 21) / 10 + 1) * 10;
+    const int nHeightCheckpoint = nHeightFrom + 10;
+    std::vector<uint256> vHash(21);
+    std::vector<CBlockIndex> vIndex(21);
+    for (unsigned int i = 0; i < vIndex.size(); i++) {
+        vHash[i] = uint256(i + 1);
+        vIndex[i].phashBlock = &vHash[i];
+        vIndex[i].nHeight = nHeightFrom - 10 + i;
+        vIndex[i].pprev = i == 0 ? NULL : &vIndex[i - 1];
+        if (i < 10)
+            WriteCheckpointTestBlock(vIndex[i], 1000 + i, i == 3 ? bnMint : CBigNum(0));
+    }
+    const uint256 hashFrom = vHash[10];
+
+    LOCK(cs_main);
+    CBlockIndex* pindexTipOld = chainActive.Tip();
+    chainActive.SetTip(&vIndex[19]);
+
+    // The checkpoint computed from the blocks themselves
+    uint256 nCheckpointBlocks = 0;
+    BOOST_CHECK(CalculateAccumulatorCheckpoint(nHeightCheckpoint, nCheckpointBlocks, mapAccumulators));
+    BOOST_CHECK(nCheckpointBlocks != 0);
+
+    // Copies of the index up to block h - 10, one of which doesn't match the block on disk
+    uint256 hashFromBad = uint256(100);
+    std::vector<CBlockIndex> vIndexQueued(vIndex.begin(), vIndex.begin() + 11);
+    std::vector<CBlockIndex> vIndexBad(vIndexQueued);
+    for (unsigned int i = 1; i < vIndexQueued.size(); i++) {
+        vIndexQueued[i].pprev = &vIndexQueued[i - 1];
+        vIndexBad[i].pprev = &vIndexBad[i - 1];
+    }
+    vIndexBad.back().phashBlock = &hashFromBad;
+    vIndexBad[5].hashMerkleRoot = uint256(1);
+
+    // Only blocks ten before a checkpoint, with the data of all of its mints, are queued
+    BOOST_CHECK(!QueueAccumulatorCheckpoint(&vIndexQueued[9]));
+    vIndexQueued[3].nStatus = 0;
+    BOOST_CHECK(!QueueAccumulatorCheckpoint(&vIndexQueued.back()));
+    vIndexQueued[3].nStatus = BLOCK_HAVE_DATA | BLOCK_VALID_TRANSACTIONS;
+
+    BOOST_CHECK(QueueAccumulatorCheckpoint(&vIndexBad.back()));
+    BOOST_CHECK(QueueAccumulatorCheckpoint(&vIndexQueued.back()));
+
+    // Everything the computation needs was copied, the index can go away before it runs
+    vIndexQueued.clear();
+    vIndexBad.clear();
+    BOOST_CHECK(!GetPrecomputedCheckpoint(hashFrom, nHeightCheckpoint, 0, nCheckpoint, mapAccumulators));
+
+    boost::thread thread(&ThreadAccumulatorCheckpoints);
+    for (int i = 0; i < 1000 && !GetPrecomputedCheckpoint(hashFrom, nHeightCheckpoint, 0, nCheckpoint, mapAccumulators); i++)
+        MilliSleep(10);
+    thread.interrupt();
+    thread.join();
+
+    // It matches the one computed from the blocks
+    nCheckpoint = 0;
+    BOOST_CHECK(GetPrecomputedCheckpoint(hashFrom, nHeightCheckpoint, 0, nCheckpoint, mapAccumulators));
+    BOOST_CHECK(nCheckpoint == nCheckpointBlocks);
+    BOOST_CHECK(!GetPrecomputedCheckpoint(hashFromBad, nHeightCheckpoint, 0, nCheckpoint, mapAccumulators));
+
+    // It is only used for the checkpoint it was computed for
+    BOOST_CHECK(!GetPrecomputedCheckpoint(hashFrom, nHeightCheckpoint + 10, 0, nCheckpoint, mapAccumulators));
+    BOOST_CHECK(!GetPrecomputedCheckpoint(hashFrom, nHeightCheckpoint, uint256(1), nCheckpoint, mapAccumulators));
+
+    // A block that agrees with it is accepted
+    CBlock block;
+    block.nAccumulatorCheckpoint = nCheckpointBlocks;
+    BOOST_CHECK(ValidateAccumulatorCheckpoint(block, &vIndex[20], mapAccumulators));
+
+    // Once the blocks say otherwise, they win over the precomputed checkpoint
+    WriteCheckpointTestBlock(vIndex[3], 1100, bnMintOther);
+    AccumulatorMap mapAccumulatorsOther(Params().Zerocoin_Params());
+    std::list<PublicCoin> listPubcoins;
+    listPubcoins.push_back(PublicCoin(Params().Zerocoin_Params(), bnMintOther, CoinDenomination::ZQ_ONE));
+    BOOST_CHECK(mapAccumulatorsOther.AccumulateBatch(listPubcoins, true));
+    uint256 nCheckpointOther = mapAccumulatorsOther.GetCheckpoint();
+    BOOST_CHECK(nCheckpointOther != nCheckpointBlocks);
+
+    BOOST_CHECK(CalculateAccumulatorCheckpoint(nHeightCheckpoint, nCheckpoint, mapAccumulators));
+    BOOST_CHECK(nCheckpoint == nCheckpointBlocks);
+    block.nAccumulatorCheckpoint = nCheckpointOther;
+    BOOST_CHECK(ValidateAccumulatorCheckpoint(block, &vIndex[20], mapAccumulators));
+    BOOST_CHECK(!GetPrecomputedCheckpoint(hashFrom, nHeightCheckpoint, 0, nCheckpoint, mapAccumulators));
+    block.nAccumulatorCheckpoint = nCheckpointBlocks;
+    BOOST_CHECK(!ValidateAccumulatorCheckpoint(block, &vIndex[20], mapAccumulators));
+
+    BOOST_CHECK(!EraseAccumulatorCheckpoint(hashFromBad));
+    BOOST_CHECK(!EraseAccumulatorCheckpoint(hashFrom));
+
+    chainActive.SetTip(pindexTipOld);
+    ModifiableParams()->setZerocoinStartHeight(nStartHeightOld);
+    ModifiableParams()->setZerocoinLastOldParams(nLastOldParamsOld);
+}
+
 BOOST_AUTO_TEST_CASE(deterministic_tests)
 {
     SelectParams(CBaseChainParams::UNITTEST);
@@ -525,5 +752,42 @@ BOOST_AUTO_TEST_CASE(deterministic_tests)
     BOOST_CHECK_MESSAGE(hash == uint256("c90c225f2cbdee5ef053b1f9f70053dd83724c58126d0e1b8425b88091d1f73f"), "minting determinism isn't as expected");
 }
 
+BOOST_AUTO_TEST_CASE(mintpool_parallel_matches_serial)
+{
+    SelectParams(CBaseChainParams::UNITTEST);
+    uint256 seedMaster("3a1947364362e2e7c073b386869c89c905c0cf462448ffd6c2021bd03ce689f6");
+    uint256 hashSeed = Hash(seedMaster.begin(), seedMaster.end());
+
+    string strWalletFile = "mintpooltestwallet.dat";
+    CWalletDB walletdb(strWalletFile, "cr+");
+
+    CWallet wallet(strWalletFile);
+    CzHLIXWallet zWallet(wallet.strWalletFile);
+    zWallet.SetMasterSeed(seedMaster, true);
+    wallet.setZWallet(&zWallet);
+
+    // Counts 3 to 6, then 5 to 12, so the second call only derives the missing ones
+    zWallet.GenerateMintPool(3, 4);
+    zWallet.GenerateMintPool(5, 8);
+
+    std::map<uint256, std::vector<pair<uint256, uint32_t> > > mapMintPool = CWalletDB(strWalletFile).MapMintPool();
+    std::map<uint32_t, uint256> mapPool;
+    for (const pair<uint256, uint32_t>& pMint : mapMintPool[hashSeed])
+        mapPool[pMint.second] = pMint.first;
+    BOOST_CHECK_EQUAL(mapPool.size(), 10U);
+
+    // Every count in the range holds the mint that serial derivation gives
+    for (uint32_t nCount = 3; nCount <= 13; nCount++) {
+        PrivateCoin coin(Params().Zerocoin_Params(), CoinDenomination::ZQ_ONE, false);
+        CDeterministicMint dMint;
+        zWallet.GenerateMint(nCount, CoinDenomination::ZQ_ONE, coin, dMint);
+        bool fInRange = nCount <= 12;
+        BOOST_CHECK_EQUAL(zWallet.IsInMintPool(coin.getPublicCoin().getValue()), fInRange);
+        BOOST_CHECK_EQUAL(mapPool.count(nCount) > 0, fInRange);
+        if (fInRange)
+            BOOST_CHECK(mapPool[nCount] == dMint.GetPubcoinHash());
+    }
+}
+
 
 BOOST_AUTO_TEST_SUITE_END()
@@ -10,6 +10,7 @@
 #include "wallet/wallet.h"
 #include "wallet/walletdb.h"
 #include "txdb.h"
+#include "zhlixtracker.h"
 #include <boost/test/unit_test.hpp>
 #include <iostream>
 
@@ -54,4 +55,96 @@ BOOST_AUTO_TEST_CASE(zerocoin_spend_test)
 
 }
 
+BOOST_AUTO_TEST_CASE(zerocoindb_txinfo_test)
+{
+    SelectParams(CBaseChainParams::UNITTEST);
+    CZerocoinDB db(0, true);
+    uint256 txidMint = GetRandHash(), txidSpend = GetRandHash(), txid;
+    PublicCoin pubCoin(Params().Zerocoin_Params(), CBigNum(GetRandHash()), CoinDenomination::ZQ_FIVE);
+    uint256 hashPubcoin = GetPubCoinHash(pubCoin.getValue());
+    CBigNum bnSerial(GetRandHash());
+    CDataStream ss(SER_GETHASH, 0);
+    ss << bnSerial;
+    uint256 hashSerial = Hash(ss.begin(), ss.end());
+    CZerocoinTxInfo info;
+
+    // Entries written without a height hold only the txid
+    BOOST_CHECK(db.WriteCoinMint(pubCoin, txidMint));
+    BOOST_CHECK(db.ReadCoinMint(hashPubcoin, txid) && txid == txidMint);
+    BOOST_CHECK(!db.ReadCoinMintInfo(hashPubcoin, info));
+    BOOST_CHECK(db.WriteCoinSpend(bnSerial, txidSpend));
+    BOOST_CHECK(db.ReadCoinSpend(hashSerial, txid) && txid == txidSpend);
+    BOOST_CHECK(!db.ReadCoinSpendInfo(hashSerial, info));
+
+    // Entries with a height can be read both ways
+    BOOST_CHECK(db.WriteCoinMint(pubCoin, txidMint, 1234));
+    BOOST_CHECK(db.ReadCoinMint(pubCoin.getValue(), txid) && txid == txidMint);
+    BOOST_CHECK(db.ReadCoinMintInfo(hashPubcoin, info));
+    BOOST_CHECK(info.txid == txidMint);
+    BOOST_CHECK_EQUAL(info.nHeight, 1234);
+    BOOST_CHECK(info.denom == CoinDenomination::ZQ_FIVE);
+
+    BOOST_CHECK(db.WriteCoinSpend(bnSerial, txidSpend, 1240, CoinDenomination::ZQ_FIVE));
+    BOOST_CHECK(db.ReadCoinSpend(bnSerial, txid) && txid == txidSpend);
+    BOOST_CHECK(db.ReadCoinSpendInfo(hashSerial, info));
+    BOOST_CHECK(info.txid == txidSpend);
+    BOOST_CHECK_EQUAL(info.nHeight, 1240);
+    BOOST_CHECK(info.denom == CoinDenomination::ZQ_FIVE);
+
+    BOOST_CHECK(db.EraseCoinMint(pubCoin.getValue()));
+    BOOST_CHECK(!db.ReadCoinMint(hashPubcoin, txid));
+    BOOST_CHECK(!db.ReadCoinMintInfo(hashPubcoin, info));
+}
+
+/** A transaction minting bnValue, which needs the size of a pubcoin for the mint script to parse */
+static CTransaction MintTx(const CBigNum& bnValue)
+{
+    CMutableTransaction tx;
+    std::vector<unsigned char> vch = bnValue.getvch();
+    tx.vout.push_back(CTxOut(COIN, CScript() << OP_ZEROCOINMINT << vch.size() << vch));
+    return tx;
+}
+
+BOOST_AUTO_TEST_CASE(zhlixtracker_status_update_test)
+{
+    SelectParams(CBaseChainParams::UNITTEST);
+    bool fOwnDB = !zerocoinDB;
+    if (fOwnDB)
+        zerocoinDB = new CZerocoinDB(0, true);
+
+    CBigNum bnValue = CBigNum(GetRandHash()) << 1300;
+    CBigNum bnSerial(GetRandHash()), bnRandomness(GetRandHash());
+    {
+        LOCK(cs_main);
+        CzHLIXTracker tracker("trackertest.dat");
+        CZerocoinMint mint(CoinDenomination::ZQ_ONE, bnValue, bnRandomness, bnSerial, false, 1);
+        mint.SetHeight(1);
+        mint.SetTxHash(GetRandHash());
+        tracker.Add(mint, true);
+        PublicCoin pubCoin(Params().Zerocoin_Params(), bnValue, CoinDenomination::ZQ_ONE);
+        BOOST_CHECK(zerocoinDB->WriteCoinMint(pubCoin, mint.GetTxHash(), 1));
+        BOOST_CHECK_EQUAL(tracker.ListMints(true, false, true).size(), 1U);
+
+        // Without a new tip or a transaction of the mint its status is not looked up again
+        BOOST_CHECK(zerocoinDB->WriteCoinSpend(bnSerial, GetRandHash(), 2, CoinDenomination::ZQ_ONE));
+        BOOST_CHECK_EQUAL(tracker.ListMints(true, false, true).size(), 1U);
+
+        // Nor after a transaction of some other mint
+        tracker.SetStatusDirty(MintTx(CBigNum(GetRandHash()) << 1300));
+        BOOST_CHECK_EQUAL(tracker.ListMints(true, false, true).size(), 1U);
+
+        // A transaction of the mint updates just that mint
+        tracker.SetStatusDirty(MintTx(bnValue));
+        BOOST_CHECK(tracker.ListMints(true, false, true).empty());
+        BOOST_CHECK(tracker.ListMints(true, false, true).empty());
+    }
+
+    zerocoinDB->EraseCoinMint(bnValue);
+    zerocoinDB->EraseCoinSpend(bnSerial);
+    if (fOwnDB) {
+        delete zerocoinDB;
+        zerocoinDB = NULL;
+    }
+}
+
 BOOST_AUTO_TEST_SUITE_END()
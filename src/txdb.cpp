@@ -9,6 +9,7 @@
 #include "txdb.h"
 
 #include "main.h"
+#include "muhash.h"
 #include "pow.h"
 #include "random.h"
 #include "uint256.h"
@@ -16,6 +17,10 @@
 
 #include <stdint.h>
 
+#include <atomic>
+#include <deque>
+
+#include <boost/bind.hpp>
 #include <boost/thread.hpp>
 
 using namespace std;
@@ -79,10 +84,6 @@ bool CCoinsViewDB::BatchWrite(CCoinsMap& mapCoins, const uint256& hashBlock)
 
 CBlockTreeDB::CBlockTreeDB(size_t nCacheSize, bool fMemory, bool fWipe) : CLevelDBWrapper(GetDataDir() / "blocks" / "index", nCacheSize, fMemory, fWipe)
 {
-    if (!Read('S', salt)) {
-        salt = GetRandHash();
-        Write('S', salt);
-    }
 }
 
 bool CBlockTreeDB::WriteBlockIndex(const CDiskBlockIndex& blockindex)
@@ -90,6 +91,14 @@ bool CBlockTreeDB::WriteBlockIndex(const CDiskBlockIndex& blockindex)
     return Write(std::make_pair('b', blockindex.GetBlockHash()), blockindex);
 }
 
+bool CBlockTreeDB::WriteBlockIndexes(const std::vector<CDiskBlockIndex>& vBlockIndex)
+{
+    CLevelDBBatch batch;
+    for (std::vector<CDiskBlockIndex>::const_iterator it = vBlockIndex.begin(); it != vBlockIndex.end(); it++)
+        batch.Write(std::make_pair('b', it->GetBlockHash()), *it);
+    return WriteBatch(batch);
+}
+
 bool CBlockTreeDB::WriteBatchSync(const std::vector<std::pair<int, const CBlockFileInfo*> >& fileInfo, int nLastFile, const std::vector<const CBlockIndex*>& blockinfo) {
     CLevelDBBatch batch;
     for (std::vector<std::pair<int, const CBlockFileInfo*> >::const_iterator it=fileInfo.begin(); it != fileInfo.end(); it++) {
@@ -126,58 +135,317 @@ bool CBlockTreeDB::ReadLastBlockFile(int& nFile)
     return Read('l', nFile);
 }
 
-bool CCoinsViewDB::GetStats(CCoinsStats& stats) const
+/** Serialize one transaction's coins the way hashSerialized and hashMuHash cover them */
+template <typename Stream>
+static void SerializeCoinsForHash(Stream& ss, const uint256& txid, const CCoins& coins)
 {
-    /* It seems that there are no "const iterators" for LevelDB.  Since we
-       only need read operations on it, use a const-cast to get around
-       that restriction.  */
-    boost::scoped_ptr<leveldb::Iterator> pcursor(const_cast<CLevelDBWrapper*>(&db)->NewIterator());
-    pcursor->SeekToFirst();
+    ss << txid;
+    ss << VARINT(coins.nVersion);
+    ss << (coins.fCoinBase ? 'c' : 'n');
+    ss << VARINT(coins.nHeight);
+    for (unsigned int i = 0; i < coins.vout.size(); i++) {
+        const CTxOut& out = coins.vout[i];
+        if (!out.IsNull()) {
+            ss << VARINT(i + 1);
+            ss << out;
+        }
+    }
+    ss << VARINT(0);
+}
 
-    CHashWriter ss(SER_GETHASH, PROTOCOL_VERSION);
-    stats.hashBlock = GetBestBlock();
-    ss << stats.hashBlock;
-    CAmount nTotalAmount = 0;
-    while (pcursor->Valid()) {
-        boost::this_thread::interruption_point();
+static void AddCoinsToStats(CCoinsStats& stats, const CCoins& coins, size_t nSerializedSize)
+{
+    stats.nTransactions++;
+    for (unsigned int i = 0; i < coins.vout.size(); i++) {
+        const CTxOut& out = coins.vout[i];
+        if (!out.IsNull()) {
+            stats.nTransactionOutputs++;
+            stats.nTotalAmount += out.nValue;
+        }
+    }
+    stats.nSerializedSize += 32 + nSerializedSize;
+}
+
+/**
+ * Scans the coin database for GetStats. The 'c' keys are split into ranges
+ * by the first byte of the txid, each scanned by its own thread from the
+ * same LevelDB snapshot. hashMuHash is combined from the ranges' set hashes.
+ * hashSerialized covers the coins in key order, so the ranges hand their
+ * serialized coins to the calling thread, which hashes them range by range.
+ */
+class CCoinsStatsScan
+{
+private:
+    //! Serialized coins are handed over in chunks of about this size
+    static const size_t CHUNK_SIZE = 1 << 20;
+    //! Chunks a range can have queued before its thread waits for the hasher
+    static const size_t MAX_QUEUED_CHUNKS = 16;
+
+    struct Range {
+        unsigned int nBegin;
+        unsigned int nEnd;
+        CCoinsStats stats;
+        CMuHash3072 muhash;
+        std::deque<std::string> queue;
+        bool fDone;
+        bool fError;
+
+        Range(unsigned int nBeginIn, unsigned int nEndIn) : nBegin(nBeginIn), nEnd(nEndIn), fDone(false), fError(false) {}
+    };
+
+    CLevelDBWrapper& db;
+    const leveldb::Snapshot* psnapshot;
+    CoinStatsHashType hashType;
+    std::vector<Range> vRanges;
+    boost::mutex mutex;
+    boost::condition_variable cond;
+    std::atomic<bool> fAbort;
+
+    void Push(Range& range, CDataStream& ssChunk)
+    {
+        boost::unique_lock<boost::mutex> lock(mutex);
+        while (!fAbort && range.queue.size() >= MAX_QUEUED_CHUNKS)
+            cond.wait(lock);
+        range.queue.push_back(ssChunk.str());
+        ssChunk.clear();
+        cond.notify_all();
+    }
+
+    void ScanRange(Range& range)
+    {
+        RenameThread("helix-coinstats");
+        bool fError = false;
         try {
-            leveldb::Slice slKey = pcursor->key();
-            CDataStream ssKey(slKey.data(), slKey.data() + slKey.size(), SER_DISK, CLIENT_VERSION);
-            char chType;
-            ssKey >> chType;
-            if (chType == 'c') {
+            boost::scoped_ptr<leveldb::Iterator> pcursor(db.NewIterator(psnapshot));
+            char chBegin[2] = {'c', (char)range.nBegin};
+            pcursor->Seek(leveldb::Slice(chBegin, range.nBegin ? 2 : 1));
+            CDataStream ssChunk(SER_GETHASH, PROTOCOL_VERSION);
+            CDataStream ssCoins(SER_GETHASH, PROTOCOL_VERSION);
+            for (; pcursor->Valid() && !fAbort; pcursor->Next()) {
+                leveldb::Slice slKey = pcursor->key();
+                if (slKey.size() < 2 || slKey[0] != 'c' || (unsigned char)slKey[1] >= range.nEnd)
+                    break;
+                CDataStream ssKey(slKey.data(), slKey.data() + slKey.size(), SER_DISK, CLIENT_VERSION);
+                char chType;
+                uint256 txhash;
+                ssKey >> chType >> txhash;
                 leveldb::Slice slValue = pcursor->value();
                 CDataStream ssValue(slValue.data(), slValue.data() + slValue.size(), SER_DISK, CLIENT_VERSION);
                 CCoins coins;
                 ssValue >> coins;
+                AddCoinsToStats(range.stats, coins, slValue.size());
+                if (hashType == COINSTATS_HASH_MUHASH) {
+                    ssCoins.clear();
+                    SerializeCoinsForHash(ssCoins, txhash, coins);
+                    range.muhash.Insert((const unsigned char*)&ssCoins[0], ssCoins.size());
+                } else if (hashType == COINSTATS_HASH_SERIALIZED) {
+                    SerializeCoinsForHash(ssChunk, txhash, coins);
+                    if (ssChunk.size() >= CHUNK_SIZE)
+                        Push(range, ssChunk);
+                }
+            }
+            if (!pcursor->status().ok())
+                fError = error("CCoinsStatsScan : LevelDB error - %s", pcursor->status().ToString());
+            if (!ssChunk.empty())
+                Push(range, ssChunk);
+        } catch (const std::exception& e) {
+            fError = error("CCoinsStatsScan : Deserialize or I/O error - %s", e.what());
+        }
+        boost::unique_lock<boost::mutex> lock(mutex);
+        range.fError = fError;
+        range.fDone = true;
+        cond.notify_all();
+    }
+
+    //! Feed one range's chunks to ss in order; false if the range failed
+    bool HashRange(Range& range, CHashWriter& ss)
+    {
+        while (true) {
+            std::string strChunk;
+            {
+                boost::unique_lock<boost::mutex> lock(mutex);
+                while (range.queue.empty() && !range.fDone)
+                    cond.wait(lock);
+                if (range.queue.empty())
+                    return !range.fError;
+                strChunk.swap(range.queue.front());
+                range.queue.pop_front();
+                cond.notify_all();
+            }
+            ss.write(strChunk.data(), strChunk.size());
+        }
+    }
+
+public:
+    CCoinsStatsScan(CLevelDBWrapper& dbIn, CoinStatsHashType hashTypeIn) : db(dbIn), psnapshot(dbIn.GetSnapshot()), hashType(hashTypeIn), fAbort(false)
+    {
+        int nRanges = std::max(1, std::min((int)boost::thread::hardware_concurrency(), MAX_COINSTATS_THREADS));
+        vRanges.reserve(nRanges);
+        for (int i = 0; i < nRanges; i++)
+            vRanges.push_back(Range(256 * i / nRanges, 256 * (i + 1) / nRanges));
+    }
+
+    ~CCoinsStatsScan()
+    {
+        db.ReleaseSnapshot(psnapshot);
+    }
+
+    bool Run(CCoinsStats& stats)
+    {
+        stats = CCoinsStats();
+        // The best block is read from the snapshot too, so it always matches the coins
+        boost::scoped_ptr<leveldb::Iterator> pcursor(db.NewIterator(psnapshot));
+        pcursor->Seek("B");
+        if (pcursor->Valid() && pcursor->key() == "B") {
+            CDataStream ssValue(pcursor->value().data(), pcursor->value().data() + pcursor->value().size(), SER_DISK, CLIENT_VERSION);
+            ssValue >> stats.hashBlock;
+        }
+
+        boost::thread_group threadGroup;
+        for (unsigned int i = 0; i < vRanges.size(); i++)
+            threadGroup.create_thread(boost::bind(&CCoinsStatsScan::ScanRange, this, boost::ref(vRanges[i])));
+
+        bool fOk = true;
+        try {
+            if (hashType == COINSTATS_HASH_SERIALIZED) {
+                CHashWriter ss(SER_GETHASH, PROTOCOL_VERSION);
+                ss << stats.hashBlock;
+                for (unsigned int i = 0; i < vRanges.size() && fOk; i++) {
+                    boost::this_thread::interruption_point();
+                    fOk = HashRange(vRanges[i], ss);
+                }
+                stats.hashSerialized = ss.GetHash();
+            }
+        } catch (...) {
+            {
+                boost::unique_lock<boost::mutex> lock(mutex);
+                fAbort = true;
+                cond.notify_all();
+            }
+            threadGroup.join_all();
+            throw;
+        }
+        {
+            boost::unique_lock<boost::mutex> lock(mutex);
+            fAbort = !fOk;
+            cond.notify_all();
+        }
+        threadGroup.join_all();
+
+        CMuHash3072 muhash;
+        for (std::vector<Range>::const_iterator it = vRanges.begin(); it != vRanges.end(); it++) {
+            fOk &= !it->fError;
+            stats.nTransactions += it->stats.nTransactions;
+            stats.nTransactionOutputs += it->stats.nTransactionOutputs;
+            stats.nSerializedSize += it->stats.nSerializedSize;
+            stats.nTotalAmount += it->stats.nTotalAmount;
+            muhash.Combine(it->muhash);
+        }
+        if (hashType == COINSTATS_HASH_MUHASH)
+            stats.hashMuHash = muhash.Finalize();
+        return fOk;
+    }
+};
+
+bool CCoinsViewDB::GetStats(CCoinsStats& stats, CoinStatsHashType hashType) const
+{
+    /* It seems that there are no "const iterators" for LevelDB.  Since we
+       only need read operations on it, use a const-cast to get around
+       that restriction.  */
+    CCoinsStatsScan scan(const_cast<CLevelDBWrapper&>(db), hashType);
+    if (!scan.Run(stats))
+        return false;
+
+    LOCK(cs_main);
+    BlockMap::iterator mi = mapBlockIndex.find(stats.hashBlock);
+    stats.nHeight = mi != mapBlockIndex.end() ? mi->second->nHeight : 0;
+    return true;
+}
+
+/** Snapshot of the coin database, read through a LevelDB snapshot */
+class CCoinsViewDBSnapshot : public CCoinsViewSnapshot
+{
+private:
+    CLevelDBSnapshot snapshot;
+
+public:
+    CCoinsViewDBSnapshot(CLevelDBWrapper& db) : snapshot(db) {}
+
+    uint256 GetBestBlock() const
+    {
+        uint256 hashBestChain;
+        boost::scoped_ptr<leveldb::Iterator> pcursor(snapshot.NewIterator());
+        pcursor->Seek("B");
+        if (pcursor->Valid() && pcursor->key() == "B") {
+            CDataStream ssValue(pcursor->value().data(), pcursor->value().data() + pcursor->value().size(), SER_DISK, CLIENT_VERSION);
+            ssValue >> hashBestChain;
+        }
+        return hashBestChain;
+    }
+
+    bool ForEachCoins(const boost::function<bool(const uint256&, const CCoins&)>& fn) const
+    {
+        boost::scoped_ptr<leveldb::Iterator> pcursor(snapshot.NewIterator());
+        CDataStream ssKeySet(SER_DISK, CLIENT_VERSION);
+        ssKeySet << make_pair('c', uint256(0));
+        pcursor->Seek(ssKeySet.str());
+
+        while (pcursor->Valid()) {
+            boost::this_thread::interruption_point();
+            try {
+                leveldb::Slice slKey = pcursor->key();
+                CDataStream ssKey(slKey.data(), slKey.data() + slKey.size(), SER_DISK, CLIENT_VERSION);
+                char chType;
+                ssKey >> chType;
+                if (chType != 'c')
+                    break;
                 uint256 txhash;
                 ssKey >> txhash;
-                ss << txhash;
-                ss << VARINT(coins.nVersion);
-                ss << (coins.fCoinBase ? 'c' : 'n');
-                ss << VARINT(coins.nHeight);
-                stats.nTransactions++;
-                for (unsigned int i = 0; i < coins.vout.size(); i++) {
-                    const CTxOut& out = coins.vout[i];
-                    if (!out.IsNull()) {
-                        stats.nTransactionOutputs++;
-                        ss << VARINT(i + 1);
-                        ss << out;
-                        nTotalAmount += out.nValue;
-                    }
-                }
-                stats.nSerializedSize += 32 + slValue.size();
-                ss << VARINT(0);
+                leveldb::Slice slValue = pcursor->value();
+                CDataStream ssValue(slValue.data(), slValue.data() + slValue.size(), SER_DISK, CLIENT_VERSION);
+                CCoins coins;
+                ssValue >> coins;
+                if (!fn(txhash, coins))
+                    break;
+                pcursor->Next();
+            } catch (std::exception& e) {
+                return error("%s : Deserialize or I/O error - %s", __func__, e.what());
             }
-            pcursor->Next();
-        } catch (std::exception& e) {
-            return error("%s : Deserialize or I/O error - %s", __func__, e.what());
         }
+        return pcursor->status().ok();
     }
-    stats.nHeight = mapBlockIndex.find(GetBestBlock())->second->nHeight;
+};
+
+CCoinsViewSnapshot* CCoinsViewDB::NewSnapshot() const
+{
+    return new CCoinsViewDBSnapshot(const_cast<CLevelDBWrapper&>(db));
+}
+
+CCoinsStatsHasher::CCoinsStatsHasher(CCoinsStats& statsIn, const uint256& hashBlock) : stats(statsIn), ss(SER_GETHASH, PROTOCOL_VERSION)
+{
+    stats.hashBlock = hashBlock;
+    ss << stats.hashBlock;
+}
+
+void CCoinsStatsHasher::Add(const uint256& txid, const CCoins& coins, size_t nSerializedSize)
+{
+    SerializeCoinsForHash(ss, txid, coins);
+    AddCoinsToStats(stats, coins, nSerializedSize);
+}
+
+void CCoinsStatsHasher::Finalize()
+{
     stats.hashSerialized = ss.GetHash();
-    stats.nTotalAmount = nTotalAmount;
-    return true;
+}
+
+bool CBlockTreeDB::WriteBlockSupply(const uint256& hashBlock, const CBlockSupply& supply)
+{
+    return Write(make_pair('S', hashBlock), supply);
+}
+
+bool CBlockTreeDB::ReadBlockSupply(const uint256& hashBlock, CBlockSupply& supply)
+{
+    return Read(make_pair('S', hashBlock), supply);
 }
 
 bool CBlockTreeDB::ReadTxIndex(const uint256& txid, CDiskTxPos& pos)
@@ -193,53 +461,127 @@ bool CBlockTreeDB::WriteTxIndex(const std::vector<std::pair<uint256, CDiskTxPos>
     return WriteBatch(batch);
 }
 
-bool CBlockTreeDB::ReadAddrIndex(uint160 addrid, std::vector<CExtDiskTxPos> &list) {
+bool CBlockTreeDB::ReadAddrIndex(const CAddressIndexKey& start, const boost::function<bool(const CAddressIndexKey&, const CAddressIndexValue&)>& fn)
+{
     boost::scoped_ptr<leveldb::Iterator> pcursor(NewIterator());
 
-    uint64_t lookupid;
-    {
-        CHashWriter ss(SER_GETHASH, 0);
-        ss << salt;
-        ss << addrid;
-        lookupid = (ss.GetHash()).GetLow64();
+    CDataStream ssKeySet(SER_DISK, CLIENT_VERSION);
+    ssKeySet << make_pair('d', start);
+
+    for (pcursor->Seek(ssKeySet.str()); pcursor->Valid(); pcursor->Next()) {
+        boost::this_thread::interruption_point();
+        try {
+            leveldb::Slice slKey = pcursor->key();
+            CDataStream ssKey(slKey.data(), slKey.data() + slKey.size(), SER_DISK, CLIENT_VERSION);
+            char chType;
+            ssKey >> chType;
+            if (chType != 'd')
+                break;
+            CAddressIndexKey key;
+            ssKey >> key;
+            if (key.addrid != start.addrid)
+                break;
+            leveldb::Slice slValue = pcursor->value();
+            CDataStream ssValue(slValue.data(), slValue.data() + slValue.size(), SER_DISK, CLIENT_VERSION);
+            CAddressIndexValue value;
+            ssValue >> value;
+            if (!fn(key, value))
+                break;
+        } catch (std::exception& e) {
+            return error("%s : Deserialize or I/O error - %s", __func__, e.what());
+        }
     }
+    return true;
+}
 
-    CDataStream firstKey(SER_DISK, CLIENT_VERSION);
-    firstKey << make_pair('a', lookupid);
-    pcursor->Seek(firstKey.str());
-
-    for(pcursor->Seek(firstKey.str()); pcursor->Valid(); pcursor->Next()) {
-        leveldb::Slice key = pcursor->key();
-        CDataStream ssKey(key.data(), key.data() + key.size(), SER_DISK, CLIENT_VERSION);
-        char id;
-        ssKey >> id;
-        if(id == 'a') {
-            uint64_t lid;
-            ssKey >> lid;
-            if(lid == lookupid) {
-                CExtDiskTxPos position;
-                ssKey >> position;
-                list.push_back(position);
-            } else {
+bool CBlockTreeDB::ReadAddrUnspent(const uint160& addrid, std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> >& vUnspent)
+{
+    boost::scoped_ptr<leveldb::Iterator> pcursor(NewIterator());
+
+    CDataStream ssKeySet(SER_DISK, CLIENT_VERSION);
+    ssKeySet << make_pair('u', CAddressUnspentKey(addrid, uint256(0), 0));
+
+    for (pcursor->Seek(ssKeySet.str()); pcursor->Valid(); pcursor->Next()) {
+        boost::this_thread::interruption_point();
+        try {
+            leveldb::Slice slKey = pcursor->key();
+            CDataStream ssKey(slKey.data(), slKey.data() + slKey.size(), SER_DISK, CLIENT_VERSION);
+            char chType;
+            ssKey >> chType;
+            if (chType != 'u')
                 break;
-            }
-        } else {
-            break;
+            CAddressUnspentKey key;
+            ssKey >> key;
+            if (key.addrid != addrid)
+                break;
+            leveldb::Slice slValue = pcursor->value();
+            CDataStream ssValue(slValue.data(), slValue.data() + slValue.size(), SER_DISK, CLIENT_VERSION);
+            CAddressUnspentValue value;
+            ssValue >> value;
+            vUnspent.push_back(std::make_pair(key, value));
+        } catch (std::exception& e) {
+            return error("%s : Deserialize or I/O error - %s", __func__, e.what());
         }
     }
     return true;
 }
 
-bool CBlockTreeDB::AddAddrIndex(const std::vector<std::pair<uint160, CExtDiskTxPos> > &list) {
-    unsigned char foo[0];
+bool CBlockTreeDB::ReadAddrSummary(const uint160& addrid, CAddressSummary& summary)
+{
+    if (!Exists(std::make_pair('s', addrid))) {
+        summary = CAddressSummary();
+        return true;
+    }
+    return Read(std::make_pair('s', addrid), summary);
+}
+
+bool CBlockTreeDB::UpdateAddrIndex(const std::vector<std::pair<CAddressIndexKey, CAddressIndexValue> >& vDeltas,
+                                   const std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> >& vUnspent,
+                                   bool fConnect)
+{
     CLevelDBBatch batch;
-    for (std::vector<std::pair<uint160, CExtDiskTxPos> >::const_iterator it=list.begin(); it!=list.end(); it++) {
-        CHashWriter ss(SER_GETHASH, 0);
-        ss << salt;
-        ss << it->first;
-        batch.Write(make_pair(make_pair('a', (ss.GetHash()).GetLow64()), it->second), FLATDATA(foo));
+
+    // A transaction counts once per address, however many of its inputs and
+    // outputs touch that address.
+    std::map<uint160, CAddressSummary> mapSummary;
+    std::set<std::pair<uint160, uint256> > setCounted;
+    for (std::vector<std::pair<CAddressIndexKey, CAddressIndexValue> >::const_iterator it = vDeltas.begin(); it != vDeltas.end(); it++) {
+        const CAddressIndexKey& key = it->first;
+        CAddressSummary& summary = mapSummary[key.addrid];
+        int nSign = fConnect ? 1 : -1;
+        summary.nBalance += nSign * it->second.nValue;
+        if (!key.fSpending)
+            summary.nReceived += nSign * it->second.nValue;
+        if (setCounted.insert(std::make_pair(key.addrid, key.txhash)).second)
+            summary.nTxCount += nSign;
+
+        if (fConnect)
+            batch.Write(make_pair('d', key), it->second);
+        else
+            batch.Erase(make_pair('d', key));
     }
-    return WriteBatch(batch, true);
+
+    for (std::map<uint160, CAddressSummary>::const_iterator it = mapSummary.begin(); it != mapSummary.end(); it++) {
+        CAddressSummary summary;
+        if (!ReadAddrSummary(it->first, summary))
+            return false;
+        summary.nBalance += it->second.nBalance;
+        summary.nReceived += it->second.nReceived;
+        summary.nTxCount += it->second.nTxCount;
+        if (summary.nTxCount == 0)
+            batch.Erase(make_pair('s', it->first));
+        else
+            batch.Write(make_pair('s', it->first), summary);
+    }
+
+    for (std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> >::const_iterator it = vUnspent.begin(); it != vUnspent.end(); it++) {
+        if (it->second.IsNull())
+            batch.Erase(make_pair('u', it->first));
+        else
+            batch.Write(make_pair('u', it->first), it->second);
+    }
+
+    return WriteBatch(batch);
 }
 
 bool CBlockTreeDB::WriteFlag(const std::string& name, bool fValue)
@@ -355,10 +697,12 @@ CZerocoinDB::CZerocoinDB(size_t nCacheSize, bool fMemory, bool fWipe) : CLevelDB
 {
 }
 
-bool CZerocoinDB::WriteCoinMint(const PublicCoin& pubCoin, const uint256& hashTx)
+bool CZerocoinDB::WriteCoinMint(const PublicCoin& pubCoin, const uint256& hashTx, int nHeight)
 {
     uint256 hash = GetPubCoinHash(pubCoin.getValue());
-    return Write(make_pair('m', hash), hashTx, true);
+    if (nHeight < 0)
+        return Write(make_pair('m', hash), hashTx, true);
+    return Write(make_pair('m', hash), CZerocoinTxInfo(hashTx, nHeight, pubCoin.getDenomination()), true);
 }
 
 bool CZerocoinDB::ReadCoinMint(const CBigNum& bnPubcoin, uint256& hashTx)
@@ -371,19 +715,26 @@ bool CZerocoinDB::ReadCoinMint(const uint256& hashPubcoin, uint256& hashTx)
     return Read(make_pair('m', hashPubcoin), hashTx);
 }
 
+bool CZerocoinDB::ReadCoinMintInfo(const uint256& hashPubcoin, CZerocoinTxInfo& info)
+{
+    return Read(make_pair('m', hashPubcoin), info);
+}
+
 bool CZerocoinDB::EraseCoinMint(const CBigNum& bnPubcoin)
 {
     uint256 hash = GetPubCoinHash(bnPubcoin);
     return Erase(make_pair('m', hash));
 }
 
-bool CZerocoinDB::WriteCoinSpend(const CBigNum& bnSerial, const uint256& txHash)
+bool CZerocoinDB::WriteCoinSpend(const CBigNum& bnSerial, const uint256& txHash, int nHeight, CoinDenomination denom)
 {
     CDataStream ss(SER_GETHASH, 0);
     ss << bnSerial;
     uint256 hash = Hash(ss.begin(), ss.end());
 
-    return Write(make_pair('s', hash), txHash, true);
+    if (nHeight < 0)
+        return Write(make_pair('s', hash), txHash, true);
+    return Write(make_pair('s', hash), CZerocoinTxInfo(txHash, nHeight, denom), true);
 }
 
 bool CZerocoinDB::ReadCoinSpend(const CBigNum& bnSerial, uint256& txHash)
@@ -400,6 +751,11 @@ bool CZerocoinDB::ReadCoinSpend(const uint256& hashSerial, uint256 &txHash)
     return Read(make_pair('s', hashSerial), txHash);
 }
 
+bool CZerocoinDB::ReadCoinSpendInfo(const uint256& hashSerial, CZerocoinTxInfo& info)
+{
+    return Read(make_pair('s', hashSerial), info);
+}
+
 bool CZerocoinDB::EraseCoinSpend(const CBigNum& bnSerial)
 {
     CDataStream ss(SER_GETHASH, 0);
@@ -9,6 +9,7 @@
 #ifndef BITCOIN_TXDB_H
 #define BITCOIN_TXDB_H
 
+#include "hash.h"
 #include "leveldbwrapper.h"
 #include "main.h"
 #include "primitives/zerocoin.h"
@@ -18,6 +19,8 @@
 #include <utility>
 #include <vector>
 
+#include <boost/function.hpp>
+
 class CCoins;
 class uint256;
 
@@ -27,6 +30,25 @@ static const int64_t nDefaultDbCache = 100;
 static const int64_t nMaxDbCache = sizeof(void*) > 4 ? 4096 : 1024;
 //! min. -dbcache in (MiB)
 static const int64_t nMinDbCache = 4;
+//! max. number of threads scanning the coin database for GetStats
+static const int MAX_COINSTATS_THREADS = 8;
+
+/**
+ * Accumulates the statistics and hash of a UTXO set reported by
+ * gettxoutsetinfo. Coins must be added in txid order.
+ */
+class CCoinsStatsHasher
+{
+private:
+    CCoinsStats& stats;
+    CHashWriter ss;
+
+public:
+    CCoinsStatsHasher(CCoinsStats& statsIn, const uint256& hashBlock);
+    void Add(const uint256& txid, const CCoins& coins, size_t nSerializedSize);
+    //! Set stats.hashSerialized; no coins can be added afterwards
+    void Finalize();
+};
 
 /** CCoinsView backed by the LevelDB coin database (chainstate/) */
 class CCoinsViewDB : public CCoinsView
@@ -41,7 +63,32 @@ public:
     bool HaveCoins(const uint256& txid) const;
     uint256 GetBestBlock() const;
     bool BatchWrite(CCoinsMap& mapCoins, const uint256& hashBlock);
-    bool GetStats(CCoinsStats& stats) const;
+    bool GetStats(CCoinsStats& stats, CoinStatsHashType hashType = COINSTATS_HASH_SERIALIZED) const;
+    CCoinsViewSnapshot* NewSnapshot() const;
+};
+
+/**
+ * Money supply change and zerocoin mint and spend denominations of a block,
+ * kept in the block database so -reindexmoneysupply does not need the block.
+ */
+class CBlockSupply
+{
+public:
+    CAmount nMoneySupplyDelta;
+    std::vector<libzerocoin::CoinDenomination> vMintDenominations;
+    std::vector<libzerocoin::CoinDenomination> vSpendDenominations;
+
+    CBlockSupply() : nMoneySupplyDelta(0) {}
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action, int nType, int nVersion)
+    {
+        READWRITE(nMoneySupplyDelta);
+        READWRITE(vMintDenominations);
+        READWRITE(vSpendDenominations);
+    }
 };
 
 /** Access to the block database (blocks/index/) */
@@ -51,21 +98,30 @@ public:
     CBlockTreeDB(size_t nCacheSize, bool fMemory = false, bool fWipe = false);
 
 private:
-    uint256 salt;
     CBlockTreeDB(const CBlockTreeDB&);
     void operator=(const CBlockTreeDB&);
 
 public:
     bool WriteBlockIndex(const CDiskBlockIndex& blockindex);
+    bool WriteBlockIndexes(const std::vector<CDiskBlockIndex>& vBlockIndex);
     bool WriteBatchSync(const std::vector<std::pair<int, const CBlockFileInfo*> >& fileInfo, int nLastFile, const std::vector<const CBlockIndex*>& blockinfo);
     bool ReadBlockFileInfo(int nFile, CBlockFileInfo& fileinfo);
     bool ReadLastBlockFile(int& nFile);
     bool WriteReindexing(bool fReindex);
     bool ReadReindexing(bool& fReindex);
+    bool WriteBlockSupply(const uint256& hashBlock, const CBlockSupply& supply);
+    bool ReadBlockSupply(const uint256& hashBlock, CBlockSupply& supply);
     bool ReadTxIndex(const uint256& txid, CDiskTxPos& pos);
     bool WriteTxIndex(const std::vector<std::pair<uint256, CDiskTxPos> >& list);
-    bool ReadAddrIndex(uint160 addrid, std::vector<CExtDiskTxPos> &list);
-    bool AddAddrIndex(const std::vector<std::pair<uint160, CExtDiskTxPos> > &list);
+    /** Walk the address index entries of start.addrid from start onwards, in
+     *  chain order, until fn returns false. */
+    bool ReadAddrIndex(const CAddressIndexKey& start, const boost::function<bool(const CAddressIndexKey&, const CAddressIndexValue&)>& fn);
+    bool ReadAddrUnspent(const uint160& addrid, std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> >& vUnspent);
+    bool ReadAddrSummary(const uint160& addrid, CAddressSummary& summary);
+    /** Add (fConnect) or remove the entries of one block, updating the per-address summaries */
+    bool UpdateAddrIndex(const std::vector<std::pair<CAddressIndexKey, CAddressIndexValue> >& vDeltas,
+                         const std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> >& vUnspent,
+                         bool fConnect);
     bool WriteFlag(const std::string& name, bool fValue);
     bool ReadFlag(const std::string& name, bool& fValue);
     bool WriteInt(const std::string& name, int nValue);
@@ -73,6 +129,32 @@ public:
     bool LoadBlockIndexGuts();
 };
 
+/**
+ * Value of a zerocoin database mint or spend entry: the transaction, and the
+ * height and denomination of the mint or spend. Entries written before the
+ * height and denomination were added only hold the txid.
+ */
+class CZerocoinTxInfo
+{
+public:
+    uint256 txid;
+    int nHeight;
+    libzerocoin::CoinDenomination denom;
+
+    CZerocoinTxInfo() : txid(0), nHeight(-1), denom(libzerocoin::ZQ_ERROR) {}
+    CZerocoinTxInfo(const uint256& txidIn, int nHeightIn, libzerocoin::CoinDenomination denomIn) : txid(txidIn), nHeight(nHeightIn), denom(denomIn) {}
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action, int nType, int nVersion)
+    {
+        READWRITE(txid);
+        READWRITE(nHeight);
+        READWRITE(denom);
+    }
+};
+
 class CZerocoinDB : public CLevelDBWrapper
 {
 public:
@@ -83,12 +165,16 @@ private:
     void operator=(const CZerocoinDB&);
 
 public:
-    bool WriteCoinMint(const libzerocoin::PublicCoin& pubCoin, const uint256& txHash);
+    bool WriteCoinMint(const libzerocoin::PublicCoin& pubCoin, const uint256& txHash, int nHeight = -1);
     bool ReadCoinMint(const CBigNum& bnPubcoin, uint256& txHash);
     bool ReadCoinMint(const uint256& hashPubcoin, uint256& hashTx);
-    bool WriteCoinSpend(const CBigNum& bnSerial, const uint256& txHash);
+    //! False if the mint is unknown or was recorded without its height
+    bool ReadCoinMintInfo(const uint256& hashPubcoin, CZerocoinTxInfo& info);
+    bool WriteCoinSpend(const CBigNum& bnSerial, const uint256& txHash, int nHeight = -1, libzerocoin::CoinDenomination denom = libzerocoin::ZQ_ERROR);
     bool ReadCoinSpend(const CBigNum& bnSerial, uint256& txHash);
     bool ReadCoinSpend(const uint256& hashSerial, uint256 &txHash);
+    //! False if the spend is unknown or was recorded without its height
+    bool ReadCoinSpendInfo(const uint256& hashSerial, CZerocoinTxInfo& info);
     bool EraseCoinMint(const CBigNum& bnPubcoin);
     bool EraseCoinSpend(const CBigNum& bnSerial);
     bool WipeCoins(std::string strType);
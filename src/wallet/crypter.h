@@ -198,6 +198,14 @@ public:
             mi++;
         }
     }
+    //! Number of keys held, without building the set GetKeys returns
+    size_t GetKeyCount() const
+    {
+        LOCK(cs_KeyStore);
+        if (!IsCrypted())
+            return mapKeys.size();
+        return mapCryptedKeys.size();
+    }
 
     bool GetDeterministicSeed(const uint256& hashSeed, uint256& seed);
     bool AddDeterministicSeed(const uint256& seed);
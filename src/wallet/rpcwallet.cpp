@@ -49,6 +49,15 @@ void EnsureWalletIsUnlocked(bool fAllowAnonOnly)
         throw JSONRPCError(RPC_WALLET_UNLOCK_NEEDED, "Error: Please enter the wallet passphrase with walletpassphrase first.");
 }
 
+/** Throw if a rescan from nStartHeight would need blocks that have been pruned */
+void EnsureRescanAvailable(int nStartHeight)
+{
+    LOCK(cs_main);
+    int nPruneHeight = GetPruneHeight();
+    if (nStartHeight < nPruneHeight)
+        throw JSONRPCError(RPC_WALLET_ERROR, strprintf("Rescan is not possible in pruned mode: blocks below height %d have been deleted", nPruneHeight));
+}
+
 void WalletTxToJSON(const CWalletTx& wtx, UniValue& entry)
 {
     int confirms = wtx.GetDepthInMainChain(false);
@@ -2596,6 +2605,8 @@ UniValue upgradetohd(const UniValue& params, bool fHelp)
     if (pwalletMain->IsHDEnabled()) {
         throw JSONRPCError(RPC_WALLET_ERROR, "Cannot upgrade a wallet to hd if It is already upgraded to hd.");
     }
+    // The new seed's keys are looked for in the whole chain
+    EnsureRescanAvailable(0);
 
     EnsureWalletIsUnlocked(pwalletMain);
 
@@ -27,6 +27,7 @@
 #include "ui_interface.h"
 #include "utilmoneystr.h"
 #include "bip39.h"
+#include "crypto/ripemd160.h"
 #include <tuple>
 
 #include "denomination_functions.h"
@@ -34,6 +35,7 @@
 #include "zhlixwallet.h"
 #include "primitives/deterministicmint.h"
 #include <assert.h>
+#include <atomic>
 
 #include <boost/algorithm/string/replace.hpp>
 #include <boost/thread.hpp>
@@ -680,6 +682,67 @@ bool CWallet::IsSpent(const uint256& hash, unsigned int n) const
     return false;
 }
 
+/**
+ * True if every output of ours in wtx is spent by a transaction confirmed in
+ * the main chain. Unconfirmed spends can silently drop out of the mempool, so
+ * they don't count here even though IsSpent() treats them as spent.
+ */
+bool CWallet::IsSpentInMainChain(const CWalletTx& wtx) const
+{
+    const uint256 hash = wtx.GetHash();
+    for (unsigned int i = 0; i < wtx.vout.size(); i++) {
+        if (IsMine(wtx.vout[i]) == ISMINE_NO)
+            continue;
+        bool fSpent = false;
+        pair<TxSpends::const_iterator, TxSpends::const_iterator> range = mapTxSpends.equal_range(COutPoint(hash, i));
+        for (TxSpends::const_iterator it = range.first; it != range.second && !fSpent; ++it) {
+            std::map<uint256, CWalletTx>::const_iterator mit = mapWallet.find(it->second);
+            fSpent = mit != mapWallet.end() && mit->second.GetDepthInMainChain() > 0;
+        }
+        if (!fSpent)
+            return false;
+    }
+    return true;
+}
+
+void CWallet::AddToUnspent(const CWalletTx& wtx)
+{
+    setUnspentTxs.insert(wtx.GetHash());
+    // A change to a spending transaction (confirmed, disconnected, conflicted)
+    // can make the outputs it spends available again
+    if (wtx.IsCoinBase() || wtx.IsZerocoinSpend())
+        return;
+    for (const CTxIn& txin : wtx.vin) {
+        if (mapWallet.count(txin.prevout.hash))
+            setUnspentTxs.insert(txin.prevout.hash);
+    }
+}
+
+std::vector<const CWalletTx*> CWallet::GetUnspentTxs() const
+{
+    AssertLockHeld(cs_wallet);
+    if (fUnspentTxsDirty) {
+        setUnspentTxs.clear();
+        for (const PAIRTYPE(const uint256, CWalletTx) & item : mapWallet)
+            setUnspentTxs.insert(item.first);
+        fUnspentTxsDirty = false;
+    }
+
+    std::vector<const CWalletTx*> vTxs;
+    vTxs.reserve(setUnspentTxs.size());
+    std::set<uint256>::iterator it = setUnspentTxs.begin();
+    while (it != setUnspentTxs.end()) {
+        std::map<uint256, CWalletTx>::const_iterator mit = mapWallet.find(*it);
+        if (mit == mapWallet.end() || IsSpentInMainChain(mit->second)) {
+            setUnspentTxs.erase(it++);
+            continue;
+        }
+        vTxs.push_back(&mit->second);
+        ++it;
+    }
+    return vTxs;
+}
+
 void CWallet::AddToSpends(const COutPoint& outpoint, const uint256& wtxid)
 {
     mapTxSpends.insert(make_pair(outpoint, wtxid));
@@ -1039,6 +1102,8 @@ void CWallet::MarkDirty()
         LOCK(cs_wallet);
         for (PAIRTYPE(const uint256, CWalletTx) & item : mapWallet)
             item.second.MarkDirty();
+        // Imports change which outputs are ours
+        fUnspentTxsDirty = true;
     }
 }
 
@@ -1052,6 +1117,7 @@ bool CWallet::AddToWallet(const CWalletTx& wtxIn, bool fFromLoadWallet)
         wtx.BindWallet(this);
         wtxOrdered.insert(make_pair(wtx.nOrderPos, TxPair(&wtx, (CAccountingEntry*)0)));
         AddToSpends(hash);
+        AddToUnspent(wtx);
     } else {
         LOCK(cs_wallet);
         // Inserts only if not already there, returns tx inserted or tx found
@@ -1099,6 +1165,7 @@ bool CWallet::AddToWallet(const CWalletTx& wtxIn, bool fFromLoadWallet)
 
         // Break debit/credit balance caches:
         wtx.MarkDirty();
+        AddToUnspent(wtx);
 
         // Notify UI of new or updated transaction
         NotifyTransactionChanged(this, hash, fInsertedNew ? CT_NEW : CT_UPDATED);
@@ -1139,6 +1206,9 @@ bool CWallet::AddToWalletIfInvolvingMe(const CTransaction& tx, const CBlock* pbl
 void CWallet::SyncTransaction(const CTransaction& tx, const CBlock* pblock)
 {
     LOCK2(cs_main, cs_wallet);
+    if (tx.ContainsZerocoins() && zhlixTracker)
+        zhlixTracker->SetStatusDirty(tx);
+
     if (!AddToWalletIfInvolvingMe(tx, pblock, true))
         return; // Not one of ours
 
@@ -1157,6 +1227,11 @@ void CWallet::EraseFromWallet(const uint256& hash)
         return;
     {
         LOCK(cs_wallet);
+        // The outputs the erased transaction spent count as unspent again
+        std::map<uint256, CWalletTx>::const_iterator mi = mapWallet.find(hash);
+        if (mi != mapWallet.end())
+            AddToUnspent(mi->second);
+        setUnspentTxs.erase(hash);
         if (mapWallet.erase(hash))
             CWalletDB(strWalletFile).EraseTx(hash);
     }
@@ -1830,10 +1905,194 @@ bool CWalletTx::WriteToDisk()
     return CWalletDB(pwallet->strWalletFile).WriteTx(GetHash(), *this);
 }
 
+/** Number of blocks a rescan reads and filters ahead of the wallet */
+static const unsigned int WALLET_RESCAN_BATCH = 128;
+/** Maximum number of threads reading and filtering blocks during a rescan */
+static const unsigned int WALLET_RESCAN_MAX_THREADS = 8;
+
+bool CWalletScanFilter::IsRelevant(const CScript& scriptPubKey) const
+{
+    if (setWatchOnly.count(scriptPubKey))
+        return true;
+
+    std::vector<std::vector<unsigned char> > vSolutions;
+    txnouttype whichType;
+    if (!Solver(scriptPubKey, whichType, vSolutions))
+        return false;
+
+    switch (whichType) {
+    case TX_PUBKEY:
+        return setKeyIDs.count(CPubKey(vSolutions[0]).GetID()) > 0;
+    case TX_PUBKEYHASH:
+    case TX_WITNESS_V0_KEYHASH:
+        return setKeyIDs.count(CKeyID(uint160(vSolutions[0]))) > 0;
+    case TX_SCRIPTHASH:
+        return setScriptIDs.count(CScriptID(uint160(vSolutions[0]))) > 0;
+    case TX_WITNESS_V0_SCRIPTHASH: {
+        uint160 hash;
+        CRIPEMD160().Write(&vSolutions[0][0], vSolutions[0].size()).Finalize(hash.begin());
+        return setScriptIDs.count(CScriptID(hash)) > 0;
+    }
+    case TX_MULTISIG:
+        // Only the keys are stored; the first and last solutions are the counts
+        for (unsigned int i = 1; i + 1 < vSolutions.size(); i++) {
+            if (setKeyIDs.count(CPubKey(vSolutions[i]).GetID()))
+                return true;
+        }
+        return false;
+    default:
+        return false;
+    }
+}
+
+bool CWalletScanFilter::IsRelevant(const CTransaction& tx) const
+{
+    for (const CTxOut& txout : tx.vout) {
+        if (IsRelevant(txout.scriptPubKey))
+            return true;
+    }
+    return false;
+}
+
+void CWallet::GetScanFilter(CWalletScanFilter& filter) const
+{
+    LOCK2(cs_wallet, cs_KeyStore);
+    GetKeys(filter.setKeyIDs);
+    for (const auto& entry : mapHdPubKeys)
+        filter.setKeyIDs.insert(entry.first);
+    for (const auto& entry : mapScripts)
+        filter.setScriptIDs.insert(entry.first);
+    filter.setWatchOnly = setWatchOnly;
+    filter.nKeyStoreSize = GetKeyStoreSize();
+}
+
+size_t CWallet::GetKeyStoreSize() const
+{
+    LOCK2(cs_wallet, cs_KeyStore);
+    return GetKeyCount() + mapHdPubKeys.size() + mapScripts.size() + setWatchOnly.size();
+}
+
+/**
+ * A run of consecutive blocks that worker threads read from disk and match
+ * against a CWalletScanFilter while the wallet commits the previous run.
+ */
+class CWalletScanBatch
+{
+public:
+    std::vector<CBlockIndex*> vIndex;
+    std::vector<CBlock> vBlock;
+    //! Whether the block was read; if not, the wallet reads and checks it itself
+    std::vector<char> vRead;
+    //! Per block, per transaction: whether the filter matched any output
+    std::vector<std::vector<char> > vRelevant;
+    std::shared_ptr<const CWalletScanFilter> filter;
+    //! Blocks handed out to workers so far; guarded by the worker pool
+    size_t nNext;
+    //! Set when the batch is no longer wanted; workers skip its remaining blocks
+    std::atomic<bool> fCancelled;
+
+    /** Requires cs_main to pick the blocks; reading happens without it */
+    CWalletScanBatch(CBlockIndex* pindexStart, const std::shared_ptr<const CWalletScanFilter>& filterIn) : filter(filterIn), nNext(0), fCancelled(false), nDone(0)
+    {
+        AssertLockHeld(cs_main);
+        for (CBlockIndex* pindex = pindexStart; pindex && vIndex.size() < WALLET_RESCAN_BATCH; pindex = chainActive.Next(pindex))
+            vIndex.push_back(pindex);
+        vBlock.resize(vIndex.size());
+        vRead.resize(vIndex.size(), 0);
+        vRelevant.resize(vIndex.size());
+    }
+
+    void Read(size_t i)
+    {
+        if (!fCancelled && ReadTrustedBlockFromDisk(vBlock[i], vIndex[i])) {
+            vRelevant[i].resize(vBlock[i].vtx.size());
+            for (unsigned int j = 0; j < vBlock[i].vtx.size(); j++)
+                vRelevant[i][j] = filter->IsRelevant(vBlock[i].vtx[j]);
+            vRead[i] = 1;
+        }
+        boost::unique_lock<boost::mutex> lock(cs);
+        if (++nDone == vIndex.size())
+            cond.notify_all();
+    }
+
+    /** Wait until every block has been handed to a worker and processed */
+    void Wait()
+    {
+        boost::unique_lock<boost::mutex> lock(cs);
+        while (nDone < vIndex.size())
+            cond.wait(lock);
+    }
+
+private:
+    CWaitableCriticalSection cs;
+    CConditionVariable cond;
+    size_t nDone;
+};
+
+/**
+ * Threads that read the blocks of queued rescan batches, in queue order.
+ * They are started once per rescan and shared by all of its batches.
+ */
+class CWalletScanWorkers
+{
+public:
+    explicit CWalletScanWorkers(unsigned int nThreads) : fInterrupt(false)
+    {
+        for (unsigned int i = 0; i < nThreads; i++)
+            threads.create_thread(boost::bind(&CWalletScanWorkers::ThreadRead, this));
+    }
+
+    ~CWalletScanWorkers()
+    {
+        {
+            boost::unique_lock<boost::mutex> lock(cs);
+            fInterrupt = true;
+            cond.notify_all();
+        }
+        threads.join_all();
+    }
+
+    void Add(const std::shared_ptr<CWalletScanBatch>& batch)
+    {
+        boost::unique_lock<boost::mutex> lock(cs);
+        queue.push_back(batch);
+        cond.notify_all();
+    }
+
+private:
+    CWaitableCriticalSection cs;
+    CConditionVariable cond;
+    std::deque<std::shared_ptr<CWalletScanBatch> > queue;
+    bool fInterrupt;
+    boost::thread_group threads;
+
+    void ThreadRead()
+    {
+        RenameThread("helix-rescan");
+        while (true) {
+            std::shared_ptr<CWalletScanBatch> batch;
+            size_t i;
+            {
+                boost::unique_lock<boost::mutex> lock(cs);
+                while (!fInterrupt && queue.empty())
+                    cond.wait(lock);
+                if (fInterrupt)
+                    return;
+                batch = queue.front();
+                i = batch->nNext++;
+                if (batch->nNext >= batch->vIndex.size())
+                    queue.pop_front();
+            }
+            batch->Read(i);
+        }
+    }
+};
+
 /**
- * Scan the block chain (starting in pindexStart) for transactions
- * from or to us. If fUpdate is true, found transactions that already
- * exist in the wallet will be updated.
+ * Scan the active chain from pindexStart for transactions involving the wallet.
+ * Blocks are read and matched against a keystore snapshot on worker threads, a
+ * batch ahead of the wallet, and committed in order. cs_main and cs_wallet are
+ * only held while a batch is committed, so callers should not hold them.
  */
 int CWallet::ScanForWalletTransactions(CBlockIndex* pindexStart, bool fUpdate)
 {
@@ -1845,8 +2104,10 @@ int CWallet::ScanForWalletTransactions(CBlockIndex* pindexStart, bool fUpdate)
         zhlixTracker->Init();
 
     CBlockIndex* pindex = pindexStart;
+    double dProgressStart;
+    double dProgressTip;
     {
-        LOCK2(cs_main, cs_wallet);
+        LOCK(cs_main);
 
         // no need to read and scan block, if block was created before
         // our wallet birthday (as adjusted for block time variability)
@@ -1854,74 +2115,168 @@ int CWallet::ScanForWalletTransactions(CBlockIndex* pindexStart, bool fUpdate)
             pindex = chainActive.Next(pindex);
 
         ShowProgress(_("Rescanning..."), 0); // show rescan progress in GUI as dialog or on splashscreen, if -rescan on startup
-        double dProgressStart = Checkpoints::GuessVerificationProgress(pindex, false);
-        double dProgressTip = Checkpoints::GuessVerificationProgress(chainActive.Tip(), false);
-        set<uint256> setAddedToWallet;
-        while (pindex) {
-            if (pindex->nHeight % 100 == 0 && dProgressTip - dProgressStart > 0.0)
-                ShowProgress(_("Rescanning..."), std::max(1, std::min(99, (int)((Checkpoints::GuessVerificationProgress(pindex, false) - dProgressStart) / (dProgressTip - dProgressStart) * 100))));
-
-            CBlock block;
-            ReadBlockFromDisk(block, pindex);
-            for (CTransaction& tx : block.vtx) {
-                if (AddToWalletIfInvolvingMe(tx, &block, fUpdate))
-                    ret++;
+        dProgressStart = Checkpoints::GuessVerificationProgress(pindex, false);
+        dProgressTip = Checkpoints::GuessVerificationProgress(chainActive.Tip(), false);
+    }
+
+    unsigned int nThreads = std::max(1u, std::min(boost::thread::hardware_concurrency(), WALLET_RESCAN_MAX_THREADS));
+    std::shared_ptr<CWalletScanFilter> filter = std::make_shared<CWalletScanFilter>();
+    GetScanFilter(*filter);
+
+    std::unique_ptr<CWalletScanWorkers> workers;
+    std::shared_ptr<CWalletScanBatch> batch;
+    if (pindex) {
+        workers.reset(new CWalletScanWorkers(nThreads));
+        LOCK(cs_main);
+        batch = std::make_shared<CWalletScanBatch>(pindex, filter);
+        workers->Add(batch);
+    }
+
+    set<uint256> setAddedToWallet;
+    while (batch && !batch->vIndex.empty()) {
+        // Start reading the next batch while this one is committed
+        std::shared_ptr<CWalletScanBatch> next;
+        {
+            LOCK(cs_main);
+            CBlockIndex* pindexNext = chainActive.Next(batch->vIndex.back());
+            if (pindexNext) {
+                next = std::make_shared<CWalletScanBatch>(pindexNext, filter);
+                workers->Add(next);
             }
+        }
+        batch->Wait();
 
-            //If this is a zapwallettx, need to readd zhlix
-            if (fCheckZHLIX && pindex->nHeight >= Params().Zerocoin_StartHeight()) {
-                list<CZerocoinMint> listMints;
-                BlockToZerocoinMintList(block, listMints);
-
-                for (auto& m : listMints) {
-                    if (IsMyMint(m.GetValue())) {
-                        LogPrint("zero", "%s: found mint\n", __func__);
-                        pwalletMain->UpdateMint(m.GetValue(), pindex->nHeight, m.GetTxHash(), m.GetDenomination());
-
-                        // Add the transaction to the wallet
-                        for (auto& tx : block.vtx) {
-                            uint256 txid = tx.GetHash();
-                            if (setAddedToWallet.count(txid) || mapWallet.count(txid))
-                                continue;
-                            if (txid == m.GetTxHash()) {
-                                CWalletTx wtx(pwalletMain, tx);
-                                wtx.nTimeReceived = block.GetBlockTime();
-                                wtx.SetMerkleBranch(block);
-                                pwalletMain->AddToWallet(wtx);
-                                setAddedToWallet.insert(txid);
+        CBlockIndex* pindexRestart = NULL;
+        bool fReorganized = false;
+        bool fAborted = false;
+        {
+            LOCK2(cs_main, cs_wallet);
+
+            // Keys added since the filter was built (e.g. keypool top-ups while
+            // committing) make its matches incomplete; check every transaction.
+            bool fFilterStale = batch->filter->nKeyStoreSize != GetKeyStoreSize();
+
+            for (unsigned int i = 0; i < batch->vIndex.size(); i++) {
+                pindex = batch->vIndex[i];
+
+                // The chain may have been reorganized while cs_main was released
+                if (!chainActive.Contains(pindex)) {
+                    pindexRestart = chainActive.Next(chainActive.FindFork(pindex));
+                    fReorganized = true;
+                    break;
+                }
+
+                if (pindex->nHeight % 100 == 0 && dProgressTip - dProgressStart > 0.0)
+                    ShowProgress(_("Rescanning..."), std::max(1, std::min(99, (int)((Checkpoints::GuessVerificationProgress(pindex, false) - dProgressStart) / (dProgressTip - dProgressStart) * 100))));
+
+                CBlock& block = batch->vBlock[i];
+                bool fFiltered = batch->vRead[i] && !fFilterStale;
+                if (!batch->vRead[i] && !ReadTrustedBlockFromDisk(block, pindex)) {
+                    // Stop rather than pass over a block (e.g. a pruned one) that may hold our transactions
+                    LogPrintf("%s: cannot read block %d, rescan stopped\n", __func__, pindex->nHeight);
+                    fAborted = true;
+                    break;
+                }
+                for (unsigned int j = 0; j < block.vtx.size(); j++) {
+                    const CTransaction& tx = block.vtx[j];
+                    if (fFiltered && !batch->vRelevant[i][j] && !mapWallet.count(tx.GetHash())) {
+                        // Without a matching output it can only involve us by spending our coins
+                        bool fSpendsOurs = false;
+                        for (const CTxIn& txin : tx.vin) {
+                            if (mapWallet.count(txin.prevout.hash)) {
+                                fSpendsOurs = true;
+                                break;
                             }
                         }
+                        if (!fSpendsOurs)
+                            continue;
+                    }
+                    if (AddToWalletIfInvolvingMe(tx, &block, fUpdate)) {
+                        ret++;
+                        if (!fFilterStale && batch->filter->nKeyStoreSize != GetKeyStoreSize())
+                            fFilterStale = true;
+                        fFiltered = fFiltered && !fFilterStale;
+                    }
+                }
+
+                //If this is a zapwallettx, need to readd zhlix
+                if (fCheckZHLIX && pindex->nHeight >= Params().Zerocoin_StartHeight()) {
+                    list<CZerocoinMint> listMints;
+                    BlockToZerocoinMintList(block, listMints);
+
+                    for (auto& m : listMints) {
+                        if (IsMyMint(m.GetValue())) {
+                            LogPrint("zero", "%s: found mint\n", __func__);
+                            pwalletMain->UpdateMint(m.GetValue(), pindex->nHeight, m.GetTxHash(), m.GetDenomination());
+
+                            // Add the transaction to the wallet
+                            for (auto& tx : block.vtx) {
+                                uint256 txid = tx.GetHash();
+                                if (setAddedToWallet.count(txid) || mapWallet.count(txid))
+                                    continue;
+                                if (txid == m.GetTxHash()) {
+                                    CWalletTx wtx(pwalletMain, tx);
+                                    wtx.nTimeReceived = block.GetBlockTime();
+                                    wtx.SetMerkleBranch(block);
+                                    pwalletMain->AddToWallet(wtx);
+                                    setAddedToWallet.insert(txid);
+                                }
+                            }
 
-                        //Check if the mint was ever spent
-                        int nHeightSpend = 0;
-                        uint256 txidSpend;
-                        CTransaction txSpend;
-                        if (IsSerialInBlockchain(GetSerialHash(m.GetSerialNumber()), nHeightSpend, txidSpend, txSpend)) {
-                            if (setAddedToWallet.count(txidSpend) || mapWallet.count(txidSpend))
-                                continue;
-
-                            CWalletTx wtx(pwalletMain, txSpend);
-                            CBlockIndex* pindexSpend = chainActive[nHeightSpend];
-                            CBlock blockSpend;
-                            if (ReadBlockFromDisk(blockSpend, pindexSpend))
-                                wtx.SetMerkleBranch(blockSpend);
-
-                            wtx.nTimeReceived = pindexSpend->nTime;
-                            pwalletMain->AddToWallet(wtx);
-                            setAddedToWallet.emplace(txidSpend);
+                            //Check if the mint was ever spent
+                            int nHeightSpend = 0;
+                            uint256 txidSpend;
+                            CTransaction txSpend;
+                            if (IsSerialInBlockchain(GetSerialHash(m.GetSerialNumber()), nHeightSpend, txidSpend, txSpend)) {
+                                // the spend may have been pruned
+                                if (txSpend.IsNull() || setAddedToWallet.count(txidSpend) || mapWallet.count(txidSpend))
+                                    continue;
+
+                                CWalletTx wtx(pwalletMain, txSpend);
+                                CBlockIndex* pindexSpend = chainActive[nHeightSpend];
+                                CBlock blockSpend;
+                                if (ReadTrustedBlockFromDisk(blockSpend, pindexSpend))
+                                    wtx.SetMerkleBranch(blockSpend);
+
+                                wtx.nTimeReceived = pindexSpend->nTime;
+                                pwalletMain->AddToWallet(wtx);
+                                setAddedToWallet.emplace(txidSpend);
+                            }
                         }
                     }
                 }
+
+                if (GetTime() >= nNow + 60) {
+                    nNow = GetTime();
+                    LogPrintf("Still rescanning. At block %d. Progress=%f\n", pindex->nHeight, Checkpoints::GuessVerificationProgress(pindex));
+                }
             }
 
-            pindex = chainActive.Next(pindex);
-            if (GetTime() >= nNow + 60) {
-                nNow = GetTime();
-                LogPrintf("Still rescanning. At block %d. Progress=%f\n", pindex->nHeight, Checkpoints::GuessVerificationProgress(pindex));
+            if (fReorganized) {
+                if (next)
+                    next->fCancelled = true;
+                next.reset();
+                if (pindexRestart) {
+                    next = std::make_shared<CWalletScanBatch>(pindexRestart, filter);
+                    workers->Add(next);
+                }
             }
         }
-        ShowProgress(_("Rescanning..."), 100); // hide progress dialog in GUI
+
+        if (fAborted) {
+            if (next)
+                next->fCancelled = true;
+            break;
+        }
+
+        // Later batches should see the keys this one added
+        if (filter->nKeyStoreSize != GetKeyStoreSize()) {
+            filter = std::make_shared<CWalletScanFilter>();
+            GetScanFilter(*filter);
+        }
+        batch = std::move(next);
     }
+    ShowProgress(_("Rescanning..."), 100); // hide progress dialog in GUI
     return ret;
 }
 
@@ -2031,8 +2386,7 @@ CAmount CWallet::GetBalance() const
     CAmount nTotal = 0;
     {
         LOCK2(cs_main, cs_wallet);
-        for (map<uint256, CWalletTx>::const_iterator it = mapWallet.begin(); it != mapWallet.end(); ++it) {
-            const CWalletTx* pcoin = &(*it).second;
+        for (const CWalletTx* pcoin : GetUnspentTxs()) {
             if (pcoin->IsTrusted())
                 nTotal += pcoin->GetAvailableCredit();
         }
@@ -2078,9 +2432,7 @@ CAmount CWallet::GetUnlockedCoins() const
     CAmount nTotal = 0;
     {
         LOCK2(cs_main, cs_wallet);
-        for (map<uint256, CWalletTx>::const_iterator it = mapWallet.begin(); it != mapWallet.end(); ++it) {
-            const CWalletTx* pcoin = &(*it).second;
-
+        for (const CWalletTx* pcoin : GetUnspentTxs()) {
             if (pcoin->IsTrusted() && pcoin->GetDepthInMainChain() > 0)
                 nTotal += pcoin->GetUnlockedCredit();
         }
@@ -2096,9 +2448,7 @@ CAmount CWallet::GetLockedCoins() const
     CAmount nTotal = 0;
     {
         LOCK2(cs_main, cs_wallet);
-        for (map<uint256, CWalletTx>::const_iterator it = mapWallet.begin(); it != mapWallet.end(); ++it) {
-            const CWalletTx* pcoin = &(*it).second;
-
+        for (const CWalletTx* pcoin : GetUnspentTxs()) {
             if (pcoin->IsTrusted() && pcoin->GetDepthInMainChain() > 0)
                 nTotal += pcoin->GetLockedCredit();
         }
@@ -2244,8 +2594,7 @@ CAmount CWallet::GetUnconfirmedBalance() const
     CAmount nTotal = 0;
     {
         LOCK2(cs_main, cs_wallet);
-        for (map<uint256, CWalletTx>::const_iterator it = mapWallet.begin(); it != mapWallet.end(); ++it) {
-            const CWalletTx* pcoin = &(*it).second;
+        for (const CWalletTx* pcoin : GetUnspentTxs()) {
             if (!IsFinalTx(*pcoin) || (!pcoin->IsTrusted() && pcoin->GetDepthInMainChain() == 0))
                 nTotal += pcoin->GetAvailableCredit();
         }
@@ -2258,8 +2607,7 @@ CAmount CWallet::GetImmatureBalance() const
     CAmount nTotal = 0;
     {
         LOCK2(cs_main, cs_wallet);
-        for (map<uint256, CWalletTx>::const_iterator it = mapWallet.begin(); it != mapWallet.end(); ++it) {
-            const CWalletTx* pcoin = &(*it).second;
+        for (const CWalletTx* pcoin : GetUnspentTxs()) {
             nTotal += pcoin->GetImmatureCredit();
         }
     }
@@ -2271,8 +2619,7 @@ CAmount CWallet::GetWatchOnlyBalance() const
     CAmount nTotal = 0;
     {
         LOCK2(cs_main, cs_wallet);
-        for (map<uint256, CWalletTx>::const_iterator it = mapWallet.begin(); it != mapWallet.end(); ++it) {
-            const CWalletTx* pcoin = &(*it).second;
+        for (const CWalletTx* pcoin : GetUnspentTxs()) {
             if (pcoin->IsTrusted())
                 nTotal += pcoin->GetAvailableWatchOnlyCredit();
         }
@@ -2286,8 +2633,7 @@ CAmount CWallet::GetUnconfirmedWatchOnlyBalance() const
     CAmount nTotal = 0;
     {
         LOCK2(cs_main, cs_wallet);
-        for (map<uint256, CWalletTx>::const_iterator it = mapWallet.begin(); it != mapWallet.end(); ++it) {
-            const CWalletTx* pcoin = &(*it).second;
+        for (const CWalletTx* pcoin : GetUnspentTxs()) {
             if (!IsFinalTx(*pcoin) || (!pcoin->IsTrusted() && pcoin->GetDepthInMainChain() == 0))
                 nTotal += pcoin->GetAvailableWatchOnlyCredit();
         }
@@ -2300,8 +2646,7 @@ CAmount CWallet::GetImmatureWatchOnlyBalance() const
     CAmount nTotal = 0;
     {
         LOCK2(cs_main, cs_wallet);
-        for (map<uint256, CWalletTx>::const_iterator it = mapWallet.begin(); it != mapWallet.end(); ++it) {
-            const CWalletTx* pcoin = &(*it).second;
+        for (const CWalletTx* pcoin : GetUnspentTxs()) {
             nTotal += pcoin->GetImmatureWatchOnlyCredit();
         }
     }
@@ -2313,8 +2658,7 @@ CAmount CWallet::GetLockedWatchOnlyBalance() const
     CAmount nTotal = 0;
     {
         LOCK2(cs_main, cs_wallet);
-        for (map<uint256, CWalletTx>::const_iterator it = mapWallet.begin(); it != mapWallet.end(); ++it) {
-            const CWalletTx* pcoin = &(*it).second;
+        for (const CWalletTx* pcoin : GetUnspentTxs()) {
             if (pcoin->IsTrusted() && pcoin->GetDepthInMainChain() > 0)
                 nTotal += pcoin->GetLockedWatchOnlyCredit();
         }
@@ -2331,9 +2675,8 @@ void CWallet::AvailableCoins(vector<COutput>& vCoins, bool fOnlyConfirmed, const
 
     {
         LOCK2(cs_main, cs_wallet);
-        for (map<uint256, CWalletTx>::const_iterator it = mapWallet.begin(); it != mapWallet.end(); ++it) {
-            const uint256& wtxid = it->first;
-            const CWalletTx* pcoin = &(*it).second;
+        for (const CWalletTx* pcoin : GetUnspentTxs()) {
+            const uint256& wtxid = pcoin->GetHash();
 
 	    if (fDebug) LogPrintf("AC 0a\n");
 	    for (unsigned int i = 0; i < pcoin->vout.size(); i++) {
@@ -2412,13 +2755,13 @@ void CWallet::AvailableCoins(vector<COutput>& vCoins, bool fOnlyConfirmed, const
 
 		if (fDebug) LogPrintf("AC 6\n");
 
-                if (IsLockedCoin((*it).first, i) && nCoinType != ONLY_10000)
+                if (IsLockedCoin(wtxid, i) && nCoinType != ONLY_10000)
                     continue;
 		if (fDebug) LogPrintf("AC 6a\n");
                 if (pcoin->vout[i].nValue <= 0 && !fIncludeZeroValue)
                     continue;
 		if (fDebug) LogPrintf("AC 6b\n");
-                if (coinControl && coinControl->HasSelected() && !coinControl->fAllowOtherInputs && !coinControl->IsSelected((*it).first, i))
+                if (coinControl && coinControl->HasSelected() && !coinControl->fAllowOtherInputs && !coinControl->IsSelected(wtxid, i))
                     continue;
 
 		if (fDebug) LogPrintf("AC 7\n");
@@ -3486,16 +3829,12 @@ bool CWallet::CreateCoinStake(const CKeyStore& keystore, unsigned int nBits, int
             continue;
         }
 
-        // Read block header
-	LogPrintf("CreateCoinStake: do GetBlockHeader() height %d\n",pindex->nHeight);
-        CBlockHeader block = pindex->GetBlockHeader();
-
         uint256 hashProofOfStake = 0;
         COutPoint prevoutStake = COutPoint(pcoin.first->GetHash(), pcoin.second);
         nTxNewTime = GetAdjustedTime();
 
         //iterates each utxo inside of CheckStakeKernelHash()
-        if (CheckStakeKernelHash(nBits, block, *pcoin.first, prevoutStake, nTxNewTime, nHashDrift, false, hashProofOfStake, true)) {
+        if (CheckStakeKernelHash(nBits, pindex, pcoin.first->vout[pcoin.second], prevoutStake, nTxNewTime, nHashDrift, false, hashProofOfStake, true)) {
             //Double check that this will pass time requirements
             if (nTxNewTime <= chainActive.Tip()->GetMedianTimePast()) {
                 LogPrintf("CreateCoinStake() : kernel found, but it is too far in the past \n");
@@ -5513,7 +5852,10 @@ bool CWallet::CreateZerocoinSpendTransaction(CAmount nValue, int nSecurityLevel,
         CTransaction txMint;
         uint256 hashBlock;
         bool fArchive = false;
-        if (!GetTransaction(mint.GetTxHash(), txMint, hashBlock)) {
+        CZerocoinTxInfo infoMint;
+        if (zerocoinDB->ReadCoinMintInfo(GetPubCoinHash(mint.GetValue()), infoMint) && infoMint.nHeight <= chainActive.Height()) {
+            // recorded on the active chain with its height, no transaction lookup needed
+        } else if (!GetTransaction(mint.GetTxHash(), txMint, hashBlock)) {
             receipt.SetStatus(_("Unable to find transaction containing mint"), nStatus);
             fArchive = true;
         } else if (mapBlockIndex.count(hashBlock) < 1) {
@@ -5734,6 +6076,14 @@ bool IsMintInChain(const uint256& hashPubcoin, uint256& txid, int& nHeight)
     if (!IsPubcoinInBlockchain(hashPubcoin, txid))
         return false;
 
+    CZerocoinTxInfo info;
+    if (zerocoinDB->ReadCoinMintInfo(hashPubcoin, info)) {
+        if (info.nHeight > chainActive.Height())
+            return false;
+        nHeight = info.nHeight;
+        return true;
+    }
+
     uint256 hashBlock;
     CTransaction tx;
     if (!GetTransaction(txid, tx, hashBlock))
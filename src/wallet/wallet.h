@@ -204,6 +204,27 @@ public:
     StringMap destdata;
 };
 
+/**
+ * Superset of the output scripts the wallet recognises, built from a snapshot
+ * of the keystore so rescan threads can match outputs without touching it.
+ * An output it rejects cannot be ours; transactions it flags are still checked
+ * by AddToWalletIfInvolvingMe.
+ */
+class CWalletScanFilter
+{
+public:
+    std::set<CKeyID> setKeyIDs;
+    std::set<CScriptID> setScriptIDs;
+    std::set<CScript> setWatchOnly;
+    //! Keystore size the snapshot was taken at
+    size_t nKeyStoreSize;
+
+    CWalletScanFilter() : nKeyStoreSize(0) {}
+
+    bool IsRelevant(const CScript& scriptPubKey) const;
+    bool IsRelevant(const CTransaction& tx) const;
+};
+
 /**
  * A CWallet is an extension of a keystore, which also maintains a set of transactions and balances,
  * and provides the ability to create new transactions.
@@ -251,11 +272,30 @@ private:
     void AddToSpends(const uint256& wtxid);
 
     void SyncMetaData(std::pair<TxSpends::iterator, TxSpends::iterator>);
+
+    /**
+     * Wallet transactions that may still hold unspent outputs of ours: a superset
+     * of the truly unspent ones. A transaction is (re)added whenever it, or a
+     * transaction spending from it, is added or synced, and is dropped lazily once
+     * every output of ours is spent by a transaction confirmed in the main chain.
+     * Balance and coin queries walk this set instead of all of mapWallet.
+     */
+    mutable std::set<uint256> setUnspentTxs;
+    //! Forces setUnspentTxs to be rebuilt from mapWallet (ownership may have changed)
+    mutable bool fUnspentTxsDirty;
+    void AddToUnspent(const CWalletTx& wtx);
+    bool IsSpentInMainChain(const CWalletTx& wtx) const;
+
     /* HD derive new child key (on internal or external chain) */
     void DeriveNewChildKey(const CKeyMetadata& metadata, CKey& secretRet, uint32_t nAccountIndex, bool fInternal /*= false*/, CWalletDB * walletDB);
 
 public:
 
+    //! Snapshot of the keystore that rescan threads match outputs against
+    void GetScanFilter(CWalletScanFilter& filter) const;
+    //! Number of keys, scripts and watch-only entries; grows whenever the keystore does
+    size_t GetKeyStoreSize() const;
+
     //TODO move to private after createwalletfromfile has been backported
     void MarkPreSplitKeys();
 
@@ -405,6 +445,9 @@ public:
         //Auto Combine Dust
         fCombineDust = false;
         nAutoCombineThreshold = 0;
+
+        setUnspentTxs.clear();
+        fUnspentTxsDirty = true;
     }
 
     int getZeromintPercentage()
@@ -474,6 +517,8 @@ public:
         return nWalletMaxVersion >= wf;
     }
 
+    //! Wallet transactions that may have unspent outputs of ours; requires cs_main and cs_wallet
+    std::vector<const CWalletTx*> GetUnspentTxs() const;
     void AvailableCoins(std::vector<COutput>& vCoins, bool fOnlyConfirmed = true, const CCoinControl* coinControl = NULL, bool fIncludeZeroValue = false, AvailableCoinsType nCoinType = ALL_COINS, bool fUseIX = false, int nWatchonlyConfig = 1) const;
     std::map<CTxDestination, std::vector<COutput> > AvailableCoinsByAddress(bool fConfirmed = true, CAmount maxCoinValue = 0);
     bool SelectCoinsMinConf(const CAmount& nTargetValue, int nConfMine, int nConfTheirs, std::vector<COutput> vCoins, std::set<std::pair<const CWalletTx*, unsigned int> >& setCoinsRet, CAmount& nValueRet, CoinSelectStrategy coinSelectStrategy) const;
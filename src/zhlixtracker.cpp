@@ -18,6 +18,9 @@ CzHLIXTracker::CzHLIXTracker(std::string strWalletFile)
     this->strWalletFile = strWalletFile;
     mapSerialHashes.clear();
     mapPendingSpends.clear();
+    hashStatusTip = 0;
+    fStatusDirty = true;
+    hashMaturityTip = 0;
     fInitialized = false;
 }
 
@@ -327,6 +330,7 @@ void CzHLIXTracker::SetPubcoinUsed(const uint256& hashPubcoin, const uint256& tx
     meta.isUsed = true;
     mapPendingSpends.insert(make_pair(meta.hashSerial, txid));
     UpdateState(meta);
+    SetSerialDirty(meta.hashSerial);
 }
 
 void CzHLIXTracker::SetPubcoinNotUsed(const uint256& hashPubcoin)
@@ -340,6 +344,37 @@ void CzHLIXTracker::SetPubcoinNotUsed(const uint256& hashPubcoin)
         mapPendingSpends.erase(meta.hashSerial);
 
     UpdateState(meta);
+    SetSerialDirty(meta.hashSerial);
+}
+
+void CzHLIXTracker::SetSerialDirty(const uint256& hashSerial)
+{
+    LOCK(cs_hlixtracker);
+    setDirtySerials.insert(hashSerial);
+}
+
+void CzHLIXTracker::SetStatusDirty(const CTransaction& tx)
+{
+    for (const CTxIn& txin : tx.vin) {
+        if (!txin.scriptSig.IsZerocoinSpend())
+            continue;
+        libzerocoin::CoinSpend spend = TxInToZerocoinSpend(txin);
+        uint256 hashSerial = GetSerialHash(spend.getCoinSerialNumber());
+        if (HasSerialHash(hashSerial))
+            SetSerialDirty(hashSerial);
+    }
+
+    for (const CTxOut& txout : tx.vout) {
+        if (!txout.IsZerocoinMint())
+            continue;
+        libzerocoin::PublicCoin pubcoin(Params().Zerocoin_Params());
+        CValidationState state;
+        if (!TxOutToPublicCoin(txout, pubcoin, state))
+            continue;
+        CMintMeta meta = GetMetaFromPubcoin(GetPubCoinHash(pubcoin.getValue()));
+        if (meta.hashSerial != 0)
+            SetSerialDirty(meta.hashSerial);
+    }
 }
 
 void CzHLIXTracker::RemovePending(const uint256& txid)
@@ -434,8 +469,37 @@ bool CzHLIXTracker::UpdateStatusInternal(const std::set<uint256>& setMempool, CM
 
 std::set<CMintMeta> CzHLIXTracker::ListMints(bool fUnusedOnly, bool fMatureOnly, bool fUpdateStatus)
 {
+    // A new tip can change the status of any mint. Otherwise only the mints whose
+    // transactions were seen since the last update need one.
+    CBlockIndex* pindexTip = chainActive.Tip();
+    uint256 hashTip = pindexTip ? pindexTip->GetBlockHash() : 0;
+    bool fUpdateAll = false;
+    std::set<uint256> setUpdate;
+    std::map<libzerocoin::CoinDenomination, int> mapMaturityTip;
+    {
+        LOCK(cs_hlixtracker);
+        if (fUpdateStatus) {
+            fUpdateAll = fStatusDirty || hashTip != hashStatusTip;
+            if (fUpdateAll) {
+                hashStatusTip = hashTip;
+                fStatusDirty = false;
+                setDirtySerials.clear();
+            } else {
+                setUpdate.swap(setDirtySerials);
+            }
+        }
+        if (fMatureOnly && hashTip == hashMaturityTip)
+            mapMaturityTip = mapMaturity;
+    }
+    if (fMatureOnly && mapMaturityTip.empty()) {
+        mapMaturityTip = GetMintMaturityHeight();
+        LOCK(cs_hlixtracker);
+        mapMaturity = mapMaturityTip;
+        hashMaturityTip = hashTip;
+    }
+
     CWalletDB walletdb(strWalletFile);
-    if (fUpdateStatus) {
+    if (fUpdateAll) {
         std::list<CZerocoinMint> listMintsDB = walletdb.ListMintedCoins();
         for (auto& mint : listMintsDB)
             Add(mint);
@@ -450,12 +514,11 @@ std::set<CMintMeta> CzHLIXTracker::ListMints(bool fUnusedOnly, bool fMatureOnly,
     std::vector<CMintMeta> vOverWrite;
     std::set<CMintMeta> setMints;
     std::set<uint256> setMempool;
-    {
+    if (fUpdateAll || !setUpdate.empty()) {
         LOCK(mempool.cs);
         mempool.getTransactions(setMempool);
     }
 
-    std::map<libzerocoin::CoinDenomination, int> mapMaturity = GetMintMaturityHeight();
     for (auto& it : mapSerialHashes) {
         CMintMeta mint = it.second;
 
@@ -464,7 +527,7 @@ std::set<CMintMeta> CzHLIXTracker::ListMints(bool fUnusedOnly, bool fMatureOnly,
             continue;
 
         // Update the metadata of the mints if requested
-        if (fUpdateStatus && UpdateStatusInternal(setMempool, mint)) {
+        if ((fUpdateAll || setUpdate.count(it.first)) && UpdateStatusInternal(setMempool, mint)) {
             if (mint.isArchived)
                 continue;
 
@@ -479,7 +542,7 @@ std::set<CMintMeta> CzHLIXTracker::ListMints(bool fUnusedOnly, bool fMatureOnly,
             // Not confirmed
             if (!mint.nHeight || mint.nHeight > chainActive.Height() - Params().Zerocoin_MintRequiredConfirmations())
                 continue;
-            if (mint.nHeight >= mapMaturity.at(mint.denom))
+            if (mint.nHeight >= mapMaturityTip.at(mint.denom))
                 continue;
         }
         setMints.insert(mint);
@@ -495,4 +558,6 @@ std::set<CMintMeta> CzHLIXTracker::ListMints(bool fUnusedOnly, bool fMatureOnly,
 void CzHLIXTracker::Clear()
 {
     mapSerialHashes.clear();
+    LOCK(cs_hlixtracker);
+    fStatusDirty = true;
 }
@@ -6,9 +6,11 @@
 #define HELIX_ZHLIXTRACKER_H
 
 #include "primitives/zerocoin.h"
+#include "sync.h"
 #include <list>
 
 class CDeterministicMint;
+class CTransaction;
 
 class CzHLIXTracker
 {
@@ -17,6 +19,17 @@ private:
     std::string strWalletFile;
     std::map<uint256, CMintMeta> mapSerialHashes;
     std::map<uint256, uint256> mapPendingSpends; //serialhash, txid of spend
+    //! guards the status bookkeeping below
+    mutable CCriticalSection cs_hlixtracker;
+    //! chain tip the status of all mints was last updated at, and whether all need an update regardless
+    uint256 hashStatusTip;
+    bool fStatusDirty;
+    //! serial hashes of the mints whose transactions were seen since the last update
+    std::set<uint256> setDirtySerials;
+    //! mint maturity heights for the tip in hashMaturityTip
+    uint256 hashMaturityTip;
+    std::map<libzerocoin::CoinDenomination, int> mapMaturity;
+    void SetSerialDirty(const uint256& hashSerial);
     bool UpdateStatusInternal(const std::set<uint256>& setMempool, CMintMeta& mint);
 public:
     CzHLIXTracker(std::string strWalletFile);
@@ -40,6 +53,8 @@ public:
     CAmount GetUnconfirmedBalance() const;
     std::set<CMintMeta> ListMints(bool fUnusedOnly, bool fMatureOnly, bool fUpdateStatus);
     void RemovePending(const uint256& txid);
+    /** Mark the mints that tx creates or spends for a status update on the next ListMints */
+    void SetStatusDirty(const CTransaction& tx);
     void SetPubcoinUsed(const uint256& hashPubcoin, const uint256& txid);
     void SetPubcoinNotUsed(const uint256& hashPubcoin);
     bool UnArchive(const uint256& hashPubcoin, bool isDeterministic);
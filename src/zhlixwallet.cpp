@@ -10,6 +10,11 @@
 #include "wallet/wallet.h"
 #include "primitives/deterministicmint.h"
 
+#include <algorithm>
+#include <atomic>
+
+#include <boost/thread.hpp>
+
 using namespace libzerocoin;
 
 CzHLIXWallet::CzHLIXWallet(std::string strWalletFile)
@@ -119,38 +124,56 @@ void CzHLIXWallet::GenerateMintPool(uint32_t nCountStart, uint32_t nCountEnd)
     if (nCountEnd > 0)
         nStop = std::max(n, n + nCountEnd);
 
-    bool fFound;
+    // Counts that are not in the pool yet
+    std::vector<uint32_t> vCounts;
+    for (uint32_t i = n; i < nStop; ++i) {
+        if (!mintPool.HasCount(i))
+            vCounts.push_back(i);
+    }
+    if (vCounts.empty())
+        return;
 
     uint256 hashSeed = Hash(seedMaster.begin(), seedMaster.end());
     LogPrintf("%s : n=%d nStop=%d\n", __func__, n, nStop - 1);
-    for (uint32_t i = n; i < nStop; ++i) {
-        if (ShutdownRequested())
-            return;
-
-        fFound = false;
 
-        // Prevent unnecessary repeated minted
-        for (auto& pair : mintPool) {
-            if(pair.second == i) {
-                fFound = true;
-                break;
-            }
+    // Deriving a mint is dominated by the search for a prime commitment, and
+    // mints of different counts are independent, so derive them in parallel
+    std::vector<CBigNum> vValues(vCounts.size());
+    std::vector<char> vDerived(vCounts.size(), false);
+    std::atomic<size_t> nNext(0);
+    auto derive = [&]() {
+        for (size_t j = nNext++; j < vCounts.size() && !ShutdownRequested(); j = nNext++) {
+            CBigNum bnSerial;
+            CBigNum bnRandomness;
+            CKey key;
+            SeedToZHLIX(GetZerocoinSeed(vCounts[j]), vValues[j], bnSerial, bnRandomness, key);
+            vDerived[j] = true;
         }
+    };
+    size_t nThreads = std::min<size_t>(std::max(1u, boost::thread::hardware_concurrency()), vCounts.size());
+    boost::thread_group threadGroup;
+    for (size_t t = 1; t < nThreads; t++)
+        threadGroup.create_thread(derive);
+    derive();
+    threadGroup.join_all();
+
+    // On shutdown keep the mints derived up to the first one that is missing
+    size_t nDerived = std::find(vDerived.begin(), vDerived.end(), false) - vDerived.begin();
+    if (nDerived == 0)
+        return;
 
-        if(fFound)
-            continue;
-
-        uint512 seedZerocoin = GetZerocoinSeed(i);
-        CBigNum bnValue;
-        CBigNum bnSerial;
-        CBigNum bnRandomness;
-        CKey key;
-        SeedToZHLIX(seedZerocoin, bnValue, bnSerial, bnRandomness, key);
-
-        mintPool.Add(bnValue, i);
-        CWalletDB(strWalletFile).WriteMintPoolPair(hashSeed, GetPubCoinHash(bnValue), i);
-        LogPrintf("%s : %s count=%d\n", __func__, bnValue.GetHex().substr(0, 6), i);
+    CWalletDB walletdb(strWalletFile);
+    if (!walletdb.TxnBegin()) {
+        LogPrintf("%s : failed to begin wallet database transaction\n", __func__);
+        return;
+    }
+    for (size_t j = 0; j < nDerived; j++) {
+        mintPool.Add(vValues[j], vCounts[j]);
+        walletdb.WriteMintPoolPair(hashSeed, GetPubCoinHash(vValues[j]), vCounts[j]);
+        LogPrintf("%s : %s count=%d\n", __func__, vValues[j].GetHex().substr(0, 6), vCounts[j]);
     }
+    if (!walletdb.TxnCommit())
+        LogPrintf("%s : failed to write the mint pool to the wallet database\n", __func__);
 }
 
 // pubcoin hashes are stored to db so that a full accounting of mints belonging to the seed can be tracked without regenerating
@@ -177,6 +200,35 @@ void CzHLIXWallet::GetState(int& nCount, int& nLastGenerated)
     nLastGenerated = mintPool.CountOfLastGenerated();
 }
 
+//Add a transaction of the active chain to the wallet, unless the wallet already has it in that block
+static void AddChainTxToWallet(const uint256& txid, const CBlockIndex* pindex)
+{
+    AssertLockHeld(cs_main);
+    LOCK(pwalletMain->cs_wallet);
+    auto it = pwalletMain->mapWallet.find(txid);
+    if (it != pwalletMain->mapWallet.end() && it->second.hashBlock == pindex->GetBlockHash())
+        return;
+
+    CBlock block;
+    if (!ReadBlockFromDisk(block, pindex)) {
+        LogPrintf("%s : failed to read block %d for tx %s\n", __func__, pindex->nHeight, txid.GetHex());
+        return;
+    }
+
+    for (const CTransaction& tx : block.vtx) {
+        if (tx.GetHash() != txid)
+            continue;
+
+        //Fill out wtx so that a transaction record can be created
+        CWalletTx wtx(pwalletMain, tx);
+        wtx.SetMerkleBranch(block);
+        wtx.nTimeReceived = pindex->GetBlockTime();
+        pwalletMain->AddToWallet(wtx);
+        return;
+    }
+    LogPrintf("%s : tx %s not found in block %d\n", __func__, txid.GetHex(), pindex->nHeight);
+}
+
 //Catch the counter up with the chain
 void CzHLIXWallet::SyncWithChain(bool fGenerateMintPool)
 {
@@ -214,6 +266,21 @@ void CzHLIXWallet::SyncWithChain(bool fGenerateMintPool)
                 LogPrintf("%s : Found wallet coin mint=%s count=%d tx=%s\n", __func__, pMint.first.GetHex(), pMint.second, txHash.GetHex());
                 found = true;
 
+                // the zerocoin index knows the height and denomination of mints it recorded with them
+                CZerocoinTxInfo info;
+                if (zerocoinDB->ReadCoinMintInfo(pMint.first, info) && info.nHeight <= chainActive.Height()) {
+                    if (!setAddedTx.count(txHash)) {
+                        AddChainTxToWallet(txHash, chainActive[info.nHeight]);
+                        setAddedTx.insert(txHash);
+                    }
+
+                    SetMintSeen(pMint, info.nHeight, txHash, info.denom);
+                    nLastCountUsed = std::max(pMint.second, nLastCountUsed);
+                    nCountLastUsed = std::max(nLastCountUsed, nCountLastUsed);
+                    LogPrint("zero", "%s: updated count to %d\n", __func__, nCountLastUsed);
+                    continue;
+                }
+
                 uint256 hashBlock;
                 CTransaction tx;
                 if (!GetTransaction(txHash, tx, hashBlock, true)) {
@@ -283,8 +350,11 @@ bool CzHLIXWallet::SetMintSeen(const CBigNum& bnValue, const int& nHeight, const
 {
     if (!mintPool.Has(bnValue))
         return error("%s: value not in pool", __func__);
-    pair<uint256, uint32_t> pMint = mintPool.Get(bnValue);
+    return SetMintSeen(mintPool.Get(bnValue), nHeight, txid, denom);
+}
 
+bool CzHLIXWallet::SetMintSeen(const pair<uint256, uint32_t>& pMint, const int& nHeight, const uint256& txid, const CoinDenomination& denom)
+{
     // Regenerate the mint
     uint512 seedZerocoin = GetZerocoinSeed(pMint.second);
     CBigNum bnValueGen;
@@ -294,13 +364,13 @@ bool CzHLIXWallet::SetMintSeen(const CBigNum& bnValue, const int& nHeight, const
     SeedToZHLIX(seedZerocoin, bnValueGen, bnSerial, bnRandomness, key);
 
     //Sanity check
-    if (bnValueGen != bnValue)
+    uint256 hashPubcoin = GetPubCoinHash(bnValueGen);
+    if (hashPubcoin != pMint.first)
         return error("%s: generated pubcoin and expected value do not match!", __func__);
 
     // Create mint object and database it
     uint256 hashSeed = Hash(seedMaster.begin(), seedMaster.end());
     uint256 hashSerial = GetSerialHash(bnSerial);
-    uint256 hashPubcoin = GetPubCoinHash(bnValue);
     uint256 nSerial = bnSerial.getuint256();
     uint256 hashStake = Hash(nSerial.begin(), nSerial.end());
     CDeterministicMint dMint(PrivateCoin::CURRENT_VERSION, pMint.second, hashSeed, hashSerial, hashPubcoin, hashStake);
@@ -312,17 +382,24 @@ bool CzHLIXWallet::SetMintSeen(const CBigNum& bnValue, const int& nHeight, const
     int nHeightTx;
     uint256 txidSpend;
     CTransaction txSpend;
-    if (IsSerialInBlockchain(hashSerial, nHeightTx, txidSpend, txSpend)) {
-        //Find transaction details and make a wallettx and add to wallet
+    CZerocoinTxInfo infoSpend;
+    if (zerocoinDB->ReadCoinSpendInfo(hashSerial, infoSpend) && infoSpend.nHeight <= chainActive.Height()) {
+        dMint.SetUsed(true);
+        AddChainTxToWallet(infoSpend.txid, chainActive[infoSpend.nHeight]);
+    } else if (IsSerialInBlockchain(hashSerial, nHeightTx, txidSpend, txSpend)) {
         dMint.SetUsed(true);
-        CWalletTx wtx(pwalletMain, txSpend);
-        CBlockIndex* pindex = chainActive[nHeightTx];
-        CBlock block;
-        if (ReadBlockFromDisk(block, pindex))
-            wtx.SetMerkleBranch(block);
 
-        wtx.nTimeReceived = pindex->nTime;
-        pwalletMain->AddToWallet(wtx);
+        //Find transaction details and make a wallettx and add to wallet, unless the spend was pruned
+        if (!txSpend.IsNull()) {
+            CWalletTx wtx(pwalletMain, txSpend);
+            CBlockIndex* pindex = chainActive[nHeightTx];
+            CBlock block;
+            if (ReadBlockFromDisk(block, pindex))
+                wtx.SetMerkleBranch(block);
+
+            wtx.nTimeReceived = pindex->nTime;
+            pwalletMain->AddToWallet(wtx);
+        }
     }
 
     // Add to zhlixTracker which also adds to database
@@ -43,6 +43,7 @@ public:
 
 private:
     uint512 GetZerocoinSeed(uint32_t n);
+    bool SetMintSeen(const std::pair<uint256, uint32_t>& pMint, const int& nHeight, const uint256& txid, const libzerocoin::CoinDenomination& denom);
 };
 
 #endif //HELIX_ZHLIXWALLET_H